@@ -0,0 +1,295 @@
+/*
+ * idlutils_select.h
+ *
+ * Selection (k-th smallest) and medians for float and double arrays,
+ * shared by the native libraries in place of the Numerical Recipes
+ * selip/dselip.  The input is never modified.
+ *
+ *   idlutils_select_float(arr, n, k, work)   k-th smallest, k from 0
+ *   idlutils_median_float(arr, n, work)      mean of the middle two
+ *                                            elements when n is even
+ *   (and _double versions)
+ *
+ * work is scratch for up to n elements, or NULL to allocate it as
+ * needed.  Small arrays (up to IDLUTILS_SELECT_NETWORK) are copied to
+ * the stack and sorted with a Batcher odd-even merge network, whose
+ * branch-free compare-exchanges compile to min/max instructions.
+ * Large arrays (above IDLUTILS_SELECT_HISTOGRAM) are first narrowed to
+ * a single bin of a histogram between their minimum and maximum, so
+ * only that bin is copied.  NaNs are counted in the lowest bin (where
+ * they fall in the ranking is unspecified at any n).  Everything else is
+ * introselect: median of three quickselect, switching to heapsort if
+ * partitioning stops making progress.
+ *
+ * idlutils_network_lanes_float(a, n, nlane) sorts nlane interleaved
+ * arrays of n<=IDLUTILS_SELECT_NETWORK elements at once, for medians of
+ * many short vectors.
+ */
+#ifndef IDLUTILS_SELECT_H
+#define IDLUTILS_SELECT_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IDLUTILS_SELECT_NETWORK 32
+#define IDLUTILS_SELECT_HISTOGRAM 65536
+#define IDLUTILS_SELECT_NBIN 4096
+
+/* histogram bin of x; NaNs, which are in no bin, are counted in bin 0 */
+#define IDLUTILS_SELECT_BIN(x, amin, scale)                                  \
+  (!(((double) (x)-(double) (amin))*(scale)>=0.) ? 0L :                      \
+   (((double) (x)-(double) (amin))*(scale)>=(double) IDLUTILS_SELECT_NBIN) ? \
+   (long) IDLUTILS_SELECT_NBIN-1 :                                           \
+   (long) (((double) (x)-(double) (amin))*(scale)))
+
+/* Batcher odd-even merge sort networks for 8, 16 and 32 elements */
+static const unsigned char idlutils_network8[19][2]={
+  {0,1}, {2,3}, {4,5}, {6,7}, {0,2}, {1,3}, {4,6}, {5,7}, {1,2}, {5,6},
+  {0,4}, {1,5}, {2,6}, {3,7}, {2,4}, {3,5}, {1,2}, {3,4}, {5,6}};
+
+static const unsigned char idlutils_network16[63][2]={
+  {0,1}, {2,3}, {4,5}, {6,7}, {8,9}, {10,11}, {12,13}, {14,15}, {0,2},
+  {1,3}, {4,6}, {5,7}, {8,10}, {9,11}, {12,14}, {13,15}, {1,2}, {5,6},
+  {9,10}, {13,14}, {0,4}, {1,5}, {2,6}, {3,7}, {8,12}, {9,13}, {10,14},
+  {11,15}, {2,4}, {3,5}, {10,12}, {11,13}, {1,2}, {3,4}, {5,6}, {9,10},
+  {11,12}, {13,14}, {0,8}, {1,9}, {2,10}, {3,11}, {4,12}, {5,13}, {6,14},
+  {7,15}, {4,8}, {5,9}, {6,10}, {7,11}, {2,4}, {3,5}, {6,8}, {7,9}, {10,12},
+  {11,13}, {1,2}, {3,4}, {5,6}, {7,8}, {9,10}, {11,12}, {13,14}};
+
+static const unsigned char idlutils_network32[191][2]={
+  {0,1}, {2,3}, {4,5}, {6,7}, {8,9}, {10,11}, {12,13}, {14,15}, {16,17},
+  {18,19}, {20,21}, {22,23}, {24,25}, {26,27}, {28,29}, {30,31}, {0,2},
+  {1,3}, {4,6}, {5,7}, {8,10}, {9,11}, {12,14}, {13,15}, {16,18}, {17,19},
+  {20,22}, {21,23}, {24,26}, {25,27}, {28,30}, {29,31}, {1,2}, {5,6},
+  {9,10}, {13,14}, {17,18}, {21,22}, {25,26}, {29,30}, {0,4}, {1,5}, {2,6},
+  {3,7}, {8,12}, {9,13}, {10,14}, {11,15}, {16,20}, {17,21}, {18,22},
+  {19,23}, {24,28}, {25,29}, {26,30}, {27,31}, {2,4}, {3,5}, {10,12},
+  {11,13}, {18,20}, {19,21}, {26,28}, {27,29}, {1,2}, {3,4}, {5,6}, {9,10},
+  {11,12}, {13,14}, {17,18}, {19,20}, {21,22}, {25,26}, {27,28}, {29,30},
+  {0,8}, {1,9}, {2,10}, {3,11}, {4,12}, {5,13}, {6,14}, {7,15}, {16,24},
+  {17,25}, {18,26}, {19,27}, {20,28}, {21,29}, {22,30}, {23,31}, {4,8},
+  {5,9}, {6,10}, {7,11}, {20,24}, {21,25}, {22,26}, {23,27}, {2,4}, {3,5},
+  {6,8}, {7,9}, {10,12}, {11,13}, {18,20}, {19,21}, {22,24}, {23,25},
+  {26,28}, {27,29}, {1,2}, {3,4}, {5,6}, {7,8}, {9,10}, {11,12}, {13,14},
+  {17,18}, {19,20}, {21,22}, {23,24}, {25,26}, {27,28}, {29,30}, {0,16},
+  {1,17}, {2,18}, {3,19}, {4,20}, {5,21}, {6,22}, {7,23}, {8,24}, {9,25},
+  {10,26}, {11,27}, {12,28}, {13,29}, {14,30}, {15,31}, {8,16}, {9,17},
+  {10,18}, {11,19}, {12,20}, {13,21}, {14,22}, {15,23}, {4,8}, {5,9},
+  {6,10}, {7,11}, {12,16}, {13,17}, {14,18}, {15,19}, {20,24}, {21,25},
+  {22,26}, {23,27}, {2,4}, {3,5}, {6,8}, {7,9}, {10,12}, {11,13}, {14,16},
+  {15,17}, {18,20}, {19,21}, {22,24}, {23,25}, {26,28}, {27,29}, {1,2},
+  {3,4}, {5,6}, {7,8}, {9,10}, {11,12}, {13,14}, {15,16}, {17,18}, {19,20},
+  {21,22}, {23,24}, {25,26}, {27,28}, {29,30}};
+
+#define IDLUTILS_SELECT_DEFINE(TYPE, SUFFIX)                                 \
+                                                                             \
+/* sort a[0..n-1], n<=IDLUTILS_SELECT_NETWORK, with the smallest network \
+   that fits, as if padded with +infinity: comparisons against the      \
+   padding never exchange, so they are skipped */                            \
+static inline void idlutils_network_##SUFFIX(TYPE *a, long n)               \
+{                                                                            \
+  const unsigned char (*pair)[2];                                            \
+  int c, npair;                                                              \
+  TYPE x, y;                                                                 \
+                                                                             \
+  if(n<=8) {                                                                 \
+    pair=idlutils_network8;                                                  \
+    npair=19;                                                                \
+  } else if(n<=16) {                                                         \
+    pair=idlutils_network16;                                                 \
+    npair=63;                                                                \
+  } else {                                                                   \
+    pair=idlutils_network32;                                                 \
+    npair=191;                                                               \
+  }                                                                          \
+  for(c=0;c<npair;c++) {                                                     \
+    if(pair[c][1]>=n) continue;                                              \
+    x=a[pair[c][0]];                                                         \
+    y=a[pair[c][1]];                                                         \
+    a[pair[c][0]]=(y<x) ? y : x;                                             \
+    a[pair[c][1]]=(x<y) ? y : x;                                             \
+  }                                                                          \
+}                                                                            \
+                                                                             \
+/* compare-exchange of two rows of lanes, which never overlap */          \
+static inline void idlutils_exchange_##SUFFIX(TYPE *restrict a0,            \
+                                              TYPE *restrict a1, long nlane) \
+{                                                                            \
+  long l;                                                                    \
+  TYPE x, y, lo, hi;                                                         \
+                                                                             \
+  for(l=0;l<nlane;l++) {                                                     \
+    x=a0[l];                                                                 \
+    y=a1[l];                                                                 \
+    lo=(y<x) ? y : x;                                                        \
+    hi=(x<y) ? y : x;                                                        \
+    a0[l]=lo;                                                                \
+    a1[l]=hi;                                                                \
+  }                                                                          \
+}                                                                            \
+                                                                             \
+/* the same, for nlane interleaved arrays: element i of lane l is          \
+   a[i*nlane+l]; the inner loop over lanes vectorizes */                     \
+static inline void idlutils_network_lanes_##SUFFIX(TYPE *a, long n,         \
+                                                   long nlane)               \
+{                                                                            \
+  const unsigned char (*pair)[2];                                            \
+  int c, npair;                                                              \
+                                                                             \
+  if(n<=8) {                                                                 \
+    pair=idlutils_network8;                                                  \
+    npair=19;                                                                \
+  } else if(n<=16) {                                                         \
+    pair=idlutils_network16;                                                 \
+    npair=63;                                                                \
+  } else {                                                                   \
+    pair=idlutils_network32;                                                 \
+    npair=191;                                                               \
+  }                                                                          \
+  for(c=0;c<npair;c++) {                                                     \
+    if(pair[c][1]>=n) continue;                                              \
+    idlutils_exchange_##SUFFIX(a+pair[c][0]*nlane, a+pair[c][1]*nlane,       \
+                               nlane);                                       \
+  }                                                                          \
+}                                                                            \
+                                                                             \
+static inline void idlutils_heapsort_##SUFFIX(TYPE *a, long n)              \
+{                                                                            \
+  long i, parent, child, end;                                                \
+  TYPE tmp;                                                                  \
+                                                                             \
+  /* heapify (i>=0), then move the largest to the end (i<0) */               \
+  for(i=n/2-1;i>-n;i--) {                                                    \
+    if(i>=0) {                                                               \
+      parent=i;                                                              \
+      end=n;                                                                 \
+    } else {                                                                 \
+      end=n+i;                                                               \
+      tmp=a[0]; a[0]=a[end]; a[end]=tmp;                                     \
+      parent=0;                                                              \
+    }                                                                        \
+    while((child=2*parent+1)<end) {                                          \
+      if(child+1<end && a[child]<a[child+1]) child++;                        \
+      if(!(a[parent]<a[child])) break;                                       \
+      tmp=a[parent]; a[parent]=a[child]; a[child]=tmp;                       \
+      parent=child;                                                          \
+    }                                                                        \
+  }                                                                          \
+}                                                                            \
+                                                                             \
+/* introselect in place; a[k] is returned and a is left partitioned */      \
+static inline TYPE idlutils_introselect_##SUFFIX(TYPE *a, long n, long k)   \
+{                                                                            \
+  long lo, hi, mid, i, j, depth;                                             \
+  TYPE pivot, tmp;                                                           \
+                                                                             \
+  lo=0;                                                                      \
+  hi=n-1;                                                                    \
+  for(depth=2, i=n;i>1;i/=2) depth+=2;                                       \
+  while(hi-lo+1>IDLUTILS_SELECT_NETWORK) {                                   \
+    if(depth--<=0) {                                                         \
+      idlutils_heapsort_##SUFFIX(a+lo, hi-lo+1);                             \
+      return(a[k]);                                                          \
+    }                                                                        \
+    mid=lo+(hi-lo)/2;                                                        \
+    if(a[mid]<a[lo]) { tmp=a[mid]; a[mid]=a[lo]; a[lo]=tmp; }                \
+    if(a[hi]<a[lo]) { tmp=a[hi]; a[hi]=a[lo]; a[lo]=tmp; }                   \
+    if(a[hi]<a[mid]) { tmp=a[hi]; a[hi]=a[mid]; a[mid]=tmp; }                \
+    pivot=a[mid];                                                            \
+    i=lo;                                                                    \
+    j=hi;                                                                    \
+    while(i<=j) {                                                            \
+      while(a[i]<pivot) i++;                                                 \
+      while(pivot<a[j]) j--;                                                 \
+      if(i<=j) {                                                             \
+        tmp=a[i]; a[i]=a[j]; a[j]=tmp;                                       \
+        i++;                                                                 \
+        j--;                                                                 \
+      }                                                                      \
+    }                                                                        \
+    if(k<=j) hi=j;                                                           \
+    else if(k>=i) lo=i;                                                      \
+    else return(a[k]);                                                       \
+  }                                                                          \
+  idlutils_network_##SUFFIX(a+lo, hi-lo+1);                                  \
+  return(a[k]);                                                              \
+}                                                                            \
+                                                                             \
+static inline TYPE idlutils_select_##SUFFIX(const TYPE *arr, long n, long k, \
+                                             TYPE *work)                     \
+{                                                                            \
+  TYPE small[IDLUTILS_SELECT_NETWORK], amin, amax, value, *buf;              \
+  long i, nbuf, bin, below, count[IDLUTILS_SELECT_NBIN];                     \
+  double scale;                                                              \
+                                                                             \
+  if(n<=0) return((TYPE) 0);                                                 \
+  if(k<0) k=0;                                                               \
+  if(k>n-1) k=n-1;                                                           \
+                                                                             \
+  if(n<=IDLUTILS_SELECT_NETWORK) {                                           \
+    memcpy(small, arr, n*sizeof(TYPE));                                      \
+    idlutils_network_##SUFFIX(small, n);                                     \
+    return(small[k]);                                                        \
+  }                                                                          \
+                                                                             \
+  nbuf=n;                                                                    \
+  bin=-1;                                                                    \
+  scale=0.;                                                                  \
+  amin=amax=arr[0];                                                          \
+  if(n>IDLUTILS_SELECT_HISTOGRAM) {                                          \
+    for(i=1;i<n;i++) {                                                       \
+      amin=(arr[i]<amin || amin!=amin) ? arr[i] : amin;                      \
+      amax=(arr[i]>amax || amax!=amax) ? arr[i] : amax;                      \
+    }                                                                        \
+    if(!(amax>amin)) return(amin);                                           \
+    scale=(double) IDLUTILS_SELECT_NBIN/((double) amax-(double) amin);       \
+    if(scale>0. && scale*0.==0.) {                                           \
+      memset(count, 0, sizeof(count));                                       \
+      for(i=0;i<n;i++) {                                                     \
+        bin=IDLUTILS_SELECT_BIN(arr[i], amin, scale);                        \
+        count[bin]++;                                                        \
+      }                                                                      \
+      below=0;                                                               \
+      for(bin=0;below+count[bin]<=k;bin++)                                   \
+        below+=count[bin];                                                   \
+      k-=below;                                                              \
+      nbuf=count[bin];                                                       \
+    } else {                                                                 \
+      bin=-1;                                                                \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  buf=(work!=NULL) ? work : (TYPE *) malloc(nbuf*sizeof(TYPE));              \
+  if(bin>=0) {                                                               \
+    for(i=0,nbuf=0;i<n;i++) {                                                \
+      if(IDLUTILS_SELECT_BIN(arr[i], amin, scale)==bin) buf[nbuf++]=arr[i];  \
+    }                                                                        \
+  } else {                                                                   \
+    memcpy(buf, arr, n*sizeof(TYPE));                                        \
+  }                                                                          \
+  value=idlutils_introselect_##SUFFIX(buf, nbuf, k);                         \
+  if(work==NULL) free(buf);                                                  \
+  return(value);                                                             \
+}                                                                            \
+                                                                             \
+static inline TYPE idlutils_median_##SUFFIX(const TYPE *arr, long n,         \
+                                            TYPE *work)                      \
+{                                                                            \
+  TYPE small[IDLUTILS_SELECT_NETWORK];                                       \
+                                                                             \
+  if(n<=0) return((TYPE) 0);                                                 \
+  if(n<=IDLUTILS_SELECT_NETWORK) {                                           \
+    memcpy(small, arr, n*sizeof(TYPE));                                      \
+    idlutils_network_##SUFFIX(small, n);                                     \
+    if(n%2) return(small[n/2]);                                              \
+    return(0.5*(small[n/2-1]+small[n/2]));                                   \
+  }                                                                          \
+  if(n%2) return(idlutils_select_##SUFFIX(arr, n, n/2, work));               \
+  return(0.5*(idlutils_select_##SUFFIX(arr, n, n/2-1, work)+                 \
+              idlutils_select_##SUFFIX(arr, n, n/2, work)));                 \
+}
+
+IDLUTILS_SELECT_DEFINE(float, float)
+IDLUTILS_SELECT_DEFINE(double, double)
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * idlutils_threads.h
+ *
+ * Small pthreads helpers shared by the native libraries.  The number of
+ * threads is IDLUTILS_NTHREADS from the environment if set, otherwise the
+ * number of online processors.  Setting IDLUTILS_NTHREADS=1 runs
+ * everything in the calling thread.
+ *
+ * Callers link with -lpthread.
+ */
+#ifndef IDLUTILS_THREADS_H
+#define IDLUTILS_THREADS_H
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define IDLUTILS_MAXTHREADS 64
+
+typedef void (*idlutils_thread_func)(void *arg, int ithread, int nthreads);
+
+typedef struct {
+  idlutils_thread_func func;
+  void *arg;
+  int ithread, nthreads;
+} idlutils_thread_arg;
+
+/* a shared counter handing out [lo,hi) chunks of n work items */
+typedef struct {
+  pthread_mutex_t lock;
+  long next, n, chunk;
+} idlutils_queue;
+
+/* number of threads to use for nwork independent items */
+static inline int idlutils_nthreads(long nwork)
+{
+  char *env;
+  long nthreads;
+
+  nthreads=0;
+  env=getenv("IDLUTILS_NTHREADS");
+  if(env!=NULL) nthreads=atol(env);
+  if(nthreads<=0) nthreads=sysconf(_SC_NPROCESSORS_ONLN);
+  if(nthreads>IDLUTILS_MAXTHREADS) nthreads=IDLUTILS_MAXTHREADS;
+  if(nthreads>nwork) nthreads=nwork;
+  if(nthreads<1) nthreads=1;
+  return((int) nthreads);
+}
+
+/* contiguous share [lo,hi) of n items for thread ithread */
+static inline void idlutils_range(long n, int ithread, int nthreads,
+                                  long *lo, long *hi)
+{
+  (*lo)=(n*(long) ithread)/nthreads;
+  (*hi)=(n*(long) (ithread+1))/nthreads;
+}
+
+static inline void idlutils_queue_init(idlutils_queue *queue, long n,
+                                       long chunk)
+{
+  pthread_mutex_init(&(queue->lock), NULL);
+  queue->next=0;
+  queue->n=n;
+  queue->chunk=chunk>0 ? chunk : 1;
+}
+
+/* returns 0 once the queue is empty */
+static inline int idlutils_queue_next(idlutils_queue *queue, long *lo,
+                                      long *hi)
+{
+  int got;
+
+  pthread_mutex_lock(&(queue->lock));
+  (*lo)=queue->next;
+  (*hi)=(*lo)+queue->chunk;
+  if((*hi)>queue->n) (*hi)=queue->n;
+  queue->next=(*hi);
+  got=(*hi)>(*lo);
+  pthread_mutex_unlock(&(queue->lock));
+  return(got);
+}
+
+static inline void idlutils_queue_free(idlutils_queue *queue)
+{
+  pthread_mutex_destroy(&(queue->lock));
+}
+
+static inline void *idlutils_thread_start(void *targ)
+{
+  idlutils_thread_arg *ta=(idlutils_thread_arg *) targ;
+  ta->func(ta->arg, ta->ithread, ta->nthreads);
+  return(NULL);
+}
+
+/* run func(arg, ithread, nthreads) on nthreads threads, the calling
+   thread being thread 0; if a thread cannot be created its share is run
+   by the caller after the others finish */
+static inline void idlutils_run(int nthreads, idlutils_thread_func func,
+                                void *arg)
+{
+  int i;
+  pthread_t threads[IDLUTILS_MAXTHREADS];
+  idlutils_thread_arg targ[IDLUTILS_MAXTHREADS];
+  int started[IDLUTILS_MAXTHREADS];
+
+  if(nthreads>IDLUTILS_MAXTHREADS) nthreads=IDLUTILS_MAXTHREADS;
+  if(nthreads<=1) {
+    func(arg, 0, 1);
+    return;
+  }
+
+  for(i=0;i<nthreads;i++) {
+    targ[i].func=func;
+    targ[i].arg=arg;
+    targ[i].ithread=i;
+    targ[i].nthreads=nthreads;
+    started[i]=0;
+  }
+  for(i=1;i<nthreads;i++)
+    started[i]=(pthread_create(&(threads[i]), NULL, idlutils_thread_start,
+                               &(targ[i]))==0);
+  func(arg, 0, nthreads);
+  for(i=1;i<nthreads;i++) {
+    if(started[i])
+      pthread_join(threads[i], NULL);
+    else
+      func(arg, i, nthreads);
+  }
+}
+
+#endif
@@ -0,0 +1,65 @@
+;+
+; NAME:
+;   dallpeaks
+; PURPOSE:
+;   find and centroid the peaks of all objects in an image
+; CALLING SEQUENCE:
+;   dallpeaks, image, objects, xcen=, ycen= [, sigma=, dlim=, saddle=, $
+;      maxper=, maxnpeaks=, minpeak= ]
+; INPUTS:
+;   image - [nx, ny] input image (sky subtracted)
+;   objects - [nx, ny] which object each pixel belongs to (-1 if none),
+;             as from dobjects_multi
+; OPTIONAL INPUTS:
+;   sigma - sky sigma (defaults to 1)
+;   dlim - minimum distance between peaks in pixels (default 1)
+;   saddle - saddle difference (in sigma) between distinct peaks
+;            (default 3)
+;   maxper - maximum number of peaks per object (default 1000)
+;   maxnpeaks - maximum number of peaks in total (default 100000)
+;   minpeak - minimum peak value (default sigma)
+; OUTPUTS:
+;   xcen, ycen - [npeaks] centroids of peaks, in object order
+; COMMENTS:
+;   Objects are processed on IDLUTILS_NTHREADS threads (default: all
+;   processors).
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+pro dallpeaks, image, objects, xcen=xcen, ycen=ycen, sigma=sigma, $
+               dlim=dlim, saddle=saddle, maxper=maxper, $
+               maxnpeaks=maxnpeaks, minpeak=minpeak
+
+nx=(size(image,/dim))[0]
+ny=(size(image,/dim))[1]
+
+if(NOT keyword_set(sigma)) then sigma=1.
+if(NOT keyword_set(dlim)) then dlim=1.
+if(NOT keyword_set(saddle)) then saddle=3.
+if(NOT keyword_set(maxper)) then maxper=1000L
+if(NOT keyword_set(maxnpeaks)) then maxnpeaks=100000L
+if(n_elements(minpeak) eq 0) then minpeak=sigma
+
+; Set source object name
+soname=filepath('libdimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+
+npeaks=0L
+xcen=fltarr(maxnpeaks)
+ycen=fltarr(maxnpeaks)
+retval=call_external(soname, 'idl_dallpeaks', float(image), $
+                     long(nx), long(ny), long(objects), xcen, ycen, npeaks, $
+                     float(sigma), float(dlim), float(saddle), long(maxper), $
+                     long(maxnpeaks), float(minpeak))
+
+if(npeaks eq 0) then begin
+    xcen=-1
+    ycen=-1
+    return
+endif
+xcen=xcen[0:npeaks-1]
+ycen=ycen[0:npeaks-1]
+
+end
+;------------------------------------------------------------------------------
@@ -0,0 +1,50 @@
+;+
+; NAME:
+;   dbackground
+; PURPOSE:
+;   sky background and noise maps
+; CALLING SEQUENCE:
+;   sky= dbackground(image, invvar, box=, sp=, sigma=)
+; INPUTS:
+;   image - [nx, ny] input image
+;   invvar - [nx, ny] inverse variance (default all 1.)
+;   box - box size for tiles
+; OPTIONAL INPUTS:
+;   sp - pixel separation for noise differences (default 1)
+; OUTPUTS:
+;   sky - [nx, ny] median background image
+; OPTIONAL OUTPUTS:
+;   sigma - [nx, ny] noise map
+; COMMENTS:
+;   Uses the same tiles and interpolation as dmedsmooth, so sky is
+;   identical to dmedsmooth(image, invvar, box=box). In each tile the
+;   noise is the robust sigma of differences between good pixels
+;   separated by sp, as in dsigma.
+;   Doesn't weight by inverse variance: just ignores invvar=0 data.
+;   Runs on IDLUTILS_NTHREADS threads (default: all processors).
+; REVISION HISTORY:
+;   18-Oct-2026  Written from dmedsmooth and dsigma
+;-
+;------------------------------------------------------------------------------
+function dbackground, image, invvar, box=box, sp=sp, sigma=sigma
+
+nx=(size(image,/dim))[0]
+ny=(size(image,/dim))[1]
+if(NOT keyword_set(sp)) then sp=1L
+
+; Set source object name
+soname=filepath('libdimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+
+sky=fltarr(nx,ny)
+sigma=fltarr(nx,ny)
+if(NOT keyword_set(invvar)) then $
+  invvar=fltarr(nx,ny)+1.
+retval=call_external(soname, 'idl_dbackground', float(image), $
+                     float(invvar), long(nx), long(ny), long(box), $
+                     long(sp), sky, sigma)
+
+return, sky
+
+end
+;------------------------------------------------------------------------------
@@ -0,0 +1,94 @@
+;+
+; NAME:
+;   deblend_multi
+; PURPOSE:
+;   deblend all parents in an image
+; CALLING SEQUENCE:
+;   deblend_multi, image, objects [, invvar=, sigma=, dlim=, tsmooth=, $
+;      tlimit=, tfloor=, saddle=, parallel=, maxnchild=, minpeak=, $
+;      maxntotal=, parent=, xchild=, ychild=, flux=, childmap= ]
+; INPUTS:
+;   image - [nx, ny] input image (sky subtracted)
+;   objects - [nx, ny] which parent each pixel belongs to (-1 if none),
+;             as from dobjects_multi
+; OPTIONAL INPUTS:
+;   invvar - [nx, ny] inverse variance (default 1/sigma^2)
+;   sigma - sky sigma (default 1)
+;   dlim - minimum distance between peaks in pixels (default 1)
+;   tsmooth - smoothing of templates in pixels (default 1)
+;   tlimit - template values below tlimit*sigma are floored (default 1)
+;   tfloor - floor of templates in units of sigma (default 0.01)
+;   saddle - saddle difference (in sigma) between distinct peaks
+;            (default 3)
+;   parallel - maximum normalized dot product between templates
+;              (default 0.9)
+;   maxnchild - maximum number of children per parent (default 20)
+;   minpeak - minimum peak value (default 3*sigma)
+;   maxntotal - maximum number of children in total (default 100000)
+; OUTPUTS:
+;   parent - [nchild] parent of each child, in parent order
+;   xchild, ychild - [nchild] peak positions of children
+;   flux - [nchild] flux of each child
+;   childmap - [nx, ny] child receiving the most flux in each pixel
+;              (-1 if none)
+; COMMENTS:
+;   Parents are deblended with symmetric templates and nonnegative
+;   template weights, as in the C routine deblend().  Parents are
+;   processed on IDLUTILS_NTHREADS threads (default: all processors).
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+pro deblend_multi, image, objects, invvar=invvar, sigma=sigma, dlim=dlim, $
+                   tsmooth=tsmooth, tlimit=tlimit, tfloor=tfloor, $
+                   saddle=saddle, parallel=parallel, maxnchild=maxnchild, $
+                   minpeak=minpeak, maxntotal=maxntotal, parent=parent, $
+                   xchild=xchild, ychild=ychild, flux=flux, childmap=childmap
+
+nx=(size(image,/dim))[0]
+ny=(size(image,/dim))[1]
+
+if(NOT keyword_set(sigma)) then sigma=1.
+if(NOT keyword_set(invvar)) then invvar=fltarr(nx,ny)+1./sigma^2
+if(NOT keyword_set(dlim)) then dlim=1.
+if(n_elements(tsmooth) eq 0) then tsmooth=1.
+if(n_elements(tlimit) eq 0) then tlimit=1.
+if(n_elements(tfloor) eq 0) then tfloor=0.01
+if(NOT keyword_set(saddle)) then saddle=3.
+if(NOT keyword_set(parallel)) then parallel=0.9
+if(NOT keyword_set(maxnchild)) then maxnchild=20L
+if(n_elements(minpeak) eq 0) then minpeak=3.*sigma
+if(NOT keyword_set(maxntotal)) then maxntotal=100000L
+
+; Set source object name
+soname=filepath('libdimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+
+ntotal=0L
+parent=lonarr(maxntotal)
+xchild=fltarr(maxntotal)
+ychild=fltarr(maxntotal)
+flux=fltarr(maxntotal)
+childmap=lonarr(nx,ny)
+retval=call_external(soname, 'idl_deblend_multi', float(image), $
+                     float(invvar), long(nx), long(ny), long(objects), $
+                     float(sigma), float(dlim), float(tsmooth), $
+                     float(tlimit), float(tfloor), float(saddle), $
+                     float(parallel), long(maxnchild), float(minpeak), $
+                     long(maxntotal), ntotal, parent, xchild, ychild, flux, $
+                     childmap)
+
+if(ntotal eq 0) then begin
+    parent=-1
+    xchild=-1
+    ychild=-1
+    flux=-1
+    return
+endif
+parent=parent[0:ntotal-1]
+xchild=xchild[0:ntotal-1]
+ychild=ychild[0:ntotal-1]
+flux=flux[0:ntotal-1]
+
+end
+;------------------------------------------------------------------------------
@@ -0,0 +1,122 @@
+;+
+; NAME:
+;   dimage_tiled
+; PURPOSE:
+;   run dsmooth, dmedsmooth, dfind or dobjects_multi on an image on disk
+; CALLING SEQUENCE:
+;   dimage_tiled, infile, outfile, routine [, /fits, nx=, ny=, nim=, $
+;      sigma=, box=, dpsf=, plim=, nband= ]
+; INPUTS:
+;   infile - input file: a raw dump of native-order pixels, or (with
+;            /fits) a FITS file whose primary HDU holds the image(s)
+;   outfile - output file, written in the same format
+;   routine - 'dsmooth', 'dmedsmooth', 'dfind' or 'dobjects_multi'
+; OPTIONAL INPUTS:
+;   nx, ny - image size (required for raw files; read from the header
+;            for FITS files)
+;   nim - number of images in infile for dobjects_multi (default 1, or
+;         NAXIS3 for FITS files)
+;   sigma - gaussian sigma for dsmooth
+;   box - box size for dmedsmooth
+;   dpsf, plim - as in dobjects_multi (default 1 and 10)
+;   nband - rows per band (default chosen by the C code)
+; KEYWORDS:
+;   /fits - read and write FITS files rather than raw files
+; COMMENTS:
+;   For images too large to hold in memory (with scratch). The input is
+;   memory mapped and processed in bands of rows with a halo as wide as
+;   the kernel, and the output is written band by band; results are
+;   identical to the in-memory routines. Input pixels are float (long for
+;   dfind); outputs are float for dsmooth and dmedsmooth and long (object
+;   number, -1 if none) for dfind and dobjects_multi. FITS input must have
+;   BITPIX of -32 (32 for dfind) in the primary HDU.
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+pro dimage_tiled, infile, outfile, routine, fits=fits, nx=nx, ny=ny, $
+                  nim=nim, sigma=sigma, box=box, dpsf=dpsf, plim=plim, $
+                  nband=nband
+
+if(n_params() lt 3) then begin
+    doc_library, 'dimage_tiled'
+    return
+endif
+
+if(NOT keyword_set(nband)) then nband=0L
+if(NOT keyword_set(dpsf)) then dpsf=1.
+if(NOT keyword_set(plim)) then plim=10.
+
+isint= (routine eq 'dfind' OR routine eq 'dobjects_multi')
+
+inoffset=0LL
+outoffset=0LL
+if(keyword_set(fits)) then begin
+    hdr=headfits(infile)
+    nx=long(sxpar(hdr, 'NAXIS1'))
+    ny=long(sxpar(hdr, 'NAXIS2'))
+    if(NOT keyword_set(nim)) then nim=(sxpar(hdr, 'NAXIS3') > 1L)
+    bitpix=sxpar(hdr, 'BITPIX')
+    if(bitpix ne (routine eq 'dfind' ? 32 : -32)) then $
+      message, 'unsupported BITPIX '+strtrim(string(bitpix),2)
+    inoffset=2880LL*((n_elements(hdr)*80LL+2879LL)/2880LL)
+
+    mkhdr, outhdr, (isint ? 3 : 4), [nx, ny]
+    outoffset=2880LL*((n_elements(outhdr)*80LL+2879LL)/2880LL)
+    hbytes=replicate(32B, outoffset)
+    hbytes[0]=byte(strjoin(outhdr))
+    openw, unit, outfile, /get_lun
+    writeu, unit, hbytes
+    free_lun, unit
+endif else begin
+    if(NOT keyword_set(nx) OR NOT keyword_set(ny)) then $
+      message, 'nx and ny are required for raw files'
+    if(file_test(outfile)) then file_delete, outfile
+endelse
+if(NOT keyword_set(nim)) then nim=1L
+
+; Set source object name
+soname=filepath('libdimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+
+big=long(keyword_set(fits))
+case routine of
+    'dsmooth': $
+      retval=call_external(soname, 'idl_dsmooth_tiled', string(infile), $
+                           long64(inoffset), big, string(outfile), $
+                           long64(outoffset), big, long(nx), long(ny), $
+                           float(sigma), long(nband))
+    'dmedsmooth': $
+      retval=call_external(soname, 'idl_dmedsmooth_tiled', string(infile), $
+                           long64(inoffset), big, string(outfile), $
+                           long64(outoffset), big, long(nx), long(ny), $
+                           long(box), long(nband))
+    'dfind': $
+      retval=call_external(soname, 'idl_dfind_tiled', string(infile), $
+                           long64(inoffset), big, string(outfile), $
+                           long64(outoffset), big, long(nx), long(ny), $
+                           long(nband))
+    'dobjects_multi': $
+      retval=call_external(soname, 'idl_dobjects_multi_tiled', $
+                           string(infile), long64(inoffset), big, $
+                           string(outfile), long64(outoffset), big, $
+                           long(nx), long(ny), long(nim), float(dpsf), $
+                           float(plim), long(nband))
+    else: message, 'unknown routine '+string(routine)
+endcase
+if(retval eq 0) then $
+  message, 'failed to process '+string(infile)
+
+; pad FITS data to a whole number of records
+if(keyword_set(fits)) then begin
+    ndata=4LL*long64(nx)*long64(ny)
+    npad=(2880LL-(ndata mod 2880LL)) mod 2880LL
+    if(npad gt 0) then begin
+        openu, unit, outfile, /get_lun, /append
+        writeu, unit, bytarr(npad)
+        free_lun, unit
+    endif
+endif
+
+end
+;------------------------------------------------------------------------------
@@ -0,0 +1,63 @@
+;+
+; NAME:
+;   dpeaks
+; PURPOSE:
+;   find peaks in an image
+; CALLING SEQUENCE:
+;   dpeaks, image, xcen=, ycen= [, sigma=, dlim=, saddle=, maxnpeaks=, $
+;      minpeak=, /smooth, /checkpeaks ]
+; INPUTS:
+;   image - [nx, ny] input image
+; OPTIONAL INPUTS:
+;   sigma - sky sigma (defaults to 1)
+;   dlim - minimum distance between peaks in pixels (default 1)
+;   saddle - saddle difference (in sigma) between distinct peaks
+;            (default 3)
+;   maxnpeaks - maximum number of peaks (default 100)
+;   minpeak - minimum peak value (default 0)
+; KEYWORDS:
+;   /smooth - smooth the image (gaussian sigma=2) before finding peaks
+;   /checkpeaks - drop peaks not separated from a brighter peak by a
+;                 saddle of depth saddle*sigma
+; OUTPUTS:
+;   xcen, ycen - [npeaks] pixel positions of peaks, brightest first
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+pro dpeaks, image, xcen=xcen, ycen=ycen, sigma=sigma, dlim=dlim, $
+            saddle=saddle, maxnpeaks=maxnpeaks, minpeak=minpeak, $
+            smooth=smooth, checkpeaks=checkpeaks
+
+nx=(size(image,/dim))[0]
+ny=(size(image,/dim))[1]
+
+if(NOT keyword_set(sigma)) then sigma=1.
+if(NOT keyword_set(dlim)) then dlim=1.
+if(NOT keyword_set(saddle)) then saddle=3.
+if(NOT keyword_set(maxnpeaks)) then maxnpeaks=100L
+if(NOT keyword_set(minpeak)) then minpeak=0.
+
+; Set source object name
+soname=filepath('libdimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+
+npeaks=0L
+xcen=lonarr(maxnpeaks)
+ycen=lonarr(maxnpeaks)
+retval=call_external(soname, 'idl_dpeaks', float(image), $
+                     long(nx), long(ny), npeaks, xcen, ycen, $
+                     float(sigma), float(dlim), float(saddle), $
+                     long(maxnpeaks), long(keyword_set(smooth)), $
+                     long(keyword_set(checkpeaks)), float(minpeak))
+
+if(npeaks eq 0) then begin
+    xcen=-1
+    ycen=-1
+    return
+endif
+xcen=xcen[0:npeaks-1]
+ycen=ycen[0:npeaks-1]
+
+end
+;------------------------------------------------------------------------------
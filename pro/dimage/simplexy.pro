@@ -0,0 +1,76 @@
+;+
+; NAME:
+;   simplexy
+; PURPOSE:
+;   find and centroid sources in an image
+; CALLING SEQUENCE:
+;   simplexy, image, x, y, flux [, sigma=, dpsf=, plim=, dlim=, saddle=, $
+;      maxper=, maxnpeaks=, npeaks= ]
+; INPUTS:
+;   image - [nx, ny] input image
+; OPTIONAL INPUTS:
+;   sigma - sky sigma (estimated from the image if not given)
+;   dpsf - smoothing of PSF for detection (defaults to sigma=1 pixel)
+;   plim - limiting significance in sky sigma (defaults to 8 sig)
+;   dlim - minimum distance between peaks in pixels (default 1)
+;   saddle - saddle difference (in sky sigma) between distinct peaks
+;            (default 3)
+;   maxper - maximum number of peaks per object (default 1000)
+;   maxnpeaks - maximum number of peaks in total (default 100000)
+; OUTPUTS:
+;   x, y - [npeaks] centroids of peaks
+;   flux - [npeaks] background-subtracted peak values
+; OPTIONAL OUTPUTS:
+;   npeaks - number of peaks
+;   sigma - sky sigma, if it was estimated
+; COMMENTS:
+;   Subtracts a median-smoothed background (box of 100 pixels), detects
+;   objects as in dobjects_multi, and finds peaks in each object as in
+;   dpeaks, refining each with a 3x3 parabolic centroid.
+;   Objects are processed on IDLUTILS_NTHREADS threads (default: all
+;   processors).
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+pro simplexy, image, x, y, flux, sigma=sigma, dpsf=dpsf, plim=plim, $
+              dlim=dlim, saddle=saddle, maxper=maxper, maxnpeaks=maxnpeaks, $
+              npeaks=npeaks
+
+nx=(size(image,/dim))[0]
+ny=(size(image,/dim))[1]
+
+if(NOT keyword_set(sigma)) then sigma=0.
+if(NOT keyword_set(dpsf)) then dpsf=1.
+if(NOT keyword_set(plim)) then plim=8.
+if(NOT keyword_set(dlim)) then dlim=1.
+if(NOT keyword_set(saddle)) then saddle=3.
+if(NOT keyword_set(maxper)) then maxper=1000L
+if(NOT keyword_set(maxnpeaks)) then maxnpeaks=100000L
+
+; Set source object name
+soname=filepath('libdimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+
+sigma=float(sigma)
+x=fltarr(maxnpeaks)
+y=fltarr(maxnpeaks)
+flux=fltarr(maxnpeaks)
+npeaks=0L
+retval=call_external(soname, 'idl_simplexy', float(image), $
+                     long(nx), long(ny), float(dpsf), float(plim), $
+                     float(dlim), float(saddle), long(maxper), $
+                     long(maxnpeaks), sigma, x, y, flux, npeaks)
+
+if(npeaks eq 0) then begin
+    x=-1
+    y=-1
+    flux=-1
+    return
+endif
+x=x[0:npeaks-1]
+y=y[0:npeaks-1]
+flux=flux[0:npeaks-1]
+
+end
+;------------------------------------------------------------------------------
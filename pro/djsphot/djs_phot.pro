@@ -13,7 +13,7 @@
 ;    fwhm=, fixfw=, ceps=, $
 ;    salg=, srejalg=, smaxiter=, $
 ;    lorej=, hirej=, $
-;    flerr=, skyval=, skyrms=, skyerr=, peakval=, /quick, /exact ] )
+;    flerr=, skyval=, skyrms=, skyerr=, peakval=, /quick, /exact, /idl ] )
 ;
 ; INPUTS:
 ;   xcen:       X center(s)
@@ -76,6 +76,7 @@
 ;               are integer values. If set, does not recalculate
 ;               center.
 ;   quick       Use faster photfrac algorithm (Not thoroughly tested)
+;   idl         Loop over objects in IDL rather than calling the C code.
 ;
 ; OUTPUTS:
 ;   flux:       Total flux within each circular aperture defined by objrad,
@@ -104,10 +105,15 @@
 ;     object is already centered, which doesn't cost you precision.
 ;   For similar reasons, if /exact is set, djs_phot will not try to
 ;     recentroid your object.
+;   Unless /quick or /idl is set, all objects are measured at once by
+;     aperphot.c, in parallel over objects; set IDLUTILS_NTHREADS to
+;     control the number of threads.  The gauss1 and gauss2 centering
+;     algorithms are still run in IDL, before the C code.
 ; PROCEDURES CALLED:
 ;   djs_photcen
 ;   djs_photfrac
 ;   djs_photsky()
+;   Dynamic link to aperphot.c
 ;
 ; REVISION HISTORY:
 ;   28-Nov-1996  Written by D. Schlegel, Durham.
@@ -115,6 +121,7 @@
 ;                of FITS headers; make IDL 5 compliant (DJS).
 ;   02-Nov-2000  objrad, skyrad recast as floats (D. Finkbeiner)
 ;                  If they are ints, 1% errors may arise. 
+;   18-Oct-2026  Measure all objects at once in C
 ;-
 ;------------------------------------------------------------------------------
 function djs_phot, xcen, ycen, objrad, skyrad, image, invvar, $
@@ -123,7 +130,7 @@ function djs_phot, xcen, ycen, objrad, skyrad, image, invvar, $
  salg=salg, srejalg=srejalg, smaxiter=smaxiter, $
  lorej=lorej, hirej=hirej, $
  flerr=flerr, skyval=skyval, skyrms=skyrms, skyerr=skyerr, peakval=peakval, $
- quick=quick, exact=exact
+ quick=quick, exact=exact, idl=idl
 
    ; Need 5 parameters
    if (N_params() LT 5) then begin
@@ -154,6 +161,61 @@ function djs_phot, xcen, ycen, objrad, skyrad, image, invvar, $
    skyerr = fltarr(nobj)
    if (arg_present(peakval)) then peakval = fltarr(nobj,nrad)
 
+   if (NOT keyword_set(quick) AND NOT keyword_set(idl)) then begin
+      ; Centering options, with the defaults of djs_photcen
+      if (NOT keyword_set(calg)) then calg1 = 'iweight' else calg1 = calg
+      if (NOT keyword_set(cbox)) then cbox1 = 7.0 else cbox1 = float(cbox)
+      if (NOT keyword_set(cmaxiter)) then cmaxiter1 = 10L $
+       else cmaxiter1 = long(cmaxiter)
+      if (NOT keyword_set(exact) AND calg1 NE 'iweight' $
+       AND calg1 NE 'none') then begin
+         djs_photcen, xcen, ycen, image, $
+          calg=calg1, cbox=cbox, cmaxiter=cmaxiter, cmaxshift=cmaxshift
+         calg1 = 'none'
+      endif
+
+      ; Sky options, with the defaults of djs_photsky
+      if (NOT keyword_set(salg)) then salg1 = 'mean' else salg1 = salg
+      isalg = (where(salg1 EQ ['none','mean','median','mode']))[0] > 0
+      if (keyword_set(skyrad)) then nskyrad = n_elements(skyrad) < 2 $
+       else nskyrad = 0L
+      skyrad1 = fltarr(2)
+      if (nskyrad GT 0) then skyrad1[0:nskyrad-1] = skyrad[0:nskyrad-1]
+      if (NOT keyword_set(srejalg)) then srejalg1 = 'sigclip' $
+       else srejalg1 = srejalg
+      isrejalg = (where(srejalg1 EQ ['none','sigclip','pclip']))[0] > 0
+      if (isrejalg EQ 1) then deflim = 3.0 $
+       else if (isrejalg EQ 2) then deflim = 0.05 $
+       else deflim = 0.0
+      if (NOT keyword_set(lorej)) then lorej1 = deflim else lorej1 = lorej
+      if (NOT keyword_set(hirej)) then hirej1 = deflim else hirej1 = hirej
+      if (NOT keyword_set(smaxiter)) then smaxiter1 = 10L $
+       else smaxiter1 = long(smaxiter)
+
+      useinvvar = long(keyword_set(invvar))
+      if (useinvvar) then invvar1 = float(invvar) else invvar1 = fltarr(1)
+      xcen1 = double(xcen)
+      ycen1 = double(ycen)
+      flerr1 = fltarr(nobj,nrad)
+      peakval1 = fltarr(nobj,nrad)
+
+      soname = filepath('libimage.'+idlutils_so_ext(), $
+       root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+      retval = call_external(soname, 'idl_aperphot', $
+       long(xdimen), long(ydimen), float(image), invvar1, useinvvar, $
+       long(nobj), xcen1, ycen1, long(nrad), float(objrad), $
+       long(nskyrad), skyrad1, long(keyword_set(exact)), $
+       long(calg1 EQ 'iweight'), cbox1, cmaxiter1, 0.0, $
+       long(isalg), long(isrejalg), smaxiter1, float(lorej1), float(hirej1), $
+       flux, flerr1, skyval, skyrms, skyerr, peakval1)
+
+      xcen[0] = xcen1
+      ycen[0] = ycen1
+      if (arg_present(flerr)) then flerr = flerr1
+      if (arg_present(peakval)) then peakval = peakval1
+      return, flux
+   endif
+
    ;----- LOOP THROUGH EACH OBJECT -----
    for iobj=0L, nobj-1 do begin
 
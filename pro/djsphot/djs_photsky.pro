@@ -62,6 +62,7 @@
 ;   28-Nov-1996  Written by D. Schlegel, Durham.
 ;   01-Jun-2000  Major revisions: change XYCEN to XCEN,YCEN; remove use
 ;                of FITS headers; make IDL 5 complient (DJS).
+;   18-Oct-2026  pclip keeps the sorted pixel values, not their indices
 ;-
 ;------------------------------------------------------------------------------
 ; INTERNAL SUPPORT PROCEDURES:
@@ -114,7 +115,7 @@ function djs_photsky_reject, skyval, image, srejalg, lorej, hirej
 
    'pclip': begin
       ndata = N_elements(image)
-      newimg = sort(image)
+      newimg = image[sort(image)]
       indx1 = long(lorej*ndata)
       indx2 = ndata - 1 - long(hirej*ndata)
       if (indx2 GE indx1) then $
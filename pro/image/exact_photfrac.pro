@@ -8,11 +8,12 @@
 ;
 ; CALLING SEQUENCE:
 ;   exact_photfrac, xcen, ycen, radius [, fracs=, xdimen=, ydimen=, ]
-;           pixnum=, xpixnum=, ypixnum= ]
+;           pixnum=, xpixnum=, ypixnum=, /freecache ]
+;   exact_photfrac, /freecache
 ;
 ; INPUTS:
-;   xcen - X center(s) (LONG) 
-;   ycen - Y center(s) (LONG) 
+;   xcen - X center(s)
+;   ycen - Y center(s)
 ;   radius - radius of aperture (if 2-element array, inner and outer
 ;            radii of annulus) 
 ;
@@ -22,6 +23,11 @@
 ;   safefactor - we set strictly to zero all pixels outside
 ;                max(radius)*safefactor [default 1.2]
 ;
+; KEYWORDS:
+;   /freecache - release the tables kept by the C code once done
+;                (saving them first if IDLUTILS_PHOTFRAC_CACHE is set);
+;                may be given alone, without computing any fractions
+;
 ; OUTPUTS:
 ;   fracs- contribution of each pixel to image
 ;   pixnum - Pixel number, 0-indexed, for referencing array using one index.
@@ -32,11 +38,21 @@
 ;   Uses Robert Lupton's Aperture Photometry scheme to measure seeing-
 ;   and pixel-convolved aperture photometry in band-limited images.
 ;
-;   xcen and ycen MUST be integers. This simplifies the caching 
-;   of the weights considerably. Note that for band-limited images 
-;   (the only kind that this code works for) you can always sshift 
-;   the image to get the center of the object at the center of a 
-;   pixel (ie. an integer pixel number). 
+;   The weights are looked up in tables kept by the C code
+;   (photfrac_cache.c) for each radius, tabulated on a grid of 1/16
+;   pixel in offset from the center, using the symmetry of the
+;   aperture to store one quadrant.  Integer centers give exactly the
+;   integrated weights; other centers are interpolated between the
+;   tabulated offsets, good to about 1.e-3.  Note that for band-limited
+;   images (the only kind that this code works for) you can always
+;   sshift the image to get the center of the object at the center of
+;   a pixel (ie. an integer pixel number).
+;
+;   The tables are built as needed and shared by all calls.  If the
+;   environment variable IDLUTILS_PHOTFRAC_CACHE names a directory, they
+;   are also saved there and reused by later sessions.  Each table
+;   reaches out to 4*radius (at least 20 pixels) from the center;
+;   pixels further out are integrated directly on each call.
 ;
 ; BUGS:
 ;
@@ -44,52 +60,47 @@
 ;
 ; REVISION HISTORY:
 ;   Started - 22-Aug-2003 M. Blanton (NYU)
+;   18-Oct-2026  Use cached tables in C; allow non-integer centers
+;   18-Oct-2026  Bound the size of the tables; add /freecache
 ;-
 ;------------------------------------------------------------------------------
-; utility to cache exact_photfrac values used many times
+; utility to look up exact_photfrac values in the tables kept by the C code
 function get_exact_photfrac, nx, ny, radius, xc, yc
 
-common com_exact_photfrac, exact_fracs, soname
+soname=filepath('libimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
 
-; Set source object name
-if(NOT keyword_set(soname)) then $
-  soname=filepath('libimage.'+idlutils_so_ext(), $
-                  root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+fracs=fltarr(nx,ny)
+retval=call_external(soname, 'idl_photfrac_cached', long(nx), long(ny), $
+                     float(radius), fracs, float(xc), float(yc))
 
-for i=0L, n_elements(exact_fracs)-1L do $
-  if(nx eq exact_fracs[i].nx and $
-     ny eq exact_fracs[i].ny and $
-     radius eq exact_fracs[i].radius and $
-     xc eq exact_fracs[i].xc and $
-     yc eq exact_fracs[i].yc) then $
-  return, *exact_fracs[i].fracs
+return, fracs
 
-fracs=fltarr(nx,ny)
-retval=call_external(soname, 'idl_photfrac', long(nx), long(ny), $
-                     float(radius),float(fracs),long(xc),long(yc))
+end
+;
+; utility to release the tables kept by the C code
+pro free_exact_photfrac
 
-new_exact_fracs={nx:nx, $
-                 ny:ny, $
-                 radius:radius, $
-                 fracs:ptr_new(fracs), $
-                 xc:xc, $
-                 yc:yc}
-if(n_tags(exact_fracs) gt 0) then $
-  exact_fracs=[exact_fracs,new_exact_fracs] $
-else $
-  exact_fracs=new_exact_fracs
+soname=filepath('libimage.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
 
-return, fracs
+retval=call_external(soname, 'idl_photfrac_cache_free')
 
 end
 ;
 pro exact_photfrac, xcen, ycen, radius, fracs=fracs, ydimen=ydimen, $
                     xdimen=xdimen, pixnum=pixnum, xpixnum=xpixnum, $
-                    ypixnum=ypixnum, safefactor=safefactor
+                    ypixnum=ypixnum, safefactor=safefactor, $
+                    freecache=freecache
+
+if(n_params() eq 0 AND keyword_set(freecache)) then begin
+    free_exact_photfrac
+    return
+endif
 
 if(n_params() lt 2) then begin
     print, 'Syntax - exact_photfrac, xcen, ycen, radius [, fracs=, xdimen=, ydimen=, '
-    print, '            pixnum=, xpixnum=, ypixnum= ] '
+    print, '            pixnum=, xpixnum=, ypixnum=, /freecache ] '
     return
 endif
 
@@ -99,18 +110,13 @@ if(n_elements(safefactor) eq 0) then safefactor=2.
 if(n_elements(xcen) eq 0) then xcen=0L
 if(n_elements(ycen) eq 0) then ycen=0L
 
-ini=where(long(xcen) ne xcen OR long(ycen) ne ycen, nni)
-if(nni gt 0) then begin
-    message, 'xcen and ycen MUST be integers' 
-endif
-
 ; define region to cut out
 if(keyword_set(safefactor)) then begin
     safedistance=(long(max(radius)*safefactor))>10L
-    xstart=(xcen-safedistance)>0L
-    xend=(xcen+safedistance)<(xdimen-1L)
-    ystart=(ycen-safedistance)>0L
-    yend=(ycen+safedistance)<(ydimen-1L)
+    xstart=(long(floor(xcen))-safedistance)>0L
+    xend=(long(ceil(xcen))+safedistance)<(xdimen-1L)
+    ystart=(long(floor(ycen))-safedistance)>0L
+    yend=(long(ceil(ycen))+safedistance)<(ydimen-1L)
 endif else begin
     xstart=0
     xend=xdimen-1L
@@ -135,5 +141,7 @@ if(arg_present(ypixnum) OR arg_present(pixnum)) then $
 if(arg_present(pixnum)) then $
   pixnum= ypixnum*xdimen+xpixnum
 
+if(keyword_set(freecache)) then free_exact_photfrac
+
 end
 ;------------------------------------------------------------------------------
@@ -6,7 +6,8 @@
 ;   Identify objects as the contiguous non-zero pixels in an image.
 ;
 ; CALLING SEQUENCE:
-;   mask = grow_object( image, [ xstart=, ystart=, putval=, /diagonal, nadd= ]
+;   mask = grow_object( image, [ xstart=, ystart=, putval=, /diagonal, nadd=, $
+;    npix= ] )
 ;
 ; INPUTS:
 ;   image      - Integer-valued image vector or array, where non-zero pixel
@@ -20,7 +21,8 @@
 ;   putval     - Object ID(s) to put in MASK as positive-valued long integer;
 ;                default to a unique integer (starting at 1) for each object.
 ;                This can either be a scalar, or a vector with one element
-;                per XSTART,YSTART position.
+;                per XSTART,YSTART position; only the first element is used
+;                if XSTART,YSTART are not set.
 ;   diagonal   - If set, then consider diagonally-offset pixels as contigous
 ;                as well as pixels simply to the left, right, down, or up.
 ;
@@ -31,6 +33,9 @@
 ;
 ; OPTIONAL OUTPUTS:
 ;   nadd       - Number of pixels added to all objects
+;   npix       - Number of pixels in each object, in the order they were
+;                grown; seeds that fall in an object already grown, or on
+;                a zero pixel, add no object and no element here
 ;
 ; COMMENTS:
 ;   Find the pixels that make up an "object" as the contiguous non-zero
@@ -41,8 +46,12 @@
 ;   in the image and assigned unique object IDs in MASK starting at 1.
 ;   Note that in this case, max(MASK) is the number of objects.
 ;
-;   The memory usage is 9*(nx+2)*(ny+2) bytes in addition to the input
-;   image, where [nx,ny] are the dimensions of the input image.
+;   All objects are grown in a single call to the C code, which fills
+;   each object one row segment at a time (scanline flood fill).
+;
+;   The memory usage is 5*(nx+2)*(ny+2) bytes in addition to the input
+;   image, where [nx,ny] are the dimensions of the input image, plus
+;   4 bytes per seed (or per non-zero pixel without seeds).
 ;
 ; EXAMPLES:
 ;   Create a random image of 0s and 1s, and identify all contiguous pixels
@@ -53,37 +62,15 @@
 ; BUGS:
 ;
 ; PROCEDURES CALLED:
-;   Dynamic link to grow_obj.c
+;   Dynamic link to grow_objects() in grow_obj.c
 ;
 ; REVISION HISTORY:
 ;   20-May-2003  Written by D. Schlegel, Princeton
+;   18-Oct-2026  Grow all objects in one call to grow_objects(); NPIX output
 ;-
 ;------------------------------------------------------------------------------
-function grow_obj1, image, mask, iloc, putval=putval, $
- diagonal=diagonal, nx=nx, ny=ny, workarray=workarray
-
-   ; Don't bother calling the C code if we know it won't do anything
-   if (image[iloc] EQ 0) then return, 0
-
-   if (putval LT 0) then message, 'PUTVAL cannot be negative'
-
-   soname = filepath('libimage.'+idlutils_so_ext(), $
-    root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
-
-   ; Note that NY is not actually used by the C code, because the code
-   ; quits when it no longer finds any masked pixels.  Because the image
-   ; has been padded around the edges with zeros, we know that condition
-   ; will be met without ever having to explicitly test that we've hit
-   ; the end of the image.
-   qdiag = long(keyword_set(diagonal))
-   nadd = call_external(soname, 'grow_obj', $
-    nx, ny, image, mask, iloc, putval, qdiag, workarray)
-
-   return, nadd
-end
-;------------------------------------------------------------------------------
 function grow_object, image, xstart=xstart1, ystart=ystart1, putval=putval1, $
- diagonal=diagonal, nadd=nadd
+ diagonal=diagonal, nadd=nadd, npix=npix
 
    ndim = size(image, /n_dimen)
    dims = size(image, /dimens)
@@ -94,51 +81,45 @@ function grow_object, image, xstart=xstart1, ystart=ystart1, putval=putval1, $
    nycen = n_elements(ystart1)
    if (nxcen NE nycen) then $
     message, 'Number of elements in XSTART,YSTART must agree'
-
-   ; Set default return values
-   nadd = 0L
+   if (keyword_set(putval1)) then begin
+      if (min(putval1) LE 0) then message, 'PUTVAL must be positive'
+      putval = long(putval1)
+   endif else begin
+      putval = 0L
+   endelse
+   nputval = long(keyword_set(putval1)) * n_elements(putval)
 
    ; Pad everything by 1, which was necessary to make the C code fast.
    image_pad = bytarr(nx+2,ny+2)
    image_pad[1:nx,1:ny] = image
    mask_pad = lonarr(nx+2,ny+2)
-   workarray = lonarr(nx+2,ny+2)
 
+   ; Seeds as indices into the padded image, or none to start from every
+   ; non-zero pixel in turn
    if (nxcen GE 1) then begin
-      if (keyword_set(putval1)) then $
-       objid = long( putval1[i<(n_elements(putval1)-1)] ) $
-      else $
-       objid = 1L
-      for i=0L, nxcen-1 do begin
-         iloc = long( (xstart1[i]+1) + (ystart1[i]+1) * (nx+2) )
-         nadd1 = grow_obj1(image_pad, mask_pad, iloc, $
-          putval=objid, diagonal=diagonal, $
-          nx=nx+2, ny=ny+2, workarray=workarray)
-         if (nadd1 GT 0) then begin
-            nadd = nadd + nadd1
-            if (NOT keyword_set(putval1)) then objid = objid + 1L
-         endif
-      endfor
+      iseed = long( (xstart1+1) + (ystart1+1) * (nx+2) )
+      nmax = nxcen
    endif else begin
-      indx = [where(image_pad NE 0 AND mask_pad EQ 0, ct), 0]
-      jj = 0L
-      if (keyword_set(putval1)) then objid = long(putval1[0]) $
-       else objid = 1L
-      while (jj LT ct) do begin
-         nadd1 = grow_obj1(image_pad, mask_pad, indx[jj], $
-          putval=objid, diagonal=diagonal, $
-          nx=nx+2, ny=ny+2, workarray=workarray)
-         if (nadd1 GT 0) then begin
-            nadd = nadd + nadd1
-            if (NOT keyword_set(putval1)) then objid = objid + 1L
-         endif
-         ; Pick the next pixel that can be assigned...
-         while ((image_pad[indx[jj]] EQ 0 OR mask_pad[indx[jj]] NE 0) $
-          AND jj LT ct) do jj = jj + 1
-      endwhile
+      iseed = 0L
+      nmax = long(total(image_pad NE 0, /double))
    endelse
+   npix_all = lonarr(nmax > 1)
+
+   ; All objects are grown in one call
+   soname = filepath('libimage.'+idlutils_so_ext(), $
+    root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+   qdiag = long(keyword_set(diagonal))
+   nobj = call_external(soname, 'grow_objects', $
+    long(nx+2), long(ny+2), image_pad, mask_pad, long(nxcen), iseed, $
+    nputval, putval, qdiag, npix_all)
 
-   workarray = 0 ; Clear memory
+   if (nobj GT 0) then begin
+      npix = npix_all[0:nobj-1]
+      nadd = long(total(npix, /double))
+   endif else begin
+      npix = 0L
+      nadd = 0L
+   endelse
 
    ; Un-pad the output image by 1
    mask = mask_pad[1:nx,1:ny]
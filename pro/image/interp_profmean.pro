@@ -32,6 +32,9 @@
 ;   input and output in maggies (or any linear measure of surface 
 ;   brightness)
 ;
+;   To interpolate many objects at once, use interp_profmean_batch(),
+;   which does so in C.
+;
 ; EXAMPLES:
 ;
 ; BUGS:
@@ -0,0 +1,98 @@
+;+
+; NAME:
+;   interp_profmean_batch
+;
+; PURPOSE:
+;   Interpolates the radial profiles of many objects at once
+;
+; CALLING SEQUENCE:
+;   maggies = interp_profmean_batch(nprof, profmean, radius, [profradius=, $
+;      rscale=, pmscale=, maxradius=])
+;
+; INPUTS:
+;   nprof - number of measured elements in each profile [N]
+;   profmean - values (in maggies) in the profiles [NRAD,N]
+;   radius - radii to interpolate to, either the same for every object
+;            [M] or one set per object [M,N]
+;
+; OPTIONAL INPUTS:
+;   profradius - boundaries of annuli in profile (set to photo default
+;                in arcsec) [NRAD]
+;   rscale - asinh scale for radii
+;   pmscale - asinh scale for maggies
+;
+; OUTPUTS:
+;   maggies - cumulative maggies within each radius [M,N]
+;
+; OPTIONAL OUTPUTS:
+;   maxradius - outer radius of the last measured annulus of each
+;               object [N]
+;
+; COMMENTS:
+;   Set up for using the profMean in the fpObjc files of the SDSS,
+;   input and output in maggies (or any linear measure of surface
+;   brightness).  The cumulative profile, from zero at zero radius, is
+;   interpolated by a spline in asinh(radius/rscale) and
+;   asinh(maggies/pmscale).  Objects with no profile have zero
+;   maggies at all radii.
+;
+;   All objects are interpolated in one call to the C code, in parallel,
+;   with the number of threads set by the environment variable
+;   IDLUTILS_NTHREADS.
+;
+; EXAMPLES:
+;
+; BUGS:
+;
+; PROCEDURES CALLED:
+;   Dynamic link to idl_interp_profmean_batch() in idl_interp_profmean.c
+;
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+function interp_profmean_batch, nprof, profmean, radius, $
+ profradius=profradius, rscale=rscale, pmscale=pmscale, maxradius=maxradius
+
+if(n_params() lt 3) then begin
+    print,'Syntax - maggies = interp_profmean_batch(nprof, profmean, radius $'
+    print,'          [, profradius=, rscale=, pmscale=, maxradius= ])'
+    return, -1
+endif
+
+if(NOT keyword_set(rscale)) then rscale=1.e-11
+if(NOT keyword_set(pmscale)) then pmscale=0.1
+if(NOT keyword_set(profradius)) then $
+  profradius=[0.564190, 1.692569, 2.585442, 4.406462, $
+              7.506054, 11.576202, 18.584032, 28.551561, $
+              45.503910, 70.510155, 110.530769, 172.493530, $
+              269.519104, 420.510529, 652.500061]
+nrad=n_elements(profradius)
+
+nobj=n_elements(nprof)
+if(n_elements(profmean) ne nrad*nobj) then $
+  message, 'PROFMEAN must be [NRAD,N] for N elements in NPROF'
+
+nradius=n_elements(radius)
+qshared=1L
+if(size(radius,/n_dimen) eq 2) then begin
+    if((size(radius,/dimens))[1] eq nobj) then begin
+        nradius=(size(radius,/dimens))[0]
+        qshared=0L
+    endif
+endif
+
+maxradius=fltarr(nobj)
+maggies=fltarr(nradius,nobj)
+
+soname = filepath('libimage.'+idlutils_so_ext(), $
+  root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+retval = call_external(soname, 'idl_interp_profmean_batch', long(nobj), $
+  long(nprof), float(profmean), float(profradius), long(nrad), $
+  float(pmscale), float(rscale), maxradius, long(nradius), qshared, $
+  float(radius), maggies)
+
+return, maggies
+
+end
+;------------------------------------------------------------------------------
@@ -18,6 +18,8 @@
 ;   assign     - Assignment scheme:
 ;                'ngp': nearest grid point assignment; default
 ;                'cic': cloud-in-cell assignment
+;                'tsc': triangular-shaped cloud assignment, over the 3x3
+;                       pixels nearest each point (or 3 pixels for a vector)
 ;
 ; OUTPUTS:
 ;   image      - (Modified)
@@ -27,6 +29,13 @@
 ;   as double-precision in the assignment code.  Otherwise, all values
 ;   are treated as floating-point.
 ;
+;   With integer X and Y, 'ngp' and 'cic' put the whole weight in that
+;   pixel, while 'tsc' still spreads it over the neighboring pixels.
+;
+;   Large numbers of points are added in parallel, with the number of
+;   threads set by the environment variable IDLUTILS_NTHREADS.  The image
+;   is the same for any number of threads.
+;
 ; BUGS:
 ;
 ; PROCEDURES CALLED:
@@ -34,6 +43,7 @@
 ;
 ; REVISION HISTORY:
 ;   17-May-2000  Written by D. Schlegel, Princeton
+;   18-Oct-2026  Added 'tsc' assignment; points added in parallel
 ;-
 ;------------------------------------------------------------------------------
 pro populate_image, image, x, y, weights=weights, assign=assign
@@ -49,7 +59,7 @@ pro populate_image, image, x, y, weights=weights, assign=assign
    if (ndim NE 1 AND ndim NE 2) then $
     message, 'Number of dimensions for IMAGE not supported'
    if (NOT keyword_set(assign)) then assign = 'ngp'
-   iassign = (where(assign EQ ['ngp', 'cic']))[0]
+   iassign = (where(assign EQ ['ngp', 'cic', 'tsc']))[0]
    if (iassign EQ -1) then $
     message, 'Unknown value for ASSIGN'
 
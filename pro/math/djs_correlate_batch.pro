@@ -0,0 +1,88 @@
+;+
+; NAME:
+;   djs_correlate_batch
+;
+; PURPOSE:
+;   Cross-correlate a set of spectra against a set of templates using
+;   weights (or masks).
+;
+; CALLING SEQUENCE:
+;   result = djs_correlate_batch( x, y, [ lags, xweight=, yweight= ] )
+;
+; INPUTS:
+;   x          - Spectra dimensioned [NX,NSPEC]
+;   y          - Templates dimensioned [NY,NTEMP]
+;
+; OPTIONAL INPUTS:
+;   lags       - A scalar or integer vector specifying the lags at which
+;                to compute the cross-correlation; default to one lag at 0.
+;   xweight    - Weights for X, dimensioned the same; default to 1 for all
+;                points
+;   yweight    - Weights for Y, dimensioned the same; default to 1 for all
+;                points
+;
+; OUTPUTS:
+;   result     - The output array dimensioned [NSPEC,NTEMP,NLAG], where
+;                RESULT[i,j,*] is DJS_CORRELATE(X[*,i], Y[*,j], LAGS).
+;
+; OPTIONAL OUTPUTS:
+;
+; COMMENTS:
+;   This is the same as calling DJS_CORRELATE() for every spectrum and
+;   template, but in one native call.  The transforms of each template
+;   are computed once and shared by every spectrum, and the pairs are
+;   spread over IDLUTILS_NTHREADS threads.
+;
+; EXAMPLES:
+;   Correlate the 640 spectra of a plate against 10 eigen-templates:
+;   > result = djs_correlate_batch(objflux, tflux, lindgen(401)-200, $
+;   >  xweight=objivar, yweight=(tflux NE 0))
+;
+; BUGS:
+;   The C routine only supports type FLOAT.
+;
+; PROCEDURES CALLED:
+;   Dynamic link to ccorrelate.c
+;
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+function djs_correlate_batch, x, y, lags, xweight=xweight, yweight=yweight
+
+   ; Need at least 2 parameters
+   if (N_params() LT 2) then begin
+      print, 'Syntax - result = djs_correlate_batch( x, y, [ lags, xweight=, yweight= ] )'
+      return, -1
+   endif
+
+   if (n_elements(lags) EQ 0) then lags = 0
+
+   nlag = n_elements(lags)
+   dimx = size(x, /dimens)
+   dimy = size(y, /dimens)
+   nx = dimx[0]
+   ny = dimy[0]
+   nspec = n_elements(x) / nx
+   ntemp = n_elements(y) / ny
+
+   if (NOT keyword_set(xweight)) then xweight = fltarr(nx, nspec) + 1 $
+    else if (n_elements(xweight) NE n_elements(x)) then $
+    message, 'X and XWEIGHT have inconsistent dimensions'
+   if (NOT keyword_set(yweight)) then yweight = fltarr(ny, ntemp) + 1 $
+    else if (n_elements(yweight) NE n_elements(y)) then $
+    message, 'Y and YWEIGHT have inconsistent dimensions'
+
+   ; Allocate memory for the output array
+   result = fltarr(nspec, ntemp, nlag)
+
+   soname = filepath('libmath.'+idlutils_so_ext(), $
+    root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+   retval = call_external(soname, 'ccorrelate_batch', $
+    long(nx), long(nspec), float(x), float(xweight), $
+    long(ny), long(ntemp), float(y), float(yweight), $
+    long(nlag), long(lags), result)
+
+   return, result
+end
+;------------------------------------------------------------------------------
@@ -30,6 +30,8 @@
 ;                        NOT IMPLEMENTED
 ;                These boundary conditions only take effect if WIDTH is set,
 ;                and if ARRAY is either 1-dimensional or 2-dimensional.
+;   idl        - If set, use the IDL MEDIAN() function rather than the
+;                C code.
 ;
 ; OUTPUTS:
 ;   result     - The output array.  If neither DIMENSION nor WIDTH are set,
@@ -43,6 +45,17 @@
 ;   The DIMENSION input is analogous to that used by the IDL built-in
 ;   function TOTAL.
 ;
+;   A 2-D image of any real type with only finite values is median
+;   filtered by C code when WIDTH is odd and no larger than either
+;   dimension, with boundary 'none' or 'reflect'.  Images of integer
+;   values spanning fewer than 4096 levels use the constant-time histogram
+;   method of Perreault & Hebert (2007) for large boxes.  Other images
+;   keep the box sorted as it moves for widths below 13, and otherwise
+;   rank the pixels in blocks and keep the box as a tree of counts over
+;   those ranks, O(WIDTH*log(WIDTH)) per pixel.  Strips of rows are
+;   filtered in parallel; set IDLUTILS_NTHREADS to control the number of
+;   threads.  Other cases use MEDIAN().
+;
 ;   I should like to add the functionality of having WIDTH be an N-dimensional
 ;   smoothing box.  For example, one should be able to median a 2-D image
 ;   with a 3x5 filtering box.
@@ -62,13 +75,15 @@
 ;   > medarr = djs_median(array,9)
 ;
 ; BUGS:
-;   The C routine only supports type FLOAT.
+;   The C routine for DIMENSION only supports type FLOAT.
 ;
 ; PROCEDURES CALLED:
-;   Dynamic link to arrmedian.c
+;   Dynamic link to arrmedian.c, boxmedian.c
 ;
 ; REVISION HISTORY:
 ;   06-Jul-1999  Written by David Schlegel, Princeton.
+;   18-Oct-2026  Median filter 2-D images in C
+;   18-Oct-2026  Ranked windows for large boxes over non-integer images
 ;-
 ;------------------------------------------------------------------------------
 function djs_median, array, dim, width=width, boundary=boundary, idl=idl
@@ -91,7 +106,27 @@ function djs_median, array, dim, width=width, boundary=boundary, idl=idl
 
    endif else if (NOT keyword_set(dim)) then begin
 
-      if (boundary EQ 'none') then begin
+      ; Use the C filter for odd boxes on finite 2-D images of real type
+      native = 0B
+      itype = size(array, /type)
+      if (ndim EQ 2 AND NOT keyword_set(idl) $
+       AND (boundary EQ 'none' OR boundary EQ 'reflect')) then begin
+         iwidth = long(width)
+         if (iwidth EQ width AND (iwidth MOD 2) EQ 1 AND iwidth GT 1 $
+          AND iwidth LE min(dimvec) $
+          AND total(itype EQ [1,2,3,4,5,12,13]) GT 0) then $
+          native = min(finite(array))
+      endif
+
+      if (native) then begin
+         medarr = dblarr(dimvec[0], dimvec[1])
+         soname = filepath('libmath.'+idlutils_so_ext(), $
+          root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+         retval = call_external(soname, 'boxmedian', $
+          long(dimvec[0]), long(dimvec[1]), double(array), iwidth, $
+          long(boundary EQ 'reflect'), medarr)
+         if (itype NE 5) then medarr = fix(medarr, type=itype)
+      endif else if (boundary EQ 'none') then begin
          npix = n_elements(array)
          if (npix EQ 1) then medarr = array[0] $
           else if (width EQ 1) then medarr = array $
@@ -0,0 +1,206 @@
+;+
+; NAME:
+;   djs_stackcombine
+;
+; PURPOSE:
+;   Combine a stack of images on disk without reading them into memory.
+;
+; CALLING SEQUENCE:
+;   djs_stackcombine, files, outfile, [ method=, sigrej=, maxiter=, $
+;    maskfiles=, outmaskfile=, nband=, /raw, nx=, ny=, bitpix= ]
+;
+; INPUTS:
+;   files      - Input file names, one image per file.  These are FITS
+;                files with the image in the primary HDU, unless /RAW is set.
+;   outfile    - Output file for the combined image (FLOAT), written as a
+;                FITS file unless /RAW is set.
+;
+; OPTIONAL INPUTS:
+;   method     - 'median' (default), 'sigclip' for the sigma-clipped mean
+;                as in DJS_AVSIGCLIP(), or 'sigmask' for the same with
+;                input and output masks as in DJS_AVSIGCLIP(INMASK=,OUTMASK=);
+;                'sigmask' is implied by MASKFILES or OUTMASKFILE.
+;   sigrej     - Sigma for rejection; default to 3.0.
+;   maxiter    - Maximum number of sigma rejection iterations; default to 10.
+;   maskfiles  - Input mask files, one per input file, setting =0 for good
+;                pixels; BYTE images in the same format as FILES.
+;   outmaskfile- Output mask file, a BYTE cube [NX,NY,NFILE] setting =0 for
+;                good elements, =1 for bad.
+;   nband      - Number of rows combined at a time; default to as many as
+;                make 16 million values (rows x NX x NFILE).
+;   raw        - If set, FILES and MASKFILES are raw dumps of native-order
+;                pixels, and OUTFILE and OUTMASKFILE are written the same way.
+;   nx, ny     - Image size, required with /RAW.
+;   bitpix     - Pixel type of raw input files, as FITS BITPIX; default -32.
+;
+; OUTPUTS:
+;
+; OPTIONAL OUTPUTS:
+;
+; COMMENTS:
+;   The input files are memory mapped and read a band of NBAND rows at a
+;   time, so memory in use is about 4 x NBAND x NX x NFILE bytes whatever the
+;   size of the stack.  Each band is combined with the same code as
+;   DJS_MEDIAN(array,3) or DJS_AVSIGCLIP(array,3), and the results are the
+;   same as for the stack read into an [NX,NY,NFILE] array.
+;
+;   FITS input may have BITPIX of 8, 16, 32, -32 or -64, with BSCALE and
+;   BZERO applied.  All inputs must have the same NAXIS1 and NAXIS2.
+;
+; EXAMPLES:
+;   Median-combine a set of bias frames:
+;   > files = file_search('bias-*.fits')
+;   > djs_stackcombine, files, 'bias.fits'
+;
+; BUGS:
+;   Compressed or multi-extension input files are not supported.
+;
+; PROCEDURES CALLED:
+;   headfits()
+;   mkhdr
+;   sxpar()
+;   Dynamic link to stackcombine.c
+;
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+; Write a FITS header for a data array of the given dimensions, and return
+; the byte offset of the data.
+function djs_stackcombine_header, filename, bitpix, dims
+
+   mkhdr, hdr, (bitpix EQ 8 ? 1 : 4), dims
+   offset = 2880LL * ((n_elements(hdr) * 80LL + 2879LL) / 2880LL)
+   hbytes = replicate(32B, offset)
+   hbytes[0] = byte(strjoin(hdr))
+   openw, unit, filename, /get_lun
+   writeu, unit, hbytes
+   free_lun, unit
+
+   return, offset
+end
+;------------------------------------------------------------------------------
+; Pad a FITS data segment to a whole number of records.
+pro djs_stackcombine_pad, filename, ndata
+
+   npad = (2880LL - (ndata MOD 2880LL)) MOD 2880LL
+   if (npad GT 0) then begin
+      openu, unit, filename, /get_lun, /append
+      writeu, unit, bytarr(npad)
+      free_lun, unit
+   endif
+
+   return
+end
+;------------------------------------------------------------------------------
+pro djs_stackcombine, files, outfile, method=method, sigrej=sigrej, $
+ maxiter=maxiter, maskfiles=maskfiles, outmaskfile=outmaskfile, $
+ nband=nband, raw=raw, nx=nx, ny=ny, bitpix=bitpix
+
+   ; Need at least 2 parameters
+   if (N_params() LT 2) then begin
+      print, 'Syntax - djs_stackcombine, files, outfile, [ method=, sigrej=, maxiter=, $'
+      print, ' maskfiles=, outmaskfile=, nband=, /raw, nx=, ny=, bitpix= ]'
+      return
+   endif
+
+   if (NOT keyword_set(method)) then method = 'median'
+   if (keyword_set(maskfiles) OR keyword_set(outmaskfile)) then $
+    method = 'sigmask'
+   if (NOT keyword_set(sigrej)) then sigrej = 3.0
+   if (N_elements(maxiter) EQ 0) then maxiter = 10
+   if (NOT keyword_set(nband)) then nband = 0L
+
+   case method of
+      'median' : imethod = 0L
+      'sigclip': imethod = 1L
+      'sigmask': imethod = 2L
+      else     : message, 'Unknown METHOD ' + string(method)
+   endcase
+
+   nfile = n_elements(files)
+   nmaskfile = n_elements(maskfiles)
+   if (nmaskfile NE 0 AND nmaskfile NE nfile) then $
+    message, 'MASKFILES must match FILES'
+   offsets = lon64arr(nfile)
+   bitpixs = lonarr(nfile)
+   bscale = dblarr(nfile) + 1.d0
+   bzero = dblarr(nfile)
+   maskoffsets = lon64arr(nfile > 1)
+
+   ;----------
+   ; Read the data offset and pixel type of every input
+
+   if (keyword_set(raw)) then begin
+      if (NOT keyword_set(nx) OR NOT keyword_set(ny)) then $
+       message, 'NX and NY are required for raw files'
+      if (NOT keyword_set(bitpix)) then bitpix = -32L
+      bitpixs[*] = bitpix
+   endif else begin
+      for ifile=0L, nfile-1L do begin
+         hdr = headfits(files[ifile])
+         naxis1 = long(sxpar(hdr, 'NAXIS1'))
+         naxis2 = long(sxpar(hdr, 'NAXIS2'))
+         if (ifile EQ 0) then begin
+            nx = naxis1
+            ny = naxis2
+         endif
+         if (naxis1 NE nx OR naxis2 NE ny) then $
+          message, 'Image size of ' + files[ifile] + ' does not match'
+         bitpixs[ifile] = long(sxpar(hdr, 'BITPIX'))
+         bs = sxpar(hdr, 'BSCALE', count=ct)
+         if (ct GT 0) then bscale[ifile] = bs
+         bz = sxpar(hdr, 'BZERO', count=ct)
+         if (ct GT 0) then bzero[ifile] = bz
+         offsets[ifile] = 2880LL * ((n_elements(hdr) * 80LL + 2879LL) / 2880LL)
+         if (nmaskfile GT 0) then begin
+            mhdr = headfits(maskfiles[ifile])
+            if (sxpar(mhdr, 'BITPIX') NE 8) then $
+             message, 'Mask ' + maskfiles[ifile] + ' must be BYTE'
+            maskoffsets[ifile] = $
+             2880LL * ((n_elements(mhdr) * 80LL + 2879LL) / 2880LL)
+         endif
+      endfor
+   endelse
+
+   ;----------
+   ; Start the output files
+
+   if (keyword_set(outmaskfile)) then thisoutmask = outmaskfile $
+    else thisoutmask = ''
+   if (keyword_set(raw)) then begin
+      outoffset = 0LL
+      outmaskoffset = 0LL
+      if (file_test(outfile)) then file_delete, outfile
+      if (keyword_set(thisoutmask)) then $
+       if (file_test(thisoutmask)) then file_delete, thisoutmask
+   endif else begin
+      outoffset = djs_stackcombine_header(outfile, -32, [nx, ny])
+      if (keyword_set(thisoutmask)) then $
+       outmaskoffset = djs_stackcombine_header(thisoutmask, 8, [nx, ny, nfile]) $
+      else outmaskoffset = 0LL
+   endelse
+   if (nmaskfile GT 0) then thismaskfiles = string(maskfiles) $
+    else thismaskfiles = ['']
+
+   soname = filepath('libmath.'+idlutils_so_ext(), $
+    root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+
+   retval = call_external(soname, 'stackcombine', $
+    long(nfile), string(files), offsets, bitpixs, bscale, bzero, $
+    (keyword_set(raw) ? 0L : 1L), long(nx), long(ny), imethod, $
+    float(sigrej), float(sigrej), long(maxiter), long(nmaskfile), $
+    thismaskfiles, maskoffsets, string(outfile), outoffset, $
+    string(thisoutmask), outmaskoffset, long(nband))
+   if (retval EQ 0) then $
+    message, 'Failed to combine the input files'
+
+   if (NOT keyword_set(raw)) then begin
+      djs_stackcombine_pad, outfile, 4LL * nx * ny
+      if (keyword_set(thisoutmask)) then $
+       djs_stackcombine_pad, thisoutmask, long64(nx) * ny * nfile
+   endif
+
+   return
+end
+;------------------------------------------------------------------------------
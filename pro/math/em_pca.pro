@@ -14,6 +14,14 @@
 ;         hidden= ( eigenvec^T . eigenvec )^{-1} . eigenvec^T . data
 ;         eigenvec= data . hidden^T . (hidden . hidden^T)^{-1}
 ;
+;    With WEIGHT set, each data vector n and each pixel j get their own
+;    weighted solutions:
+;
+;         hidden_n= ( eigenvec^T . W_n . eigenvec )^{-1} .
+;                   eigenvec^T . W_n . data_n
+;         eigenvec_j= ( sum_n w_jn data_jn hidden_n^T ) .
+;                     ( sum_n w_jn hidden_n hidden_n^T )^{-1}
+;
 ;    From:
 ;    Neural Information Processing Systems 10 (NIPS'97) pp.626-632
 ;    available at:
@@ -21,13 +29,16 @@
 ; CATEGORY:
 ;    Mathematical
 ; CALLING SEQUENCE:
-;    em_pca, data, k, eigenvec, hidden [, tol=, maxiter=, niter=, /verbose]
+;    em_pca, data, k, eigenvec, hidden [, tol=, maxiter=, niter=, weight=, $
+;           /verbose]
 ; INPUTS:
 ;    data - [p,N] data to be PCAed
 ;    k - number of eigenvectors desired (<p)
 ; OPTIONAL INPUT PARAMETERS:
 ;    tol - tolerance of convergence (default 0.)
 ;    maxiter - maximum number of iterations (default 20)
+;    weight - [p,N] weights of the data (e.g. inverse variances); 0 for
+;             pixels to ignore
 ; KEYWORD PARAMETERS:
 ;    /verbose - verbose output
 ;    /nofix - don't do the final real PCA
@@ -37,6 +48,18 @@
 ;             representation of the data)
 ; OPTIONAL OUTPUTS:
 ;    niter - number of iterations used
+; COMMENTS:
+;    The iterations run in C (idl_em_pca.c), which makes one threaded
+;    pass over the data per iteration, streaming it in blocks of data
+;    vectors without copying it if it is FLOAT or DOUBLE.  Set
+;    IDLUTILS_NTHREADS to control the number of threads; with WEIGHT,
+;    fewer are used if their sums (p*k*k doubles each) would take more
+;    than 256MB.  With /VERBOSE the change at each iteration is logged
+;    when the C code returns.
+;
+;    With WEIGHT, the final HIDDEN after orthonormalization is the
+;    unweighted projection of the data; set /NOORTHO to get the weighted
+;    hidden variables of the last iteration.
 ; COMMON BLOCKS:
 ; SIDE EFFECTS:
 ; BUGS:
@@ -46,9 +69,11 @@
 ; PROCEDURE:
 ; MODIFICATION HISTORY:
 ;    2003-01-26 - Written by Michael Blanton (NYU)
+;    2026-10-18 - Iterate in C; add WEIGHT
+;    2026-10-18 - Log each iteration again with /VERBOSE
 ;-
 pro em_pca, data, k, eigenvec, hidden, tol=tol, maxiter=maxiter, niter=niter, $
-            verbose=verbose, nofix=nofix, noortho=noortho
+            weight=weight, verbose=verbose, nofix=nofix, noortho=noortho
 
 ; set defaults
 if(n_elements(tol) eq 0) then tol=0.
@@ -57,7 +82,7 @@ if(n_elements(maxiter) eq 0) then maxiter=20
 ; check args
 if (n_params() lt 1) then begin
     print, 'Syntax - em_pca, data, k, eigenvec, hidden [, tol=, maxiter=, niter=, $'
-    print, '                 /verbose]'
+    print, '                 weight=, /verbose]'
     return
 endif
 
@@ -79,25 +104,41 @@ endif
 eigenvec=dblarr(p,k)
 eigenvec[0:k-1,0:k-1]=identity(k)
 
-niter=0L
-diff=tol*2.+1.
-while(niter lt maxiter and diff gt tol) do begin
-    if(keyword_set(verbose)) then splog,'niter= '+string(niter)
-    hidden=(invert(transpose(eigenvec)#eigenvec,/double)# $
-            transpose(eigenvec))#data
-    oldeigenvec=eigenvec
-    eigenvec=data#transpose(hidden)#invert(hidden#transpose(hidden),/double)
-    if(tol gt 0.) then begin
-        diff=0.
-        for i=0, k-1 do begin
-            diff=diff+abs(1.-total(oldeigenvec[*,i]*eigenvec[*,i],/double)/ $
-                          sqrt(total(oldeigenvec[*,i]^2,/double)* $
-                               total(eigenvec[*,i]^2,/double)))
-        endfor
-        if(keyword_set(verbose)) then splog,'diff= '+string(diff)
+; iterate in C; FLOAT and DOUBLE data are used in place
+dtype=size(data,/type)
+isdouble=long(dtype eq 5)
+if(n_elements(weight) gt 0) then begin
+    if(n_elements(weight) ne n_elements(data)) then begin
+        splog, 'weight must have the same dimensions as data!'
+        return
     endif
-    niter=niter+1L
-endwhile
+    weighted=1L
+    if(isdouble) then thisweight=double(weight) else thisweight=float(weight)
+endif else begin
+    weighted=0L
+    thisweight=0.
+    if(isdouble) then thisweight=0.D
+endelse
+hidden=dblarr(k,n)
+niter=0L
+diffs=dblarr(maxiter>1L)
+soname=filepath('libmath.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+if(dtype eq 4 or dtype eq 5) then $
+  retval=call_external(soname, 'idl_em_pca', long(p), long(n), long(k), $
+                       data, isdouble, thisweight, weighted, eigenvec, $
+                       hidden, long(maxiter), double(tol), niter, diffs) $
+else $
+  retval=call_external(soname, 'idl_em_pca', long(p), long(n), long(k), $
+                       float(data), isdouble, thisweight, weighted, $
+                       eigenvec, hidden, long(maxiter), double(tol), niter, $
+                       diffs)
+if(keyword_set(verbose)) then begin
+    for i=0L, niter-1L do begin
+        splog,'niter= '+string(i)
+        if(tol gt 0.) then splog,'diff= '+string(diffs[i])
+    endfor
+endif
 
 if(NOT keyword_set(noortho)) then begin
 ;   Orthonormalize
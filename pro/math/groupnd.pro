@@ -15,8 +15,14 @@
 ;   multgroup  - multiplicity of each group 
 ;   firstgroup - first member of each group 
 ;   nextgroup  - index of next member of group for each object
+; COMMENTS:
+;   Friends-of-friends: points closer than distance are linked, and
+;   groups are numbered in order of their lowest member.  The links are
+;   found with a kd-tree by the C code in src/spheregroup/ndgroup.c, in
+;   parallel; set IDLUTILS_NTHREADS to control the number of threads.
 ; REVISION HISTORY:
 ;   28-Nov-2006  Written by Mike Blanton, NYU
+;   18-Oct-2026  Use kd-tree in C
 ;-
 ;------------------------------------------------------------------------------
 function groupnd, x, distance, nextgroup=nextgroup, multgroup=multgroup, $
@@ -37,22 +43,22 @@ endif else begin
     nn=(size(x,/dim))[1]
 endelse
 
-matchnd, x, x, distance, m1=m1, m2=m2, d12=d12, nmatch=nmatch, nd=nd, $
-  maxmatch=0
+ibad=where(finite(x) eq 0, nbad)
+if(nbad gt 0) then $
+  message, 'Infinite x values in groupnd!'
 
-matches=ptrarr(nn)
-isort=sort(m1)
-iuniq=uniq(m1[isort])
-istart=0L
-for i=0L, n_elements(iuniq)-1L do begin
-    iend=iuniq[i]
-    icurr=isort[istart:iend]
-    matches[m1[icurr[0]]]=ptr_new(m2[icurr])
-    istart=iend+1L
-endfor
-
-group_on_matches, matches, first=firstgroup, next=nextgroup, $
-  mult=multgroup, in=ingroup
+ingroup=lonarr(nn)
+multgroup=lonarr(nn)
+firstgroup=lonarr(nn)
+nextgroup=lonarr(nn)
+ngroup=0L
+soname=filepath('libspheregroup.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+retval=call_external(soname, 'ndgroup', long(mm), long(nn), double(x), $
+                     double(distance), ingroup, multgroup, firstgroup, $
+                     nextgroup, ngroup)
+multgroup=multgroup[0:ngroup-1]
+firstgroup=firstgroup[0:ngroup-1]
 
 return, ingroup
 
@@ -21,6 +21,10 @@
 ;   Nk are the number of data points
 ;   Nd are the number of types of measurements
 ;   Nf are the number of model components
+;
+;   The iterations run in C (idl_nmf_sparse.c), which fuses the sparse
+;   products of each iteration into one threaded pass over the data
+;   points; set IDLUTILS_NTHREADS to control the number of threads.
 ;   
 ;   The sparse matrix structure referred to above is:
 ;       .VAL[NVAL]      - actual values in matrix
@@ -32,6 +36,7 @@
 ; REVISION HISTORY:
 ;   2005-Feb-5  Written by Mike Blanton, NYU
 ;               Adapted from Matlab code of Sam Roweis
+;   18-Oct-2026  Iterate in C
 ;
 ;----------------------------------------------------------------------
 pro nmf_sparse, data, data_ivar, ncomp, mmatrix, in_tol, coeffs=coeffs, $
@@ -60,11 +65,8 @@ endif
 ;; premake transpose of big mmatrix
 tmmatrix=transpose(mmatrix)
 
-;; create datap=data*data_ivar
-datap=data
-datahatp=data
+;; model at the data points
 datahat=data
-datap.val=data.val*data_ivar.val
 
 ;; initialize templates and coeffs
 if(keyword_set(templates) eq 0) then $
@@ -84,41 +86,28 @@ err=total((datahat.val-data.val)^2*data_ivar.val,/double)
 splog, 'initial error= '+ $
   strtrim(string(sqrt(err/float(n_elements(datahat.val)))),2)
 
-err=1.d+99
-eold=1.d+100
-iters=1L
-
 if(in_tol gt 1.) then begin
-    maxiters=in_tol
-    tol=0 
+    maxiters=long(in_tol)
+    tol=0.D
 endif else begin
-    tol=in_tol
+    tol=double(in_tol)
     maxiters=1000000000L
 endelse
 
-while(iters le maxiters and abs(err-eold)/err gt tol) do begin
-    datahatp.val=datahat.val*data_ivar.val
-;;    mdatap=transpose(mmatrix)#datap
-    mmsparse, mdatap, mmatrix, datap
-;;    mdatahatp=transpose(mmatrix)#datahatp
-    mmsparse, mdatahatp, mmatrix, datahatp
-    coeffs=coeffs*((transpose(templates)#mdatap)/ $
-                   (transpose(templates)#mdatahatp))
-    templates=templates*((mdatap#transpose(coeffs))/ $
-                         (mdatahatp#transpose(coeffs)))
-    ttot=total(templates, 1)
-	  for i=0L, n_elements(ttot)-1L do $
-      templates[*,i]=templates[*,i]/ttot[i]
-    
-    mcoeffs=templates#coeffs
-;;  datahat=mmatrix#mcoeffs
-    mmeval, datahat, tmmatrix, mcoeffs
-
-    eold=err
-    err=total((datahat.val-data.val)^2*data_ivar.val,/double)
-    splog, 'error at iter '+strtrim(string(iters),2)+' = '+ $
-      strtrim(string(sqrt(err/float(n_elements(datahat.val)))),2)
-    iters=iters+1L
-endwhile
+;; iterate in C, keeping the data, templates and coeffs resident
+templates=double(templates)
+coeffs=double(coeffs)
+iters=0L
+err=0.D
+soname=filepath('libmath.'+idlutils_so_ext(), $
+                root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+retval=call_external(soname, 'idl_nmf_sparse', long(nd), long(nk), $
+                     long(nf), long(ncomp), float(data.val), $
+                     float(data_ivar.val), long(data.x), $
+                     long(data.rowstart), long(data.nxrow), $
+                     float(mmatrix), templates, coeffs, maxiters, tol, $
+                     iters, err)
+splog, 'error after '+strtrim(string(iters),2)+' iters = '+ $
+  strtrim(string(sqrt(err/float(n_elements(datahat.val)))),2)
 
 end
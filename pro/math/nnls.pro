@@ -4,20 +4,23 @@
 ; PURPOSE:
 ;   non-negative least-square fitting routine
 ; COMMENTS:
-;   See documentation in $IDLUTILS_DIR/src/math/nnls.f.
+;   See documentation in $IDLUTILS_DIR/src/math/nnls.f; the arguments
+;   are the same, but the solver is the C version in idl_nnls.c, which
+;   leaves A and B unchanged and returns the residual vector in ZZ.
+;   See NNLS_BATCH() for many right-hand sides with the same A.
 ;-
 pro nnls, a,mda,m,n,b,x,resnorm,w,zz,indx,mde
   a= reform(float(a),mda,n)
-  mda= fix(mda)
-  m= fix(m)
-  n= fix(n)
+  mda= long(mda)
+  m= long(m)
+  n= long(n)
   b= float(b)
   x= fltarr(n)
   resnorm= float(1.0)
   w= fltarr(n)
   zz= fltarr(m)
-  indx= intarr(n)
-  mde= fix(1)
+  indx= lonarr(n)
+  mde= 1L
   soname = filepath('libmath.'+idlutils_so_ext(), $
     root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
   retval= call_external(soname,'idl_nnls', $
@@ -0,0 +1,95 @@
+;+
+; NAME:
+;   nnls_batch
+;
+; PURPOSE:
+;   Non-negative least-squares fits of many vectors with one design matrix.
+;
+; CALLING SEQUENCE:
+;   x = nnls_batch( a, b, [ passive=, maxiter=, resnorm=, dual=, status= ] )
+;
+; INPUTS:
+;   a          - Design matrix dimensioned [M,N]
+;   b          - Vectors to fit, dimensioned [M] or [M,NRHS]
+;
+; OPTIONAL INPUTS:
+;   passive    - Starting passive sets dimensioned [N,NRHS], setting =1 for
+;                coefficients expected to be positive, as returned by an
+;                earlier call; if not set, start every fit from zero.
+;   maxiter    - Maximum number of iterations per fit; default to 3*N.
+;
+; OUTPUTS:
+;   x          - Coefficients dimensioned [N,NRHS], minimizing |A##X-B|
+;                subject to X >= 0 for each column of B.
+;
+; OPTIONAL OUTPUTS:
+;   passive    - Final passive sets dimensioned [N,NRHS], =1 where X > 0.
+;   resnorm    - Euclidean norm of the residual of each fit [NRHS]
+;   dual       - Dual vectors A^T (B - A X) dimensioned [N,NRHS], which are
+;                zero in the passive sets and <= 0 elsewhere.
+;   status     - Status of each fit [NRHS]: 1 for success, 2 for bad
+;                dimensions, 3 if MAXITER was reached.
+;
+; COMMENTS:
+;   This is the Lawson & Hanson active-set method of NNLS, but working
+;   from the normal equations so that A^T A is computed once and shared
+;   by every fit.  The fits are spread over IDLUTILS_NTHREADS threads.
+;   Starting from the passive sets of a similar problem, such as the
+;   neighboring spectra or the previous iteration of an outer fit, usually
+;   converges in one or two steps.
+;
+; EXAMPLES:
+;   Fit 10 templates to each of 1000 spectra, then refit with new spectra
+;   starting from the same passive sets:
+;   > coeff = nnls_batch(templates, flux, passive=passive)
+;   > coeff2 = nnls_batch(templates, flux2, passive=passive)
+;
+; BUGS:
+;
+; PROCEDURES CALLED:
+;   Dynamic link to idl_nnls.c
+;
+; REVISION HISTORY:
+;   18-Oct-2026  Written
+;-
+;------------------------------------------------------------------------------
+function nnls_batch, a, b, passive=passive, maxiter=maxiter, $
+ resnorm=resnorm, dual=dual, status=status
+
+   ; Need at least 2 parameters
+   if (N_params() LT 2) then begin
+      print, 'Syntax - x = nnls_batch( a, b, [ passive=, maxiter=, resnorm=, dual=, status= ] )'
+      return, -1
+   endif
+
+   dims = size(a, /dimens)
+   m = dims[0]
+   n = n_elements(a) / m
+   nrhs = n_elements(b) / m
+   if (n_elements(b) NE m * nrhs) then $
+    message, 'A and B have inconsistent dimensions'
+
+   if (n_elements(passive) EQ n * nrhs) then begin
+      warm = 1L
+      thispassive = long(passive NE 0)
+   endif else begin
+      warm = 0L
+      thispassive = lonarr(n, nrhs)
+   endelse
+   if (NOT keyword_set(maxiter)) then maxiter = 0L
+
+   x = fltarr(n, nrhs)
+   resnorm = fltarr(nrhs)
+   dual = fltarr(n, nrhs)
+   status = lonarr(nrhs)
+
+   soname = filepath('libmath.'+idlutils_so_ext(), $
+    root_dir=getenv('IDLUTILS_DIR'), subdirectory='lib')
+   retval = call_external(soname, 'idl_nnls_batch', $
+    float(a), long(m), long(n), long(nrhs), float(b), x, thispassive, $
+    warm, long(maxiter), resnorm, dual, status)
+   passive = reform(thispassive, n, nrhs)
+
+   return, x
+end
+;------------------------------------------------------------------------------
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+#include "idlutils_threads.h"
+
+/*
+ * dallpeaks.c
+ *
+ * Find and centroid the peaks of every object in an object image (as
+ * returned by dfind or dobjects_multi).  Each object is cut out on its
+ * bounding box with the other pixels zeroed, run through dpeaks, and
+ * each peak is refined with dcen3x3.  Objects are spread over threads;
+ * the output is in object order regardless of the number of threads.
+ * Each thread appends the peaks it finds to its own list, so memory
+ * goes with the number of peaks found rather than objects times maxper.
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+typedef struct {
+  float *x, *y;
+  long n, nalloc;
+} dallpeaks_list;
+
+typedef struct {
+  float *image;
+  int *objects;
+  int nx, ny, nobj, maxper;
+  float sigma, dlim, saddle, minpeak;
+  int *xmin, *xmax, *ymin, *ymax;
+  int *nper;          /* [nobj] peaks of each object */
+  int *owner;         /* [nobj] thread whose list holds them */
+  long *offset;       /* [nobj] and where they start in it */
+  dallpeaks_list list[IDLUTILS_MAXTHREADS];
+  idlutils_queue queue;
+} dallpeaks_work;
+
+/* peaks of object iobj, appended to list */
+static void dallpeaks_object(dallpeaks_work *w, int iobj,
+                             dallpeaks_list *list, int ithread,
+                             float **oimage, int **xc, int **yc, int *nbuf)
+{
+  int i, j, ip, jp, onx, ony, npeaks, k;
+  float cimage[9], xsub, ysub;
+
+  onx=w->xmax[iobj]-w->xmin[iobj]+1;
+  ony=w->ymax[iobj]-w->ymin[iobj]+1;
+  if(onx*ony>(*nbuf)) {
+    FREEVEC(*oimage);
+    (*nbuf)=onx*ony;
+    (*oimage)=(float *) malloc((*nbuf)*sizeof(float));
+  }
+
+  for(j=0;j<ony;j++)
+    for(i=0;i<onx;i++) {
+      k=(i+w->xmin[iobj])+(j+w->ymin[iobj])*w->nx;
+      (*oimage)[i+j*onx]=(w->objects[k]==iobj) ? w->image[k] : 0.;
+    }
+
+  dpeaks(*oimage, onx, ony, &npeaks, *xc, *yc, w->sigma, w->dlim,
+         w->saddle, w->maxper, 1, 1, w->minpeak);
+
+  if(list->n+npeaks>list->nalloc) {
+    list->nalloc=2*(list->n+npeaks);
+    list->x=(float *) realloc(list->x, list->nalloc*sizeof(float));
+    list->y=(float *) realloc(list->y, list->nalloc*sizeof(float));
+  }
+  w->owner[iobj]=ithread;
+  w->offset[iobj]=list->n;
+
+  for(k=0;k<npeaks;k++) {
+    xsub=(float) (*xc)[k];
+    ysub=(float) (*yc)[k];
+    if((*xc)[k]>0 && (*xc)[k]<onx-1 && (*yc)[k]>0 && (*yc)[k]<ony-1) {
+      for(jp=0;jp<3;jp++)
+        for(ip=0;ip<3;ip++)
+          cimage[ip+jp*3]=(*oimage)[((*xc)[k]+ip-1)+((*yc)[k]+jp-1)*onx];
+      if(dcen3x3(cimage, &xsub, &ysub)) {
+        xsub+=(float) ((*xc)[k]-1);
+        ysub+=(float) ((*yc)[k]-1);
+      } else {
+        xsub=(float) (*xc)[k];
+        ysub=(float) (*yc)[k];
+      }
+    }
+    list->x[list->n]=xsub+(float) w->xmin[iobj];
+    list->y[list->n]=ysub+(float) w->ymin[iobj];
+    list->n++;
+  }
+  w->nper[iobj]=npeaks;
+}
+
+static void dallpeaks_thread(void *arg, int ithread, int nthreads)
+{
+  dallpeaks_work *w=(dallpeaks_work *) arg;
+  float *oimage=NULL;
+  int *xc, *yc, nbuf=0;
+  long lo, hi, iobj;
+
+  xc=(int *) malloc(w->maxper*sizeof(int));
+  yc=(int *) malloc(w->maxper*sizeof(int));
+  while(idlutils_queue_next(&(w->queue), &lo, &hi))
+    for(iobj=lo;iobj<hi;iobj++)
+      if(w->xmax[iobj]>=w->xmin[iobj])
+        dallpeaks_object(w, (int) iobj, &(w->list[ithread]), ithread,
+                         &oimage, &xc, &yc, &nbuf);
+  FREEVEC(oimage);
+  FREEVEC(xc);
+  FREEVEC(yc);
+}
+
+int dallpeaks(float *image,
+              int nx,
+              int ny,
+              int *objects,
+              float *xcen,
+              float *ycen,
+              int *npeaks,
+              float sigma,
+              float dlim,
+              float saddle,
+              int maxper,
+              int maxnpeaks,
+              float minpeak)
+{
+  dallpeaks_work w;
+  int i, j, k, l, iobj;
+  dallpeaks_list *list;
+
+  (*npeaks)=0;
+  if(maxper<=0 || maxnpeaks<=0) return(1);
+
+  /* 1. bounding box of each object */
+  w.nobj=0;
+  for(k=0;k<nx*ny;k++)
+    if(objects[k]>=w.nobj) w.nobj=objects[k]+1;
+  if(w.nobj==0) return(1);
+
+  w.xmin=(int *) malloc(w.nobj*sizeof(int));
+  w.xmax=(int *) malloc(w.nobj*sizeof(int));
+  w.ymin=(int *) malloc(w.nobj*sizeof(int));
+  w.ymax=(int *) malloc(w.nobj*sizeof(int));
+  for(iobj=0;iobj<w.nobj;iobj++) {
+    w.xmin[iobj]=nx;
+    w.xmax[iobj]=-1;
+    w.ymin[iobj]=ny;
+    w.ymax[iobj]=-1;
+  }
+  for(j=0;j<ny;j++)
+    for(i=0;i<nx;i++) {
+      iobj=objects[i+j*nx];
+      if(iobj<0) continue;
+      if(i<w.xmin[iobj]) w.xmin[iobj]=i;
+      if(i>w.xmax[iobj]) w.xmax[iobj]=i;
+      if(j<w.ymin[iobj]) w.ymin[iobj]=j;
+      if(j>w.ymax[iobj]) w.ymax[iobj]=j;
+    }
+
+  /* 2. peaks of each object, in parallel */
+  w.image=image;
+  w.objects=objects;
+  w.nx=nx;
+  w.ny=ny;
+  w.maxper=maxper;
+  w.sigma=sigma;
+  w.dlim=dlim;
+  w.saddle=saddle;
+  w.minpeak=minpeak;
+  /* IDs with no pixels are skipped, and have no peaks */
+  w.nper=(int *) calloc(w.nobj, sizeof(int));
+  w.owner=(int *) calloc(w.nobj, sizeof(int));
+  w.offset=(long *) calloc(w.nobj, sizeof(long));
+  memset(w.list, 0, sizeof(w.list));
+  idlutils_queue_init(&(w.queue), w.nobj, 1);
+  idlutils_run(idlutils_nthreads(w.nobj), dallpeaks_thread, &w);
+  idlutils_queue_free(&(w.queue));
+
+  /* 3. collect in object order */
+  for(iobj=0;iobj<w.nobj && (*npeaks)<maxnpeaks;iobj++) {
+    list=&(w.list[w.owner[iobj]]);
+    for(l=0;l<w.nper[iobj] && (*npeaks)<maxnpeaks;l++) {
+      xcen[*npeaks]=list->x[w.offset[iobj]+l];
+      ycen[*npeaks]=list->y[w.offset[iobj]+l];
+      (*npeaks)++;
+    }
+  }
+
+  FREEVEC(w.xmin);
+  FREEVEC(w.xmax);
+  FREEVEC(w.ymin);
+  FREEVEC(w.ymax);
+  FREEVEC(w.nper);
+  FREEVEC(w.owner);
+  FREEVEC(w.offset);
+  for(i=0;i<IDLUTILS_MAXTHREADS;i++) {
+    FREEVEC(w.list[i].x);
+    FREEVEC(w.list[i].y);
+  }
+
+  return(1);
+} /* end dallpeaks */
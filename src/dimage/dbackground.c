@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+#include "idlutils_threads.h"
+
+/*
+ * dbackground.c
+ *
+ * Sky background and noise maps: on the same grid of tiles as
+ * dmedsmooth, take the median of the good pixels and the dsigma-style
+ * robust sigma of pixel differences (separation sp) in each tile, from
+ * one pass over the tile, then interpolate both grids back to the full
+ * image with the dmedsmooth kernel.  Scratch memory is per-thread and
+ * scales with the tile size.
+ *
+ * dbackground_band does the same for a band of output rows, given only
+ * the input rows within DBACKGROUND_HALO(box) of the band; the result
+ * is identical to the corresponding rows of the full-image maps.
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+float dselip(unsigned long k, unsigned long n, float *arr);
+
+typedef struct {
+  float *image, *invvar;
+  int nx, ny, box, sp;
+  int nxgrid, nygrid;
+  int *xgrid, *ygrid, *xlo, *xhi, *ylo, *yhi;
+  float *skygrid, *sigmagrid;
+  float *sky, *sigma;
+  int row0;        /* image row held in image[0], invvar[0] */
+  int rlo, rhi;    /* output rows [rlo, rhi), held from sky[0], sigma[0] */
+  int jglo, jghi;  /* grid rows needed for them */
+  idlutils_queue queue;
+} dbackground_work;
+
+/* one tile: median of the good pixels and robust sigma of differences */
+static void dbackground_tile(dbackground_work *w, int i, int j,
+                             float *arr, float *diff)
+{
+  int ip, jp, nb, ndiff, nm, nx, sp, k;
+  float tot;
+
+  nx=w->nx;
+  sp=w->sp;
+  nb=0;
+  ndiff=0;
+  for(jp=w->ylo[j];jp<=w->yhi[j];jp++) {
+    for(ip=w->xlo[i];ip<=w->xhi[i];ip++) {
+      k=ip+(jp-w->row0)*nx;
+      if(w->invvar[k]>0.) {
+        arr[nb]=w->image[k];
+        nb++;
+        if(ip+sp<=w->xhi[i] && w->invvar[k+sp]>0.) {
+          diff[ndiff]=fabs(w->image[k]-w->image[k+sp]);
+          ndiff++;
+        }
+        if(jp+sp<=w->yhi[j] && w->invvar[k+sp*nx]>0.) {
+          diff[ndiff]=fabs(w->image[k]-w->image[k+sp*nx]);
+          ndiff++;
+        }
+      }
+    }
+  }
+
+  if(nb>1) {
+    nm=2*(nb/4)+1;
+    w->skygrid[i+j*w->nxgrid]=dselip(nm,nb,arr);
+  } else {
+    w->skygrid[i+j*w->nxgrid]=w->image[(long) w->xlo[i]+
+                                       ((long) w->ylo[j]-w->row0)*nx];
+  }
+
+  if(ndiff<=1) {
+    w->sigmagrid[i+j*w->nxgrid]=0.;
+  } else if(ndiff<=10) {
+    tot=0.;
+    for(k=0;k<ndiff;k++)
+      tot+=diff[k]*diff[k];
+    w->sigmagrid[i+j*w->nxgrid]=sqrt(tot/(float) ndiff);
+  } else {
+    w->sigmagrid[i+j*w->nxgrid]=
+      dselip((int) floor(ndiff*0.68),ndiff,diff)/sqrt(2.);
+  }
+}
+
+static void dbackground_tiles(void *arg, int ithread, int nthreads)
+{
+  dbackground_work *w=(dbackground_work *) arg;
+  float *arr, *diff;
+  long lo, hi, t;
+  int ntile;
+
+  ntile=(2*w->box+5)*(2*w->box+5);
+  arr=(float *) malloc(ntile*sizeof(float));
+  diff=(float *) malloc(2*ntile*sizeof(float));
+  while(idlutils_queue_next(&(w->queue), &lo, &hi))
+    for(t=lo;t<hi;t++)
+      dbackground_tile(w, (int) (t%w->nxgrid),
+                       w->jglo+(int) (t/w->nxgrid), arr, diff);
+  FREEVEC(arr);
+  FREEVEC(diff);
+}
+
+/* quadratic interpolation kernel of dmedsmooth, for offset d from a
+   grid point whose neighbours lie msize below and psize above */
+static float dbackground_kernel(float d, int msize, int psize)
+{
+  if(d>-1.5*msize && d<=-0.5*msize)
+    return(0.5*(d/msize+1.5)*(d/msize+1.5));
+  else if(d>-0.5*msize && d<0.)
+    return(-(d*d/msize/msize-0.75));
+  else if(d<0.5*psize && d>=0.)
+    return(-(d*d/psize/psize-0.75));
+  else if(d>=0.5*psize && d <1.5*psize)
+    return(0.5*(d/psize-1.5)*(d/psize-1.5));
+  return(0.);
+}
+
+static void dbackground_sizes(int *grid, int ngrid, int sp, int i,
+                              int *msize, int *psize)
+{
+  (*psize)=sp;
+  (*msize)=sp;
+  if(i==0) (*psize)=grid[1]-grid[0];
+  if(i==1) (*msize)=grid[1]-grid[0];
+  if(i==ngrid-2) (*psize)=grid[ngrid-1]-grid[ngrid-2];
+  if(i==ngrid-1) (*msize)=grid[ngrid-1]-grid[ngrid-2];
+}
+
+/* interpolate both grids onto a strip of output rows; each pixel sums
+   its grid contributions in the same order as dmedsmooth */
+static void dbackground_interp(void *arg, int ithread, int nthreads)
+{
+  dbackground_work *w=(dbackground_work *) arg;
+  long lo, hi;
+  int i, j, ip, jp, ist, ind, jst, jnd, msize, psize, nx, sp;
+  float ykernel, kernel, *sky, *sigma;
+
+  nx=w->nx;
+  sp=w->box;
+  idlutils_range(w->rhi-w->rlo, ithread, nthreads, &lo, &hi);
+  for(jp=w->rlo+lo;jp<w->rlo+hi;jp++) {
+    sky=w->sky+(long) (jp-w->rlo)*nx;
+    sigma=w->sigma+(long) (jp-w->rlo)*nx;
+    for(ip=0;ip<nx;ip++) {
+      sky[ip]=0.;
+      sigma[ip]=0.;
+    }
+    for(j=w->jglo;j<=w->jghi;j++) {
+      jst=(long) ( (float) w->ygrid[j] - sp*1.5);
+      jnd=(long) ( (float) w->ygrid[j] + sp*1.5);
+      if(jp<jst || jp>jnd) continue;
+      dbackground_sizes(w->ygrid, w->nygrid, sp, j, &msize, &psize);
+      ykernel=dbackground_kernel((float) jp-w->ygrid[j], msize, psize);
+      for(i=0;i<w->nxgrid;i++) {
+        ist=(long) ( (float) w->xgrid[i] - sp*1.5);
+        ind=(long) ( (float) w->xgrid[i] + sp*1.5);
+        if(ist<0) ist=0;
+        if(ind>nx-1) ind=nx-1;
+        dbackground_sizes(w->xgrid, w->nxgrid, sp, i, &msize, &psize);
+        for(ip=ist;ip<=ind;ip++) {
+          kernel=dbackground_kernel((float) ip-w->xgrid[i], msize, psize)*
+            ykernel;
+          sky[ip]+=kernel*w->skygrid[i+j*w->nxgrid];
+          sigma[ip]+=kernel*w->sigmagrid[i+j*w->nxgrid];
+        }
+      }
+    }
+  }
+}
+
+static int *dbackground_grid(int n, int sp, int *ngrid, int **lo, int **hi)
+{
+  int i, off, *grid;
+
+  (*ngrid)=n/sp+2;
+  if((*ngrid)<3) (*ngrid)=3;
+  (*lo)=(int *) malloc((*ngrid)*sizeof(int));
+  (*hi)=(int *) malloc((*ngrid)*sizeof(int));
+  grid=(int *) malloc((*ngrid)*sizeof(int));
+  off=(n-1-((*ngrid)-3)*sp)/2;
+  for(i=0;i<(*ngrid);i++)
+    grid[i]=(i-1)*sp+off;
+  for(i=0;i<(*ngrid);i++) {
+    (*lo)[i]=grid[i]-sp;
+    if((*lo)[i]<0) (*lo)[i]=0;
+    (*hi)[i]=grid[i]+sp;
+    if((*hi)[i]>n-1) (*hi)[i]=n-1;
+  }
+  return(grid);
+}
+
+/*
+ * image, invvar - rows [row0, ...) of the [nx, ny] input, covering
+ *                 [rlo-DBACKGROUND_HALO(box), rhi+DBACKGROUND_HALO(box))
+ *                 within the image; pixels with invvar<=0 are ignored
+ * box - tile spacing (tiles are 2*box+1 on a side, as in dmedsmooth)
+ * sp - pixel separation for the noise differences (as in dsigma)
+ * sky, sigma - rows [rlo, rhi) of the output background and noise maps
+ */
+int dbackground_band(float *image,
+                     float *invvar,
+                     int nx,
+                     int ny,
+                     int box,
+                     int sp,
+                     int row0,
+                     int rlo,
+                     int rhi,
+                     float *sky,
+                     float *sigma)
+{
+  dbackground_work w;
+  int nthreads, j;
+
+  if(box<1) box=1;
+  if(sp<1) sp=1;
+
+  w.image=image;
+  w.invvar=invvar;
+  w.nx=nx;
+  w.ny=ny;
+  w.box=box;
+  w.sp=sp;
+  w.sky=sky;
+  w.sigma=sigma;
+  w.row0=row0;
+  w.rlo=rlo;
+  w.rhi=rhi;
+  w.xgrid=dbackground_grid(nx, box, &(w.nxgrid), &(w.xlo), &(w.xhi));
+  w.ygrid=dbackground_grid(ny, box, &(w.nygrid), &(w.ylo), &(w.yhi));
+  w.skygrid=(float *) malloc(w.nxgrid*w.nygrid*sizeof(float));
+  w.sigmagrid=(float *) malloc(w.nxgrid*w.nygrid*sizeof(float));
+
+  /* only the grid rows whose kernels reach the output rows */
+  w.jglo=w.nygrid;
+  w.jghi=-1;
+  for(j=0;j<w.nygrid;j++) {
+    if((long) ( (float) w.ygrid[j] + box*1.5) < rlo ||
+       (long) ( (float) w.ygrid[j] - box*1.5) > rhi-1) continue;
+    if(j<w.jglo) w.jglo=j;
+    if(j>w.jghi) w.jghi=j;
+  }
+
+  if(w.jghi>=w.jglo) {
+    nthreads=idlutils_nthreads((long) w.nxgrid*(w.jghi-w.jglo+1));
+    idlutils_queue_init(&(w.queue), (long) w.nxgrid*(w.jghi-w.jglo+1), 1);
+    idlutils_run(nthreads, dbackground_tiles, &w);
+    idlutils_queue_free(&(w.queue));
+  }
+
+  nthreads=idlutils_nthreads(rhi-rlo);
+  idlutils_run(nthreads, dbackground_interp, &w);
+
+  FREEVEC(w.skygrid);
+  FREEVEC(w.sigmagrid);
+  FREEVEC(w.xgrid);
+  FREEVEC(w.ygrid);
+  FREEVEC(w.xlo);
+  FREEVEC(w.xhi);
+  FREEVEC(w.ylo);
+  FREEVEC(w.yhi);
+
+	return(1);
+} /* end dbackground_band */
+
+/*
+ * image, invvar - [nx, ny] input; pixels with invvar<=0 are ignored
+ * sky, sigma - [nx, ny] output background and noise maps
+ */
+int dbackground(float *image,
+                float *invvar,
+                int nx,
+                int ny,
+                int box,
+                int sp,
+                float *sky,
+                float *sigma)
+{
+  return(dbackground_band(image, invvar, nx, ny, box, sp, 0, 0, ny, sky,
+                          sigma));
+} /* end dbackground */
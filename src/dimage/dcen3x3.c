@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * dcen3x3.c
+ *
+ * Find center of a star inside a 3x3 image by fitting a parabola to each
+ * row and column, then intersecting the two lines through the row and
+ * column centers.
+ *
+ * 10/2026 */
+
+/* center of a parabola through (0,f0), (1,f1), (2,f2), with the
+   correction for a gaussian profile; returns 0 if there is no maximum */
+static int dcen3(float f0, float f1, float f2, float *xcen)
+{
+  float s, d, aa, sod, kk;
+
+  kk=(4./3.);
+  s=0.5*(f2-f0);
+  d=2.*f1-(f0+f2);
+
+  if(d<=1.e-10*fabs(f1)) return(0);
+  aa=f1+0.5*s*s/d;
+  if(aa<=0.) return(0);
+  sod=s/d;
+  (*xcen)=sod*(1.+kk*(0.25*d/aa)*(1.-4.*sod*sod))+1.;
+
+  return(1);
+} /* end dcen3 */
+
+int dcen3x3(float *image, float *xcen, float *ycen)
+{
+  float mx0=0., mx1=0., mx2=0.;
+  float my0=0., my1=0., my2=0.;
+  float bx, by, mx, my;
+  int goodcen=0;
+
+  /* center of each row */
+  goodcen+=dcen3(image[0+3*0], image[1+3*0], image[2+3*0], &mx0);
+  goodcen+=dcen3(image[0+3*1], image[1+3*1], image[2+3*1], &mx1);
+  goodcen+=dcen3(image[0+3*2], image[1+3*2], image[2+3*2], &mx2);
+
+  /* center of each column */
+  goodcen+=dcen3(image[0+3*0], image[0+3*1], image[0+3*2], &my0);
+  goodcen+=dcen3(image[1+3*0], image[1+3*1], image[1+3*2], &my1);
+  goodcen+=dcen3(image[2+3*0], image[2+3*1], image[2+3*2], &my2);
+
+  if(goodcen!=6) return(0);
+
+  /* x = mx + bx * (y-1) through the row centers, and
+     y = my + by * (x-1) through the column centers */
+  bx=0.5*(mx2-mx0);
+  mx=mx1;
+  by=0.5*(my2-my0);
+  my=my1;
+  if(fabs(1.-bx*by)<1.e-6) return(0);
+
+  (*xcen)=(mx+bx*(my-1.)-bx*by)/(1.-bx*by);
+  (*ycen)=(my+by*((*xcen)-1.));
+
+  /* the center must lie inside the middle pixel's neighbourhood */
+  if((*xcen)<0. || (*xcen)>2. || (*ycen)<0. || (*ycen)>2.) return(0);
+
+  return(1);
+} /* end dcen3x3 */
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * dcentral.c
+ *
+ * Given the peaks of an object (e.g. from dpeaks), flag those belonging
+ * to the central object: the peak nearest the image center, plus any
+ * peak within dlim of it or not separated from it by a saddle deeper
+ * than saddle*sigma in the smoothed image.
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+int dcentral(float *image,
+             int nx,
+             int ny,
+             int npeaks,
+             float *xcen,
+             float *ycen,
+             int *central,
+             float sigma,
+             float dlim,
+             float saddle,
+             int maxnpeaks)
+{
+  int i, k, ic, kc, kp, *mask=NULL, *object=NULL;
+  float *simage=NULL, dx, dy, dist2, mindist2, level;
+
+  if(npeaks>maxnpeaks) npeaks=maxnpeaks;
+  if(npeaks<=0) return(0);
+  for(i=0;i<npeaks;i++)
+    central[i]=0;
+
+  /* 1. peak nearest the center */
+  ic=0;
+  mindist2=-1.;
+  for(i=0;i<npeaks;i++) {
+    dx=xcen[i]-0.5*(float) (nx-1);
+    dy=ycen[i]-0.5*(float) (ny-1);
+    dist2=dx*dx+dy*dy;
+    if(mindist2<0. || dist2<mindist2) {
+      mindist2=dist2;
+      ic=i;
+    }
+  }
+  central[ic]=1;
+
+  /* 2. other peaks connected to it */
+  simage=(float *) malloc((size_t) nx*ny*sizeof(float));
+  mask=(int *) malloc((size_t) nx*ny*sizeof(int));
+  object=(int *) malloc((size_t) nx*ny*sizeof(int));
+  dsmooth(image, nx, ny, 2, simage);
+  kc=((int) floor(xcen[ic]+0.5))+((int) floor(ycen[ic]+0.5))*nx;
+  for(i=0;i<npeaks;i++) {
+    if(i==ic) continue;
+    dx=xcen[i]-xcen[ic];
+    dy=ycen[i]-ycen[ic];
+    if(dx*dx+dy*dy<dlim*dlim) {
+      central[i]=1;
+      continue;
+    }
+    kp=((int) floor(xcen[i]+0.5))+((int) floor(ycen[i]+0.5))*nx;
+    level=(simage[kp]<simage[kc] ? simage[kp] : simage[kc])-saddle*sigma;
+    for(k=0;k<nx*ny;k++)
+      mask[k]=(simage[k]>level);
+    dfind(mask, nx, ny, object);
+    if(object[kp]>=0 && object[kp]==object[kc]) central[i]=1;
+  }
+
+  FREEVEC(simage);
+  FREEVEC(mask);
+  FREEVEC(object);
+
+  return(1);
+} /* end dcentral */
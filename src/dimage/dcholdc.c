@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * dcholdc.c
+ *
+ * Cholesky decomposition and back-substitution (after Numerical Recipes
+ * choldc/cholsl, zero-indexed).  a is [n, n] and symmetric; on output
+ * its lower triangle holds the factor, with the diagonal in p.  Rather
+ * than exiting on a non-positive pivot, that row is zeroed (p[i]=0) and
+ * dcholsl returns x[i]=0 for it, so degenerate directions drop out of
+ * the solution.
+ *
+ * 10/2026 */
+
+void dcholdc(float *a,
+             int n,
+             float p[])
+{
+  int i, j, k;
+  double sum;
+
+  for(i=0;i<n;i++) {
+    for(j=i;j<n;j++) {
+      sum=a[i*n+j];
+      for(k=i-1;k>=0;k--)
+        sum-=(double) a[i*n+k]*a[j*n+k];
+      if(i==j) {
+        if(sum<=1.e-7*fabs(a[i*n+i]))
+          p[i]=0.;
+        else
+          p[i]=sqrt(sum);
+      } else {
+        a[j*n+i]=(p[i]>0.) ? sum/p[i] : 0.;
+      }
+    }
+  }
+} /* end dcholdc */
+
+void dcholsl(float *a,
+             int n,
+             float p[],
+             float b[],
+             float x[])
+{
+  int i, k;
+  double sum;
+
+  for(i=0;i<n;i++) {
+    sum=b[i];
+    for(k=i-1;k>=0;k--)
+      sum-=(double) a[i*n+k]*x[k];
+    x[i]=(p[i]>0.) ? sum/p[i] : 0.;
+  }
+  for(i=n-1;i>=0;i--) {
+    sum=x[i];
+    for(k=i+1;k<n;k++)
+      sum-=(double) a[k*n+i]*x[k];
+    x[i]=(p[i]>0.) ? sum/p[i] : 0.;
+  }
+} /* end dcholsl */
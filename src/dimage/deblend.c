@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+#include "idlutils_threads.h"
+
+/*
+ * deblend.c
+ *
+ * Deblend a parent image into children: find peaks (dpeaks), build
+ * symmetric templates (dtemplates, or the PSF for children from
+ * starstart on), floor the templates, fit their weights (dweights) and
+ * apportion the flux (dfluxes).
+ *
+ * deblend_multi deblends every parent of an object image (as from
+ * dobjects_multi) with parents spread over threads.  Each thread keeps
+ * one workspace for the cutout, templates, children and weight solve,
+ * grown as needed and reused from parent to parent.
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+typedef struct {
+  int npix, nchild, ncut;  /* sizes currently allocated for */
+  float *cut, *smooth, *templates, *cimages;
+  float *weights, *xcenf, *ycenf, *work;
+  int *xcen, *ycen, *ikept;
+} deblend_workspace;
+
+static void deblend_workspace_size(deblend_workspace *ws, int npix,
+                                   int nchild)
+{
+  if(npix>ws->npix) {
+    FREEVEC(ws->smooth);
+    ws->smooth=(float *) malloc((size_t) npix*sizeof(float));
+  }
+  if(npix>ws->npix || nchild>ws->nchild) {
+    FREEVEC(ws->templates);
+    FREEVEC(ws->cimages);
+    ws->templates=(float *) malloc((size_t) npix*nchild*sizeof(float));
+    ws->cimages=(float *) malloc((size_t) npix*nchild*sizeof(float));
+  }
+  if(nchild>ws->nchild) {
+    FREEVEC(ws->weights);
+    FREEVEC(ws->xcenf);
+    FREEVEC(ws->ycenf);
+    FREEVEC(ws->work);
+    FREEVEC(ws->xcen);
+    FREEVEC(ws->ycen);
+    FREEVEC(ws->ikept);
+    ws->weights=(float *) malloc(nchild*sizeof(float));
+    ws->xcenf=(float *) malloc(nchild*sizeof(float));
+    ws->ycenf=(float *) malloc(nchild*sizeof(float));
+    ws->work=(float *) malloc(DWEIGHTS_NWORK(nchild)*sizeof(float));
+    ws->xcen=(int *) malloc(nchild*sizeof(int));
+    ws->ycen=(int *) malloc(nchild*sizeof(int));
+    ws->ikept=(int *) malloc(nchild*sizeof(int));
+  }
+  if(npix>ws->npix) ws->npix=npix;
+  if(nchild>ws->nchild) ws->nchild=nchild;
+}
+
+static void deblend_workspace_free(deblend_workspace *ws)
+{
+  FREEVEC(ws->cut);
+  FREEVEC(ws->smooth);
+  FREEVEC(ws->templates);
+  FREEVEC(ws->cimages);
+  FREEVEC(ws->weights);
+  FREEVEC(ws->xcenf);
+  FREEVEC(ws->ycenf);
+  FREEVEC(ws->work);
+  FREEVEC(ws->xcen);
+  FREEVEC(ws->ycen);
+  FREEVEC(ws->ikept);
+}
+
+/* the deblend itself; templates, cimages [nx, ny, maxnchild] and the
+   peak lists are the caller's, the rest comes from ws */
+static int deblend_ws(float *image, float *invvar, int nx, int ny,
+                      int *nchild, int *xcen, int *ycen, float *cimages,
+                      float *templates, float sigma, float dlim,
+                      float tsmooth, float tlimit, float tfloor,
+                      float saddle, float parallel, int maxnchild,
+                      float minpeak, int starstart, float *psf, int pnx,
+                      int pny, int dontsettemplates, deblend_workspace *ws)
+{
+  int i, j, ip, jp, k, npix;
+  float *tk;
+
+  npix=nx*ny;
+  deblend_workspace_size(ws, npix, maxnchild);
+
+  if(!dontsettemplates) {
+    /* 1. peaks */
+    if((*nchild)<=0)
+      dpeaks(image, nx, ny, nchild, xcen, ycen, sigma, dlim, saddle,
+             maxnchild, 1, 1, minpeak);
+    if((*nchild)>maxnchild) (*nchild)=maxnchild;
+    if((*nchild)<=0) return(0);
+
+    /* 2. symmetric templates from the smoothed image */
+    if(tsmooth>0.)
+      dsmooth(image, nx, ny, tsmooth, ws->smooth);
+    else
+      memcpy(ws->smooth, image, (size_t) npix*sizeof(float));
+    dtemplates(ws->smooth, nx, ny, nchild, xcen, ycen, templates, sigma,
+               parallel, ws->ikept);
+    if((*nchild)<=0) return(0);
+
+    /* 3. PSF templates for stars, and the template floor */
+    for(k=0;k<(*nchild);k++) {
+      xcen[k]=xcen[ws->ikept[k]];
+      ycen[k]=ycen[ws->ikept[k]];
+      tk=templates+(size_t) k*npix;
+      if(psf!=NULL && pnx>0 && pny>0 && starstart>=0 &&
+         ws->ikept[k]>=starstart) {
+        for(j=0;j<ny;j++) {
+          jp=j-ycen[k]+pny/2;
+          for(i=0;i<nx;i++) {
+            ip=i-xcen[k]+pnx/2;
+            tk[i+j*nx]=(ip>=0 && ip<pnx && jp>=0 && jp<pny) ?
+              psf[ip+jp*pnx] : 0.;
+          }
+        }
+      }
+      for(i=0;i<npix;i++)
+        if(tk[i]<tlimit*sigma) tk[i]=tfloor*sigma;
+    }
+  }
+  if((*nchild)<=0) return(0);
+
+  /* 4. weights and children */
+  dweights_work(image, invvar, nx, ny, *nchild, templates, 1, ws->weights,
+                ws->work);
+  for(k=0;k<(*nchild);k++) {
+    ws->xcenf[k]=(float) xcen[k];
+    ws->ycenf[k]=(float) ycen[k];
+  }
+  dfluxes(image, templates, ws->weights, nx, ny, ws->xcenf, ws->ycenf,
+          *nchild, cimages, sigma);
+
+  return(1);
+}
+
+int deblend(float *image,
+            float *invvar,
+            int nx,
+            int ny,
+            int *nchild,
+            int *xcen,
+            int *ycen,
+            float *cimages,
+            float *templates,
+            float sigma,
+            float dlim,
+            float tsmooth,  /* smoothing of template */
+            float tlimit,   /* lowest template value in units of sigma */
+            float tfloor,   /* vals < tlimit*sigma are set to tfloor*sigma */
+            float saddle,   /* number of sigma for allowed saddle */
+            float parallel, /* how parallel you allow templates to be */
+            int maxnchild,
+            float minpeak,
+            int starstart,
+            float *psf,
+            int pnx,
+            int pny,
+            int dontsettemplates)
+{
+  deblend_workspace ws;
+  int retval;
+
+  memset(&ws, 0, sizeof(deblend_workspace));
+  retval=deblend_ws(image, invvar, nx, ny, nchild, xcen, ycen, cimages,
+                    templates, sigma, dlim, tsmooth, tlimit, tfloor, saddle,
+                    parallel, maxnchild, minpeak, starstart, psf, pnx, pny,
+                    dontsettemplates, &ws);
+  deblend_workspace_free(&ws);
+
+  return(retval);
+} /* end deblend */
+
+typedef struct {
+  float *x, *y;       /* child peaks */
+  float *f;           /* child fluxes */
+  long n, nalloc;
+} deblend_multi_list;
+
+typedef struct {
+  float *image, *invvar;
+  int *objects;
+  int nx, ny, nobj, maxnchild;
+  float sigma, dlim, tsmooth, tlimit, tfloor, saddle, parallel, minpeak;
+  int *xmin, *xmax, *ymin, *ymax;
+  int *nper;          /* [nobj] children of each parent */
+  int *owner;         /* [nobj] thread whose list holds its children */
+  long *offset;       /* [nobj] first of its children in that list */
+  int *childmap;      /* child within its parent, for now */
+  idlutils_queue queue;
+  deblend_multi_list list[IDLUTILS_MAXTHREADS];
+} deblend_multi_work;
+
+static void deblend_multi_parent(deblend_multi_work *w, int iobj,
+                                 deblend_multi_list *list, int ithread,
+                                 deblend_workspace *ws)
+{
+  int i, j, k, l, kbest, onx, ony, npix, nchild;
+  float *image, *invvar, *x, *y, *f, best;
+
+  onx=w->xmax[iobj]-w->xmin[iobj]+1;
+  ony=w->ymax[iobj]-w->ymin[iobj]+1;
+  npix=onx*ony;
+
+  if(2*npix>ws->ncut) {
+    FREEVEC(ws->cut);
+    ws->ncut=2*npix;
+    ws->cut=(float *) malloc((size_t) ws->ncut*sizeof(float));
+  }
+  image=ws->cut;
+  invvar=ws->cut+npix;
+  deblend_workspace_size(ws, npix, w->maxnchild);
+  for(j=0;j<ony;j++)
+    for(i=0;i<onx;i++) {
+      k=(i+w->xmin[iobj])+(j+w->ymin[iobj])*w->nx;
+      if(w->objects[k]==iobj) {
+        image[i+j*onx]=w->image[k];
+        invvar[i+j*onx]=w->invvar[k];
+      } else {
+        image[i+j*onx]=0.;
+        invvar[i+j*onx]=0.;
+      }
+    }
+
+  nchild=0;
+  deblend_ws(image, invvar, onx, ony, &nchild, ws->xcen, ws->ycen,
+             ws->cimages, ws->templates, w->sigma, w->dlim, w->tsmooth,
+             w->tlimit, w->tfloor, w->saddle, w->parallel, w->maxnchild,
+             w->minpeak, -1, NULL, 0, 0, 0, ws);
+
+  /* a parent with no usable peak is its own single child */
+  if(nchild<=0) {
+    nchild=1;
+    ws->xcen[0]=onx/2;
+    ws->ycen[0]=ony/2;
+    memcpy(ws->cimages, image, (size_t) npix*sizeof(float));
+  }
+
+  if(list->n+nchild>list->nalloc) {
+    list->nalloc=2*(list->n+nchild);
+    list->x=(float *) realloc(list->x, list->nalloc*sizeof(float));
+    list->y=(float *) realloc(list->y, list->nalloc*sizeof(float));
+    list->f=(float *) realloc(list->f, list->nalloc*sizeof(float));
+  }
+  w->nper[iobj]=nchild;
+  w->owner[iobj]=ithread;
+  w->offset[iobj]=list->n;
+  x=list->x+list->n;
+  y=list->y+list->n;
+  f=list->f+list->n;
+  list->n+=nchild;
+  for(l=0;l<nchild;l++) {
+    x[l]=(float) (ws->xcen[l]+w->xmin[iobj]);
+    y[l]=(float) (ws->ycen[l]+w->ymin[iobj]);
+    f[l]=0.;
+  }
+  for(j=0;j<ony;j++)
+    for(i=0;i<onx;i++) {
+      k=(i+w->xmin[iobj])+(j+w->ymin[iobj])*w->nx;
+      if(w->objects[k]!=iobj) continue;
+      kbest=0;
+      best=ws->cimages[i+j*onx];
+      for(l=0;l<nchild;l++) {
+        f[l]+=ws->cimages[(size_t) l*npix+i+j*onx];
+        if(ws->cimages[(size_t) l*npix+i+j*onx]>best) {
+          best=ws->cimages[(size_t) l*npix+i+j*onx];
+          kbest=l;
+        }
+      }
+      w->childmap[k]=kbest;
+    }
+}
+
+static void deblend_multi_thread(void *arg, int ithread, int nthreads)
+{
+  deblend_multi_work *w=(deblend_multi_work *) arg;
+  deblend_workspace ws;
+  long lo, hi, iobj;
+
+  memset(&ws, 0, sizeof(deblend_workspace));
+  while(idlutils_queue_next(&(w->queue), &lo, &hi))
+    for(iobj=lo;iobj<hi;iobj++)
+      if(w->xmax[iobj]>=w->xmin[iobj])
+        deblend_multi_parent(w, (int) iobj, &(w->list[ithread]), ithread,
+                             &ws);
+  deblend_workspace_free(&ws);
+}
+
+/*
+ * Deblend all parents in objects [nx, ny] (-1 for no parent).  Outputs,
+ * for up to maxntotal children in parent order: the parent of each child,
+ * its peak position and flux; childmap [nx, ny] gives the child that
+ * receives the most flux in each pixel (-1 outside parents or beyond
+ * maxntotal).
+ */
+int deblend_multi(float *image,
+                  float *invvar,
+                  int nx,
+                  int ny,
+                  int *objects,
+                  float sigma,
+                  float dlim,
+                  float tsmooth,
+                  float tlimit,
+                  float tfloor,
+                  float saddle,
+                  float parallel,
+                  int maxnchild,
+                  float minpeak,
+                  int maxntotal,
+                  int *ntotal,
+                  int *parent,
+                  float *xchild,
+                  float *ychild,
+                  float *flux,
+                  int *childmap)
+{
+  deblend_multi_work w;
+  deblend_multi_list *list;
+  int i, j, k, l, iobj, *first=NULL;
+
+  (*ntotal)=0;
+  for(k=0;k<nx*ny;k++)
+    childmap[k]=-1;
+  if(maxnchild<=0) return(0);
+
+  w.nobj=0;
+  for(k=0;k<nx*ny;k++)
+    if(objects[k]>=w.nobj) w.nobj=objects[k]+1;
+  if(w.nobj==0) return(1);
+
+  w.xmin=(int *) malloc(w.nobj*sizeof(int));
+  w.xmax=(int *) malloc(w.nobj*sizeof(int));
+  w.ymin=(int *) malloc(w.nobj*sizeof(int));
+  w.ymax=(int *) malloc(w.nobj*sizeof(int));
+  for(iobj=0;iobj<w.nobj;iobj++) {
+    w.xmin[iobj]=nx;
+    w.xmax[iobj]=-1;
+    w.ymin[iobj]=ny;
+    w.ymax[iobj]=-1;
+  }
+  for(j=0;j<ny;j++)
+    for(i=0;i<nx;i++) {
+      iobj=objects[i+j*nx];
+      if(iobj<0) continue;
+      if(i<w.xmin[iobj]) w.xmin[iobj]=i;
+      if(i>w.xmax[iobj]) w.xmax[iobj]=i;
+      if(j<w.ymin[iobj]) w.ymin[iobj]=j;
+      if(j>w.ymax[iobj]) w.ymax[iobj]=j;
+    }
+
+  w.image=image;
+  w.invvar=invvar;
+  w.objects=objects;
+  w.nx=nx;
+  w.ny=ny;
+  w.maxnchild=maxnchild;
+  w.sigma=sigma;
+  w.dlim=dlim;
+  w.tsmooth=tsmooth;
+  w.tlimit=tlimit;
+  w.tfloor=tfloor;
+  w.saddle=saddle;
+  w.parallel=parallel;
+  w.minpeak=minpeak;
+  w.childmap=childmap;
+  /* IDs with no pixels are skipped, and keep no children */
+  w.nper=(int *) calloc(w.nobj, sizeof(int));
+  w.owner=(int *) calloc(w.nobj, sizeof(int));
+  w.offset=(long *) calloc(w.nobj, sizeof(long));
+  memset(w.list, 0, sizeof(w.list));
+
+  idlutils_queue_init(&(w.queue), w.nobj, 1);
+  idlutils_run(idlutils_nthreads(w.nobj), deblend_multi_thread, &w);
+  idlutils_queue_free(&(w.queue));
+
+  /* number the children in parent order */
+  first=(int *) malloc(w.nobj*sizeof(int));
+  for(iobj=0;iobj<w.nobj;iobj++) {
+    first[iobj]=(*ntotal);
+    list=&(w.list[w.owner[iobj]]);
+    for(l=0;l<w.nper[iobj] && (*ntotal)<maxntotal;l++) {
+      parent[*ntotal]=iobj;
+      xchild[*ntotal]=list->x[w.offset[iobj]+l];
+      ychild[*ntotal]=list->y[w.offset[iobj]+l];
+      flux[*ntotal]=list->f[w.offset[iobj]+l];
+      (*ntotal)++;
+    }
+  }
+  for(k=0;k<nx*ny;k++) {
+    if(objects[k]<0) continue;
+    childmap[k]+=first[objects[k]];
+    if(childmap[k]>=maxntotal) childmap[k]=-1;
+  }
+
+  FREEVEC(first);
+  FREEVEC(w.xmin);
+  FREEVEC(w.xmax);
+  FREEVEC(w.ymin);
+  FREEVEC(w.ymax);
+  FREEVEC(w.nper);
+  FREEVEC(w.owner);
+  FREEVEC(w.offset);
+  for(i=0;i<IDLUTILS_MAXTHREADS;i++) {
+    FREEVEC(w.list[i].x);
+    FREEVEC(w.list[i].y);
+    FREEVEC(w.list[i].f);
+  }
+
+  return(1);
+} /* end deblend_multi */
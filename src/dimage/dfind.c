@@ -15,10 +15,6 @@
 
 #define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
 
-static int *matches=NULL;
-static int *nmatches=NULL;
-static int *mapgroup=NULL;
-
 int dfind(int *image, 
           int nx, 
           int ny,
@@ -26,6 +22,7 @@ int dfind(int *image,
 {
   int i,ip,j,jp,k,kp,l,ist,ind,jst,jnd,igroup,minearly,checkearly,tmpearly;
   int ngroups;
+  int *matches=NULL, *nmatches=NULL, *mapgroup=NULL;
 
   mapgroup=(int *) malloc((size_t) nx*ny*sizeof(int));
   matches=(int *) malloc((size_t) nx*ny*9*sizeof(int));
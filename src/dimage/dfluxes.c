@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * dfluxes.c
+ *
+ * Apportion the image among children in proportion to their weighted
+ * templates.  Where the weighted templates sum to less than 1.e-3 sigma
+ * the pixel goes to the nearest child instead.  children is
+ * [nx, ny, nchild].
+ *
+ * 10/2026 */
+
+int dfluxes(float *image,
+            float *templates,
+            float *weights,
+            int nx,
+            int ny,
+            float *xcen,
+            float *ycen,
+            int nchild,
+            float *children,
+            float sigma)
+{
+  int i, j, k, kmin, npix;
+  float tot, dx, dy, dist2, mindist2;
+
+  npix=nx*ny;
+  for(j=0;j<ny;j++) {
+    for(i=0;i<nx;i++) {
+      tot=0.;
+      for(k=0;k<nchild;k++)
+        tot+=weights[k]*templates[(size_t) k*npix+i+j*nx];
+      if(tot>1.e-3*sigma && tot>0.) {
+        for(k=0;k<nchild;k++)
+          children[(size_t) k*npix+i+j*nx]=image[i+j*nx]*weights[k]*
+            templates[(size_t) k*npix+i+j*nx]/tot;
+      } else {
+        kmin=0;
+        mindist2=-1.;
+        for(k=0;k<nchild;k++) {
+          children[(size_t) k*npix+i+j*nx]=0.;
+          dx=(float) i-xcen[k];
+          dy=(float) j-ycen[k];
+          dist2=dx*dx+dy*dy;
+          if(mindist2<0. || dist2<mindist2) {
+            mindist2=dist2;
+            kmin=k;
+          }
+        }
+        if(nchild>0)
+          children[(size_t) kmin*npix+i+j*nx]=image[i+j*nx];
+      }
+    }
+  }
+
+  return(1);
+} /* end dfluxes */
@@ -17,6 +17,9 @@ int dfluxes(float *image, float *templates, float *weights, int nx, int ny,
             float sigma);
 int dweights(float *image, float *invvar, int nx, int ny, int ntemplates, 
              float *templates, int nonneg, float *weights);
+#define DWEIGHTS_NWORK(n) (2*(n)*(n)+5*(n))
+int dweights_work(float *image, float *invvar, int nx, int ny, int ntemplates,
+                  float *templates, int nonneg, float *weights, float *work);
 void dcholsl(float *a, int n, float p[], float b[], float x[]);
 void dcholdc(float *a, int n, float p[]);
 int dfind(int *image, int nx, int ny, int *object);
@@ -58,10 +61,21 @@ int deblend(float *image,
 						int pnx,
 						int pny,
 						int dontsettemplates);
+int deblend_multi(float *image, float *invvar, int nx, int ny, int *objects,
+                  float sigma, float dlim, float tsmooth, float tlimit,
+                  float tfloor, float saddle, float parallel, int maxnchild,
+                  float minpeak, int maxntotal, int *ntotal, int *parent,
+                  float *xchild, float *ychild, float *flux, int *childmap);
 int dcen3x3(float *image, float *xcen, float *ycen);
 int dsigma(float *image, int nx, int ny, int sp,float *sigma);
 int dmedsmooth(float *image, float *invvar, int nx, int ny, int box,
 							 float *smooth);
+int dbackground(float *image, float *invvar, int nx, int ny, int box, int sp,
+                float *sky, float *sigma);
+#define DBACKGROUND_HALO(box) ((5*(box))/2+2)
+int dbackground_band(float *image, float *invvar, int nx, int ny, int box,
+                     int sp, int row0, int rlo, int rhi, float *sky,
+                     float *sigma);
 int dallpeaks(float *image, int nx, int ny, int *objects, float *xcen, 
 							float *ycen, int *npeaks, float sigma, float dlim, float saddle, 
 							int maxper, int maxnpeaks, float minpeak);
@@ -72,3 +86,14 @@ int dtemplates(float *image, int nx, int ny, int *ntemplates, int *xcen,
 							 int *ycen, float *templates, float sigma, float parallel, 
 							 int *ikept);
 int dsersic_params(float flux, float n, float r50, float *amp, float *r0);
+int dsmooth_tiled(char *infile, long inoffset, int inbig, char *outfile,
+                  long outoffset, int outbig, int nx, int ny, float sigma,
+                  int nband);
+int dmedsmooth_tiled(char *infile, long inoffset, int inbig, char *outfile,
+                     long outoffset, int outbig, int nx, int ny, int box,
+                     int nband);
+int dfind_tiled(char *infile, long inoffset, int inbig, char *outfile,
+                long outoffset, int outbig, int nx, int ny, int nband);
+int dobjects_multi_tiled(char *infile, long inoffset, int inbig,
+                         char *outfile, long outoffset, int outbig, int nx,
+                         int ny, int nim, float dpsf, float plim, int nband);
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * dpeaks.c
+ *
+ * Find peaks in an image (usually the cutout of one detected object).
+ * Peaks are local maxima of the (optionally smoothed) image above
+ * minpeak, taken in order of decreasing height.  A peak is dropped if it
+ * lies within dlim of a brighter peak, or (if checkpeaks is set) if the
+ * region above its own height minus saddle*sigma connects it to a
+ * brighter peak.
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+typedef struct {
+  float value;
+  int indx;
+} dpeaks_peak;
+
+static int dpeaks_compare(const void *first, const void *second)
+{
+  const dpeaks_peak *p1=(const dpeaks_peak *) first;
+  const dpeaks_peak *p2=(const dpeaks_peak *) second;
+  if(p1->value>p2->value) return(-1);
+  if(p1->value<p2->value) return(1);
+  return(p1->indx-p2->indx);
+}
+
+int dpeaks(float *image,
+           int nx,
+           int ny,
+           int *npeaks,
+           int *xcen,
+           int *ycen,
+           float sigma,    /* sky sigma */
+           float dlim,     /* limiting distance between peaks */
+           float saddle,   /* number of sigma for allowed saddle */
+           int maxnpeaks,
+           int smooth,     /* smooth image before finding peaks? */
+           int checkpeaks, /* check saddle points between peaks? */
+           float minpeak)
+{
+  int i, j, ip, jp, ist, jst, ind, jnd, k, kp, l, ncand, good, isbig;
+  int *mask=NULL, *object=NULL;
+  float *simage=NULL, level, dx, dy;
+  dpeaks_peak *cand=NULL;
+
+  (*npeaks)=0;
+  if(nx<=0 || ny<=0 || maxnpeaks<=0) return(0);
+
+  /* 1. smooth image */
+  simage=(float *) malloc((size_t) nx*ny*sizeof(float));
+  if(smooth)
+    dsmooth(image, nx, ny, 2, simage);
+  else
+    memcpy(simage, image, (size_t) nx*ny*sizeof(float));
+
+  /* 2. find local maxima; ties go to the first pixel in raster order */
+  cand=(dpeaks_peak *) malloc((size_t) nx*ny*sizeof(dpeaks_peak));
+  ncand=0;
+  for(j=0;j<ny;j++) {
+    jst=j-1;
+    jnd=j+1;
+    if(jst<0) jst=0;
+    if(jnd>ny-1) jnd=ny-1;
+    for(i=0;i<nx;i++) {
+      ist=i-1;
+      ind=i+1;
+      if(ist<0) ist=0;
+      if(ind>nx-1) ind=nx-1;
+      k=i+j*nx;
+      if(simage[k]<=minpeak) continue;
+      isbig=1;
+      for(jp=jst;jp<=jnd && isbig;jp++)
+        for(ip=ist;ip<=ind && isbig;ip++) {
+          kp=ip+jp*nx;
+          if(kp<k && simage[kp]>=simage[k]) isbig=0;
+          if(kp>k && simage[kp]>simage[k]) isbig=0;
+        }
+      if(isbig) {
+        cand[ncand].value=simage[k];
+        cand[ncand].indx=k;
+        ncand++;
+      }
+    }
+  }
+
+  /* 3. sort by height */
+  qsort(cand, ncand, sizeof(dpeaks_peak), dpeaks_compare);
+
+  /* 4. keep the peaks separated from all brighter kept ones */
+  if(checkpeaks && ncand>1) {
+    mask=(int *) malloc((size_t) nx*ny*sizeof(int));
+    object=(int *) malloc((size_t) nx*ny*sizeof(int));
+  }
+  for(l=0;l<ncand && (*npeaks)<maxnpeaks;l++) {
+    i=cand[l].indx%nx;
+    j=cand[l].indx/nx;
+    good=1;
+    for(kp=0;kp<(*npeaks) && good;kp++) {
+      dx=(float) (xcen[kp]-i);
+      dy=(float) (ycen[kp]-j);
+      if(dx*dx+dy*dy<dlim*dlim) good=0;
+    }
+    if(good && checkpeaks && (*npeaks)>0) {
+      level=cand[l].value-saddle*sigma;
+      for(k=0;k<nx*ny;k++)
+        mask[k]=(simage[k]>level);
+      dfind(mask, nx, ny, object);
+      for(kp=0;kp<(*npeaks) && good;kp++)
+        if(object[xcen[kp]+ycen[kp]*nx]==object[cand[l].indx]) good=0;
+    }
+    if(good) {
+      xcen[*npeaks]=i;
+      ycen[*npeaks]=j;
+      (*npeaks)++;
+    }
+  }
+
+  FREEVEC(simage);
+  FREEVEC(cand);
+  FREEVEC(mask);
+  FREEVEC(object);
+
+  return(1);
+} /* end dpeaks */
@@ -17,8 +17,6 @@
 
 #define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
 
-static float *diff=NULL;
-
 float dselip(unsigned long k, unsigned long n, float *arr);
 
 int dsigma(float *image, 
@@ -27,7 +25,7 @@ int dsigma(float *image,
 					 int sp,
 					 float *sigma)
 {
-	float tot;
+	float tot, *diff=NULL;
   int i,j,dx,dy, ndiff;
 
 	if(nx==1 && ny==1) {
@@ -43,7 +41,8 @@ int dsigma(float *image,
 	if(dy>ny/4) dy=ny/4;
 	if(dy<=0) dy=1;
 	
-	diff=(float *) malloc(2*nx*ny*sizeof(float));
+	/* only every dx-th, dy-th pixel is sampled */
+	diff=(float *) malloc(2*(nx/dx+1)*(ny/dy+1)*sizeof(float));
 	ndiff=0;
 	for(j=0;j<ny;j+=dy) {
 		for(i=0;i<nx;i+=dx) {
@@ -60,6 +59,7 @@ int dsigma(float *image,
 
 	if(ndiff<=1) {
 		(*sigma)=0.;
+		FREEVEC(diff);
 		return(0);
 	}
 
@@ -68,6 +68,7 @@ int dsigma(float *image,
 		for(i=0;i<ndiff;i++)
 			tot+=diff[i]*diff[i];
 		(*sigma)=sqrt(tot/(float) ndiff);
+		FREEVEC(diff);
 		return(0);
 	}
 
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * dtemplates.c
+ *
+ * Symmetric templates for deblending: for each peak, the template at
+ * each pixel is the minimum of the image there and at the pixel
+ * reflected through the peak (zero if the reflection falls outside the
+ * image, or the minimum is negative).  Templates are then taken in peak
+ * order, and one is dropped if its normalized dot product with any
+ * earlier kept template exceeds "parallel".  On output ntemplates is the
+ * number kept, templates [nx, ny, ntemplates] holds them in order, and
+ * ikept[k] is the index of the peak that template k came from.
+ *
+ * 10/2026 */
+
+int dtemplates(float *image,
+               int nx,
+               int ny,
+               int *ntemplates,
+               int *xcen,
+               int *ycen,
+               float *templates,
+               float sigma,
+               float parallel,
+               int *ikept)
+{
+  int i, j, ip, jp, k, l, nkept, npix, good;
+  float *tk, *tl, val;
+  double dot, normk, *norm=NULL;
+
+  npix=nx*ny;
+  norm=(double *) malloc((*ntemplates+1)*sizeof(double));
+
+  nkept=0;
+  for(k=0;k<(*ntemplates);k++) {
+    tk=templates+(size_t) nkept*npix;
+    normk=0.;
+    for(j=0;j<ny;j++) {
+      jp=2*ycen[k]-j;
+      for(i=0;i<nx;i++) {
+        ip=2*xcen[k]-i;
+        val=0.;
+        if(ip>=0 && ip<nx && jp>=0 && jp<ny) {
+          val=image[i+j*nx];
+          if(image[ip+jp*nx]<val) val=image[ip+jp*nx];
+          if(val<0.) val=0.;
+        }
+        tk[i+j*nx]=val;
+        normk+=(double) val*val;
+      }
+    }
+    if(normk<=0.) continue;
+    normk=sqrt(normk);
+
+    good=1;
+    for(l=0;l<nkept && good;l++) {
+      tl=templates+(size_t) l*npix;
+      dot=0.;
+      for(i=0;i<npix;i++)
+        dot+=(double) tk[i]*tl[i];
+      if(dot/(normk*norm[l])>parallel) good=0;
+    }
+    if(good) {
+      norm[nkept]=normk;
+      ikept[nkept]=k;
+      nkept++;
+    }
+  }
+  (*ntemplates)=nkept;
+
+  free(norm);
+  return(1);
+} /* end dtemplates */
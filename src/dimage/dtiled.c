@@ -0,0 +1,574 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "dimage.h"
+
+/*
+ * dtiled.c
+ *
+ * Out-of-core versions of dsmooth, dmedsmooth, dfind and dobjects_multi
+ * for images too large to hold in memory.  The input is a 4-byte
+ * pixel array (float, or int for dfind) at a byte offset in a file, such
+ * as a raw dump or the data segment of a FITS file (big-endian); it is
+ * memory mapped and processed in bands of nband full-width rows plus a
+ * halo as wide as the kernel, and each band of output is written back to
+ * the mapped output file before moving on.  Memory in use is a few
+ * bands, not the image.
+ *
+ * Results are identical to the in-memory routines.  dfind_tiled labels
+ * each band with dfind, joins labels that touch across band seams and
+ * renumbers in a second pass so objects are numbered in raster order,
+ * as dfind numbers them.
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+#define DTILED_NBAND 64
+
+typedef struct {
+  int fd;
+  char *map;       /* whole file mapped from byte 0 */
+  size_t size;
+  long offset;     /* byte offset of the first pixel */
+  int swap;        /* pixels stored in the other byte order */
+  int nx;
+  long released;   /* rows before this have been released */
+} dtiled_file;
+
+float dselip(unsigned long k, unsigned long n, float *arr);
+
+static int dtiled_littleendian()
+{
+  int one=1;
+  return((int) *((char *) &one));
+}
+
+static void dtiled_swap(void *buf, long n)
+{
+  long i;
+  char *c, tmp;
+
+  c=(char *) buf;
+  for(i=0;i<n;i++,c+=4) {
+    tmp=c[0]; c[0]=c[3]; c[3]=tmp;
+    tmp=c[1]; c[1]=c[2]; c[2]=tmp;
+  }
+}
+
+/* map npix 4-byte pixels at offset; output files are created or
+   extended as needed */
+static int dtiled_open(dtiled_file *f, char *filename, long offset,
+                       int bigendian, int nx, long npix, int output)
+{
+  struct stat st;
+
+  f->map=NULL;
+  f->released=0;
+  f->offset=offset;
+  f->nx=nx;
+  f->swap=(bigendian!=0)==(dtiled_littleendian()!=0);
+  f->size=(size_t) offset+(size_t) npix*4;
+
+  if(output)
+    f->fd=open(filename, O_RDWR|O_CREAT, 0644);
+  else
+    f->fd=open(filename, O_RDONLY);
+  if(f->fd<0) {
+    fprintf(stderr, "dtiled: cannot open %s\n", filename);
+    return(0);
+  }
+  if(fstat(f->fd, &st)!=0) {
+    close(f->fd);
+    return(0);
+  }
+  if((size_t) st.st_size<f->size) {
+    if(!output || ftruncate(f->fd, (off_t) f->size)!=0) {
+      fprintf(stderr, "dtiled: %s is too short\n", filename);
+      close(f->fd);
+      return(0);
+    }
+  }
+
+  f->map=(char *) mmap(NULL, f->size,
+                       output ? PROT_READ|PROT_WRITE : PROT_READ,
+                       MAP_SHARED, f->fd, 0);
+  if(f->map==MAP_FAILED) {
+    fprintf(stderr, "dtiled: cannot map %s\n", filename);
+    f->map=NULL;
+    close(f->fd);
+    return(0);
+  }
+  madvise(f->map, f->size, MADV_SEQUENTIAL);
+  return(1);
+}
+
+/* a scratch file in $TMPDIR, deleted when closed */
+static int dtiled_scratch(dtiled_file *f, int nx, long npix)
+{
+  FILE *fp;
+
+  fp=tmpfile();
+  if(fp==NULL) {
+    fprintf(stderr, "dtiled: cannot create scratch file\n");
+    return(0);
+  }
+  f->fd=dup(fileno(fp));
+  fclose(fp);
+  f->offset=0;
+  f->released=0;
+  f->nx=nx;
+  f->swap=0;
+  f->size=(size_t) npix*4;
+  if(f->fd<0 || ftruncate(f->fd, (off_t) f->size)!=0) {
+    if(f->fd>=0) close(f->fd);
+    return(0);
+  }
+  f->map=(char *) mmap(NULL, f->size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                       f->fd, 0);
+  if(f->map==MAP_FAILED) {
+    f->map=NULL;
+    close(f->fd);
+    return(0);
+  }
+  return(1);
+}
+
+static void dtiled_close(dtiled_file *f)
+{
+  if(f->map!=NULL) {
+    msync(f->map, f->size, MS_SYNC);
+    munmap(f->map, f->size);
+    f->map=NULL;
+  }
+  if(f->fd>=0) close(f->fd);
+  f->fd=-1;
+}
+
+/* let the kernel drop the pages of the rows before row, which are done
+   with; dirty pages are written back first */
+static void dtiled_release(dtiled_file *f, long row)
+{
+  long pagesize, start, end;
+
+  if(row<=f->released) return;
+  pagesize=sysconf(_SC_PAGESIZE);
+  start=f->offset+f->released*f->nx*4;
+  end=f->offset+row*f->nx*4;
+  f->released=row;
+  start=((start+pagesize-1)/pagesize)*pagesize;
+  end=(end/pagesize)*pagesize;
+  if(end>start) {
+    msync(f->map+start, end-start, MS_ASYNC);
+    madvise(f->map+start, end-start, MADV_DONTNEED);
+  }
+}
+
+static void dtiled_read(dtiled_file *f, void *buf, long row, long nrows)
+{
+  memcpy(buf, f->map+f->offset+row*f->nx*4, (size_t) nrows*f->nx*4);
+  if(f->swap) dtiled_swap(buf, nrows*f->nx);
+}
+
+static void dtiled_write(dtiled_file *f, void *buf, long row, long nrows)
+{
+  char *dest;
+
+  dest=f->map+f->offset+row*f->nx*4;
+  memcpy(dest, buf, (size_t) nrows*f->nx*4);
+  if(f->swap) dtiled_swap(dest, nrows*f->nx);
+}
+
+int dsmooth_tiled(char *infile,
+                  long inoffset,
+                  int inbig,
+                  char *outfile,
+                  long outoffset,
+                  int outbig,
+                  int nx,
+                  int ny,
+                  float sigma,
+                  int nband)
+{
+  dtiled_file in, out;
+  float *buf=NULL, *smooth=NULL;
+  long r0, r1, lo, hi;
+  int half;
+
+  if(nband<=0) nband=DTILED_NBAND;
+  if(!dtiled_open(&in, infile, inoffset, inbig, nx, (long) nx*ny, 0))
+    return(0);
+  if(!dtiled_open(&out, outfile, outoffset, outbig, nx, (long) nx*ny, 1)) {
+    dtiled_close(&in);
+    return(0);
+  }
+
+  half=(int) ceilf(3.*sigma);
+  buf=(float *) malloc((size_t) nx*(nband+2*half)*sizeof(float));
+  smooth=(float *) malloc((size_t) nx*(nband+2*half)*sizeof(float));
+  for(r0=0;r0<ny;r0+=nband) {
+    r1=r0+nband;
+    if(r1>ny) r1=ny;
+    lo=r0-half;
+    if(lo<0) lo=0;
+    hi=r1+half;
+    if(hi>ny) hi=ny;
+    dtiled_read(&in, buf, lo, hi-lo);
+    dsmooth(buf, nx, hi-lo, sigma, smooth);
+    dtiled_write(&out, smooth+(r0-lo)*nx, r0, r1-r0);
+    dtiled_release(&in, lo);
+    dtiled_release(&out, r1);
+  }
+
+  FREEVEC(buf);
+  FREEVEC(smooth);
+  dtiled_close(&in);
+  dtiled_close(&out);
+  return(1);
+} /* end dsmooth_tiled */
+
+int dmedsmooth_tiled(char *infile,
+                     long inoffset,
+                     int inbig,
+                     char *outfile,
+                     long outoffset,
+                     int outbig,
+                     int nx,
+                     int ny,
+                     int box,
+                     int nband)
+{
+  dtiled_file in, out;
+  float *buf=NULL, *invvar=NULL, *sky=NULL, *sigma=NULL;
+  long r0, r1, lo, hi, k;
+  int halo;
+
+  if(box<1) box=1;
+  halo=DBACKGROUND_HALO(box);
+  if(nband<=0) nband=(2*halo>DTILED_NBAND) ? 2*halo : DTILED_NBAND;
+  if(!dtiled_open(&in, infile, inoffset, inbig, nx, (long) nx*ny, 0))
+    return(0);
+  if(!dtiled_open(&out, outfile, outoffset, outbig, nx, (long) nx*ny, 1)) {
+    dtiled_close(&in);
+    return(0);
+  }
+
+  buf=(float *) malloc((size_t) nx*(nband+2*halo)*sizeof(float));
+  invvar=(float *) malloc((size_t) nx*(nband+2*halo)*sizeof(float));
+  sky=(float *) malloc((size_t) nx*nband*sizeof(float));
+  sigma=(float *) malloc((size_t) nx*nband*sizeof(float));
+  for(k=0;k<(long) nx*(nband+2*halo);k++)
+    invvar[k]=1.;
+  for(r0=0;r0<ny;r0+=nband) {
+    r1=r0+nband;
+    if(r1>ny) r1=ny;
+    lo=r0-halo;
+    if(lo<0) lo=0;
+    hi=r1+halo;
+    if(hi>ny) hi=ny;
+    dtiled_read(&in, buf, lo, hi-lo);
+    dbackground_band(buf, invvar, nx, ny, box, 1, lo, r0, r1, sky, sigma);
+    dtiled_write(&out, sky, r0, r1-r0);
+    dtiled_release(&in, lo);
+    dtiled_release(&out, r1);
+  }
+
+  FREEVEC(buf);
+  FREEVEC(invvar);
+  FREEVEC(sky);
+  FREEVEC(sigma);
+  dtiled_close(&in);
+  dtiled_close(&out);
+  return(1);
+} /* end dmedsmooth_tiled */
+
+static long dtiled_root(long *parent, long k)
+{
+  while(parent[k]!=k) {
+    parent[k]=parent[parent[k]];
+    k=parent[k];
+  }
+  return(k);
+}
+
+static void dtiled_union(long *parent, long k1, long k2)
+{
+  k1=dtiled_root(parent, k1);
+  k2=dtiled_root(parent, k2);
+  if(k1<k2) parent[k2]=k1;
+  else if(k2<k1) parent[k1]=k2;
+}
+
+static int dtiled_dfind(dtiled_file *in, dtiled_file *out, int nx, int ny,
+                        int nband)
+{
+  int *mask=NULL, *object=NULL, *lastrow=NULL;
+  long *parent=NULL, *number=NULL, nlabels, nalloc, base, nobj;
+  long r0, r1, i, ip, k;
+
+  mask=(int *) malloc((size_t) nx*nband*sizeof(int));
+  object=(int *) malloc((size_t) nx*nband*sizeof(int));
+  lastrow=(int *) malloc((size_t) nx*sizeof(int));
+  nalloc=1024;
+  parent=(long *) malloc(nalloc*sizeof(long));
+
+  /* 1. label each band, joining labels across the seam above it */
+  nlabels=0;
+  for(r0=0;r0<ny;r0+=nband) {
+    r1=r0+nband;
+    if(r1>ny) r1=ny;
+    dtiled_read(in, mask, r0, r1-r0);
+    dfind(mask, nx, r1-r0, object);
+
+    base=nlabels;
+    for(k=0;k<(r1-r0)*nx;k++) {
+      if(object[k]<0) continue;
+      object[k]+=base;
+      if(object[k]>=nlabels) nlabels=object[k]+1;
+    }
+    if(nlabels>nalloc) {
+      while(nlabels>nalloc) nalloc*=2;
+      parent=(long *) realloc(parent, nalloc*sizeof(long));
+    }
+    for(k=base;k<nlabels;k++)
+      parent[k]=k;
+
+    if(r0>0) {
+      for(i=0;i<nx;i++) {
+        if(object[i]<0) continue;
+        for(ip=i-1;ip<=i+1;ip++)
+          if(ip>=0 && ip<nx && lastrow[ip]>=0)
+            dtiled_union(parent, object[i], lastrow[ip]);
+      }
+    }
+    memcpy(lastrow, object+(r1-r0-1)*nx, nx*sizeof(int));
+    dtiled_write(out, object, r0, r1-r0);
+    dtiled_release(in, r1);
+    dtiled_release(out, r1);
+  }
+
+  /* 2. renumber the merged objects in order of first appearance */
+  out->released=0;
+  number=(long *) malloc((nlabels+1)*sizeof(long));
+  for(k=0;k<nlabels;k++)
+    number[k]=-1;
+  nobj=0;
+  for(r0=0;r0<ny;r0+=nband) {
+    r1=r0+nband;
+    if(r1>ny) r1=ny;
+    dtiled_read(out, object, r0, r1-r0);
+    for(k=0;k<(r1-r0)*nx;k++) {
+      if(object[k]<0) continue;
+      i=dtiled_root(parent, object[k]);
+      if(number[i]<0) {
+        number[i]=nobj;
+        nobj++;
+      }
+      object[k]=number[i];
+    }
+    dtiled_write(out, object, r0, r1-r0);
+    dtiled_release(out, r1);
+  }
+
+  FREEVEC(mask);
+  FREEVEC(object);
+  FREEVEC(lastrow);
+  FREEVEC(parent);
+  FREEVEC(number);
+  return(1);
+}
+
+int dfind_tiled(char *infile,
+                long inoffset,
+                int inbig,
+                char *outfile,
+                long outoffset,
+                int outbig,
+                int nx,
+                int ny,
+                int nband)
+{
+  dtiled_file in, out;
+  int retval;
+
+  if(nband<=0) nband=DTILED_NBAND;
+  if(!dtiled_open(&in, infile, inoffset, inbig, nx, (long) nx*ny, 0))
+    return(0);
+  if(!dtiled_open(&out, outfile, outoffset, outbig, nx, (long) nx*ny, 1)) {
+    dtiled_close(&in);
+    return(0);
+  }
+  retval=dtiled_dfind(&in, &out, nx, ny, nband);
+  dtiled_close(&in);
+  dtiled_close(&out);
+  return(retval);
+} /* end dfind_tiled */
+
+/* smooth rows [rlo, rhi) of the image into smooth, which holds them */
+static void dtiled_smooth_rows(dtiled_file *in, float *buf, float *tmp,
+                               int nx, int ny, float dpsf, long rlo,
+                               long rhi, float *smooth)
+{
+  long lo, hi;
+  int half;
+
+  half=(int) ceilf(3.*dpsf);
+  lo=rlo-half;
+  if(lo<0) lo=0;
+  hi=rhi+half;
+  if(hi>ny) hi=ny;
+  dtiled_read(in, buf, lo, hi-lo);
+  dsmooth(buf, nx, hi-lo, dpsf, tmp);
+  memcpy(smooth, tmp+(rlo-lo)*nx, (size_t) (rhi-rlo)*nx*sizeof(float));
+}
+
+/* dsigma of the smoothed image, from the same sampled differences */
+static float dtiled_sigma(dtiled_file *in, float *buf, float *tmp,
+                          float *smooth, int nx, int ny, float dpsf, int sp,
+                          int nband)
+{
+  float *diff=NULL, sigma, tot;
+  long r0, r1, rhi, i, j, dx, dy, ndiff;
+
+  if(nx==1 && ny==1) return(0.);
+  dx=50;
+  if(dx>nx/4) dx=nx/4;
+  if(dx<=0) dx=1;
+  dy=50;
+  if(dy>ny/4) dy=ny/4;
+  if(dy<=0) dy=1;
+
+  diff=(float *) malloc(2*(nx/dx+1)*(ny/dy+1)*sizeof(float));
+  ndiff=0;
+  for(r0=0;r0<ny;r0+=nband) {
+    r1=r0+nband;
+    if(r1>ny) r1=ny;
+    rhi=r1+sp;
+    if(rhi>ny) rhi=ny;
+    dtiled_smooth_rows(in, buf, tmp, nx, ny, dpsf, r0, rhi, smooth);
+    for(j=r0;j<r1;j++) {
+      if(j%dy) continue;
+      for(i=0;i<nx;i+=dx) {
+        if(i<nx-sp) {
+          diff[ndiff]=fabs(smooth[i+(j-r0)*nx]-smooth[i+sp+(j-r0)*nx]);
+          ndiff++;
+        }
+        if(j<ny-sp) {
+          diff[ndiff]=fabs(smooth[i+(j-r0)*nx]-smooth[i+(j+sp-r0)*nx]);
+          ndiff++;
+        }
+      }
+    }
+    dtiled_release(in, r0);
+  }
+
+  if(ndiff<=1) {
+    sigma=0.;
+  } else if(ndiff<=10) {
+    tot=0.;
+    for(i=0;i<ndiff;i++)
+      tot+=diff[i]*diff[i];
+    sigma=sqrt(tot/(float) ndiff);
+  } else {
+    sigma=(dselip((int) floor(ndiff*0.68),ndiff,diff))/sqrt(2.);
+  }
+  FREEVEC(diff);
+  return(sigma);
+}
+
+int dobjects_multi_tiled(char *infile,
+                         long inoffset,
+                         int inbig,
+                         char *outfile,
+                         long outoffset,
+                         int outbig,
+                         int nx,
+                         int ny,
+                         int nim,
+                         float dpsf,
+                         float plim,
+                         int nband)
+{
+  dtiled_file in, out, mask;
+  float *buf=NULL, *tmp=NULL, *smooth=NULL, sigma, limit;
+  int *mbuf=NULL, sp, half, grow, retval;
+  long nhalo, k, r0, r1, slo, shi, i, j, ip, jp, ist, ind, jst, jnd;
+
+  if(nband<=0) nband=DTILED_NBAND;
+  if(!dtiled_open(&out, outfile, outoffset, outbig, nx, (long) nx*ny, 1))
+    return(0);
+  if(!dtiled_scratch(&mask, nx, (long) nx*ny)) {
+    dtiled_close(&out);
+    return(0);
+  }
+
+  sp=(int) (8*dpsf);
+  half=(int) ceilf(3.*dpsf);
+  grow=(long) (3*dpsf);
+  nhalo=half+(sp>grow ? sp : 2*grow);
+  buf=(float *) malloc((size_t) nx*(nband+2*nhalo)*sizeof(float));
+  tmp=(float *) malloc((size_t) nx*(nband+2*nhalo)*sizeof(float));
+  smooth=(float *) malloc((size_t) nx*(nband+2*nhalo)*sizeof(float));
+  mbuf=(int *) malloc((size_t) nx*nband*sizeof(int));
+
+  for(k=0;k<nim;k++) {
+    if(!dtiled_open(&in, infile, inoffset+k*(long) nx*ny*4, inbig, nx,
+                    (long) nx*ny, 0)) {
+      retval=0;
+      goto finish;
+    }
+    sigma=dtiled_sigma(&in, buf, tmp, smooth, nx, ny, dpsf, sp, nband);
+    limit=sigma*plim;
+
+    /* mask rows [r0, r1) from the smoothed rows within grow of them */
+    for(r0=0;r0<ny;r0+=nband) {
+      r1=r0+nband;
+      if(r1>ny) r1=ny;
+      slo=r0-grow;
+      if(slo<0) slo=0;
+      shi=r1+grow;
+      if(shi>ny) shi=ny;
+      dtiled_smooth_rows(&in, buf, tmp, nx, ny, dpsf, slo, shi, smooth);
+      dtiled_read(&mask, mbuf, r0, r1-r0);
+      for(j=slo;j<shi;j++) {
+        jst=j-grow;
+        if(jst<r0) jst=r0;
+        jnd=j+grow;
+        if(jnd>r1-1) jnd=r1-1;
+        if(jnd<jst) continue;
+        for(i=0;i<nx;i++) {
+          if(smooth[i+(j-slo)*nx]>limit) {
+            ist=i-grow;
+            if(ist<0) ist=0;
+            ind=i+grow;
+            if(ind>nx-1) ind=nx-1;
+            for(jp=jst;jp<=jnd;jp++)
+              for(ip=ist;ip<=ind;ip++)
+                mbuf[ip+(jp-r0)*nx]=1;
+          }
+        }
+      }
+      dtiled_write(&mask, mbuf, r0, r1-r0);
+      dtiled_release(&in, slo);
+      dtiled_release(&mask, r1);
+    }
+    dtiled_close(&in);
+  }
+
+  retval=dtiled_dfind(&mask, &out, nx, ny, nband);
+
+finish:
+  FREEVEC(buf);
+  FREEVEC(tmp);
+  FREEVEC(smooth);
+  FREEVEC(mbuf);
+  dtiled_close(&mask);
+  dtiled_close(&out);
+  return(retval);
+} /* end dobjects_multi_tiled */
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * dweights.c
+ *
+ * Least-squares weights of templates [nx, ny, ntemplates] fit to an
+ * image, weighted by invvar, through the normal equations and a
+ * Cholesky solve.  With nonneg set, the most negative weight is fixed
+ * at zero and the rest refit until no weight is negative.
+ *
+ * dweights_work does the same using caller-supplied scratch of at least
+ * DWEIGHTS_NWORK(ntemplates) floats, so the deblender can reuse one
+ * workspace per thread.
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+int dweights_work(float *image,
+                  float *invvar,
+                  int nx,
+                  int ny,
+                  int ntemplates,
+                  float *templates,
+                  int nonneg,
+                  float *weights,
+                  float *work)
+{
+  int i, k, l, n, npix, nactive, kmin;
+  float *aa, *bb, *asub, *bsub, *p, *x, *active, wmin;
+  double sum;
+
+  n=ntemplates;
+  npix=nx*ny;
+  aa=work;
+  asub=aa+n*n;
+  bb=asub+n*n;
+  bsub=bb+n;
+  p=bsub+n;
+  x=p+n;
+  active=x+n;
+
+  /* 1. normal equations */
+  for(k=0;k<n;k++) {
+    for(l=0;l<=k;l++) {
+      sum=0.;
+      for(i=0;i<npix;i++)
+        sum+=(double) templates[(size_t) k*npix+i]*
+          templates[(size_t) l*npix+i]*invvar[i];
+      aa[k*n+l]=aa[l*n+k]=sum;
+    }
+    sum=0.;
+    for(i=0;i<npix;i++)
+      sum+=(double) templates[(size_t) k*npix+i]*image[i]*invvar[i];
+    bb[k]=sum;
+    active[k]=1.;
+    weights[k]=0.;
+  }
+
+  /* 2. solve on the active set, dropping negative weights if asked */
+  nactive=n;
+  while(nactive>0) {
+    for(k=0,i=0;k<n;k++) {
+      if(!active[k]) continue;
+      bsub[i]=bb[k];
+      for(l=0,nactive=0;l<n;l++) {
+        if(!active[l]) continue;
+        asub[i*n+nactive]=aa[k*n+l];
+        nactive++;
+      }
+      i++;
+    }
+    for(k=0;k<nactive;k++)
+      for(l=0;l<nactive;l++)
+        asub[k*nactive+l]=asub[k*n+l];
+    dcholdc(asub, nactive, p);
+    dcholsl(asub, nactive, p, bsub, x);
+
+    kmin=-1;
+    wmin=0.;
+    for(k=0,i=0;k<n;k++) {
+      if(!active[k]) continue;
+      weights[k]=x[i];
+      if(nonneg && x[i]<wmin) {
+        wmin=x[i];
+        kmin=k;
+      }
+      i++;
+    }
+    if(kmin<0) break;
+    active[kmin]=0.;
+    weights[kmin]=0.;
+    nactive--;
+  }
+
+  return(1);
+} /* end dweights_work */
+
+int dweights(float *image,
+             float *invvar,
+             int nx,
+             int ny,
+             int ntemplates,
+             float *templates,
+             int nonneg,
+             float *weights)
+{
+  float *work=NULL;
+
+  work=(float *) malloc(DWEIGHTS_NWORK(ntemplates)*sizeof(float));
+  dweights_work(image, invvar, nx, ny, ntemplates, templates, nonneg,
+                weights, work);
+  FREEVEC(work);
+
+  return(1);
+} /* end dweights */
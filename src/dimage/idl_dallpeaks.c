@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "export.h"
+#include "dimage.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+static void free_memory()
+{
+}
+
+/********************************************************************/
+IDL_LONG idl_dallpeaks (int      argc,
+                        void *   argv[])
+{
+	IDL_LONG nx,ny,*objects,*npeaks,maxper,maxnpeaks;
+	float *image, *xcen, *ycen, sigma, dlim, saddle, minpeak;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	image=((float *)argv[i]); i++;
+	nx=*((int *)argv[i]); i++;
+	ny=*((int *)argv[i]); i++;
+	objects=((IDL_LONG *)argv[i]); i++;
+	xcen=((float *)argv[i]); i++;
+	ycen=((float *)argv[i]); i++;
+	npeaks=((IDL_LONG *)argv[i]); i++;
+	sigma=*((float *)argv[i]); i++;
+	dlim=*((float *)argv[i]); i++;
+	saddle=*((float *)argv[i]); i++;
+	maxper=*((int *)argv[i]); i++;
+	maxnpeaks=*((int *)argv[i]); i++;
+	minpeak=*((float *)argv[i]); i++;
+	
+	/* 1. run the fitting routine */
+	retval=(IDL_LONG) dallpeaks(image, nx, ny, (int *) objects, xcen, ycen,
+                              (int *) npeaks, sigma, dlim, saddle, maxper,
+                              maxnpeaks, minpeak);
+	
+	/* 2. free memory and leave */
+	free_memory();
+	return retval;
+}
+
+/***************************************************************************/
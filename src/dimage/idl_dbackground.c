@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "export.h"
+#include "dimage.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+static void free_memory()
+{
+}
+
+/********************************************************************/
+IDL_LONG idl_dbackground (int      argc,
+                          void *   argv[])
+{
+	IDL_LONG nx,ny,box,sp;
+	float *image, *invvar, *sky, *sigma;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	image=((float *)argv[i]); i++;
+	invvar=((float *)argv[i]); i++;
+	nx=*((int *)argv[i]); i++;
+	ny=*((int *)argv[i]); i++;
+  box=*((int *)argv[i]); i++;
+  sp=*((int *)argv[i]); i++;
+  sky=((float *)argv[i]); i++;
+  sigma=((float *)argv[i]); i++;
+	
+	/* 1. run the fitting routine */
+	retval=(IDL_LONG) dbackground(image, invvar, nx, ny, box, sp, sky, sigma);
+	
+	/* 2. free memory and leave */
+	free_memory();
+	return retval;
+}
+
+/***************************************************************************/
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "export.h"
+#include "dimage.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+static void free_memory()
+{
+}
+
+/********************************************************************/
+IDL_LONG idl_deblend_multi (int      argc,
+                            void *   argv[])
+{
+	IDL_LONG nx,ny,*objects,maxnchild,maxntotal,*ntotal,*parent,*childmap;
+	float *image, *invvar, sigma, dlim, tsmooth, tlimit, tfloor, saddle;
+	float parallel, minpeak, *xchild, *ychild, *flux;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	image=((float *)argv[i]); i++;
+	invvar=((float *)argv[i]); i++;
+	nx=*((int *)argv[i]); i++;
+	ny=*((int *)argv[i]); i++;
+	objects=((IDL_LONG *)argv[i]); i++;
+	sigma=*((float *)argv[i]); i++;
+	dlim=*((float *)argv[i]); i++;
+	tsmooth=*((float *)argv[i]); i++;
+	tlimit=*((float *)argv[i]); i++;
+	tfloor=*((float *)argv[i]); i++;
+	saddle=*((float *)argv[i]); i++;
+	parallel=*((float *)argv[i]); i++;
+	maxnchild=*((int *)argv[i]); i++;
+	minpeak=*((float *)argv[i]); i++;
+	maxntotal=*((int *)argv[i]); i++;
+	ntotal=((IDL_LONG *)argv[i]); i++;
+	parent=((IDL_LONG *)argv[i]); i++;
+	xchild=((float *)argv[i]); i++;
+	ychild=((float *)argv[i]); i++;
+	flux=((float *)argv[i]); i++;
+	childmap=((IDL_LONG *)argv[i]); i++;
+	
+	/* 1. run the fitting routine */
+	retval=(IDL_LONG) deblend_multi(image, invvar, nx, ny, (int *) objects,
+                                  sigma, dlim, tsmooth, tlimit, tfloor, saddle,
+                                  parallel, maxnchild, minpeak, maxntotal,
+                                  (int *) ntotal, (int *) parent, xchild,
+                                  ychild, flux, (int *) childmap);
+	
+	/* 2. free memory and leave */
+	free_memory();
+	return retval;
+}
+
+/***************************************************************************/
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "export.h"
+#include "dimage.h"
+
+/*
+ * Entry points for the out-of-core dimage routines in dtiled.c.  File
+ * names come in as IDL strings, byte offsets as IDL 64-bit integers.
+ */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+static void free_memory()
+{
+}
+
+/********************************************************************/
+IDL_LONG idl_dsmooth_tiled (int      argc,
+                            void *   argv[])
+{
+	IDL_LONG nx,ny,inbig,outbig,nband;
+	IDL_LONG64 inoffset,outoffset;
+	char *infile, *outfile;
+	float sigma;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	infile=((IDL_STRING *)argv[i])->s; i++;
+	inoffset=*((IDL_LONG64 *)argv[i]); i++;
+	inbig=*((int *)argv[i]); i++;
+	outfile=((IDL_STRING *)argv[i])->s; i++;
+	outoffset=*((IDL_LONG64 *)argv[i]); i++;
+	outbig=*((int *)argv[i]); i++;
+	nx=*((int *)argv[i]); i++;
+	ny=*((int *)argv[i]); i++;
+	sigma=*((float *)argv[i]); i++;
+	nband=*((int *)argv[i]); i++;
+	
+	/* 1. run the fitting routine */
+	retval=(IDL_LONG) dsmooth_tiled(infile, (long) inoffset, inbig, outfile,
+                                  (long) outoffset, outbig, nx, ny, sigma,
+                                  nband);
+	
+	/* 2. free memory and leave */
+	free_memory();
+	return retval;
+}
+
+/********************************************************************/
+IDL_LONG idl_dmedsmooth_tiled (int      argc,
+                               void *   argv[])
+{
+	IDL_LONG nx,ny,inbig,outbig,box,nband;
+	IDL_LONG64 inoffset,outoffset;
+	char *infile, *outfile;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	infile=((IDL_STRING *)argv[i])->s; i++;
+	inoffset=*((IDL_LONG64 *)argv[i]); i++;
+	inbig=*((int *)argv[i]); i++;
+	outfile=((IDL_STRING *)argv[i])->s; i++;
+	outoffset=*((IDL_LONG64 *)argv[i]); i++;
+	outbig=*((int *)argv[i]); i++;
+	nx=*((int *)argv[i]); i++;
+	ny=*((int *)argv[i]); i++;
+	box=*((int *)argv[i]); i++;
+	nband=*((int *)argv[i]); i++;
+	
+	/* 1. run the fitting routine */
+	retval=(IDL_LONG) dmedsmooth_tiled(infile, (long) inoffset, inbig, outfile,
+                                     (long) outoffset, outbig, nx, ny, box,
+                                     nband);
+	
+	/* 2. free memory and leave */
+	free_memory();
+	return retval;
+}
+
+/********************************************************************/
+IDL_LONG idl_dfind_tiled (int      argc,
+                          void *   argv[])
+{
+	IDL_LONG nx,ny,inbig,outbig,nband;
+	IDL_LONG64 inoffset,outoffset;
+	char *infile, *outfile;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	infile=((IDL_STRING *)argv[i])->s; i++;
+	inoffset=*((IDL_LONG64 *)argv[i]); i++;
+	inbig=*((int *)argv[i]); i++;
+	outfile=((IDL_STRING *)argv[i])->s; i++;
+	outoffset=*((IDL_LONG64 *)argv[i]); i++;
+	outbig=*((int *)argv[i]); i++;
+	nx=*((int *)argv[i]); i++;
+	ny=*((int *)argv[i]); i++;
+	nband=*((int *)argv[i]); i++;
+	
+	/* 1. run the fitting routine */
+	retval=(IDL_LONG) dfind_tiled(infile, (long) inoffset, inbig, outfile,
+                                (long) outoffset, outbig, nx, ny, nband);
+	
+	/* 2. free memory and leave */
+	free_memory();
+	return retval;
+}
+
+/********************************************************************/
+IDL_LONG idl_dobjects_multi_tiled (int      argc,
+                                   void *   argv[])
+{
+	IDL_LONG nx,ny,nim,inbig,outbig,nband;
+	IDL_LONG64 inoffset,outoffset;
+	char *infile, *outfile;
+	float dpsf, plim;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	infile=((IDL_STRING *)argv[i])->s; i++;
+	inoffset=*((IDL_LONG64 *)argv[i]); i++;
+	inbig=*((int *)argv[i]); i++;
+	outfile=((IDL_STRING *)argv[i])->s; i++;
+	outoffset=*((IDL_LONG64 *)argv[i]); i++;
+	outbig=*((int *)argv[i]); i++;
+	nx=*((int *)argv[i]); i++;
+	ny=*((int *)argv[i]); i++;
+	nim=*((int *)argv[i]); i++;
+	dpsf=*((float *)argv[i]); i++;
+	plim=*((float *)argv[i]); i++;
+	nband=*((int *)argv[i]); i++;
+	
+	/* 1. run the fitting routine */
+	retval=(IDL_LONG) dobjects_multi_tiled(infile, (long) inoffset, inbig,
+                                         outfile, (long) outoffset, outbig,
+                                         nx, ny, nim, dpsf, plim, nband);
+	
+	/* 2. free memory and leave */
+	free_memory();
+	return retval;
+}
+
+/***************************************************************************/
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dimage.h"
+
+/*
+ * simplexy.c
+ *
+ * Find sources in an image: subtract a median-smoothed background,
+ * estimate the noise (if not given), detect objects, then find and
+ * centroid the peaks of each object.
+ *
+ * image - [nx, ny] input image
+ * dpsf - gaussian sigma of PSF for detection smoothing
+ * plim - detection limit in units of sky sigma
+ * dlim - closest two peaks can be
+ * saddle - saddle difference (in sigma) for two peaks to be distinct
+ * maxper - maximum number of peaks per object
+ * maxnpeaks - maximum number of peaks total
+ * sigma - sky sigma; estimated from the image if passed as 0
+ * x, y, flux - [maxnpeaks] peak positions and background-subtracted
+ *              peak values
+ * npeaks - number of peaks found
+ *
+ * 10/2026 */
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+/* box for the median background */
+#define SIMPLEXY_BOX 100
+
+int simplexy(float *image,
+             int nx,
+             int ny,
+             float dpsf,
+             float plim,
+             float dlim,
+             float saddle,
+             int maxper,
+             int maxnpeaks,
+             float *sigma,
+             float *x,
+             float *y,
+             float *flux,
+             int *npeaks)
+{
+  int i, j, k, box, *objects=NULL;
+  float *invvar=NULL, *smooth=NULL, *simage=NULL;
+
+  (*npeaks)=0;
+  if(nx<=0 || ny<=0) return(0);
+
+  /* 1. subtract median-smoothed background */
+  box=SIMPLEXY_BOX;
+  if(box>nx/2) box=nx/2;
+  if(box>ny/2) box=ny/2;
+  if(box<1) box=1;
+  invvar=(float *) malloc((size_t) nx*ny*sizeof(float));
+  smooth=(float *) malloc((size_t) nx*ny*sizeof(float));
+  simage=(float *) malloc((size_t) nx*ny*sizeof(float));
+  for(k=0;k<nx*ny;k++)
+    invvar[k]=1.;
+  dmedsmooth(image, invvar, nx, ny, box, smooth);
+  for(k=0;k<nx*ny;k++)
+    simage[k]=image[k]-smooth[k];
+  FREEVEC(invvar);
+  FREEVEC(smooth);
+
+  /* 2. noise */
+  if((*sigma)==0.)
+    dsigma(simage, nx, ny, 5, sigma);
+
+  /* 3. detect objects */
+  objects=(int *) malloc((size_t) nx*ny*sizeof(int));
+  dobjects_multi(simage, nx, ny, 1, dpsf, plim, objects);
+
+  /* 4. peaks and centroids of each object */
+  dallpeaks(simage, nx, ny, objects, x, y, npeaks, *sigma, dlim, saddle,
+            maxper, maxnpeaks, *sigma);
+
+  for(k=0;k<(*npeaks);k++) {
+    i=(int) floor(x[k]+0.5);
+    j=(int) floor(y[k]+0.5);
+    if(i<0) i=0;
+    if(i>nx-1) i=nx-1;
+    if(j<0) j=0;
+    if(j>ny-1) j=ny-1;
+    flux[k]=simage[i+j*nx];
+  }
+
+  FREEVEC(simage);
+  FREEVEC(objects);
+
+  return(1);
+} /* end simplexy */
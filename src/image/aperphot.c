@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ph.h"
+#include "idlutils_threads.h"
+
+/*
+ * aperphot.c
+ *
+ * Aperture photometry of many objects at once, as djs_phot.pro does one
+ * object at a time: recentering (djs_photcen with calg='iweight'), sky in
+ * an annulus (djs_photsky), then the flux, error and peak in each object
+ * aperture.  The apertures are weighted either by the exact overlap of the
+ * circle with each pixel, as djs_photfrac.pro, or by the band-limited
+ * fractions of photfrac_cached(), as exact_photfrac.pro.
+ *
+ * Each object only looks at its own cutout of the image, so objects are
+ * handed out to threads in chunks and the results do not depend on the
+ * number of threads.
+ */
+
+/* objects handed to a thread at a time */
+#define APERPHOT_CHUNK 16
+
+#define APERPHOT_CALG_NONE 0
+#define APERPHOT_CALG_IWEIGHT 1
+
+#define APERPHOT_SALG_NONE 0
+#define APERPHOT_SALG_MEAN 1
+#define APERPHOT_SALG_MEDIAN 2
+#define APERPHOT_SALG_MODE 3
+
+#define APERPHOT_SREJ_NONE 0
+#define APERPHOT_SREJ_SIGCLIP 1
+#define APERPHOT_SREJ_PCLIP 2
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+typedef struct {
+  IDL_LONG nx, ny, useinvvar, nobj, nrad, nskyrad, exact;
+  IDL_LONG calg, cmaxiter, salg, srejalg, smaxiter;
+  float *image, *invvar, *objrad, *skyrad, cbox, ceps, lorej, hirej;
+  double *xcen, *ycen;
+  float *flux, *flerr, *skyval, *skyrms, *skyerr, *peakval;
+  idlutils_queue queue;
+} aperphot_work;
+
+/* the weights of one aperture over a box of the image */
+typedef struct {
+  IDL_LONG i0, j0, ni, nj;
+  int keepzero;         /* whether pixels of zero weight are in the aperture */
+  float *frac;          /* frac[(j-j0)*ni+(i-i0)] */
+  long nalloc;
+} aperphot_aperture;
+
+/********************************************************************/
+/* area of the pixel [xa,xb]x[ya,yb] below the circle of radius r, plus
+   the area (xb-xa)*ya below it, as djs_photfrac_intcirc */
+static double aperphot_intcirc(double xa, double xb, double ya, double yb,
+                               double r)
+{
+  double gg,hh;
+
+  xa/=r;
+  xb/=r;
+  ya/=r;
+  yb/=r;
+  if(yb>=1.) {
+    gg=xa;
+  } else {
+    gg=sqrt(1.-yb*yb);
+    if(xa>gg) gg=xa;
+  }
+  hh=sqrt(1.-ya*ya);
+  if(xb<hh) hh=xb;
+  return(r*r*((gg-xa)*yb+(xb-hh)*ya+
+              0.5*(hh*sqrt(1.-hh*hh)+asin(hh)-gg*sqrt(1.-gg*gg)-asin(gg))));
+} /* end aperphot_intcirc */
+
+/********************************************************************/
+/* area of [xa,xb]x[ya,yb], with 0<=xa<=xb and 0<=ya<=yb, within the
+   annulus [r1,r2] */
+static double aperphot_piece(double xa, double xb, double ya, double yb,
+                             double r1, double r2)
+{
+  double sqa,sqb,area;
+
+  sqa=xa*xa+ya*ya;
+  sqb=xb*xb+yb*yb;
+  if(sqb<=r1*r1 || sqa>=r2*r2) return(0.);
+  area=(sqb<=r2*r2) ? (xb-xa)*yb : aperphot_intcirc(xa, xb, ya, yb, r2);
+  area-=(sqa>=r1*r1) ? (xb-xa)*ya : aperphot_intcirc(xa, xb, ya, yb, r1);
+  return(area);
+} /* end aperphot_piece */
+
+/********************************************************************/
+/* the pieces of pixel i about center c, each folded onto the positive
+   axis; the pixel holding the center is split in two across it */
+static int aperphot_split(IDL_LONG i, IDL_LONG isplit, double c, double *a,
+                          double *b)
+{
+  double lo,hi;
+
+  lo=(double) i-0.5-c;
+  hi=lo+1.;
+  if(i==isplit) {
+    a[0]=0.;
+    b[0]=fabs(lo);
+    a[1]=0.;
+    b[1]=fabs(hi);
+    return(2);
+  }
+  lo=fabs(lo);
+  hi=fabs(hi);
+  a[0]=(lo<hi) ? lo : hi;
+  b[0]=(lo<hi) ? hi : lo;
+  return(1);
+} /* end aperphot_split */
+
+/********************************************************************/
+static void aperphot_alloc(aperphot_aperture *ap)
+{
+  if((long) ap->ni*ap->nj>ap->nalloc) {
+    ap->nalloc=(long) ap->ni*ap->nj;
+    FREEVEC(ap->frac);
+    ap->frac=(float *) malloc(ap->nalloc*sizeof(float));
+  }
+} /* end aperphot_alloc */
+
+/********************************************************************/
+/* the annulus [r1,r2] by its exact overlap with each pixel, over the
+   pixels that djs_photfrac.pro looks at; 0 if there are none */
+static int aperphot_geometric(aperphot_work *w, double xcen, double ycen,
+                              double r1, double r2, aperphot_aperture *ap)
+{
+  IDL_LONG i,j,i1,j1,isplit,jsplit;
+  int nxp,nyp,ix,iy;
+  double xa[2],xb[2],ya[2],yb[2],f;
+
+  ap->i0=(IDL_LONG) floor(xcen+0.5-r2);
+  if(ap->i0<0) ap->i0=0;
+  i1=(IDL_LONG) ceil(xcen-0.5+r2);
+  if(i1>w->nx-1) i1=w->nx-1;
+  ap->j0=(IDL_LONG) floor(ycen+0.5-r2);
+  if(ap->j0<0) ap->j0=0;
+  j1=(IDL_LONG) ceil(ycen-0.5+r2);
+  if(j1>w->ny-1) j1=w->ny-1;
+  if(ap->i0>=w->nx || i1<0 || i1<ap->i0 ||
+     ap->j0>=w->ny || j1<0 || j1<ap->j0) return(0);
+  ap->ni=i1-ap->i0+1;
+  ap->nj=j1-ap->j0+1;
+  ap->keepzero=0;
+  aperphot_alloc(ap);
+
+  isplit=(IDL_LONG) floor(xcen+0.5);
+  jsplit=(IDL_LONG) floor(ycen+0.5);
+  for(j=0;j<ap->nj;j++) {
+    nyp=aperphot_split(ap->j0+j, jsplit, ycen, ya, yb);
+    for(i=0;i<ap->ni;i++) {
+      nxp=aperphot_split(ap->i0+i, isplit, xcen, xa, xb);
+      f=0.;
+      for(iy=0;iy<nyp;iy++)
+        for(ix=0;ix<nxp;ix++)
+          f+=aperphot_piece(xa[ix], xb[ix], ya[iy], yb[iy], r1, r2);
+      ap->frac[j*ap->ni+i]=(float) f;
+    }
+  }
+  return(1);
+} /* end aperphot_geometric */
+
+/********************************************************************/
+/* the annulus [r1,r2] (a circle if r1 is 0) by the band-limited
+   fractions, over the box exact_photfrac.pro cuts out */
+static int aperphot_exact(aperphot_work *w, double xcen, double ycen,
+                          double r1, double r2, aperphot_aperture *ap,
+                          float **frac1, long *nalloc1)
+{
+  IDL_LONG safe,i1,j1;
+  long k,n;
+
+  safe=(IDL_LONG) (r2*2.);
+  if(safe<10) safe=10;
+  ap->i0=(IDL_LONG) floor(xcen)-safe;
+  if(ap->i0<0) ap->i0=0;
+  i1=(IDL_LONG) ceil(xcen)+safe;
+  if(i1>w->nx-1) i1=w->nx-1;
+  ap->j0=(IDL_LONG) floor(ycen)-safe;
+  if(ap->j0<0) ap->j0=0;
+  j1=(IDL_LONG) ceil(ycen)+safe;
+  if(j1>w->ny-1) j1=w->ny-1;
+  if(i1<ap->i0 || j1<ap->j0) return(0);
+  ap->ni=i1-ap->i0+1;
+  ap->nj=j1-ap->j0+1;
+  ap->keepzero=1;
+  aperphot_alloc(ap);
+
+  n=(long) ap->ni*ap->nj;
+  photfrac_cached(ap->ni, ap->nj, (float) r2, ap->frac,
+                  (float) (xcen-ap->i0), (float) (ycen-ap->j0));
+  if(r1>0.) {
+    if(n>(*nalloc1)) {
+      (*nalloc1)=n;
+      FREEVEC(*frac1);
+      (*frac1)=(float *) malloc(n*sizeof(float));
+    }
+    photfrac_cached(ap->ni, ap->nj, (float) r1, *frac1,
+                    (float) (xcen-ap->i0), (float) (ycen-ap->j0));
+    for(k=0;k<n;k++) ap->frac[k]-=(*frac1)[k];
+  }
+  return(1);
+} /* end aperphot_exact */
+
+/********************************************************************/
+/* intensity-weighted centering in a box of width cbox, as djs_photcen.pro
+   with calg='iweight'.  djs_photcen clamps each new center to within
+   cmaxshift of itself, which never moves it, so cmaxshift is not needed
+   here either */
+static void aperphot_center(aperphot_work *w, double *xcen, double *ycen)
+{
+  IDL_LONG i,j,i0,i1,j0,j1,iiter;
+  double radius,xrad,yrad,xa,xb,ya,yb,f,norm,sx,sy,v,dx,dy;
+  float *row;
+
+  radius=0.5*w->cbox;
+  dx=dy=2.*w->ceps+1.;
+  for(iiter=0;iiter<=w->cmaxiter &&
+        (fabs(dx)>w->ceps || fabs(dy)>w->ceps);iiter++) {
+    dx=(*xcen);
+    dy=(*ycen);
+
+    /* the largest symmetric box within the image */
+    xrad=radius;
+    if((*xcen)<xrad) xrad=((*xcen)>0.) ? (*xcen) : 0.;
+    if(w->nx-(*xcen)<xrad) xrad=(w->nx-(*xcen)>0.) ? w->nx-(*xcen) : 0.;
+    yrad=radius;
+    if((*ycen)<yrad) yrad=((*ycen)>0.) ? (*ycen) : 0.;
+    if(w->ny-(*ycen)<yrad) yrad=(w->ny-(*ycen)>0.) ? w->ny-(*ycen) : 0.;
+    i0=(IDL_LONG) floor((*xcen)+0.5-xrad);
+    i1=(IDL_LONG) ceil((*xcen)-0.5+xrad);
+    j0=(IDL_LONG) floor((*ycen)+0.5-yrad);
+    j1=(IDL_LONG) ceil((*ycen)-0.5+yrad);
+    if(i0>=w->nx || i1<0 || j0>=w->ny || j1<0) return;
+    if(i0<0) i0=0;
+    if(i1>w->nx-1) i1=w->nx-1;
+    if(j0<0) j0=0;
+    if(j1>w->ny-1) j1=w->ny-1;
+
+    norm=sx=sy=0.;
+    for(j=j0;j<=j1;j++) {
+      ya=(double) j-0.5-(*ycen);
+      yb=ya+1.;
+      if(ya<-yrad) ya=-yrad;
+      if(yb>yrad) yb=yrad;
+      row=w->image+(long) j*w->nx;
+      for(i=i0;i<=i1;i++) {
+        xa=(double) i-0.5-(*xcen);
+        xb=xa+1.;
+        if(xa<-xrad) xa=-xrad;
+        if(xb>xrad) xb=xrad;
+        f=(xb-xa)*(yb-ya);
+        v=(double) row[i]*f;
+        norm+=v;
+        sx+=v*((double) i-(*xcen));
+        sy+=v*((double) j-(*ycen));
+      }
+    }
+
+    /* insist that the total flux is positive */
+    if(norm>0.) {
+      (*xcen)+=sx/norm;
+      (*ycen)+=sy/norm;
+    }
+
+    dx-=(*xcen);
+    dy-=(*ycen);
+  }
+} /* end aperphot_center */
+
+/********************************************************************/
+static int aperphot_compare(const void *a, const void *b)
+{
+  float fa=*((const float *) a), fb=*((const float *) b);
+
+  if(fa<fb) return(-1);
+  if(fa>fb) return(1);
+  return(0);
+} /* end aperphot_compare */
+
+/********************************************************************/
+/* sky level in the annulus, as djs_photsky.pro; vals and sub need room
+   for every pixel of the aperture */
+static void aperphot_sky(aperphot_work *w, const aperphot_aperture *ap,
+                         float *vals, float *sub, float *skyval,
+                         float *skyrms, float *skyerr)
+{
+  IDL_LONG i,j,k,n,nsub,nfilled,iiter,lo,hi;
+  double sky,sum,diff,sig,dsky;
+  float f,*row;
+
+  /* 1. the pixels in the annulus, only those more than half filled
+     unless that is none of them */
+  n=nfilled=0;
+  for(j=0;j<ap->nj;j++) {
+    row=w->image+(long) (ap->j0+j)*w->nx+ap->i0;
+    for(i=0;i<ap->ni;i++) {
+      f=ap->frac[j*ap->ni+i];
+      if(f==0. && !ap->keepzero) continue;
+      if(f>0.5) sub[nfilled++]=row[i];
+      vals[n++]=row[i];
+    }
+  }
+  if(nfilled>0) {
+    memcpy(vals, sub, nfilled*sizeof(float));
+    n=nfilled;
+  }
+  memcpy(sub, vals, n*sizeof(float));
+  nsub=n;
+
+  /* 2. iterate until the sky does not change, nothing is left, or
+     smaxiter rejections */
+  sky=sig=0.;
+  (*skyval)=(*skyrms)=(*skyerr)=0.;
+  dsky=1.;
+  for(iiter=0;iiter<=w->smaxiter && nsub>0 && dsky!=0.;iiter++) {
+    if(iiter>0) dsky=(*skyval);
+
+    switch(w->salg) {
+    case APERPHOT_SALG_MEAN:
+      sum=0.;
+      for(k=0;k<nsub;k++) sum+=sub[k];
+      sky=sum/(double) nsub;
+      break;
+    case APERPHOT_SALG_MEDIAN:
+      /* the upper middle value for an even number, as IDL median() */
+      qsort(sub, nsub, sizeof(float), aperphot_compare);
+      sky=sub[nsub/2];
+      break;
+    default:
+      sky=0.;
+      break;
+    }
+    (*skyval)=(float) sky;
+    sky=(*skyval);
+    sum=0.;
+    for(k=0;k<nsub;k++) {
+      diff=sub[k]-sky;
+      sum+=diff*diff;
+    }
+    (*skyrms)=(float) sqrt(sum/(double) nsub);
+    (*skyerr)=(float) ((*skyrms)/sqrt((double) nsub));
+
+    /* reject from the full list of pixels */
+    switch(w->srejalg) {
+    case APERPHOT_SREJ_SIGCLIP:
+      sum=0.;
+      for(k=0;k<n;k++) {
+        diff=vals[k]-sky;
+        sum+=diff*diff;
+      }
+      sig=sqrt(sum/(double) n);
+      nsub=0;
+      for(k=0;k<n;k++)
+        if(vals[k]>sky-w->lorej*sig && vals[k]<sky+w->hirej*sig)
+          sub[nsub++]=vals[k];
+      if(nsub==0) {
+        memcpy(sub, vals, n*sizeof(float));
+        nsub=n;
+      }
+      break;
+    case APERPHOT_SREJ_PCLIP:
+      memcpy(sub, vals, n*sizeof(float));
+      qsort(sub, n, sizeof(float), aperphot_compare);
+      lo=(IDL_LONG) (w->lorej*n);
+      hi=n-1-(IDL_LONG) (w->hirej*n);
+      if(hi>=lo) {
+        if(lo>0) memmove(sub, sub+lo, (hi-lo+1)*sizeof(float));
+        nsub=hi-lo+1;
+      } else {
+        nsub=n;
+      }
+      break;
+    default:
+      memcpy(sub, vals, n*sizeof(float));
+      nsub=n;
+      break;
+    }
+
+    if(iiter>0) dsky-=(*skyval);
+  }
+} /* end aperphot_sky */
+
+/********************************************************************/
+static void aperphot_objects(void *arg, int ithread, int nthreads)
+{
+  aperphot_work *w=(aperphot_work *) arg;
+  aperphot_aperture ap;
+  float *frac1=NULL,*vals=NULL,*sub=NULL,*row,*ivrow,f,v,peak,minivar;
+  long nalloc1=0,nvals=0,lo,hi,iobj,k;
+  IDL_LONG i,j,irad,npix,ok;
+  double xcen,ycen,r1,r2,area,sum,sigma2,err;
+
+  ap.frac=NULL;
+  ap.nalloc=0;
+  while(idlutils_queue_next(&(w->queue), &lo, &hi)) {
+    for(iobj=lo;iobj<hi;iobj++) {
+      xcen=w->xcen[iobj];
+      ycen=w->ycen[iobj];
+
+      /* 1. recenter, except with exact weights */
+      if(!w->exact && w->calg==APERPHOT_CALG_IWEIGHT)
+        aperphot_center(w, &xcen, &ycen);
+      w->xcen[iobj]=xcen;
+      w->ycen[iobj]=ycen;
+
+      /* 2. sky */
+      w->skyval[iobj]=w->skyrms[iobj]=w->skyerr[iobj]=0.;
+      if(w->nskyrad>0 && w->salg!=APERPHOT_SALG_NONE) {
+        r1=(w->nskyrad>1) ? fabs(w->skyrad[0]) : 0.;
+        r2=fabs(w->skyrad[w->nskyrad>1 ? 1 : 0]);
+        ok=w->exact ?
+          aperphot_exact(w, xcen, ycen, r1, r2, &ap, &frac1, &nalloc1) :
+          aperphot_geometric(w, xcen, ycen, r1, r2, &ap);
+        if(ok) {
+          if((long) ap.ni*ap.nj>nvals) {
+            nvals=(long) ap.ni*ap.nj;
+            FREEVEC(vals);
+            FREEVEC(sub);
+            vals=(float *) malloc(nvals*sizeof(float));
+            sub=(float *) malloc(nvals*sizeof(float));
+          }
+          aperphot_sky(w, &ap, vals, sub, &(w->skyval[iobj]),
+                       &(w->skyrms[iobj]), &(w->skyerr[iobj]));
+        }
+      }
+
+      /* 3. flux in each aperture */
+      for(irad=0;irad<w->nrad;irad++) {
+        k=irad*w->nobj+iobj;
+        w->flux[k]=w->flerr[k]=w->peakval[k]=0.;
+        r2=w->objrad[irad];
+        ok=0;
+        if(r2>0.)
+          ok=w->exact ?
+            aperphot_exact(w, xcen, ycen, 0., r2, &ap, &frac1, &nalloc1) :
+            aperphot_geometric(w, xcen, ycen, 0., r2, &ap);
+        npix=0;
+        area=sum=sigma2=0.;
+        peak=0.;
+        minivar=1.;
+        if(ok) {
+          for(j=0;j<ap.nj;j++) {
+            row=w->image+(long) (ap.j0+j)*w->nx+ap.i0;
+            ivrow=w->useinvvar ? w->invvar+(long) (ap.j0+j)*w->nx+ap.i0 :
+              NULL;
+            for(i=0;i<ap.ni;i++) {
+              f=ap.frac[j*ap.ni+i];
+              if(f==0. && !ap.keepzero) continue;
+              v=row[i];
+              area+=f;
+              sum+=(double) v*f;
+              if(npix==0 || v>peak) peak=v;
+              if(ivrow!=NULL) {
+                if(npix==0 || ivrow[i]<minivar) minivar=ivrow[i];
+                if(ivrow[i]>0.) sigma2+=f/ivrow[i];
+              }
+              npix++;
+            }
+          }
+        }
+        if(npix>0) {
+          w->flux[k]=(float) (sum-area*w->skyval[iobj]);
+          w->flerr[k]=(float) (area*w->skyerr[iobj]);
+          w->peakval[k]=peak;
+        }
+
+        /* pixel errors from invvar in quadrature; -1 if any pixel has
+           none */
+        if(w->useinvvar) {
+          if(npix==0 || minivar<=0.) sigma2=0.;
+          if(sigma2<=0.) {
+            w->flerr[k]=-1.;
+          } else {
+            err=w->flerr[k];
+            w->flerr[k]=(float) sqrt(err*err+sigma2);
+          }
+        }
+      }
+    }
+  }
+
+  FREEVEC(ap.frac);
+  FREEVEC(frac1);
+  FREEVEC(vals);
+  FREEVEC(sub);
+} /* end aperphot_objects */
+
+/********************************************************************/
+/* nx, ny, image[nx,ny], invvar[nx,ny], useinvvar, nobj, xcen[nobj],
+   ycen[nobj] (DOUBLE), nrad, objrad[nrad], nskyrad, skyrad[2], exact,
+   calg, cbox, cmaxiter, ceps, salg, srejalg, smaxiter, lorej, hirej,
+   flux[nobj,nrad], flerr[nobj,nrad], skyval[nobj], skyrms[nobj],
+   skyerr[nobj], peakval[nobj,nrad].
+
+   Photometry of all objects in all apertures, as djs_phot.pro.  calg is
+   0 for none or 1 for iweight; salg is 0 for none, 1 for mean, 2 for
+   median, 3 for mode; srejalg is 0 for none, 1 for sigclip, 2 for pclip.
+   nskyrad is 0 for no sky, 1 for a circle of radius skyrad[0] or 2 for
+   the annulus skyrad[0..1].  exact uses the weights of exact_photfrac.pro
+   and does not recenter.  xcen and ycen are replaced with the new
+   centers.  invvar is only read if useinvvar is set */
+IDL_LONG idl_aperphot (int      argc,
+                       void *   argv[])
+{
+  aperphot_work w;
+  IDL_LONG i;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  w.nx=*((IDL_LONG *)argv[i]); i++;
+  w.ny=*((IDL_LONG *)argv[i]); i++;
+  w.image=((float *)argv[i]); i++;
+  w.invvar=((float *)argv[i]); i++;
+  w.useinvvar=*((IDL_LONG *)argv[i]); i++;
+  w.nobj=*((IDL_LONG *)argv[i]); i++;
+  w.xcen=((double *)argv[i]); i++;
+  w.ycen=((double *)argv[i]); i++;
+  w.nrad=*((IDL_LONG *)argv[i]); i++;
+  w.objrad=((float *)argv[i]); i++;
+  w.nskyrad=*((IDL_LONG *)argv[i]); i++;
+  w.skyrad=((float *)argv[i]); i++;
+  w.exact=*((IDL_LONG *)argv[i]); i++;
+  w.calg=*((IDL_LONG *)argv[i]); i++;
+  w.cbox=*((float *)argv[i]); i++;
+  w.cmaxiter=*((IDL_LONG *)argv[i]); i++;
+  w.ceps=*((float *)argv[i]); i++;
+  w.salg=*((IDL_LONG *)argv[i]); i++;
+  w.srejalg=*((IDL_LONG *)argv[i]); i++;
+  w.smaxiter=*((IDL_LONG *)argv[i]); i++;
+  w.lorej=*((float *)argv[i]); i++;
+  w.hirej=*((float *)argv[i]); i++;
+  w.flux=((float *)argv[i]); i++;
+  w.flerr=((float *)argv[i]); i++;
+  w.skyval=((float *)argv[i]); i++;
+  w.skyrms=((float *)argv[i]); i++;
+  w.skyerr=((float *)argv[i]); i++;
+  w.peakval=((float *)argv[i]); i++;
+  if(w.nx<=0 || w.ny<=0 || w.nobj<=0) return retval;
+
+  /* 1. objects in parallel */
+  idlutils_queue_init(&(w.queue), w.nobj, APERPHOT_CHUNK);
+  idlutils_run(idlutils_nthreads(w.nobj/APERPHOT_CHUNK+1), aperphot_objects,
+               &w);
+  idlutils_queue_free(&(w.queue));
+
+  /* 2. keep any new photfrac nodes on disk, once for the whole batch */
+  if(w.exact) photfrac_cache_save();
+
+  return retval;
+}
+
+/***************************************************************************/
@@ -103,3 +103,155 @@ IDL_LONG grow_obj
    return retval;
 }
 
+/******************************************************************************/
+/* Stack of pixels from which to fill, kept between objects */
+typedef struct {
+   IDL_LONG *  list;
+   IDL_LONG    n;
+   IDL_LONG    nalloc;
+} grow_stack;
+
+static void grow_push
+  (grow_stack *  stack,
+   IDL_LONG      iloc)
+{
+   if (stack->n == stack->nalloc) {
+      stack->nalloc = (stack->nalloc > 0) ? 2 * stack->nalloc : 1024;
+      stack->list = (IDL_LONG *)
+       realloc(stack->list, stack->nalloc * sizeof(IDL_LONG));
+   }
+   stack->list[stack->n++] = iloc;
+}
+
+/******************************************************************************/
+/* Scanline flood fill of the object touching ISEED, which must be a
+   non-zero pixel not yet in MASK.  Each run of pixels is filled whole,
+   then the start of each fillable run in the rows above and below it
+   (reaching one pixel further each way for diagonals) is pushed.
+   Returns the number of pixels set to PUTVAL. */
+static IDL_LONG grow_fill
+  (IDL_LONG         nx,
+   unsigned char *  image,
+   IDL_LONG      *  mask,
+   IDL_LONG         iseed,
+   IDL_LONG         putval,
+   IDL_LONG         qdiag,
+   grow_stack    *  stack)
+{
+   IDL_LONG    iloc;
+   IDL_LONG    ilo;
+   IDL_LONG    ihi;
+   IDL_LONG    i;
+   IDL_LONG    ioff;
+   IDL_LONG    nadd = 0;
+   int         irow;
+   int         qlast;
+
+#define GROW_FREE(k) (image[k] != 0 && mask[k] == 0)
+
+   stack->n = 0;
+   grow_push(stack, iseed);
+   while (stack->n > 0) {
+      iloc = stack->list[--stack->n];
+      if (!GROW_FREE(iloc)) continue;
+
+      /* The padding of zeros ends every run within its row */
+      ilo = iloc;
+      while (GROW_FREE(ilo-1)) ilo--;
+      ihi = iloc;
+      while (GROW_FREE(ihi+1)) ihi++;
+      for (i=ilo; i <= ihi; i++) mask[i] = putval;
+      nadd += ihi - ilo + 1;
+
+      for (irow=0; irow < 2; irow++) {
+         ioff = (irow == 0) ? -nx : nx;
+         qlast = 0;
+         for (i=ilo-qdiag; i <= ihi+qdiag; i++) {
+            if (GROW_FREE(i+ioff)) {
+               if (!qlast) grow_push(stack, i+ioff);
+               qlast = 1;
+            } else {
+               qlast = 0;
+            }
+         }
+      }
+   }
+
+#undef GROW_FREE
+
+   return nadd;
+}
+
+/******************************************************************************/
+/* Grow every object in one call, either from each of the NSEED pixels
+   ISEED or, if NSEED is 0, from every non-zero pixel in turn.  The image
+   and mask are padded by a row or column of zeros on each side, as for
+   grow_obj().  The object grown from seed K gets PUTVAL[K<(NPUTVAL-1)],
+   or without seeds every object gets PUTVAL[0]; with NPUTVAL of 0 the
+   objects are numbered from 1 instead.  Seeds already in an object add nothing.
+   The number of pixels in each object grown is put in NPIX, in the order
+   they were grown, and the number of objects grown is returned. */
+IDL_LONG grow_objects
+  (int         argc,
+   void    *   argv[])
+{
+   IDL_LONG    nx;
+   IDL_LONG    ny;
+   unsigned char *  image;
+   IDL_LONG *  mask;
+   IDL_LONG    nseed;
+   IDL_LONG *  iseed;
+   IDL_LONG    nputval;
+   IDL_LONG *  putval;
+   IDL_LONG    qdiag;
+   IDL_LONG *  npix;
+
+   grow_stack  stack;
+   IDL_LONG    npad;
+   IDL_LONG    nstart;
+   IDL_LONG    istart;
+   IDL_LONG    iloc;
+   IDL_LONG    objid;
+   IDL_LONG    nadd;
+   IDL_LONG    retval = 0;
+
+   /* Allocate pointers from IDL */
+   nx = *((IDL_LONG *)argv[0]);
+   ny = *((IDL_LONG *)argv[1]);
+   image = (unsigned char *)argv[2];
+   mask = (IDL_LONG *)argv[3];
+   nseed = *((IDL_LONG *)argv[4]);
+   iseed = (IDL_LONG *)argv[5];
+   nputval = *((IDL_LONG *)argv[6]);
+   putval = (IDL_LONG *)argv[7];
+   qdiag = (*((IDL_LONG *)argv[8]) != 0);
+   npix = (IDL_LONG *)argv[9];
+
+   stack.list = NULL;
+   stack.n = 0;
+   stack.nalloc = 0;
+
+   npad = nx * ny;
+   nstart = (nseed > 0) ? nseed : npad;
+   objid = 1;
+   for (istart=0; istart < nstart; istart++) {
+      iloc = (nseed > 0) ? iseed[istart] : istart;
+      if (iloc < 0 || iloc >= npad) continue;
+      if (image[iloc] == 0 || mask[iloc] != 0) continue;
+
+      if (nputval > 0) {
+         objid = (nseed > 0 && istart < nputval) ? putval[istart]
+          : putval[(nseed > 0) ? nputval-1 : 0];
+      }
+      /* Filling with 0 would never end */
+      if (objid <= 0) continue;
+
+      nadd = grow_fill(nx, image, mask, iloc, objid, qdiag, &stack);
+      npix[retval++] = nadd;
+      if (nputval == 0) objid++;
+   }
+
+   if (stack.list != NULL) free(stack.list);
+
+   return retval;
+}
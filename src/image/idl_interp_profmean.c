@@ -3,23 +3,14 @@
 #include <stdlib.h>
 #include "ph.h"
 
-#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
-static void free_memory()
-{
-}
-
-int init_interp_profmean(int in_nprof, float *in_profmean,
-                          float *profradius, int in_nrad, float *maxradius, 
-                          float in_rscale, float in_pmscale);
-float interp_prof(float radius);
-
 /********************************************************************/
 IDL_LONG idl_interp_profmean(int      argc,
                              void *   argv[])
 {
-	IDL_LONG nprof, nrad; 
+	IDL_LONG nprof, nrad;
   float *profmean, *profradius, *maxradius, rscale, pmscale,radius,*value;
-	
+	interp_profmean_work *work;
+
 	IDL_LONG i;
 	IDL_LONG retval=1;
 
@@ -34,16 +25,50 @@ IDL_LONG idl_interp_profmean(int      argc,
 	maxradius=((float *)argv[i]); i++;
   radius=*(float *)argv[i]; i++;
 	value=((float *)argv[i]); i++;
-	
+
 	/* 1. run the fitting routine */
-	retval=(IDL_LONG) init_interp_profmean(nprof,profmean,profradius, 
-                                         nrad,maxradius,rscale,pmscale);
-  *value=interp_prof(radius) ;
-    
+	work=interp_profmean_alloc(nrad);
+	retval=(IDL_LONG) interp_profmean_init(work,nprof,profmean,profradius,
+                                         maxradius,rscale,pmscale);
+  *value=interp_profmean_value(work,radius);
+
 	/* 2. free memory and leave */
-	free_memory();
+	interp_profmean_free(work);
 	return retval;
 }
 
-/***************************************************************************/
+/********************************************************************/
+IDL_LONG idl_interp_profmean_batch(int      argc,
+                                   void *   argv[])
+{
+	IDL_LONG nobj, nrad, nradius, qshared;
+	int *nprof;
+  float *profmean, *profradius, *maxradius, rscale, pmscale, *radius, *value;
+
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	nobj=*((int *)argv[i]); i++;
+	nprof=((int *)argv[i]); i++;
+	profmean=((float *)argv[i]); i++;
+	profradius=((float *)argv[i]); i++;
+	nrad=*((int *)argv[i]); i++;
+	pmscale=*(float *)argv[i]; i++;
+	rscale=*(float *)argv[i]; i++;
+	maxradius=((float *)argv[i]); i++;
+	nradius=*((int *)argv[i]); i++;
+	qshared=*((int *)argv[i]); i++;
+	radius=((float *)argv[i]); i++;
+	value=((float *)argv[i]); i++;
 
+	/* 1. interpolate all the profiles */
+	retval=(IDL_LONG) interp_profmean_batch(nobj,nprof,profmean,profradius,
+                                          nrad,rscale,pmscale,maxradius,
+                                          nradius,qshared,radius,value);
+
+	return retval;
+}
+
+/***************************************************************************/
@@ -28,7 +28,7 @@ IDL_LONG idl_photfrac (int      argc,
 	ycen=*((int *)argv[i]); i++;
 	
 	/* 1. run the fitting routine */
-	retval=(IDL_LONG) photfrac(xnpix,ynpix,radius,frac,xcen,ycen);
+	retval=(IDL_LONG) photfrac_threaded(xnpix,ynpix,radius,frac,xcen,ycen);
 	
 	/* 2. free memory and leave */
 	free_memory();
@@ -37,3 +37,45 @@ IDL_LONG idl_photfrac (int      argc,
 
 /***************************************************************************/
 
+/********************************************************************/
+/* as idl_photfrac, but with FLOAT xcen and ycen, using the tables in
+   photfrac_cache.c */
+IDL_LONG idl_photfrac_cached (int      argc,
+                              void *   argv[])
+{
+	IDL_LONG xnpix,ynpix;
+	float *frac,radius,xcen,ycen;
+	
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	xnpix=*((int *)argv[i]); i++;
+	ynpix=*((int *)argv[i]); i++;
+	radius=*((float *)argv[i]); i++;
+	frac=(float *)argv[i]; i++;
+	xcen=*((float *)argv[i]); i++;
+	ycen=*((float *)argv[i]); i++;
+	
+	/* 1. look up the fractions */
+	retval=(IDL_LONG) photfrac_cached(xnpix,ynpix,radius,frac,xcen,ycen);
+
+	/* 2. keep any new nodes on disk */
+	photfrac_cache_save();
+	
+	return retval;
+}
+
+/***************************************************************************/
+
+/********************************************************************/
+/* release the tables of photfrac_cache.c, saving any new nodes */
+IDL_LONG idl_photfrac_cache_free (int      argc,
+                                  void *   argv[])
+{
+	photfrac_cache_free();
+	return 1;
+}
+
+/***************************************************************************/
@@ -11,6 +11,10 @@ static void free_memory()
 int reject_cr_psf(float *image, float *image_ivar, int xnpix, int ynpix,
                   float nsig, float *psfvals, float cfudge, float c2fudge,
                   int *rejected, int *ignoremask);
+int reject_cr_psf_iterate(float *image, float *image_ivar, int xnpix, 
+                          int ynpix, float nsig, float *psfvals, float cfudge,
+                          float c2fudge, int *rejected, int *ignoremask,
+                          int niter);
 
 /********************************************************************/
 IDL_LONG idl_reject_cr_psf(int      argc,
@@ -48,3 +52,41 @@ IDL_LONG idl_reject_cr_psf(int      argc,
 
 /***************************************************************************/
 
+
+/********************************************************************/
+/* as idl_reject_cr_psf, followed by niter passes over the neighbors of
+   rejected pixels (until no more are found if niter<0), as reject_cr.pro */
+IDL_LONG idl_reject_cr(int      argc,
+                       void *   argv[])
+{
+	IDL_LONG i;
+	IDL_LONG retval=1;
+
+  float *image, *image_ivar, nsig, *psfvals, cfudge, c2fudge;
+  IDL_LONG *rejected, *ignoremask;
+  IDL_LONG xnpix, ynpix, niter;
+
+	/* 0. allocate pointers from IDL */
+	i=0;
+	image=((float *)argv[i]); i++;
+	image_ivar=((float *)argv[i]); i++;
+	xnpix=*((IDL_LONG *)argv[i]); i++;
+	ynpix=*((IDL_LONG *)argv[i]); i++;
+	nsig=*(float *)argv[i]; i++;
+	psfvals=(float *)argv[i]; i++;
+	cfudge=*((float *)argv[i]); i++;
+  c2fudge=*(float *)argv[i]; i++;
+	rejected=((IDL_LONG *)argv[i]); i++;
+	ignoremask=((IDL_LONG *)argv[i]); i++;
+	niter=*((IDL_LONG *)argv[i]); i++;
+	
+	/* 1. run the rejection */
+	retval=(IDL_LONG) reject_cr_psf_iterate(image,image_ivar,(int) xnpix,
+                                          (int) ynpix,nsig,psfvals,cfudge,
+                                          c2fudge,(int *)rejected, 
+                                          (int *)ignoremask,(int) niter);
+  
+	return retval;
+}
+
+/***************************************************************************/
@@ -1,116 +1,279 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include "ph.h"
+#include "idlutils_threads.h"
 
 /* Interpolate a profmean radial profile */
 
+/*
+ * The cumulative flux within each annulus radius is interpolated by a
+ * spline (p_tautsp) in asinh(radius/rscale), asinh(flux/pmscale).  All
+ * the state for one profile is in an interp_profmean_work, so any number
+ * of threads may each interpolate their own objects;
+ * interp_profmean_batch() does so for many objects at once.
+ * init_interp_profmean() and interp_prof() keep one work of their own
+ * for single profiles.
+ */
+
 #define GAMMA 2.5
 #define PI 3.14159265358979
 
-/* interpolation info */
-static int nprof;
-static float gmma=GAMMA, *brek=NULL, *s=NULL, *coef=NULL;
-static int ltaut, ktaut, iflag, jderiv;
+/* objects handed to a thread at a time */
+#define INTERP_PROFMEAN_CHUNK 64
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+struct interp_profmean_work_struct {
+  int nrad;             /* annuli allocated for */
+  int npts;             /* points in the spline; 0 if no profile */
+  int ok;               /* 0 if the spline could not be made */
+  float rscale,pmscale;
+  float *radius;        /* [nrad+1] radii, from 0 */
+  float *aaradius;      /* [nrad+1] asinh(radius/rscale) */
+  float *profcum;       /* [nrad+1] cumulative flux */
+  float *aaprofcum;     /* [nrad+1] asinh(profcum/pmscale) */
+  float *s;             /* [nrad+1,6] p_tautsp workspace */
+  float *brek;          /* [2*nrad+1] breakpoints */
+  float *coef;          /* [4,2*nrad] coefficients */
+  int ltaut,ktaut;
+  int ilo;              /* last interval found by p_ppvalu */
+};
+
+typedef struct {
+  int nobj;
+  int *nprof;
+  float *profmean;
+  float *profradius;
+  int nrad;
+  float rscale,pmscale;
+  float *maxradius;
+  int nradius;
+  int qshared;
+  float *radius;
+  float *value;
+  idlutils_queue queue;
+} interp_profmean_job;
+
+static interp_profmean_work *p_work=NULL;
+
+/********************************************************************/
+interp_profmean_work *interp_profmean_alloc(int nrad)
+{
+  interp_profmean_work *work;
+  int n;
+
+  if(nrad<0) nrad=0;
+  n=nrad+1;
+  work=(interp_profmean_work *) malloc(sizeof(interp_profmean_work));
+  work->nrad=nrad;
+  work->npts=0;
+  work->ok=1;
+  work->radius=(float *) malloc(n*sizeof(float));
+  work->aaradius=(float *) malloc(n*sizeof(float));
+  work->profcum=(float *) malloc(n*sizeof(float));
+  work->aaprofcum=(float *) malloc(n*sizeof(float));
+  work->s=(float *) malloc(6*n*sizeof(float));
+  work->brek=(float *) malloc(2*n*sizeof(float));
+  work->coef=(float *) malloc(8*n*sizeof(float));
+  work->ilo=1;
+  return(work);
+} /* end interp_profmean_alloc */
+
+/********************************************************************/
+void interp_profmean_free(interp_profmean_work *work)
+{
+  if(work==NULL) return;
+  FREEVEC(work->radius);
+  FREEVEC(work->aaradius);
+  FREEVEC(work->profcum);
+  FREEVEC(work->aaprofcum);
+  FREEVEC(work->s);
+  FREEVEC(work->brek);
+  FREEVEC(work->coef);
+  free((char *) work);
+} /* end interp_profmean_free */
+
+/********************************************************************/
+/* sets up the interpolation of one profile of nprof annuli, of at most
+   work->nrad; returns 0 if the radii do not increase */
+int interp_profmean_init(interp_profmean_work *work,
+                         int nprof,
+                         float *profmean,
+                         float *profradius,
+                         float *maxradius,
+                         float rscale,
+                         float pmscale)
+{
+  int i,j,n;
+
+  work->rscale=rscale;
+  work->pmscale=pmscale;
+  work->npts=0;
+  work->ok=1;
+  work->ilo=1;
+  if(nprof>work->nrad) nprof=work->nrad;
+
+  /* if no profile exists, flux is necessarily zero */
+  if(nprof<=0) {
+    (*maxradius)=0.;
+    return(1);
+  }
+
+  /* radii from the center; asinh for interpolation */
+  work->radius[0]=work->aaradius[0]=0.;
+  for(i=1;i<=nprof;i++) {
+    work->radius[i]=profradius[i-1];
+    work->aaradius[i]=asinh(work->radius[i]/rscale);
+  } /* end for i */
+
+  /* return maximum radius to look at */
+  (*maxradius)=work->radius[nprof];
 
-float ppvalu_(float *brek, float *coef, int *l, int *k,
-							 float *x, int *jderiv);
-void tautsp_(float r[], float f[], int *n, float *gmma,
-						 float *s, float *brek, float *coef, int *l,
-						 int *k, int *iflag);
+  /* create cumulative profile */
+  n=nprof+1;
+  work->profcum[0]=0.;
+  for(j=1;j<n;j++)
+    work->profcum[j]=work->profcum[j-1]+PI*profmean[j-1]
+      *(work->radius[j]*work->radius[j]-work->radius[j-1]*work->radius[j-1]);
+  for(j=0;j<n;j++)
+    work->aaprofcum[j]=asinh(work->profcum[j]/pmscale);
+  work->npts=n;
 
-/* radii of annuli for radial profile */
-static int nrad;
-static float rscale,pmscale;
-static float *radius=NULL;
-static float *aaradius=NULL;
+  if(n>=4) {
+    /* create spline */
+    if(p_tautsp(work->aaradius, work->aaprofcum, n, GAMMA, work->s,
+                work->brek, work->coef, &(work->ltaut), &(work->ktaut))!=1)
+      work->ok=0;
+  } else {
+    /* too few points for the spline; join them with straight lines */
+    for(j=0;j<n-1;j++) {
+      if(!(work->aaradius[j+1]>work->aaradius[j])) work->ok=0;
+      work->brek[j]=work->aaradius[j];
+      work->coef[4*j]=work->aaprofcum[j];
+      work->coef[4*j+1]=(work->aaprofcum[j+1]-work->aaprofcum[j])/
+        (work->aaradius[j+1]-work->aaradius[j]);
+      work->coef[4*j+2]=work->coef[4*j+3]=0.;
+    }
+    work->brek[n-1]=work->aaradius[n-1];
+    work->ltaut=n-1;
+    work->ktaut=4;
+  }
 
-static float *profmean=NULL;
-static float *profcum=NULL;
-static float *aaprofcum=NULL;
+  return(work->ok);
+} /* end interp_profmean_init */
 
+/********************************************************************/
+/* returns cumulative maggies within radius */
+float interp_profmean_value(interp_profmean_work *work, float radius)
+{
+  float val,ar;
+
+  if(work->npts==0) return(0.);
+  if(!work->ok) return(NAN);
+  ar=asinh(radius/work->rscale);
+  val=p_ppvalu(work->brek, work->coef, work->ltaut, work->ktaut, ar, 0,
+               &(work->ilo));
+  val=work->pmscale*sinh(val);
+  return(val);
+} /* end interp_profmean_value */
+
+/********************************************************************/
+static void interp_profmean_objects(void *arg, int ithread, int nthreads)
+{
+  interp_profmean_job *job=(interp_profmean_job *) arg;
+  interp_profmean_work *work;
+  float *radius,*value;
+  long lo,hi,iobj;
+  int j;
+
+  work=interp_profmean_alloc(job->nrad);
+  while(idlutils_queue_next(&(job->queue), &lo, &hi)) {
+    for(iobj=lo;iobj<hi;iobj++) {
+      interp_profmean_init(work, job->nprof[iobj],
+                           job->profmean+iobj*job->nrad, job->profradius,
+                           job->maxradius+iobj, job->rscale, job->pmscale);
+      radius=job->qshared ? job->radius : job->radius+iobj*job->nradius;
+      value=job->value+iobj*job->nradius;
+      for(j=0;j<job->nradius;j++)
+        value[j]=interp_profmean_value(work, radius[j]);
+    }
+  }
+  interp_profmean_free(work);
+} /* end interp_profmean_objects */
+
+/********************************************************************/
+/* interpolates the profiles profmean[nobj][nrad] of nobj objects, each
+   with nprof[iobj] annuli, to the radii radius[nradius] (if qshared) or
+   radius[nobj][nradius], putting the cumulative maggies in
+   value[nobj][nradius] and the outer radius in maxradius[nobj];
+   objects are done in parallel, each thread with its own workspace */
+int interp_profmean_batch(int nobj,
+                          int *nprof,
+                          float *profmean,
+                          float *profradius,
+                          int nrad,
+                          float rscale,
+                          float pmscale,
+                          float *maxradius,
+                          int nradius,
+                          int qshared,
+                          float *radius,
+                          float *value)
+{
+  interp_profmean_job job;
+
+  if(nobj<=0) return(1);
+
+  job.nobj=nobj;
+  job.nprof=nprof;
+  job.profmean=profmean;
+  job.profradius=profradius;
+  job.nrad=nrad;
+  job.rscale=rscale;
+  job.pmscale=pmscale;
+  job.maxradius=maxradius;
+  job.nradius=nradius;
+  job.qshared=qshared;
+  job.radius=radius;
+  job.value=value;
+  idlutils_queue_init(&(job.queue), nobj, INTERP_PROFMEAN_CHUNK);
+  idlutils_run(idlutils_nthreads(nobj/INTERP_PROFMEAN_CHUNK+1),
+               interp_profmean_objects, &job);
+  idlutils_queue_free(&(job.queue));
+
+  return(1);
+} /* end interp_profmean_batch */
+
+/********************************************************************/
 /* sets up profile interpolation */
 int init_interp_profmean(int in_nprof,
-                          float *in_profmean,
-                          float *profradius,
-                          int in_nrad,
-                          float *maxradius, 
-                          float in_rscale, 
-                          float in_pmscale)
+                         float *in_profmean,
+                         float *profradius,
+                         int in_nrad,
+                         float *maxradius,
+                         float in_rscale,
+                         float in_pmscale)
 {
-	int i,j,initialized_profinterp;
-
-	/* initialize some variables if necessary */
-  rscale=in_rscale;
-  pmscale=in_pmscale;
-	nprof=in_nprof;
-	nrad=in_nrad;
-  initialized_profinterp=0;
-	if(!initialized_profinterp) {
-    radius=(float *) malloc((nrad+4)*sizeof(float));
-    aaradius=(float *) malloc((nrad+4)*sizeof(float));
-    profmean=(float *) malloc((nrad+4)*sizeof(float));
-    profcum=(float *) malloc((nrad+4)*sizeof(float));
-    aaprofcum=(float *) malloc((nrad+4)*sizeof(float));
-		/* put radius in arcsec; asinh for interpolation later */
-    radius[0]=aaradius[0]=0.;
-		for(i=1;i<=nrad;i++) {
-			radius[i]=profradius[i-1];
-			aaradius[i]=asinh(radius[i]/rscale);
-		} /* end for i */
-		
-		/* allocate some memory */
-		s=(float *) malloc((nrad)*6*sizeof(float));
-		brek=(float *) malloc(4*(nrad)*sizeof(float));
-		coef=(float *) malloc((nrad)*4*(nrad)*sizeof(float));
-		initialized_profinterp=1;
-	} /* end if */
-	
-	if(nprof<=0) {  /* if no profile exists, flux is necessarily zero */
-		(*maxradius)=0.;
-	} else {  /* else we do the interpolation */
-		
-		/* copy profile */
-		for(j=0;j<nprof;j++) 
-			profmean[j]=in_profmean[j];
-		for(j=nprof;j<nrad+4;j++) 
-			profmean[j]=0.;
-    
-		/* return maximum radius to look at */
-		(*maxradius)=radius[nprof]; 
-    
-		/* make sure extrapolation is zero */
-		for(j=nprof;j<nprof+1;j++)
-			profmean[j]=0.;
-		nprof+=1;
-		
-		/* create cumulative profile */
-		profcum[0]=0.;
-		for(j=1;j<nprof;j++) 
-			profcum[j]=profcum[j-1]+PI*profmean[j-1]
-				*(radius[j]*radius[j]-radius[j-1]*radius[j-1]);
-		for(j=0;j<nprof;j++) 
-      aaprofcum[j]=asinh(profcum[j]/pmscale);
-		
-		/* create spline */
-		ktaut=nprof;
-		ltaut=4*nprof;
-		tautsp_(aaradius,aaprofcum,&nprof,&gmma,s,
-						brek,coef,&ltaut,&ktaut,&iflag);
-	} /* end if */
+  /* keep the workspace between calls, unless it is too small */
+  if(p_work!=NULL && p_work->nrad<in_nrad) {
+    interp_profmean_free(p_work);
+    p_work=NULL;
+  }
+  if(p_work==NULL) p_work=interp_profmean_alloc(in_nrad);
+
+  interp_profmean_init(p_work, in_nprof<in_nrad ? in_nprof : in_nrad,
+                       in_profmean, profradius, maxradius, in_rscale,
+                       in_pmscale);
 
   return(1);
-} /* end initProfInterp */
+} /* end init_interp_profmean */
 
+/********************************************************************/
 /* returns cumulative maggies */
-float interp_prof(float radius) 
+float interp_prof(float radius)
 {
-	float val,ar;
-	
-	if(nprof==0) return(0.);
-	jderiv=0;
-	ar=asinh(radius/rscale);
-	val=ppvalu_(brek,coef,&ltaut,&ktaut,&ar,&jderiv);
-  val=pmscale*sinh(val);
-	return(val);
-} /* end flux */
-
+  if(p_work==NULL) return(0.);
+  return(interp_profmean_value(p_work, radius));
+} /* end interp_prof */
@@ -2,16 +2,18 @@
 #include <stdio.h>
 #include <math.h>
 #include "ph.h"
-#define FUNC(x) ((*func)(x))
+#define FUNC(x) ((*func)(x,params))
 
-float p_midpnt(float (*func)(float), float a, float b, int n)
+/* the running estimate is kept in *s between calls with successive n,
+   rather than in a static, so that integrations can run concurrently */
+float p_midpnt(float (*func)(float, void *), void *params, float a, float b,
+							 int n, float *s)
 {
 	float x,tnm,sum,del,ddel;
-	static float s;
 	int it,j;
 
 	if (n == 1) {
-		return (s=(b-a)*FUNC(0.5*(a+b)));
+		return (*s=(b-a)*FUNC(0.5*(a+b)));
 	} else {
 		for(it=1,j=1;j<n-1;j++) it *= 3;
 		tnm=it;
@@ -25,8 +27,8 @@ float p_midpnt(float (*func)(float), float a, float b, int n)
 			sum += FUNC(x);
 			x += del;
 		}
-		s=(s+(b-a)*sum/(float)tnm)/3.0;
-		return s;
+		*s=(*s+(b-a)*sum/(float)tnm)/3.0;
+		return *s;
 	}
 }
 #undef FUNC
@@ -0,0 +1,107 @@
+#include <math.h>
+#include "ph.h"
+
+/*
+ * Value at x of the jderiv-th derivative of a piecewise polynomial in the
+ * form made by p_tautsp(); ppvalu and interv from de Boor's "A Practical
+ * Guide to Splines", translated from the Fortran.  The interval found
+ * last is kept in *ilo (1-indexed; start it at 1) rather than in a static,
+ * so each caller, and each thread, keeps its own.
+ */
+
+#define XT(i) xt[(i)-1]
+
+/* left = max(i: xt(i) < xt(lxt) and xt(i) <= x), 1-indexed */
+static void p_interv(float *xt, int lxt, float x, int *left, int *ilo)
+{
+	int ihi,istep,middle;
+
+	if((*ilo)<1) (*ilo)=1;
+	ihi=(*ilo)+1;
+	if(ihi>=lxt) {
+		if(x>=XT(lxt)) goto last;
+		if(lxt<=1) goto first;
+		(*ilo)=lxt-1;
+		ihi=lxt;
+	}
+
+	if(x>=XT(ihi)) {
+		/* increase ihi to capture x */
+		istep=1;
+		for(;;) {
+			(*ilo)=ihi;
+			ihi=(*ilo)+istep;
+			if(ihi>=lxt) break;
+			if(x<XT(ihi)) goto narrow;
+			istep*=2;
+		}
+		if(x>=XT(lxt)) goto last;
+		ihi=lxt;
+	} else if(x>=XT(*ilo)) {
+		(*left)=(*ilo);
+		return;
+	} else {
+		/* decrease ilo to capture x */
+		istep=1;
+		for(;;) {
+			ihi=(*ilo);
+			(*ilo)=ihi-istep;
+			if((*ilo)<=1) break;
+			if(x>=XT(*ilo)) goto narrow;
+			istep*=2;
+		}
+		(*ilo)=1;
+		if(x<XT(1)) goto first;
+	}
+
+	/* now xt(ilo) <= x < xt(ihi); narrow the interval */
+ narrow:
+	for(;;) {
+		middle=((*ilo)+ihi)/2;
+		if(middle==(*ilo)) break;
+		if(x<XT(middle))
+			ihi=middle;
+		else
+			(*ilo)=middle;
+	}
+	(*left)=(*ilo);
+	return;
+
+ first:
+	(*left)=1;
+	return;
+
+ last:
+	(*left)=lxt;
+	while((*left)>1) {
+		(*left)--;
+		if(XT(*left)<XT(lxt)) return;
+	}
+}
+
+#undef XT
+
+float p_ppvalu(float *brek, float *coef, int l, int k, float x, int jderiv,
+							 int *ilo)
+{
+	int i,m;
+	float fmmjdr,h,value;
+
+	value=0.;
+	fmmjdr=k-jderiv;
+	/* derivatives of order k or higher are identically zero */
+	if(fmmjdr<=0.) return(value);
+
+	/* index i of the largest breakpoint to the left of x */
+	p_interv(brek, l+1, x, &i, ilo);
+
+	/* evaluate the jderiv-th derivative of the i-th piece at x */
+	h=x-brek[i-1];
+	m=k;
+	do {
+		value=(value/fmmjdr)*h+coef[(i-1)*k+m-1];
+		m--;
+		fmmjdr-=1.;
+	} while(fmmjdr>0.);
+	return(value);
+}
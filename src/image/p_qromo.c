@@ -8,15 +8,16 @@
 #define JMAXP (JMAX+1)
 #define K 5
 
-float p_qromo(float (*func)(float), float a, float b,
-							 float (*choose)(float(*)(float), float, float, int))
+float p_qromo(float (*func)(float, void *), void *params, float a, float b,
+							 float (*choose)(float(*)(float, void *), void *, float, float, 
+															 int, float *))
 {
 	int j;
-	float ss,dss,h[JMAXP+1],s[JMAXP+1];
+	float ss,dss,h[JMAXP+1],s[JMAXP+1],state;
 
 	h[1]=1.0;
 	for (j=1;j<=JMAX;j++) {
-		s[j]=(*choose)(func,a,b,j);
+		s[j]=(*choose)(func,params,a,b,j,&state);
 		if (j >= K) {
 			p_polint(&h[j-K],&s[j-K],K,0.0,&ss,&dss);
 			if (fabs(dss) < EPS*fabs(ss) || ss<EPS) return ss;
@@ -0,0 +1,240 @@
+#include <math.h>
+#include "ph.h"
+
+/*
+ * Cubic spline interpolant to tau[i], gtau[i], i=0..ntau-1, with knots
+ * added where needed to avoid extraneous inflection points; tautsp from
+ * de Boor's "A Practical Guide to Splines", translated from the Fortran.
+ * The workspace s is [ntau,6]; brek gets up to 2*ntau-1 breakpoints and
+ * coef [4,2*ntau-2] coefficients.  Returns 1 if ok, or 2 if there are
+ * fewer than 4 points or tau is not strictly increasing.
+ */
+
+#define S(i,j) s[((j)-1)*ntau+(i)-1]
+#define TAU(i) tau[(i)-1]
+#define GTAU(i) gtau[(i)-1]
+#define BREK(i) brek[(i)-1]
+#define COEF(i,j) coef[((j)-1)*4+(i)-1]
+#define MIN1(a) ((a)<1.f ? (a) : 1.f)
+
+int p_tautsp(float *tau, float *gtau, int ntau, float gamma, float *s,
+						 float *brek, float *coef, int *l, int *k)
+{
+	int i,method,ntaum1,ll;
+	float alpha=0.,c,d,del,denom,divdif,entry,entry3=0.,factor=0.,factr2,gam;
+	float onemg3,onemzt=0.,ratio=0.,sixth,temp,z=.5,zeta=0.,zt2=0.;
+
+	/* there must be at least 4 interpolation points */
+	if(ntau<4) return(2);
+
+	/* delta tau and first and second divided differences of the data */
+	ntaum1=ntau-1;
+	for(i=1;i<=ntaum1;i++) {
+		S(i,1)=TAU(i+1)-TAU(i);
+		if(!(S(i,1)>0.f)) return(2);
+		S(i+1,4)=(GTAU(i+1)-GTAU(i))/S(i,1);
+	}
+	for(i=2;i<=ntaum1;i++)
+		S(i,4)=S(i+1,4)-S(i,4);
+
+	/* system of equations for the second derivatives at tau: one
+		 continuity equation at each interior point, plus one more at the
+		 first and the last interior point */
+	i=2;
+	S(2,2)=S(1,1)/3.f;
+	sixth=1.f/6.f;
+	method=2;
+	gam=gamma;
+	if(gam<=0.f) method=1;
+	if(gam>3.f) {
+		method=3;
+		gam=gam-3.f;
+	}
+	onemg3=1.f-gam/3.f;
+
+	for(;;) {
+		/* z(i) and zeta(i) */
+		z=.5f;
+		if(method==3 || (method==2 && !(S(i,4)*S(i+1,4)<0.f))) {
+			temp=fabs(S(i+1,4));
+			denom=fabs(S(i,4))+temp;
+			if(denom!=0.f) {
+				z=temp/denom;
+				if(fabs(z-.5f)<=sixth) z=.5f;
+			}
+		}
+		S(i,5)=z;
+
+		/* the part of the i-th equation which depends on the i-th interval */
+		if(z<.5f) {
+			zeta=gam*z;
+			onemzt=1.f-zeta;
+			zt2=zeta*zeta;
+			alpha=MIN1(onemg3/onemzt);
+			factor=zeta/(alpha*(zt2-1.f)+1.f);
+			S(i,6)=zeta*factor/6.f;
+			S(i,2)=S(i,2)+S(i,1)*((1.f-alpha*onemzt)*factor/2.f-S(i,6));
+			/* ensure a nonzero pivot when z=0 follows z=1 */
+			if(S(i,2)<=0.f) S(i,2)=1.f;
+			S(i,3)=S(i,1)/6.f;
+		} else if(z==.5f) {
+			S(i,2)=S(i,2)+S(i,1)/3.f;
+			S(i,3)=S(i,1)/6.f;
+		} else {
+			onemzt=gam*(1.f-z);
+			zeta=1.f-onemzt;
+			alpha=MIN1(onemg3/zeta);
+			factor=onemzt/(1.f-alpha*zeta*(1.f+onemzt));
+			S(i,6)=onemzt*factor/6.f;
+			S(i,2)=S(i,2)+S(i,1)/3.f;
+			S(i,3)=S(i,6)*S(i,1);
+		}
+
+		if(i==2) {
+			/* the first two equations enforce continuity of the first and
+				 of the third derivative across tau(2) */
+			S(1,5)=.5f;
+			S(1,2)=S(1,1)/6.f;
+			S(1,3)=S(2,2);
+			entry3=S(2,3);
+			if(z<.5f) {
+				factr2=zeta*(alpha*(zt2-1.f)+1.f)/(alpha*(zeta*zt2-1.f)+1.f);
+				ratio=factr2*S(2,1)/S(1,2);
+				S(2,2)=factr2*S(2,1)+S(1,1);
+				S(2,3)=-factr2*S(1,1);
+			} else if(z==.5f) {
+				ratio=S(2,1)/S(1,2);
+				S(2,2)=S(2,1)+S(1,1);
+				S(2,3)=-S(1,1);
+			} else {
+				ratio=S(2,1)/S(1,2);
+				S(2,2)=S(2,1)+S(1,1);
+				S(2,3)=-S(1,1)*6.f*alpha*S(2,6);
+			}
+			/* eliminate the first unknown from the second equation */
+			S(2,2)=ratio*S(1,3)+S(2,2);
+			S(2,3)=ratio*entry3+S(2,3);
+			S(1,4)=S(2,4);
+			S(2,4)=ratio*S(1,4);
+		} else {
+			/* eliminate the (i-1)st unknown from the i-th equation */
+			S(i,2)=ratio*S(i-1,3)+S(i,2);
+			S(i,4)=ratio*S(i-1,4)+S(i,4);
+		}
+
+		/* the part of the next equation which depends on the i-th interval */
+		if(z<.5f) {
+			ratio=-S(i,6)*S(i,1)/S(i,2);
+			S(i+1,2)=S(i,1)/3.f;
+		} else if(z==.5f) {
+			ratio=-(S(i,1)/6.f)/S(i,2);
+			S(i+1,2)=S(i,1)/3.f;
+		} else {
+			ratio=-(S(i,1)/6.f)/S(i,2);
+			S(i+1,2)=S(i,1)*((1.f-zeta*alpha)*factor/2.f-S(i,6));
+		}
+
+		i++;
+		if(i>=ntaum1) break;
+	}
+	S(i,5)=.5f;
+
+	/* the last two equations enforce continuity of the third and of the
+		 first derivative across tau(ntau-1) */
+	entry=ratio*S(i-1,3)+S(i,2)+S(i,1)/3.f;
+	S(i+1,2)=S(i,1)/6.f;
+	S(i+1,4)=ratio*S(i-1,4)+S(i,4);
+	if(z<.5f) {
+		ratio=S(i,1)*6.f*S(i-1,6)*alpha/S(i-1,2);
+		S(i,2)=ratio*S(i-1,3)+S(i,1)+S(i-1,1);
+		S(i,3)=-S(i-1,1);
+	} else if(z==.5f) {
+		ratio=S(i,1)/S(i-1,2);
+		S(i,2)=ratio*S(i-1,3)+S(i,1)+S(i-1,1);
+		S(i,3)=-S(i-1,1);
+	} else {
+		factr2=onemzt*(alpha*(onemzt*onemzt-1.f)+1.f)/
+			(alpha*(onemzt*onemzt*onemzt-1.f)+1.f);
+		ratio=factr2*S(i,1)/S(i-1,2);
+		S(i,2)=ratio*S(i-1,3)+factr2*S(i-1,1)+S(i,1);
+		S(i,3)=-factr2*S(i-1,1);
+	}
+	/* eliminate x(i) from the last equation */
+	S(i,4)=ratio*S(i-1,4);
+	ratio=-entry/S(i,2);
+	S(i+1,2)=ratio*S(i,3)+S(i+1,2);
+	S(i+1,4)=ratio*S(i,4)+S(i+1,4);
+
+	/* back substitution */
+	S(ntau,4)=S(ntau,4)/S(ntau,2);
+	do {
+		S(i,4)=(S(i,4)-S(i,3)*S(i+1,4))/S(i,2);
+		i--;
+	} while(i>1);
+	S(1,4)=(S(1,4)-S(1,3)*S(2,4)-entry3*S(3,4))/S(1,2);
+
+	/* polynomial pieces */
+	BREK(1)=TAU(1);
+	ll=1;
+	for(i=1;i<=ntaum1;i++) {
+		COEF(1,ll)=GTAU(i);
+		COEF(3,ll)=S(i,4);
+		divdif=(GTAU(i+1)-GTAU(i))/S(i,1);
+		z=S(i,5);
+		if(z<.5f && z!=0.f) {
+			zeta=gam*z;
+			onemzt=1.f-zeta;
+			c=S(i+1,4)/6.f;
+			d=S(i,4)*S(i,6);
+			ll++;
+			del=zeta*S(i,1);
+			BREK(ll)=TAU(i)+del;
+			zt2=zeta*zeta;
+			alpha=MIN1(onemg3/onemzt);
+			factor=onemzt*onemzt*alpha;
+			COEF(1,ll)=GTAU(i)+divdif*del
+				+S(i,1)*S(i,1)*(d*onemzt*(factor-1.f)+c*zeta*(zt2-1.f));
+			COEF(2,ll)=divdif+S(i,1)*(d*(1.f-3.f*factor)+c*(3.f*zt2-1.f));
+			COEF(3,ll)=6.f*(d*alpha*onemzt+c*zeta);
+			COEF(4,ll)=6.f*(c-d*alpha)/S(i,1);
+			COEF(4,ll-1)=COEF(4,ll)-6.f*d*(1.f-alpha)/(del*zt2);
+			COEF(2,ll-1)=COEF(2,ll)-del*(COEF(3,ll)-(del/2.f)*COEF(4,ll-1));
+		} else if(z==.5f) {
+			COEF(2,ll)=divdif-S(i,1)*(2.f*S(i,4)+S(i+1,4))/6.f;
+			COEF(4,ll)=(S(i+1,4)-S(i,4))/S(i,1);
+		} else if(z>.5f && gam*(1.f-z)!=0.f) {
+			onemzt=gam*(1.f-z);
+			zeta=1.f-onemzt;
+			alpha=MIN1(onemg3/zeta);
+			c=S(i+1,4)*S(i,6);
+			d=S(i,4)/6.f;
+			del=zeta*S(i,1);
+			BREK(ll+1)=TAU(i)+del;
+			COEF(2,ll)=divdif-S(i,1)*(2.f*d+c);
+			COEF(4,ll)=6.f*(c*alpha-d)/S(i,1);
+			ll++;
+			COEF(4,ll)=COEF(4,ll-1)+6.f*(1.f-alpha)*c/(S(i,1)*onemzt*onemzt*onemzt);
+			COEF(3,ll)=COEF(3,ll-1)+del*COEF(4,ll-1);
+			COEF(2,ll)=COEF(2,ll-1)+del*(COEF(3,ll-1)+(del/2.f)*COEF(4,ll-1));
+			COEF(1,ll)=COEF(1,ll-1)+del*(COEF(2,ll-1)+(del/2.f)*(COEF(3,ll-1)
+																										+(del/3.f)*COEF(4,ll-1)));
+		} else {
+			/* z is 0 or 1: a straight line */
+			COEF(2,ll)=divdif;
+			COEF(3,ll)=0.f;
+			COEF(4,ll)=0.f;
+		}
+		ll++;
+		BREK(ll)=TAU(i+1);
+	}
+	*l=ll-1;
+	*k=4;
+	return(1);
+}
+
+#undef S
+#undef TAU
+#undef GTAU
+#undef BREK
+#undef COEF
+#undef MIN1
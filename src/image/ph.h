@@ -1,12 +1,41 @@
 #include "export.h" 
-float p_qromo(float (*func)(float), float a, float b,
-              float (*choose)(float(*)(float), float, float, int));
+float p_qromo(float (*func)(float, void *), void *params, float a, float b,
+              float (*choose)(float(*)(float, void *), void *, float, float, 
+                              int, float *));
 void p_polint(float xa[], float ya[], int n, float x, float *y, 
 							float *dy);
-float p_midpnt(float (*func)(float), float a, float b, int n);
-float p_midinf(float (*func)(float), float a, float b, int n);
+float p_midpnt(float (*func)(float, void *), void *params, float a, float b, 
+               int n, float *s);
+float p_midinf(float (*func)(float, void *), void *params, float a, float b, 
+               int n, float *s);
 void p_free_vector(float *v, long nl, long nh);
 float *p_vector(long nl, long nh);
 void p_cisi(float x, float *ci, float *si);
+float photfrac_value(float radius, float fi, float fj);
 int photfrac(int xnpix, int ynpix, float radius, float *frac, long xcen, 
              long ycen);
+int photfrac_threaded(int xnpix, int ynpix, float radius, float *frac, 
+                      long xcen, long ycen);
+int photfrac_cached(int xnpix, int ynpix, float radius, float *frac, 
+                    float xcen, float ycen);
+void photfrac_cache_save(void);
+void photfrac_cache_free(void);
+int p_tautsp(float *tau, float *gtau, int ntau, float gamma, float *s,
+             float *brek, float *coef, int *l, int *k);
+float p_ppvalu(float *brek, float *coef, int l, int k, float x, int jderiv,
+               int *ilo);
+typedef struct interp_profmean_work_struct interp_profmean_work;
+interp_profmean_work *interp_profmean_alloc(int nrad);
+void interp_profmean_free(interp_profmean_work *work);
+int interp_profmean_init(interp_profmean_work *work, int nprof,
+                         float *profmean, float *profradius,
+                         float *maxradius, float rscale, float pmscale);
+float interp_profmean_value(interp_profmean_work *work, float radius);
+int interp_profmean_batch(int nobj, int *nprof, float *profmean,
+                          float *profradius, int nrad, float rscale,
+                          float pmscale, float *maxradius, int nradius,
+                          int qshared, float *radius, float *value);
+int init_interp_profmean(int in_nprof, float *in_profmean,
+                         float *profradius, int in_nrad, float *maxradius,
+                         float in_rscale, float in_pmscale);
+float interp_prof(float radius);
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <math.h>
 #include "ph.h"
+#include "idlutils_threads.h"
 
 /*
  * photfrac.c
@@ -11,6 +12,10 @@
  * contribute to an aperture of a given size (only
  * return one quadrant).
  *
+ * The integrand gets its parameters through p_qromo and p_midpnt, so
+ * the code is reentrant and photfrac_threaded() integrates pixels in
+ * parallel.
+ *
  * Mike Blanton
  * 8/2003 */
 
@@ -19,17 +24,32 @@
 #define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
 void p_cisi(float x, float *ci, float *si);
 
-static float p_fi, p_fj;
-static float p_radius;
+/* pixels handed to a thread at a time */
+#define PHOTFRAC_CHUNK 16
+
+/* the integrand's parameters, passed through p_qromo and p_midpnt so
+   that any number of integrals can run at once */
+typedef struct {
+  float fi, fj;
+  float radius;
+} photfrac_params;
+
+typedef struct {
+  int xnpix, ynpix;
+  float radius, *frac;
+  long xcen, ycen;
+  idlutils_queue queue;
+} photfrac_work;
 
-float photfrac_func(float x) {
+float photfrac_func(float x, void *params) {
+  photfrac_params *p=(photfrac_params *) params;
   float sincarg,y_int1,y_int2,dum_int,val;
 
-  sincarg=PI*(p_fj+sqrt(p_radius*p_radius-x*x));
+  sincarg=PI*(p->fj+sqrt(p->radius*p->radius-x*x));
   p_cisi(sincarg, &dum_int, &y_int1);
-  sincarg=PI*(p_fj-sqrt(p_radius*p_radius-x*x));
+  sincarg=PI*(p->fj-sqrt(p->radius*p->radius-x*x));
   p_cisi(sincarg, &dum_int, &y_int2);
-  sincarg=PI*(p_fi-x);
+  sincarg=PI*(p->fi-x);
   if(sincarg==0.) 
     val=(y_int1-y_int2)/PI;
   else 
@@ -38,6 +58,19 @@ float photfrac_func(float x) {
   return(val);
 } /* end photfrac_func */
 
+/* fraction for a single pixel offset (fi,fj) from the aperture center */
+float photfrac_value(float radius, 
+                     float fi, 
+                     float fj)
+{
+  photfrac_params p;
+
+  p.radius=radius;
+  p.fi=fi;
+  p.fj=fj;
+  return(p_qromo(photfrac_func, &p, -radius, radius, p_midpnt));
+} /* end photfrac_value */
+
 int photfrac(int xnpix, 
              int ynpix,
              float radius, 
@@ -47,16 +80,56 @@ int photfrac(int xnpix,
 {
   int i,j;
 
-  p_radius=radius;
-
   for(i=0;i<xnpix;i++) {
-    p_fi=(float) (i-xcen);
     for(j=0;j<ynpix;j++) {
-      p_fj=(float) (j-ycen);
       frac[j*xnpix+i]= 
-        p_qromo(photfrac_func, -radius, radius, p_midpnt);
+        photfrac_value(radius, (float) (i-xcen), (float) (j-ycen));
     }
   } /* end for i,j */
 
 	return(1);
 } /* end photfrac */
+
+static void photfrac_pixels(void *arg, int ithread, int nthreads)
+{
+  photfrac_work *w=(photfrac_work *) arg;
+  long lo,hi,k;
+  int i,j;
+
+  while(idlutils_queue_next(&(w->queue), &lo, &hi)) {
+    for(k=lo;k<hi;k++) {
+      i=k%w->xnpix;
+      j=k/w->xnpix;
+      w->frac[k]=photfrac_value(w->radius, (float) (i-w->xcen), 
+                                (float) (j-w->ycen));
+    }
+  }
+} /* end photfrac_pixels */
+
+/* as photfrac(), with the pixels integrated in parallel; each pixel is
+   integrated exactly as by photfrac(), so the results are identical */
+int photfrac_threaded(int xnpix, 
+                      int ynpix,
+                      float radius, 
+                      float *frac, 
+                      long xcen, 
+                      long ycen)
+{
+  photfrac_work w;
+  long npix;
+
+  npix=(long) xnpix*ynpix;
+  if(npix<=0) return(1);
+  w.xnpix=xnpix;
+  w.ynpix=ynpix;
+  w.radius=radius;
+  w.frac=frac;
+  w.xcen=xcen;
+  w.ycen=ycen;
+  idlutils_queue_init(&(w.queue), npix, PHOTFRAC_CHUNK);
+  idlutils_run(idlutils_nthreads(npix/PHOTFRAC_CHUNK+1), photfrac_pixels, 
+               &w);
+  idlutils_queue_free(&(w.queue));
+
+	return(1);
+} /* end photfrac_threaded */
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "ph.h"
+#include "idlutils_threads.h"
+
+/*
+ * photfrac_cache.c
+ *
+ * Tables of photfrac values shared across calls, so that aperture
+ * weights become lookups.  For each radius there is one table of the
+ * fraction at offsets (dx,dy) from the aperture center, on a grid of
+ * PHOTFRAC_NOFF nodes per pixel.  The fraction is symmetric in the sign
+ * of dx and of dy, so only the quadrant dx,dy>=0 is tabulated.  A pixel
+ * at an integer offset is a node of the table and gets exactly the
+ * photfrac value; other offsets are interpolated bilinearly between the
+ * four surrounding nodes.
+ *
+ * Nodes are only integrated the first time they are needed, in parallel,
+ * and the table grows to cover whatever offsets are asked for, out to
+ * PHOTFRAC_SAFE times the radius (and at least PHOTFRAC_DMIN pixels);
+ * pixels further out are integrated directly each time, as photfrac()
+ * does, so the memory of a table is bounded by its radius rather than
+ * by the size of the image.  Lookups hold only a read lock on their
+ * table; missing nodes are integrated outside any lock and added under
+ * the write lock, so callers in many threads (as aperphot.c) wait for
+ * each other only while nodes are being added.  If
+ * IDLUTILS_PHOTFRAC_CACHE names a directory, each table is read from
+ * there when first used and written back by photfrac_cache_save(), so
+ * the integrals are shared between sessions too.  The IDL entry points
+ * save once at the end of each call, rather than after every aperture.
+ * photfrac_cache_free() releases all the tables.
+ */
+
+#define PHOTFRAC_NOFF 16
+
+/* tables reach offsets of PHOTFRAC_SAFE*radius, or PHOTFRAC_DMIN pixels
+   if more; enough for the annuli of aperphot.c with r2<=2*r1 */
+#define PHOTFRAC_SAFE 4.
+#define PHOTFRAC_DMIN 20.
+
+/* stride of node numbers independent of the size of the table */
+#define PHOTFRAC_STRIDE 1048576L
+#define PHOTFRAC_MAGIC 0x50484652
+
+/* nodes handed to a thread at a time */
+#define PHOTFRAC_CHUNK 16
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+typedef struct photfrac_table_struct {
+  float radius;
+  int nside;            /* nodes per side, offsets 0..(nside-1)/NOFF */
+  int nsidemax;         /* most nodes per side it may grow to */
+  float *val;           /* val[iy*nside+ix], NAN until integrated */
+  int nnew;             /* nodes integrated since last saved */
+  pthread_rwlock_t lock;  /* read to look up, write to grow or add nodes */
+  struct photfrac_table_struct *next;
+} photfrac_table;
+
+typedef struct {
+  float radius;
+  long *todo;           /* nodes to integrate, as iy*PHOTFRAC_STRIDE+ix */
+  float *val;           /* and their values */
+  long ntodo;
+  int xnpix,ynpix,nsidemax;
+  float xcen,ycen;
+  float *frac;          /* pixels beyond the table are integrated here */
+  idlutils_queue queue; /* ntodo nodes, then xnpix*ynpix pixels */
+} photfrac_fill;
+
+/* p_tables_lock only guards the list; each table has its own lock */
+static photfrac_table *p_tables=NULL;
+static pthread_mutex_t p_tables_lock=PTHREAD_MUTEX_INITIALIZER;
+
+/********************************************************************/
+/* copy the nodes of a table of nside0 per side into val, where it has
+   nside per side, wherever val has not been integrated */
+static void photfrac_merge(float *val, int nside, const float *val0,
+                           int nside0)
+{
+  int ix,iy,n;
+
+  n=(nside<nside0) ? nside : nside0;
+  for(iy=0;iy<n;iy++)
+    for(ix=0;ix<n;ix++)
+      if(isnan(val[iy*nside+ix]))
+        val[iy*nside+ix]=val0[iy*nside0+ix];
+} /* end photfrac_merge */
+
+/********************************************************************/
+static void photfrac_filename(float radius, char *filename, size_t len)
+{
+  char *dir;
+
+  filename[0]='\0';
+  dir=getenv("IDLUTILS_PHOTFRAC_CACHE");
+  if(dir==NULL || dir[0]=='\0') return;
+  snprintf(filename, len, "%s/photfrac_%.9g_%d.dat", dir, radius,
+           PHOTFRAC_NOFF);
+} /* end photfrac_filename */
+
+/********************************************************************/
+/* nodes per side needed out to the largest offset tabulated */
+static int photfrac_nsidemax(float radius)
+{
+  double dmax;
+
+  dmax=PHOTFRAC_SAFE*fabs(radius);
+  if(dmax<PHOTFRAC_DMIN) dmax=PHOTFRAC_DMIN;
+  return((int) ceil(dmax*PHOTFRAC_NOFF)+2);
+} /* end photfrac_nsidemax */
+
+/********************************************************************/
+/* grow the table to at least nside nodes per side, up to nsidemax; the
+   write lock must be held */
+static void photfrac_grow(photfrac_table *table, int nside)
+{
+  float *val;
+  long i;
+
+  if(nside>table->nsidemax) nside=table->nsidemax;
+  if(table->nside>=nside) return;
+  if(nside<table->nside+table->nside/2) nside=table->nside+table->nside/2;
+  if(nside>table->nsidemax) nside=table->nsidemax;
+  val=(float *) malloc((size_t) nside*nside*sizeof(float));
+  for(i=0;i<(long) nside*nside;i++) val[i]=NAN;
+  if(table->val!=NULL)
+    photfrac_merge(val, nside, table->val, table->nside);
+  FREEVEC(table->val);
+  table->val=val;
+  table->nside=nside;
+} /* end photfrac_grow */
+
+/********************************************************************/
+/* read any nodes saved on disk into the table */
+static void photfrac_load(photfrac_table *table)
+{
+  char filename[4096];
+  FILE *fp;
+  int header[3],nside0;
+  float radius0,*val0;
+
+  photfrac_filename(table->radius, filename, sizeof(filename));
+  if(filename[0]=='\0') return;
+  fp=fopen(filename, "rb");
+  if(fp==NULL) return;
+  if(fread(header, sizeof(int), 3, fp)!=3 ||
+     header[0]!=PHOTFRAC_MAGIC || header[1]!=PHOTFRAC_NOFF ||
+     fread(&radius0, sizeof(float), 1, fp)!=1 ||
+     radius0!=table->radius) {
+    fclose(fp);
+    return;
+  }
+  nside0=header[2];
+  val0=(float *) malloc((size_t) nside0*nside0*sizeof(float));
+  if(fread(val0, sizeof(float), (size_t) nside0*nside0, fp)==
+     (size_t) nside0*nside0) {
+    /* take as much of the disk table as this one may hold */
+    photfrac_grow(table, nside0);
+    photfrac_merge(table->val, table->nside, val0, nside0);
+  }
+  FREEVEC(val0);
+  fclose(fp);
+} /* end photfrac_load */
+
+/********************************************************************/
+/* write the table to disk, through a temporary file so that readers
+   never see a partial table */
+static void photfrac_save(photfrac_table *table)
+{
+  char filename[4096],tmpname[4200];
+  FILE *fp;
+  int header[3],ok;
+
+  photfrac_filename(table->radius, filename, sizeof(filename));
+  if(filename[0]=='\0') return;
+
+  /* pick up anything another session saved meanwhile */
+  photfrac_load(table);
+
+  snprintf(tmpname, sizeof(tmpname), "%s.%ld.tmp", filename,
+           (long) getpid());
+  fp=fopen(tmpname, "wb");
+  if(fp==NULL) return;
+  header[0]=PHOTFRAC_MAGIC;
+  header[1]=PHOTFRAC_NOFF;
+  header[2]=table->nside;
+  ok=(fwrite(header, sizeof(int), 3, fp)==3 &&
+      fwrite(&(table->radius), sizeof(float), 1, fp)==1 &&
+      fwrite(table->val, sizeof(float), (size_t) table->nside*table->nside,
+             fp)==(size_t) table->nside*table->nside);
+  if(fclose(fp)!=0) ok=0;
+  if(ok && rename(tmpname, filename)==0)
+    table->nnew=0;
+  else
+    remove(tmpname);
+} /* end photfrac_save */
+
+/********************************************************************/
+/* the table for this radius, made (and read from disk) the first time */
+static photfrac_table *photfrac_find_table(float radius)
+{
+  photfrac_table *table;
+
+  pthread_mutex_lock(&p_tables_lock);
+  for(table=p_tables;table!=NULL;table=table->next)
+    if(table->radius==radius) break;
+  if(table==NULL) {
+    table=(photfrac_table *) malloc(sizeof(photfrac_table));
+    table->radius=radius;
+    table->nside=0;
+    table->nsidemax=photfrac_nsidemax(radius);
+    table->val=NULL;
+    table->nnew=0;
+    pthread_rwlock_init(&(table->lock), NULL);
+    photfrac_load(table);
+    table->next=p_tables;
+    p_tables=table;
+  }
+  pthread_mutex_unlock(&p_tables_lock);
+
+  return(table);
+} /* end photfrac_find_table */
+
+/********************************************************************/
+/* node below offset d from the center, and the weight of the next one */
+static void photfrac_corner(float d, int *inode, float *t)
+{
+  float u;
+
+  u=fabs(d)*PHOTFRAC_NOFF;
+  (*inode)=(int) floor(u);
+  (*t)=u-(float) (*inode);
+} /* end photfrac_corner */
+
+/********************************************************************/
+/* whether the pixel whose lower node is (ix,iy) is within the table's
+   reach; the same for every call, whatever the table holds */
+static int photfrac_intable(int ix, int iy, int nsidemax)
+{
+  return(ix>=0 && iy>=0 && ix+1<nsidemax && iy+1<nsidemax);
+} /* end photfrac_intable */
+
+/********************************************************************/
+/* mark a node for integration if the table does not have it yet; the
+   read lock must be held */
+static void photfrac_need(photfrac_table *table, int ix, int iy, char *need,
+                          int nneed)
+{
+  if(ix<table->nside && iy<table->nside &&
+     !isnan(table->val[iy*table->nside+ix])) return;
+  need[iy*nneed+ix]=1;
+} /* end photfrac_need */
+
+/********************************************************************/
+static void photfrac_nodes(void *arg, int ithread, int nthreads)
+{
+  photfrac_fill *f=(photfrac_fill *) arg;
+  long lo,hi,k;
+  int i,j,ix,iy;
+  float tx,ty;
+
+  while(idlutils_queue_next(&(f->queue), &lo, &hi))
+    for(k=lo;k<hi;k++) {
+      if(k<f->ntodo) {
+        f->val[k]=
+          photfrac_value(f->radius,
+                         (float) (f->todo[k]%PHOTFRAC_STRIDE)/
+                         (float) PHOTFRAC_NOFF,
+                         (float) (f->todo[k]/PHOTFRAC_STRIDE)/
+                         (float) PHOTFRAC_NOFF);
+      } else {
+        i=(int) ((k-f->ntodo)%f->xnpix);
+        j=(int) ((k-f->ntodo)/f->xnpix);
+        photfrac_corner((float) i-f->xcen, &ix, &tx);
+        photfrac_corner((float) j-f->ycen, &iy, &ty);
+        if(!photfrac_intable(ix, iy, f->nsidemax))
+          f->frac[k-f->ntodo]=
+            photfrac_value(f->radius, fabs((float) i-f->xcen),
+                           fabs((float) j-f->ycen));
+      }
+    }
+} /* end photfrac_nodes */
+
+/********************************************************************/
+/* as photfrac(), but for any center, and using the tables */
+int photfrac_cached(int xnpix,
+                    int ynpix,
+                    float radius,
+                    float *frac,
+                    float xcen,
+                    float ycen)
+{
+  photfrac_table *table;
+  photfrac_fill fill;
+  int i,j,nside,nsidemax,nneed,ix,iy,ixmax,iymax;
+  long k,nfar,nitems;
+  float tx,ty,f0,f1,*val;
+  char *need;
+
+  if(xnpix<=0 || ynpix<=0) return(1);
+  table=photfrac_find_table(radius);
+  nsidemax=table->nsidemax;
+
+  /* 1. mark the nodes needed that are not yet in the table, over the
+     nodes this box can reach; nodes with zero weight are skipped, so
+     that integer offsets only ever need their own node.  Pixels beyond
+     the table are only counted */
+  photfrac_corner(fabs(xcen)>fabs((float) (xnpix-1)-xcen) ? xcen :
+                  (float) (xnpix-1)-xcen, &ixmax, &tx);
+  photfrac_corner(fabs(ycen)>fabs((float) (ynpix-1)-ycen) ? ycen :
+                  (float) (ynpix-1)-ycen, &iymax, &ty);
+  nneed=(ixmax>iymax ? ixmax : iymax)+2;
+  if(nneed>nsidemax) nneed=nsidemax;
+  need=(char *) calloc((size_t) nneed*nneed, sizeof(char));
+  nfar=0;
+  pthread_rwlock_rdlock(&(table->lock));
+  for(j=0;j<ynpix;j++) {
+    photfrac_corner((float) j-ycen, &iy, &ty);
+    for(i=0;i<xnpix;i++) {
+      photfrac_corner((float) i-xcen, &ix, &tx);
+      if(!photfrac_intable(ix, iy, nsidemax)) {
+        nfar++;
+        continue;
+      }
+      photfrac_need(table, ix, iy, need, nneed);
+      if(tx>0.) photfrac_need(table, ix+1, iy, need, nneed);
+      if(ty>0.) photfrac_need(table, ix, iy+1, need, nneed);
+      if(tx>0. && ty>0.) photfrac_need(table, ix+1, iy+1, need, nneed);
+    }
+  }
+  pthread_rwlock_unlock(&(table->lock));
+  fill.ntodo=0;
+  for(k=0;k<(long) nneed*nneed;k++)
+    if(need[k]) fill.ntodo++;
+  fill.todo=(long *) malloc((fill.ntodo+1)*sizeof(long));
+  fill.ntodo=0;
+  for(iy=0;iy<nneed;iy++)
+    for(ix=0;ix<nneed;ix++)
+      if(need[iy*nneed+ix]) fill.todo[fill.ntodo++]=iy*PHOTFRAC_STRIDE+ix;
+  FREEVEC(need);
+
+  /* 2. integrate the nodes, and the pixels beyond the table, in parallel
+     and outside any lock, then add the nodes to the table; another call
+     may have added some meanwhile, with the same values */
+  if(fill.ntodo>0 || nfar>0) {
+    fill.radius=radius;
+    fill.val=(float *) malloc((fill.ntodo+1)*sizeof(float));
+    fill.xnpix=xnpix;
+    fill.ynpix=ynpix;
+    fill.nsidemax=nsidemax;
+    fill.xcen=xcen;
+    fill.ycen=ycen;
+    fill.frac=frac;
+    nitems=fill.ntodo+(nfar>0 ? (long) xnpix*ynpix : 0L);
+    idlutils_queue_init(&(fill.queue), nitems, PHOTFRAC_CHUNK);
+    idlutils_run(idlutils_nthreads((fill.ntodo+nfar)/PHOTFRAC_CHUNK+1),
+                 photfrac_nodes, &fill);
+    idlutils_queue_free(&(fill.queue));
+
+    if(fill.ntodo>0) {
+      /* todo is in order, so its last node has the largest iy */
+      ixmax=0;
+      for(k=0;k<fill.ntodo;k++) {
+        ix=(int) (fill.todo[k]%PHOTFRAC_STRIDE);
+        if(ix>ixmax) ixmax=ix;
+      }
+      iymax=(int) (fill.todo[fill.ntodo-1]/PHOTFRAC_STRIDE);
+      pthread_rwlock_wrlock(&(table->lock));
+      photfrac_grow(table, (ixmax>iymax ? ixmax : iymax)+1);
+      for(k=0;k<fill.ntodo;k++) {
+        val=table->val+(fill.todo[k]/PHOTFRAC_STRIDE)*table->nside+
+          fill.todo[k]%PHOTFRAC_STRIDE;
+        if(isnan(*val)) {
+          (*val)=fill.val[k];
+          table->nnew++;
+        }
+      }
+      pthread_rwlock_unlock(&(table->lock));
+    }
+    FREEVEC(fill.val);
+  }
+  FREEVEC(fill.todo);
+
+  /* 3. look up each pixel within the table */
+  pthread_rwlock_rdlock(&(table->lock));
+  nside=table->nside;
+  val=table->val;
+  for(j=0;j<ynpix;j++) {
+    photfrac_corner((float) j-ycen, &iy, &ty);
+    for(i=0;i<xnpix;i++) {
+      photfrac_corner((float) i-xcen, &ix, &tx);
+      if(!photfrac_intable(ix, iy, nsidemax)) continue;
+      f0=val[iy*nside+ix];
+      if(tx>0.)
+        f0=(1.-tx)*f0+tx*val[iy*nside+ix+1];
+      if(ty>0.) {
+        f1=val[(iy+1)*nside+ix];
+        if(tx>0.)
+          f1=(1.-tx)*f1+tx*val[(iy+1)*nside+ix+1];
+        f0=(1.-ty)*f0+ty*f1;
+      }
+      frac[j*xnpix+i]=f0;
+    }
+  } /* end for i,j */
+  pthread_rwlock_unlock(&(table->lock));
+
+  return(1);
+} /* end photfrac_cached */
+
+/********************************************************************/
+/* write every table with new nodes to IDLUTILS_PHOTFRAC_CACHE, if set */
+void photfrac_cache_save(void)
+{
+  photfrac_table *table;
+
+  pthread_mutex_lock(&p_tables_lock);
+  for(table=p_tables;table!=NULL;table=table->next) {
+    pthread_rwlock_wrlock(&(table->lock));
+    if(table->nnew>0) photfrac_save(table);
+    pthread_rwlock_unlock(&(table->lock));
+  }
+  pthread_mutex_unlock(&p_tables_lock);
+} /* end photfrac_cache_save */
+
+/********************************************************************/
+/* save any new nodes, then free all the tables; no lookups may be
+   running */
+void photfrac_cache_free(void)
+{
+  photfrac_table *table,*next;
+
+  photfrac_cache_save();
+  pthread_mutex_lock(&p_tables_lock);
+  for(table=p_tables;table!=NULL;table=next) {
+    next=table->next;
+    FREEVEC(table->val);
+    pthread_rwlock_destroy(&(table->lock));
+    free((char *) table);
+  }
+  p_tables=NULL;
+  pthread_mutex_unlock(&p_tables_lock);
+} /* end photfrac_cache_free */
@@ -1,229 +1,249 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "export.h"
+#include "idlutils_threads.h"
+
+/*
+ * pop_image.c
+ *
+ * Scatter-add weights onto an image at a list of positions, with
+ * nearest grid point (NGP), cloud-in-cell (CIC) or triangular-shaped
+ * cloud (TSC) assignment.  The four entry points, for FLOAT or DOUBLE
+ * images and for real or LONG positions, all come from the one kernel in
+ * pop_image_kernel.h.
+ *
+ * With more than one thread, the image is cut into bands of whole pixels,
+ * each band added to by one thread at a time.  Each block of points is
+ * first sorted by band, keeping the points in order within each band, so
+ * every pixel receives its weights in the same order as when the points
+ * are added one by one; the image is the same for any number of threads.
+ */
+
+#define POP_NGP 0
+#define POP_CIC 1
+#define POP_TSC 2
+
+/* points sorted by band at a time */
+#define POP_IMAGE_BLOCK 4194304
+
+/* points below which one thread is used */
+#define POP_IMAGE_CHUNK 65536
+
+#define POP_CAT2(a, b) a ## _ ## b
+#define POP_CAT(a, b) POP_CAT2(a, b)
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+typedef int (*pop_image_span_func)(void *, IDL_LONG, long *, long *);
+typedef void (*pop_image_add_func)(void *, IDL_LONG, long, long);
+
+typedef struct {
+   void              *  kernel;
+   pop_image_span_func   span;
+   pop_image_add_func    add;
+   IDL_LONG              ipt0;       /* first point of this block */
+   IDL_LONG              nblock;     /* points in this block */
+   long                  npix;
+   long                  bandsize;
+   int                   nband;
+   int                   nchunk;
+   IDL_LONG           *  offset;     /* [nchunk][nband] */
+   IDL_LONG           *  bandstart;  /* [nband+1] */
+   IDL_LONG           *  bucket;     /* points of the block, by band */
+   idlutils_queue        queue;
+} pop_image_work;
 
 /******************************************************************************/
-IDL_LONG pop_image_float_float
-  (int         argc,
-   void    *   argv[])
+/* Count the points of each band in this thread's chunk of the block */
+static void pop_image_count
+  (void     *  arg,
+   int         ithread,
+   int         nthreads)
 {
-   IDL_LONG    npts;
-   float    *  xvec;
-   float    *  yvec;
-   float    *  wvec;
-   IDL_LONG    nx;
-   IDL_LONG    ny;
-   float    *  image;
-   IDL_LONG    iassign;
-
-   IDL_LONG    ipt;
-   IDL_LONG    ix1;
-   IDL_LONG    iy1;
-   IDL_LONG    retval = 1;
-   float       dx;
-   float       dy;
-
-   /* Allocate pointers from IDL */
-   npts = *((IDL_LONG *)argv[0]);
-   xvec = (float *)argv[1];
-   yvec = (float *)argv[2];
-   wvec = (float *)argv[3];
-   nx = *((IDL_LONG *)argv[4]);
-   ny = *((IDL_LONG *)argv[5]);
-   image = (float *)argv[6];
-   iassign = *((IDL_LONG *)argv[7]);
-
-   if (iassign == 0) {
-
-      /* NGP assignment */
-
-      for (ipt=0; ipt < npts; ipt++) {
-         ix1 = floor(xvec[ipt]+0.5);
-         iy1 = floor(yvec[ipt]+0.5);
-
-         if (ix1 >= 0 && ix1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+iy1*nx] += wvec[ipt];
-      }
-   } else if (iassign == 1) {
-
-      /* CIC assignment */
-
-      for (ipt=0; ipt < npts; ipt++) {
-         ix1 = floor(xvec[ipt]);
-         iy1 = floor(yvec[ipt]);
-
-         dx = ix1 + 1 - xvec[ipt];
-         dy = iy1 + 1 - yvec[ipt];
-
-         if (ix1 >= 0 && ix1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+iy1*nx] += wvec[ipt] * dx * dy;
-         if (ix1+1 >= 0 && ix1+1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+1+iy1*nx] += wvec[ipt] * (1.0 - dx) * dy;
-         if (ix1 >= 0 && ix1 < nx && iy1+1 >= 0 && iy1+1 < ny)
-          image[ix1+(iy1+1)*nx] += wvec[ipt] * dx * (1.0 - dy);
-         if (ix1+1 >= 0 && ix1+1 < nx && iy1+1 >= 0 && iy1+1 < ny)
-          image[ix1+1+(iy1+1)*nx] += wvec[ipt] * (1.0 - dx) * (1.0 - dy);
-      }
-
+   pop_image_work *  w = (pop_image_work *) arg;
+   IDL_LONG *  count = w->offset + (long) ithread * w->nband;
+   long        lo;
+   long        hi;
+   long        ipt;
+   long        first;
+   long        last;
+
+   memset(count, 0, w->nband * sizeof(IDL_LONG));
+   idlutils_range(w->nblock, ithread, nthreads, &lo, &hi);
+   for (ipt=lo; ipt < hi; ipt++) {
+      if (!w->span(w->kernel, w->ipt0+ipt, &first, &last)) continue;
+      count[first/w->bandsize]++;
+      if (last/w->bandsize != first/w->bandsize) count[last/w->bandsize]++;
    }
-
-   return retval;
 }
+
 /******************************************************************************/
-IDL_LONG pop_image_float_long
-  (int         argc,
-   void    *   argv[])
+/* Put the points of this thread's chunk into their bands */
+static void pop_image_fill
+  (void     *  arg,
+   int         ithread,
+   int         nthreads)
 {
-   IDL_LONG    npts;
-   IDL_LONG *  xvec;
-   IDL_LONG *  yvec;
-   float    *  wvec;
-   IDL_LONG    nx;
-   IDL_LONG    ny;
-   float    *  image;
-   IDL_LONG    iassign;
+   pop_image_work *  w = (pop_image_work *) arg;
+   IDL_LONG *  offset = w->offset + (long) ithread * w->nband;
+   long        lo;
+   long        hi;
+   long        ipt;
+   long        first;
+   long        last;
+
+   idlutils_range(w->nblock, ithread, nthreads, &lo, &hi);
+   for (ipt=lo; ipt < hi; ipt++) {
+      if (!w->span(w->kernel, w->ipt0+ipt, &first, &last)) continue;
+      w->bucket[offset[first/w->bandsize]++] = ipt;
+      if (last/w->bandsize != first/w->bandsize)
+       w->bucket[offset[last/w->bandsize]++] = ipt;
+   }
+}
 
-   IDL_LONG    ipt;
-   IDL_LONG    ix1;
-   IDL_LONG    iy1;
-   IDL_LONG    retval = 1;
-
-   /* Allocate pointers from IDL */
-   npts = *((IDL_LONG *)argv[0]);
-   xvec = (IDL_LONG *)argv[1];
-   yvec = (IDL_LONG *)argv[2];
-   wvec = (float *)argv[3];
-   nx = *((IDL_LONG *)argv[4]);
-   ny = *((IDL_LONG *)argv[5]);
-   image = (float *)argv[6];
-   iassign = *((IDL_LONG *)argv[7]);
-
-   if (iassign == 0 || iassign == 1) {
-
-      /* NGP or CIC assignment */
-
-      for (ipt=0; ipt < npts; ipt++) {
-         ix1 = xvec[ipt];
-         iy1 = yvec[ipt];
-
-         if (ix1 >= 0 && ix1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+iy1*nx] += wvec[ipt];
+/******************************************************************************/
+/* Add the points of each band, in order, to that band only */
+static void pop_image_bands
+  (void     *  arg,
+   int         ithread,
+   int         nthreads)
+{
+   pop_image_work *  w = (pop_image_work *) arg;
+   long        lo;
+   long        hi;
+   long        iband;
+   long        pixlo;
+   long        pixhi;
+   IDL_LONG    k;
+
+   while (idlutils_queue_next(&(w->queue), &lo, &hi)) {
+      for (iband=lo; iband < hi; iband++) {
+         pixlo = iband * w->bandsize;
+         pixhi = pixlo + w->bandsize;
+         if (pixhi > w->npix) pixhi = w->npix;
+         for (k=w->bandstart[iband]; k < w->bandstart[iband+1]; k++)
+          w->add(w->kernel, w->ipt0+w->bucket[k], pixlo, pixhi);
       }
    }
-
-   return retval;
 }
 
 /******************************************************************************/
-IDL_LONG pop_image_double_double
-  (int         argc,
-   void    *   argv[])
+/* Add all the points, in parallel where that pays */
+static void pop_image_run
+  (IDL_LONG              npts,
+   IDL_LONG              nx,
+   IDL_LONG              ny,
+   pop_image_span_func   span,
+   pop_image_add_func    add,
+   void               *  kernel)
 {
-   IDL_LONG    npts;
-   double   *  xvec;
-   double   *  yvec;
-   double   *  wvec;
-   IDL_LONG    nx;
-   IDL_LONG    ny;
-   double   *  image;
-   IDL_LONG    iassign;
-
+   pop_image_work w;
    IDL_LONG    ipt;
-   IDL_LONG    ix1;
-   IDL_LONG    iy1;
-   IDL_LONG    retval = 1;
-   double      dx;
-   double      dy;
-
-   /* Allocate pointers from IDL */
-   npts = *((IDL_LONG *)argv[0]);
-   xvec = (double *)argv[1];
-   yvec = (double *)argv[2];
-   wvec = (double *)argv[3];
-   nx = *((IDL_LONG *)argv[4]);
-   ny = *((IDL_LONG *)argv[5]);
-   image = (double *)argv[6];
-   iassign = *((IDL_LONG *)argv[7]);
-
-   if (iassign == 0) {
-
-      /* NGP assignment */
-
-      for (ipt=0; ipt < npts; ipt++) {
-         ix1 = floor(xvec[ipt]+0.5);
-         iy1 = floor(yvec[ipt]+0.5);
-
-         if (ix1 >= 0 && ix1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+iy1*nx] += wvec[ipt];
-      }
-   } else if (iassign == 1) {
-
-      /* CIC assignment */
-
-      for (ipt=0; ipt < npts; ipt++) {
-         ix1 = floor(xvec[ipt]);
-         iy1 = floor(yvec[ipt]);
-
-         dx = ix1 + 1 - xvec[ipt];
-         dy = iy1 + 1 - yvec[ipt];
+   IDL_LONG    pos;
+   long        maxspan;
+   int         nthreads;
+   int         iband;
+   int         ichunk;
+
+   if (npts <= 0 || nx <= 0 || ny <= 0) return;
+   w.npix = (long) nx * ny;
+
+   /* Bands must be wider than any one point reaches, here two rows and
+      a pixel (or two pixels along a vector), so that a point adds to at
+      most two of them */
+   maxspan = (ny > 1) ? 2 * (long) nx + 2 : 2;
+   nthreads = idlutils_nthreads(npts / POP_IMAGE_CHUNK + 1);
+   w.nband = 4 * nthreads;
+   if (w.nband > w.npix / (maxspan+1)) w.nband = w.npix / (maxspan+1);
+
+   if (nthreads <= 1 || w.nband <= 1) {
+      for (ipt=0; ipt < npts; ipt++)
+       add(kernel, ipt, 0, w.npix);
+      return;
+   }
 
-         if (ix1 >= 0 && ix1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+iy1*nx] += wvec[ipt] * dx * dy;
-         if (ix1+1 >= 0 && ix1+1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+1+iy1*nx] += wvec[ipt] * (1.0 - dx) * dy;
-         if (ix1 >= 0 && ix1 < nx && iy1+1 >= 0 && iy1+1 < ny)
-          image[ix1+(iy1+1)*nx] += wvec[ipt] * dx * (1.0 - dy);
-         if (ix1+1 >= 0 && ix1+1 < nx && iy1+1 >= 0 && iy1+1 < ny)
-          image[ix1+1+(iy1+1)*nx] += wvec[ipt] * (1.0 - dx) * (1.0 - dy);
+   w.kernel = kernel;
+   w.span = span;
+   w.add = add;
+   w.bandsize = (w.npix + w.nband - 1) / w.nband;
+   w.nchunk = nthreads;
+   w.offset = (IDL_LONG *) malloc((size_t) w.nchunk * w.nband
+    * sizeof(IDL_LONG));
+   w.bandstart = (IDL_LONG *) malloc((w.nband+1) * sizeof(IDL_LONG));
+   w.bucket = (IDL_LONG *) malloc((size_t) 2
+    * (npts < POP_IMAGE_BLOCK ? npts : POP_IMAGE_BLOCK) * sizeof(IDL_LONG));
+
+   for (w.ipt0=0; w.ipt0 < npts; w.ipt0 += POP_IMAGE_BLOCK) {
+      w.nblock = npts - w.ipt0;
+      if (w.nblock > POP_IMAGE_BLOCK) w.nblock = POP_IMAGE_BLOCK;
+
+      /* Sort the block by band, chunk by chunk so points stay in order */
+      idlutils_run(w.nchunk, pop_image_count, &w);
+      pos = 0;
+      for (iband=0; iband < w.nband; iband++) {
+         w.bandstart[iband] = pos;
+         for (ichunk=0; ichunk < w.nchunk; ichunk++) {
+            ipt = w.offset[(long) ichunk * w.nband + iband];
+            w.offset[(long) ichunk * w.nband + iband] = pos;
+            pos += ipt;
+         }
       }
+      w.bandstart[w.nband] = pos;
+      idlutils_run(w.nchunk, pop_image_fill, &w);
 
+      /* Then add each band */
+      idlutils_queue_init(&(w.queue), w.nband, 1);
+      idlutils_run(nthreads, pop_image_bands, &w);
+      idlutils_queue_free(&(w.queue));
    }
 
-   return retval;
+   FREEVEC(w.offset);
+   FREEVEC(w.bandstart);
+   FREEVEC(w.bucket);
 }
+
 /******************************************************************************/
-IDL_LONG pop_image_double_long
-  (int         argc,
-   void    *   argv[])
-{
-   IDL_LONG    npts;
-   IDL_LONG *  xvec;
-   IDL_LONG *  yvec;
-   double   *  wvec;
-   IDL_LONG    nx;
-   IDL_LONG    ny;
-   double   *  image;
-   IDL_LONG    iassign;
+#define POP_NAME pop_image_float_float
+#define POP_IMG float
+#define POP_POS float
+#define POP_INTPOS 0
+#include "pop_image_kernel.h"
+#undef POP_NAME
+#undef POP_IMG
+#undef POP_POS
+#undef POP_INTPOS
 
-   IDL_LONG    ipt;
-   IDL_LONG    ix1;
-   IDL_LONG    iy1;
-   IDL_LONG    retval = 1;
-
-   /* Allocate pointers from IDL */
-   npts = *((IDL_LONG *)argv[0]);
-   xvec = (IDL_LONG *)argv[1];
-   yvec = (IDL_LONG *)argv[2];
-   wvec = (double *)argv[3];
-   nx = *((IDL_LONG *)argv[4]);
-   ny = *((IDL_LONG *)argv[5]);
-   image = (double *)argv[6];
-   iassign = *((IDL_LONG *)argv[7]);
-
-   if (iassign == 0 || iassign == 1) {
-
-      /* NGP or CIC assignment */
-
-      for (ipt=0; ipt < npts; ipt++) {
-         ix1 = xvec[ipt];
-         iy1 = yvec[ipt];
-
-         if (ix1 >= 0 && ix1 < nx && iy1 >= 0 && iy1 < ny)
-          image[ix1+iy1*nx] += wvec[ipt];
-      }
-   }
+/******************************************************************************/
+#define POP_NAME pop_image_float_long
+#define POP_IMG float
+#define POP_POS IDL_LONG
+#define POP_INTPOS 1
+#include "pop_image_kernel.h"
+#undef POP_NAME
+#undef POP_IMG
+#undef POP_POS
+#undef POP_INTPOS
 
-   return retval;
-}
+/******************************************************************************/
+#define POP_NAME pop_image_double_double
+#define POP_IMG double
+#define POP_POS double
+#define POP_INTPOS 0
+#include "pop_image_kernel.h"
+#undef POP_NAME
+#undef POP_IMG
+#undef POP_POS
+#undef POP_INTPOS
 
+/******************************************************************************/
+#define POP_NAME pop_image_double_long
+#define POP_IMG double
+#define POP_POS IDL_LONG
+#define POP_INTPOS 1
+#include "pop_image_kernel.h"
+#undef POP_NAME
+#undef POP_IMG
+#undef POP_POS
+#undef POP_INTPOS
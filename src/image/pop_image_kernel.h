@@ -0,0 +1,206 @@
+/*
+ * pop_image_kernel.h
+ *
+ * One pop_image_<image>_<positions> entry point.  pop_image.c includes
+ * this once for each pair of types, with these defined:
+ *
+ *   POP_NAME    name of the IDL entry point
+ *   POP_IMG     type of the image and the weights, float or double
+ *   POP_POS     type of the positions, POP_IMG or IDL_LONG
+ *   POP_INTPOS  1 if the positions are integers, for which NGP and CIC
+ *               both put the whole weight in that pixel
+ *
+ * The arithmetic of each assignment is written out as it always was, so
+ * that images come out bit for bit the same, only faster.
+ */
+
+#define POP_FN(suffix) POP_CAT(POP_NAME, suffix)
+
+typedef struct {
+   IDL_LONG    npts;
+   POP_POS  *  xvec;
+   POP_POS  *  yvec;
+   POP_IMG  *  wvec;
+   IDL_LONG    nx;
+   IDL_LONG    ny;
+   POP_IMG  *  image;
+   IDL_LONG    iassign;
+} POP_FN(work);
+
+/******************************************************************************/
+/* The cell nearest the point, or below it for CIC */
+static void POP_FN(cell)
+  (POP_FN(work) *  w,
+   IDL_LONG        ipt,
+   IDL_LONG     *  ix1,
+   IDL_LONG     *  iy1)
+{
+#if POP_INTPOS
+   *ix1 = w->xvec[ipt];
+   *iy1 = w->yvec[ipt];
+#else
+   if (w->iassign == POP_CIC) {
+      *ix1 = floor(w->xvec[ipt]);
+      *iy1 = floor(w->yvec[ipt]);
+   } else {
+      *ix1 = floor(w->xvec[ipt]+0.5);
+      *iy1 = floor(w->yvec[ipt]+0.5);
+   }
+#endif
+}
+
+/******************************************************************************/
+/* First and last pixel, as indices into the image, that the point adds
+   to; returns 0 if none are in the image */
+static int POP_FN(span)
+  (void        *  arg,
+   IDL_LONG       ipt,
+   long        *  first,
+   long        *  last)
+{
+   POP_FN(work) *  w = (POP_FN(work) *) arg;
+   IDL_LONG    ix1;
+   IDL_LONG    iy1;
+   IDL_LONG    ixlo;
+   IDL_LONG    ixhi;
+   IDL_LONG    iylo;
+   IDL_LONG    iyhi;
+
+   POP_FN(cell)(w, ipt, &ix1, &iy1);
+   if (ix1 < -1 || ix1 > w->nx || iy1 < -1 || iy1 > w->ny) return 0;
+   ixlo = ixhi = ix1;
+   iylo = iyhi = iy1;
+   if (w->iassign == POP_TSC) {
+      ixlo--;
+      ixhi++;
+      if (w->ny > 1) {
+         iylo--;
+         iyhi++;
+      }
+   }
+#if !POP_INTPOS
+   else if (w->iassign == POP_CIC) {
+      ixhi++;
+      iyhi++;
+   }
+#endif
+   if (ixlo < 0) ixlo = 0;
+   if (ixhi > w->nx-1) ixhi = w->nx-1;
+   if (iylo < 0) iylo = 0;
+   if (iyhi > w->ny-1) iyhi = w->ny-1;
+   if (ixlo > ixhi || iylo > iyhi) return 0;
+
+   *first = ixlo + (long) iylo * w->nx;
+   *last = ixhi + (long) iyhi * w->nx;
+   return 1;
+}
+
+/******************************************************************************/
+/* Add the point to the pixels with indices in [lo,hi) */
+static void POP_FN(add)
+  (void        *  arg,
+   IDL_LONG       ipt,
+   long           lo,
+   long           hi)
+{
+   POP_FN(work) *  w = (POP_FN(work) *) arg;
+   IDL_LONG    nx = w->nx;
+   IDL_LONG    ny = w->ny;
+   POP_IMG  *  image = w->image;
+   IDL_LONG    ix1;
+   IDL_LONG    iy1;
+   IDL_LONG    i;
+   IDL_LONG    j;
+   long        k;
+   POP_IMG     dx;
+   POP_IMG     dy;
+   double      wx[3];
+   double      wy[3];
+
+#define POP_ADD(ix, iy, val) \
+   if ((ix) >= 0 && (ix) < nx && (iy) >= 0 && (iy) < ny) { \
+      k = (ix) + (long) (iy) * nx; \
+      if (k >= lo && k < hi) image[k] += val; \
+   }
+
+   POP_FN(cell)(w, ipt, &ix1, &iy1);
+
+   if (w->iassign == POP_TSC) {
+
+      /* TSC assignment; along X only for a vector */
+
+#if POP_INTPOS
+      dx = 0.0;
+      dy = 0.0;
+#else
+      dx = w->xvec[ipt] - ix1;
+      dy = w->yvec[ipt] - iy1;
+#endif
+      wx[0] = 0.5 * (0.5 - dx) * (0.5 - dx);
+      wx[1] = 0.75 - dx * dx;
+      wx[2] = 0.5 * (0.5 + dx) * (0.5 + dx);
+      if (ny > 1) {
+         wy[0] = 0.5 * (0.5 - dy) * (0.5 - dy);
+         wy[1] = 0.75 - dy * dy;
+         wy[2] = 0.5 * (0.5 + dy) * (0.5 + dy);
+      } else {
+         wy[0] = wy[2] = 0.0;
+         wy[1] = 1.0;
+      }
+      for (j=-1; j <= 1; j++) {
+         if (wy[j+1] == 0.0) continue;
+         for (i=-1; i <= 1; i++)
+          POP_ADD(ix1+i, iy1+j, w->wvec[ipt] * wx[i+1] * wy[j+1]);
+      }
+
+#if !POP_INTPOS
+   } else if (w->iassign == POP_CIC) {
+
+      /* CIC assignment */
+
+      dx = ix1 + 1 - w->xvec[ipt];
+      dy = iy1 + 1 - w->yvec[ipt];
+
+      POP_ADD(ix1, iy1, w->wvec[ipt] * dx * dy);
+      POP_ADD(ix1+1, iy1, w->wvec[ipt] * (1.0 - dx) * dy);
+      POP_ADD(ix1, iy1+1, w->wvec[ipt] * dx * (1.0 - dy));
+      POP_ADD(ix1+1, iy1+1, w->wvec[ipt] * (1.0 - dx) * (1.0 - dy));
+#endif
+
+   } else {
+
+      /* NGP assignment, or CIC at integer positions */
+
+      POP_ADD(ix1, iy1, w->wvec[ipt]);
+   }
+
+#undef POP_ADD
+}
+
+/******************************************************************************/
+IDL_LONG POP_NAME
+  (int         argc,
+   void    *   argv[])
+{
+   POP_FN(work) w;
+   IDL_LONG    retval = 1;
+
+   /* Allocate pointers from IDL */
+   w.npts = *((IDL_LONG *)argv[0]);
+   w.xvec = (POP_POS *)argv[1];
+   w.yvec = (POP_POS *)argv[2];
+   w.wvec = (POP_IMG *)argv[3];
+   w.nx = *((IDL_LONG *)argv[4]);
+   w.ny = *((IDL_LONG *)argv[5]);
+   w.image = (POP_IMG *)argv[6];
+   w.iassign = *((IDL_LONG *)argv[7]);
+
+   if (w.iassign != POP_NGP && w.iassign != POP_CIC && w.iassign != POP_TSC)
+    return retval;
+
+   pop_image_run(w.npts, w.nx, w.ny, POP_FN(span), POP_FN(add), &w);
+
+   return retval;
+}
+
+#undef POP_FN
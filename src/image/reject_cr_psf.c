@@ -3,6 +3,7 @@
 #include <string.h>
 #include <math.h>
 #include "ph.h"
+#include "idlutils_threads.h"
 
 /*
  * reject_cr_psf.c
@@ -16,12 +17,235 @@
  *
  * Does not check edge pixels at ALL. 
  *
+ * reject_cr_psf() first runs the background test of every pixel on strips
+ * of rows in parallel, with the original image, and only the pixels that
+ * pass it, or that a rejection just before them could change, are then
+ * tested fully in scan order.
+ *
+ * reject_cr_psf_iterate() then looks again at the neighbors of rejected
+ * pixels with tougher conditions, as reject_cr.pro used to, until no
+ * more are found.
+ *
  * Mike Blanton
  * 10/2003 */
 
 #define PI 3.14159265358979
 #define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
 
+/* relative slack on the background test of reject_cr_row(), far above
+   float rounding, so that it can only let extra pixels through to
+   reject_cr_pixel() */
+#define REJECT_CR_SLACK 1.e-5f
+
+typedef struct {
+  float *image, *image_ivar, nsig;
+  int xnpix, ynpix, *rejected, *ignoremask;
+  unsigned char *cand;
+} reject_cr_work;
+
+/********************************************************************/
+/* test the interior pixel (i,j); if rejected, replace it in image with
+   the background that rejected it and return 1 */
+static int reject_cr_pixel(float *image, 
+                           float *image_ivar, 
+                           int xnpix, 
+                           int i,
+                           int j,
+                           float nsig,
+                           float *psfvals,
+                           float cfudge,
+                           float c2fudge)
+{
+  float sigmaback[4],back[4],imcurr,ival,lval,invsigma,goodback[3][3];
+  int ip,jp;
+
+  if(image_ivar[j*xnpix+i]<=0.) return(0);
+  /* a pair with no good pixels has sigmaback NaN, and can never reject */
+  back[0]=back[1]=back[2]=back[3]=0.;
+  invsigma=sqrt(image_ivar[j*xnpix+i]);
+  imcurr=image[j*xnpix+i];
+        
+  /* check if it exceeds background for ALL four pairs */
+  ival=invsigma*imcurr;
+  for(ip=-1;ip<=1;ip++)
+    for(jp=-1;jp<=1;jp++)
+      goodback[jp+1][ip+1]=(float) (image_ivar[(j+jp)*xnpix+(i+ip)]>0.);
+  if((goodback[1][0]+goodback[1][2])>0) {
+    back[0]=(image[j*xnpix+(i-1)]*goodback[1][0]
+             +image[j*xnpix+(i+1)]*goodback[1][2])/
+      (goodback[1][0]+goodback[1][2]);
+    if(ival<back[0]*invsigma+nsig) return(0);
+  } /* end if */
+  if((goodback[0][1]+goodback[2][1])>0) {
+    back[1]=(image[(j-1)*xnpix+i]*goodback[0][1]+
+             image[(j+1)*xnpix+i]*goodback[2][1])/
+      (goodback[0][1]+goodback[2][1]);
+    if(ival<back[1]*invsigma+nsig) return(0);
+  } /* end if */
+  if((goodback[0][0]+goodback[2][2])>0) {
+    back[2]=(image[(j-1)*xnpix+(i-1)]*goodback[0][0]+
+             image[(j+1)*xnpix+(i+1)]*goodback[2][2])/
+      (goodback[0][0]+goodback[2][2]);
+    if(ival<back[2]*invsigma+nsig) return(0);
+  } /* end if */
+  if((goodback[2][0]+goodback[0][2])>0) {
+    back[3]=(image[(j+1)*xnpix+(i-1)]*goodback[2][0]+
+             image[(j-1)*xnpix+(i+1)]*goodback[0][2])/
+      (goodback[2][0]+goodback[0][2]);
+    if(ival<back[3]*invsigma+nsig) return(0);
+    ival=invsigma*imcurr;
+  } /* end if */
+
+  /* if it does, now check if ANY pair violates PSF conditions */
+  sigmaback[0]=
+    sqrt((goodback[1][0]/(image_ivar[j*xnpix+(i-1)]+1.-goodback[1][0])+ 
+          goodback[1][2]/(image_ivar[j*xnpix+(i+1)]+1.-goodback[1][2]))/
+         (goodback[1][0]+goodback[1][2]));
+  lval=(ival-cfudge)*c2fudge*psfvals[0];
+  if(lval>invsigma*(back[0]+cfudge*sigmaback[0])) {
+    image[j*xnpix+i]=back[0];
+    return(1);
+  }
+  sigmaback[1]=
+    sqrt((goodback[0][1]/(image_ivar[(j-1)*xnpix+i]+1.-goodback[0][1])+ 
+          goodback[2][1]/(image_ivar[(j+1)*xnpix+i]+1.-goodback[2][1]))/
+         (goodback[0][1]+goodback[2][1]));
+  if(lval>invsigma*(back[1]+cfudge*sigmaback[1])) {
+    image[j*xnpix+i]=back[1];
+    return(1);
+  }
+  sigmaback[2]=
+    sqrt((goodback[0][0]/(image_ivar[(j-1)*xnpix+(i-1)]+1.- 
+                          goodback[0][0])+ 
+          goodback[2][2]/(image_ivar[(j+1)*xnpix+(i+1)]+1.- 
+                          goodback[2][2]))/
+         (goodback[0][0]+goodback[2][2]));
+  lval=(ival-cfudge)*c2fudge*psfvals[1];
+  if(lval>invsigma*(back[2]+cfudge*sigmaback[2])) {
+    image[j*xnpix+i]=back[2];
+    return(1);
+  }
+  sigmaback[3]=
+    sqrt((goodback[2][0]/(image_ivar[(j+1)*xnpix+(i-1)]+1.- 
+                          goodback[2][0])+ 
+          goodback[0][2]/(image_ivar[(j-1)*xnpix+(i+1)]+1.- 
+                          goodback[0][2]))/
+         (goodback[2][0]+goodback[0][2]));
+  if(lval>invsigma*(back[3]+cfudge*sigmaback[3])) {
+    image[j*xnpix+i]=back[3];
+    return(1);
+  }
+
+  return(0);
+} /* end reject_cr_pixel */
+
+/********************************************************************/
+/* the background test of reject_cr_pixel() for the interior of row j,
+   without branches so that it vectorizes: cand[i] is 0 where the pixel
+   certainly fails it, and 1 where it may pass.  A pair fails the pixel
+   if invsigma*(image-back)<nsig; with nsig>0 that is image<=back, or
+   ivar*(image-back)^2<nsig^2, which needs no square root.  The
+   difference is pushed up by the slack, so rounding in either form can
+   not fail a pixel that reject_cr_pixel() would pass.  With nsig<=0
+   every pixel is a candidate */
+static void reject_cr_row(const float *image, 
+                          const float *image_ivar, 
+                          const int *ignoremask,
+                          int xnpix, 
+                          int j,
+                          float nsig,
+                          const float *good0,
+                          const float *good1,
+                          const float *good2,
+                          unsigned char *cand)
+{
+  const float *im0,*im1,*im2,*iv1;
+  float g00,g01,g02,g10,g12,g20,g21,g22,v,den,b,d,nsig2;
+  int i,fail,pos;
+
+  im0=image+(long) (j-1)*xnpix;
+  im1=im0+xnpix;
+  im2=im1+xnpix;
+  iv1=image_ivar+(long) j*xnpix;
+  pos=(nsig>0.f);
+  nsig2=nsig*nsig*(1.f-REJECT_CR_SLACK);
+  for(i=1;i<xnpix-1;i++) {
+    g00=good0[i-1];
+    g01=good0[i];
+    g02=good0[i+1];
+    g10=good1[i-1];
+    g12=good1[i+1];
+    g20=good2[i-1];
+    g21=good2[i];
+    g22=good2[i+1];
+    v=iv1[i];
+
+    /* the same backgrounds as reject_cr_pixel(), for each pair with a
+       good pixel; 1+g*g is den wherever den is not zero */
+    den=g10+g12;
+    b=(im1[i-1]*g10+im1[i+1]*g12)/(1.f+g10*g12);
+    d=im1[i]-b+REJECT_CR_SLACK*(fabsf(im1[i])+fabsf(b));
+    fail=(den>0.f) & ((d<=0.f) | (v*d*d<nsig2));
+    den=g01+g21;
+    b=(im0[i]*g01+im2[i]*g21)/(1.f+g01*g21);
+    d=im1[i]-b+REJECT_CR_SLACK*(fabsf(im1[i])+fabsf(b));
+    fail|=(den>0.f) & ((d<=0.f) | (v*d*d<nsig2));
+    den=g00+g22;
+    b=(im0[i-1]*g00+im2[i+1]*g22)/(1.f+g00*g22);
+    d=im1[i]-b+REJECT_CR_SLACK*(fabsf(im1[i])+fabsf(b));
+    fail|=(den>0.f) & ((d<=0.f) | (v*d*d<nsig2));
+    den=g20+g02;
+    b=(im2[i-1]*g20+im0[i+1]*g02)/(1.f+g20*g02);
+    d=im1[i]-b+REJECT_CR_SLACK*(fabsf(im1[i])+fabsf(b));
+    fail|=(den>0.f) & ((d<=0.f) | (v*d*d<nsig2));
+
+    cand[i]=(unsigned char) ((v>0.f) & (ignoremask[(long) j*xnpix+i]==0) &
+                             !(fail & pos));
+  }
+} /* end reject_cr_row */
+
+/********************************************************************/
+/* goodback of reject_cr_pixel() for row j, as 1. or 0. */
+static void reject_cr_good(const float *image_ivar, int xnpix, long j,
+                           float *good)
+{
+  int i;
+
+  for(i=0;i<xnpix;i++) good[i]=(float) (image_ivar[j*xnpix+i]>0.);
+} /* end reject_cr_good */
+
+/********************************************************************/
+/* the background test for a strip of rows; each row of goodback is
+   computed once and kept while the three rows that use it are done */
+static void reject_cr_strip(void *arg, int ithread, int nthreads)
+{
+  reject_cr_work *w=(reject_cr_work *) arg;
+  float *good,*g0,*g1,*g2,*tmp;
+  long lo,hi,j;
+  int i;
+
+  idlutils_range(w->ynpix-2, ithread, nthreads, &lo, &hi);
+  if(hi<=lo) return;
+  good=(float *) malloc((size_t) 3*w->xnpix*sizeof(float));
+  g0=good;
+  g1=good+w->xnpix;
+  g2=good+2*w->xnpix;
+  reject_cr_good(w->image_ivar, w->xnpix, lo, g0);
+  reject_cr_good(w->image_ivar, w->xnpix, lo+1, g1);
+  for(j=lo+1;j<hi+1;j++) {
+    reject_cr_good(w->image_ivar, w->xnpix, j+1, g2);
+    for(i=1;i<w->xnpix-1;i++) w->rejected[j*w->xnpix+i]=0;
+    reject_cr_row(w->image, w->image_ivar, w->ignoremask, w->xnpix, (int) j,
+                  w->nsig, g0, g1, g2, w->cand+j*w->xnpix);
+    tmp=g0;
+    g0=g1;
+    g1=g2;
+    g2=tmp;
+  }
+  FREEVEC(good);
+} /* end reject_cr_strip */
+
+/********************************************************************/
 int reject_cr_psf(float *image, 
                   float *image_ivar, 
                   int xnpix, 
@@ -35,100 +259,207 @@ int reject_cr_psf(float *image,
                   int *rejected, 
                   int *ignoremask)
 {
-  float *sigmaback,*back,imcurr,ival,lval,invsigma,goodback[3][3];
-  int i,j,ip,jp;
+  reject_cr_work w;
+  unsigned char *cand;
+  int i,j,ip;
 
-  sigmaback=(float *) malloc(4*sizeof(float));
-  back=(float *) malloc(4*sizeof(float));
-  
+  if(xnpix<3 || ynpix<3) return(0);
+
+  /* 1. background test on the original image, in parallel */
+  w.image=image;
+  w.image_ivar=image_ivar;
+  w.nsig=nsig;
+  w.xnpix=xnpix;
+  w.ynpix=ynpix;
+  w.rejected=rejected;
+  w.ignoremask=ignoremask;
+  w.cand=cand=(unsigned char *) malloc((size_t) xnpix*ynpix);
+  idlutils_run(idlutils_nthreads((long) (ynpix-2)*xnpix/65536+1),
+               reject_cr_strip, &w);
+
+  /* 2. the full test in scan order; replacing a rejected pixel changes
+     the background of the four neighbors after it, which are tested
+     whatever the first pass said */
   for(j=1;j<ynpix-1;j++) {
     for(i=1;i<xnpix-1;i++) {
-      rejected[j*xnpix+i]=0;
-      if(image_ivar[j*xnpix+i]>0. && ignoremask[j*xnpix+i]==0) {
-        invsigma=sqrt(image_ivar[j*xnpix+i]);
-        imcurr=image[j*xnpix+i];
-        
-        /* check if it exceeds background for ALL four pairs */
-        ival=invsigma*imcurr;
-        for(ip=-1;ip<=1;ip++)
-          for(jp=-1;jp<=1;jp++)
-            goodback[jp+1][ip+1]=(float) (image_ivar[(j+jp)*xnpix+(i+ip)]>0.);
-        if((goodback[1][0]+goodback[1][2])>0) {
-          back[0]=(image[j*xnpix+(i-1)]*goodback[1][0]
-                   +image[j*xnpix+(i+1)]*goodback[1][2])/
-            (goodback[1][0]+goodback[1][2]);
-          if(ival<back[0]*invsigma+nsig) continue;
-        } /* end if */
-        if((goodback[0][1]+goodback[2][1])>0) {
-          back[1]=(image[(j-1)*xnpix+i]*goodback[0][1]+
-                   image[(j+1)*xnpix+i]*goodback[2][1])/
-            (goodback[0][1]+goodback[2][1]);
-          if(ival<back[1]*invsigma+nsig) continue;
-        } /* end if */
-        if((goodback[0][0]+goodback[2][2])>0) {
-          back[2]=(image[(j-1)*xnpix+(i-1)]*goodback[0][0]+
-                   image[(j+1)*xnpix+(i+1)]*goodback[2][2])/
-            (goodback[0][0]+goodback[2][2]);
-          if(ival<back[2]*invsigma+nsig) continue;
-        } /* end if */
-        if((goodback[2][0]+goodback[0][2])>0) {
-          back[3]=(image[(j+1)*xnpix+(i-1)]*goodback[2][0]+
-                   image[(j-1)*xnpix+(i+1)]*goodback[0][2])/
-            (goodback[2][0]+goodback[0][2]);
-          if(ival<back[3]*invsigma+nsig) continue;
-          ival=invsigma*imcurr;
-        } /* end if */
-
-        /* if it does, now check if ANY pair violates PSF conditions */
-        sigmaback[0]=
-          sqrt((goodback[1][0]/(image_ivar[j*xnpix+(i-1)]+1.-goodback[1][0])+ 
-                goodback[1][2]/(image_ivar[j*xnpix+(i+1)]+1.-goodback[1][2]))/
-               (goodback[1][0]+goodback[1][2]));
-        lval=(ival-cfudge)*c2fudge*psfvals[0];
-        if(lval>invsigma*(back[0]+cfudge*sigmaback[0])) {
-          rejected[j*xnpix+i]=1;
-          image[j*xnpix+i]=back[0];
-          continue;
-        }
-        sigmaback[1]=
-          sqrt((goodback[0][1]/(image_ivar[(j-1)*xnpix+i]+1.-goodback[0][1])+ 
-                goodback[2][1]/(image_ivar[(j+1)*xnpix+i]+1.-goodback[2][1]))/
-               (goodback[0][1]+goodback[2][1]));
-        if(lval>invsigma*(back[1]+cfudge*sigmaback[1])) {
-          rejected[j*xnpix+i]=1;
-          image[j*xnpix+i]=back[1];
-          continue;
-        }
-        sigmaback[2]=
-          sqrt((goodback[0][0]/(image_ivar[(j-1)*xnpix+(i-1)]+1.- 
-                                goodback[0][0])+ 
-                goodback[2][2]/(image_ivar[(j+1)*xnpix+(i+1)]+1.- 
-                                goodback[2][2]))/
-               (goodback[0][0]+goodback[2][2]));
-        lval=(ival-cfudge)*c2fudge*psfvals[1];
-        if(lval>invsigma*(back[2]+cfudge*sigmaback[2])) {
-          rejected[j*xnpix+i]=1;
-          image[j*xnpix+i]=back[2];
-          continue;
+      if(!cand[j*xnpix+i]) continue;
+      rejected[j*xnpix+i]=reject_cr_pixel(image, image_ivar, xnpix, i, j,
+                                          nsig, psfvals, cfudge, c2fudge);
+      if(rejected[j*xnpix+i]) {
+        if(i+1<xnpix-1 && image_ivar[j*xnpix+i+1]>0. &&
+           ignoremask[j*xnpix+i+1]==0) cand[j*xnpix+i+1]=1;
+        if(j+1<ynpix-1)
+          for(ip=i-1;ip<=i+1;ip++)
+            if(ip>=1 && ip<xnpix-1 && image_ivar[(j+1)*xnpix+ip]>0. &&
+               ignoremask[(j+1)*xnpix+ip]==0) cand[(j+1)*xnpix+ip]=1;
+      }
+    } /* end for i */
+  } /* end for j */
+
+  FREEVEC(cand);
+  return(0);
+  
+} /* end reject_cr_psf */
+
+/********************************************************************/
+/* min-heap of pixel indices, so pixels come off in the order
+   reject_cr_psf() would have scanned them */
+typedef struct {
+  long *ind;
+  long n, nalloc;
+} reject_cr_heap;
+
+static void reject_cr_push(reject_cr_heap *heap, long p)
+{
+  long k;
+
+  if(heap->n>=heap->nalloc) {
+    heap->nalloc=2*heap->nalloc+1024;
+    heap->ind=(long *) realloc(heap->ind, heap->nalloc*sizeof(long));
+  }
+  k=heap->n++;
+  while(k>0 && heap->ind[(k-1)/2]>p) {
+    heap->ind[k]=heap->ind[(k-1)/2];
+    k=(k-1)/2;
+  }
+  heap->ind[k]=p;
+} /* end reject_cr_push */
+
+static long reject_cr_pop(reject_cr_heap *heap)
+{
+  long top,last,k,c;
+
+  top=heap->ind[0];
+  last=heap->ind[--heap->n];
+  k=0;
+  for(;;) {
+    c=2*k+1;
+    if(c>=heap->n) break;
+    if(c+1<heap->n && heap->ind[c+1]<heap->ind[c]) c++;
+    if(heap->ind[c]>=last) break;
+    heap->ind[k]=heap->ind[c];
+    k=c;
+  }
+  if(heap->n>0) heap->ind[k]=last;
+  return(top);
+} /* end reject_cr_pop */
+
+/********************************************************************/
+/* queue pixel (i,j) for this pass if it can be tested and is not
+   already queued */
+static void reject_cr_queue(reject_cr_heap *heap, unsigned char *queued,
+                            float *tmp_ivar, int *ignoremask, int xnpix,
+                            int ynpix, int i, int j)
+{
+  long p;
+
+  if(i<1 || i>xnpix-2 || j<1 || j>ynpix-2) return;
+  p=(long) j*xnpix+i;
+  if(queued[p] || tmp_ivar[p]<=0. || ignoremask[p]) return;
+  queued[p]=1;
+  reject_cr_push(heap, p);
+} /* end reject_cr_queue */
+
+/********************************************************************/
+/* reject_cr_psf(), then up to niter passes (until none are new if niter
+   is negative) over the neighbors of the rejected pixels, with cfudge=0
+   and c2fudge=1.  In each of these passes the inverse variance is
+   image_ivar on the neighbors of pixels rejected so far, and zero
+   elsewhere.  The results are those of rescanning the whole frame each
+   pass, but only pixels near those rejected in the last pass, or earlier
+   in this pass, are tested again; the others would give what they gave
+   before. */
+int reject_cr_psf_iterate(float *image, 
+                          float *image_ivar, 
+                          int xnpix, 
+                          int ynpix,
+                          float nsig,
+                          float *psfvals,
+                          float cfudge,
+                          float c2fudge,
+                          int *rejected, 
+                          int *ignoremask,
+                          int niter)
+{
+  float *tmp_ivar;
+  unsigned char *queued;
+  long *newrej,nnew,nalloc,npix,p,k;
+  reject_cr_heap heap;
+  int i,j,ip,jp,iter,reach;
+
+  /* 1. the first full pass */
+  npix=(long) xnpix*ynpix;
+  for(p=0;p<npix;p++) rejected[p]=0;
+  reject_cr_psf(image, image_ivar, xnpix, ynpix, nsig, psfvals, cfudge,
+                c2fudge, rejected, ignoremask);
+  nnew=0;
+  for(p=0;p<npix;p++) if(rejected[p]) nnew++;
+  if(nnew==0) return(0);
+  nalloc=nnew;
+  newrej=(long *) malloc(nalloc*sizeof(long));
+  nnew=0;
+  for(p=0;p<npix;p++) if(rejected[p]) newrej[nnew++]=p;
+
+  tmp_ivar=(float *) calloc(npix, sizeof(float));
+  queued=(unsigned char *) calloc(npix, sizeof(unsigned char));
+  heap.ind=NULL;
+  heap.n=heap.nalloc=0;
+
+  for(iter=0;(niter<0 || iter<niter) && nnew>0;iter++) {
+
+    /* 2. open up the neighbors of the pixels newly rejected */
+    for(k=0;k<nnew;k++) {
+      i=newrej[k]%xnpix;
+      j=newrej[k]/xnpix;
+      for(jp=j-1;jp<=j+1;jp++)
+        for(ip=i-1;ip<=i+1;ip++) {
+          p=(long) jp*xnpix+ip;
+          tmp_ivar[p]=rejected[p] ? 0. : image_ivar[p];
         }
-        sigmaback[3]=
-          sqrt((goodback[2][0]/(image_ivar[(j+1)*xnpix+(i-1)]+1.- 
-                                goodback[2][0])+ 
-                goodback[0][2]/(image_ivar[(j-1)*xnpix+(i+1)]+1.- 
-                                goodback[0][2]))/
-               (goodback[2][0]+goodback[0][2]));
-        if(lval>invsigma*(back[3]+cfudge*sigmaback[3])) {
-          rejected[j*xnpix+i]=1;
-          image[j*xnpix+i]=back[3];
-          continue;
+    }
+
+    /* 3. queue every pixel that can see a change: after the first pass
+       everything open is new, later only what is within two pixels of
+       a new rejection */
+    reach=(iter==0) ? 1 : 2;
+    for(k=0;k<nnew;k++) {
+      i=newrej[k]%xnpix;
+      j=newrej[k]/xnpix;
+      for(jp=j-reach;jp<=j+reach;jp++)
+        for(ip=i-reach;ip<=i+reach;ip++)
+          reject_cr_queue(&heap, queued, tmp_ivar, ignoremask, xnpix, ynpix,
+                          ip, jp);
+    }
+
+    /* 4. test in scan order; a rejection changes the image under the
+       pixels after it, so they are queued too */
+    nnew=0;
+    while(heap.n>0) {
+      p=reject_cr_pop(&heap);
+      queued[p]=0;
+      i=p%xnpix;
+      j=p/xnpix;
+      if(reject_cr_pixel(image, tmp_ivar, xnpix, i, j, nsig, psfvals, 0., 
+                         1.)) {
+        rejected[p]=1;
+        if(nnew>=nalloc) {
+          nalloc=2*nalloc+1024;
+          newrej=(long *) realloc(newrej, nalloc*sizeof(long));
         }
-        
-      } /* end if */
-    } /* end for j */
-  } /* end for i */
-  
-  FREEVEC(sigmaback);
-  FREEVEC(back);
+        newrej[nnew++]=p;
+        reject_cr_queue(&heap, queued, tmp_ivar, ignoremask, xnpix, ynpix,
+                        i+1, j);
+        for(ip=i-1;ip<=i+1;ip++)
+          reject_cr_queue(&heap, queued, tmp_ivar, ignoremask, xnpix, ynpix,
+                          ip, j+1);
+      }
+    }
+  }
+
+  FREEVEC(heap.ind);
+  FREEVEC(queued);
+  FREEVEC(tmp_ivar);
+  FREEVEC(newrej);
   return(0);
-  
-} /* end photfrac */
+
+} /* end reject_cr_psf_iterate */
@@ -1,26 +1,213 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "export.h"
-#include "nr.h"
+#include "idlutils_threads.h"
+#include "arrcombine.h"
 
-float vector_avsigclip
-  (IDL_LONG    nData,
-   float    *  pData,
+/* Number of adjacent output pixels (along the "lo" dimensions) that are
+ * clipped together, one per vector lane.
+ */
+#define AVSIGCLIP_BLOCK 64
+
+typedef struct {
+   float    *  array;
+   float    *  avearr;
+   IDL_LONG    nlo;
+   IDL_LONG    nmid;
+   IDL_LONG    nhi;
+   IDL_LONG    nblock;
+   float       sigrejlo;
+   float       sigrejhi;
+   IDL_LONG    maxiter;
+   idlutils_queue queue;
+} avsigclip_work;
+
+/******************************************************************************/
+/* Sigma-clipped means of the "nlane" interleaved vectors in tile[], where
+ * element imid of lane "lane" is tile[imid*nlane+lane].  Each iteration
+ * keeps the values strictly within (mean - sigrejlo*disp, mean +
+ * sigrejhi*disp) of the previous iteration, as a per-lane mask rather than
+ * a compacted copy, and accumulates the mean and dispersion of the kept
+ * values in one pass (in double precision, relative to the previous mean).
+ * A lane whose values are all rejected keeps its previous mean.  Once no
+ * mask changes, further iterations would give the same answer, so they
+ * are skipped.
+ */
+static void avsigclip_tile
+  (float    *  tile,
+   char     *  mask,
+   IDL_LONG    nmid,
+   IDL_LONG    nlane,
    float       sigrejlo,
    float       sigrejhi,
-   IDL_LONG    maxiter);
-void vector_mean_and_dispersion
-  (IDL_LONG    nData,
-   float    *  pData,
-   float    *  pMean,
-   float    *  pDispersion);
-float vector_mean
-  (IDL_LONG    nData,
-   float    *  pData);
-float vector_sum
-  (IDL_LONG    nData,
-   float    *  pData);
+   IDL_LONG    maxiter,
+   float    *  pOut)
+{
+   double      sum[AVSIGCLIP_BLOCK];
+   double      sumsq[AVSIGCLIP_BLOCK];
+   double      shift[AVSIGCLIP_BLOCK];
+   float       mval[AVSIGCLIP_BLOCK];
+   float       mdisp[AVSIGCLIP_BLOCK];
+   float       vlo[AVSIGCLIP_BLOCK];
+   float       vhi[AVSIGCLIP_BLOCK];
+   IDL_LONG    nGood[AVSIGCLIP_BLOCK];
+   IDL_LONG    nchange;
+   IDL_LONG    iiter;
+   IDL_LONG    imid;
+   IDL_LONG    lane;
+   float    *  pRow;
+   char     *  pMask;
+   double      diff;
+   double      var;
+   char        good;
+
+   /* First compute the mean and dispersion of all values */
+   for (lane=0; lane < nlane; lane++) {
+      shift[lane] = tile[lane];
+      sum[lane] = 0.0;
+      sumsq[lane] = 0.0;
+      nGood[lane] = nmid;
+   }
+   for (imid=0; imid < nmid; imid++) {
+      pRow = tile + imid*nlane;
+      for (lane=0; lane < nlane; lane++) {
+         diff = pRow[lane] - shift[lane];
+         sum[lane] += diff;
+         sumsq[lane] += diff * diff;
+      }
+   }
+   if (maxiter > 0) memset(mask, 1, nmid * nlane);
+
+   for (iiter=0; ; iiter++) {
+      for (lane=0; lane < nlane; lane++) {
+         if (nGood[lane] == 0) continue;
+         mval[lane] = shift[lane] + sum[lane] / nGood[lane];
+         mdisp[lane] = 0.0;
+         if (nGood[lane] > 1) {
+            var = (sumsq[lane] - sum[lane] * sum[lane] / nGood[lane])
+             / (nGood[lane] - 1);
+            if (var > 0.0) mdisp[lane] = sqrt(var);
+         }
+      }
+      if (iiter == maxiter) break;
+
+      /* Iterate with rejection */
+      for (lane=0; lane < nlane; lane++) {
+         vlo[lane] = mval[lane] - sigrejlo*mdisp[lane];
+         vhi[lane] = mval[lane] + sigrejhi*mdisp[lane];
+         shift[lane] = mval[lane];
+         sum[lane] = 0.0;
+         sumsq[lane] = 0.0;
+         nGood[lane] = 0;
+      }
+      nchange = 0;
+      for (imid=0; imid < nmid; imid++) {
+         pRow = tile + imid*nlane;
+         pMask = mask + imid*nlane;
+         for (lane=0; lane < nlane; lane++) {
+            good = (pRow[lane] > vlo[lane] && pRow[lane] < vhi[lane]);
+            nchange += (good != pMask[lane]);
+            pMask[lane] = good;
+            diff = good ? pRow[lane] - shift[lane] : 0.0;
+            sum[lane] += diff;
+            sumsq[lane] += diff * diff;
+            nGood[lane] += good;
+         }
+      }
+      if (nchange == 0) break;
+   }
+
+   memcpy(pOut, mval, nlane * sizeof(float));
+}
+
+/******************************************************************************/
+static void avsigclip_thread
+  (void     *  arg,
+   int         ithread,
+   int         nthreads)
+{
+   avsigclip_work * w = (avsigclip_work *) arg;
+   IDL_LONG    nlane;
+   IDL_LONG    ilo0;
+   IDL_LONG    ihi;
+   IDL_LONG    imid;
+   float    *  tile;
+   char     *  mask;
+   float    *  pIn;
+   long        lo;
+   long        hi;
+   long        item;
+
+   nlane = (w->nlo < AVSIGCLIP_BLOCK) ? w->nlo : AVSIGCLIP_BLOCK;
+   tile = malloc(nlane * w->nmid * sizeof(float));
+   mask = malloc(nlane * w->nmid * sizeof(char));
+
+   while (idlutils_queue_next(&(w->queue), &lo, &hi)) {
+      for (item=lo; item < hi; item++) {
+         ihi = item / w->nblock;
+         ilo0 = (item % w->nblock) * AVSIGCLIP_BLOCK;
+         nlane = w->nlo - ilo0;
+         if (nlane > AVSIGCLIP_BLOCK) nlane = AVSIGCLIP_BLOCK;
+
+         /* Gather the vectors of "nlane" adjacent pixels */
+         pIn = w->array + ilo0 + ihi * w->nmid * w->nlo;
+         for (imid=0; imid < w->nmid; imid++)
+            memcpy(tile + imid*nlane, pIn + imid * w->nlo,
+             nlane * sizeof(float));
+
+         avsigclip_tile(tile, mask, w->nmid, nlane, w->sigrejlo, w->sigrejhi,
+          w->maxiter, w->avearr + ilo0 + ihi * w->nlo);
+      }
+   }
+
+   free(tile);
+   free(mask);
+}
+
+/******************************************************************************/
+/* Sigma-clipped means along the middle dimension of an nhi x nmid x nlo
+ * cube.
+ */
+void arravsigclip_cube
+  (float    *  array,
+   IDL_LONG    nlo,
+   IDL_LONG    nmid,
+   IDL_LONG    nhi,
+   float       sigrejlo,
+   float       sigrejhi,
+   IDL_LONG    maxiter,
+   float    *  avearr)
+{
+   avsigclip_work w;
+   long        nitem;
+   long        chunk;
+
+   if (nlo <= 0 || nhi <= 0 || nmid <= 0) return;
+   w.array = array;
+   w.avearr = avearr;
+   w.nlo = nlo;
+   w.nmid = nmid;
+   w.nhi = nhi;
+   w.sigrejlo = sigrejlo;
+   w.sigrejhi = sigrejhi;
+   w.maxiter = (maxiter < 0) ? 0 : maxiter;
+
+   /* Clip tiles of adjacent pixels, handed out to the threads in chunks
+    * of roughly 64k input values.
+    */
+   w.nblock = (nlo + AVSIGCLIP_BLOCK - 1) / AVSIGCLIP_BLOCK;
+   nitem = (long) w.nblock * nhi;
+   chunk = 65536 / ((nlo < AVSIGCLIP_BLOCK ? nlo : AVSIGCLIP_BLOCK)
+    * (long) nmid);
+   if (chunk < 1) chunk = 1;
+
+   idlutils_queue_init(&(w.queue), nitem, chunk);
+   idlutils_run(idlutils_nthreads((nitem + chunk - 1) / chunk),
+    avsigclip_thread, &w);
+   idlutils_queue_free(&(w.queue));
+}
 
 /******************************************************************************/
 IDL_LONG arravsigclip
@@ -40,12 +227,6 @@ IDL_LONG arravsigclip
    IDL_LONG    nlo;
    IDL_LONG    nmid;
    IDL_LONG    nhi;
-   IDL_LONG    ilo;
-   IDL_LONG    imid;
-   IDL_LONG    ihi;
-   IDL_LONG    i1;
-   IDL_LONG    indx;
-   float    *  tempvec;
    IDL_LONG    retval = 1;
 
    /* Allocate pointers from IDL */
@@ -64,134 +245,8 @@ IDL_LONG arravsigclip
    for (i=dim; i < ndim; i++) nhi *= dimvec[i];
    nmid = dimvec[dim-1];
 
-   /* Allocate memory for temporary vector */
-   tempvec = malloc(nmid * sizeof(float));
-
-   /* Loop through all pixels in array */
-   for (ilo=0; ilo < nlo; ilo++) {
-      for (ihi=0; ihi < nhi; ihi++) {
-         i1 = ilo + ihi * nmid * nlo;
-         /* Construct the vector of values from which to compute */
-         for (imid=0; imid < nmid; imid++) {
-            indx = i1 + imid * nlo;
-            tempvec[imid] = array[indx];
-         }
-         /* Compute a single average value with sigma clipping */
-         avearr[ilo + ihi * nlo] =
-          vector_avsigclip(nmid, tempvec, sigrejlo, sigrejhi, maxiter);
-      }
-   }
-
-   /* Free temporary memory */
-   free(tempvec);
+   arravsigclip_cube(array, nlo, nmid, nhi, sigrejlo, sigrejhi, maxiter,
+    avearr);
 
    return retval;
 }
-
-/******************************************************************************/
-float vector_avsigclip
-  (IDL_LONG    nData,
-   float    *  pData,
-   float       sigrejlo,
-   float       sigrejhi,
-   IDL_LONG    maxiter)
-{
-   IDL_LONG   i;
-   IDL_LONG   nGood;
-   IDL_LONG   iiter;
-   float      mval;
-   float      mdisp;
-   float    * pGood;
-
-   /* First compute the mean and dispersion */
-   if (maxiter > 0) {
-      /* Allocate memory for temporary vector */
-      pGood = malloc(nData * sizeof(float));
-
-      vector_mean_and_dispersion(nData, pData, &mval, &mdisp);
-   } else {
-      mval = vector_mean(nData, pData);
-   }
-
-   /* Iterate with rejection */
-   for (iiter=0; iiter < maxiter; iiter++) {
-      /* Copy all values within rejection limits into temporary vector */
-      nGood = 0;
-      for (i=0; i < nData; i++) {
-         if (pData[i] > mval - sigrejlo*mdisp
-          && pData[i] < mval + sigrejhi*mdisp)
-          pGood[nGood++] = pData[i];
-      }
-      if (nGood == 0) {
-         iiter = maxiter;
-      } else {
-         vector_mean_and_dispersion(nGood, pGood, &mval, &mdisp);
-      }
-   }
-
-   /* Free memory */
-   if (maxiter > 0) free(pGood);
-
-   return mval;
-}
-
-/******************************************************************************/
-/* Find the mean and dispersion of the nData elements.
- * Return a dispersion of zero if there are fewer than two data elements.
- */
-void vector_mean_and_dispersion
-  (IDL_LONG    nData,
-   float    *  pData,
-   float    *  pMean,
-   float    *  pDispersion)
-{
-   IDL_LONG    i;
-   float       vmean;
-   float       vdisp;
-   float       vtemp;
-
-   vmean = vector_mean(nData, pData);
-   vdisp = 0.0;
-   if (nData > 1) {
-      for (i=0; i<nData; i++) {
-         vtemp = pData[i] - vmean;
-         vdisp += vtemp * vtemp;
-      }
-      vdisp = sqrt(vdisp/(nData-1));
-   }
-
-   *pMean = vmean;
-   *pDispersion = vdisp;
-}
-
-/******************************************************************************/
-/* Find the mean value of the nData elements of a floating point array pData[].
- */
-float vector_mean
-  (IDL_LONG    nData,
-   float    *  pData)
-{
-   float       vmean;
-
-   vmean = vector_sum(nData, pData);
-   vmean /=  nData;
-
-   return vmean;
-}
-
-/******************************************************************************/
-/* Find the summed value of the nData elements of a floating point array pData[].
- */
-float vector_sum
-  (IDL_LONG    nData,
-   float    *  pData)
-{
-   IDL_LONG    i;
-   float       vsum;
-
-   vsum = 0.0;
-   for (i=0; i<nData; i++) vsum += pData[i];
-
-   return vsum;
-}
-
@@ -2,7 +2,21 @@
 #include <math.h>
 #include <stdlib.h>
 #include "export.h"
-#include "nr.h"
+#include "idlutils_threads.h"
+#include "arrcombine.h"
+
+typedef struct {
+   float    *  array;
+   char     *  maskin;
+   char     *  maskout;
+   float    *  avearr;
+   IDL_LONG    nlo;
+   IDL_LONG    nmid;
+   IDL_LONG    nhi;
+   float       sigrejlo;
+   float       sigrejhi;
+   IDL_LONG    maxiter;
+} avsigmask_work;
 
 float vector_avsigclip_mask
   (IDL_LONG    nData,
@@ -23,6 +37,101 @@ float vector_mean_mask
    float    *  pData,
    char     *  pMask);
 
+/******************************************************************************/
+/* Each thread clips a contiguous range of the nlo*nhi output pixels.
+ */
+static void avsigmask_thread
+  (void     *  arg,
+   int         ithread,
+   int         nthreads)
+{
+   avsigmask_work * w = (avsigmask_work *) arg;
+   IDL_LONG    ilo;
+   IDL_LONG    imid;
+   IDL_LONG    ihi;
+   IDL_LONG    i1;
+   IDL_LONG    indx;
+   float    *  tempvec;
+   char     *  tempm1;
+   char     *  tempm2;
+   long        lo;
+   long        hi;
+   long        ipix;
+
+   /* Allocate memory for temporary vector */
+   tempvec = malloc(w->nmid * sizeof(float));
+   tempm1 = malloc(w->nmid * sizeof(char));
+   tempm2 = malloc(w->nmid * sizeof(char));
+
+   /* Loop through this thread's pixels in array */
+   idlutils_range((long) w->nlo * w->nhi, ithread, nthreads, &lo, &hi);
+   for (ipix=lo; ipix < hi; ipix++) {
+      ilo = ipix % w->nlo;
+      ihi = ipix / w->nlo;
+      i1 = ilo + ihi * w->nmid * w->nlo;
+
+      /* Construct the vector of values from which to compute */
+      for (imid=0; imid < w->nmid; imid++) {
+         indx = i1 + imid * w->nlo;
+         tempvec[imid] = w->array[indx];
+         tempm1[imid] = w->maskin[indx];
+         tempm2[imid] = w->maskout[indx];
+      }
+
+      /* Compute a single average value with sigma clipping */
+      w->avearr[ilo + ihi * w->nlo] =
+       vector_avsigclip_mask(w->nmid, tempvec, tempm1, tempm2,
+        w->sigrejlo, w->sigrejhi, w->maxiter);
+
+      /* Copy output mask values */
+      for (imid=0; imid < w->nmid; imid++) {
+         indx = i1 + imid * w->nlo;
+         w->maskout[indx] = tempm2[imid];
+      }
+   }
+
+   /* Free temporary memory */
+   free(tempvec);
+   free(tempm1);
+   free(tempm2);
+}
+
+/******************************************************************************/
+/* Sigma-clipped means along the middle dimension of an nhi x nmid x nlo
+ * cube, ignoring values flagged in maskin and flagging rejected values
+ * (and those in maskin) in maskout.
+ */
+void arravsigmask_cube
+  (float    *  array,
+   char     *  maskin,
+   char     *  maskout,
+   IDL_LONG    nlo,
+   IDL_LONG    nmid,
+   IDL_LONG    nhi,
+   float       sigrejlo,
+   float       sigrejhi,
+   IDL_LONG    maxiter,
+   float    *  avearr)
+{
+   avsigmask_work w;
+   long        npix;
+
+   if (nlo <= 0 || nhi <= 0 || nmid <= 0) return;
+   w.array = array;
+   w.maskin = maskin;
+   w.maskout = maskout;
+   w.avearr = avearr;
+   w.nlo = nlo;
+   w.nmid = nmid;
+   w.nhi = nhi;
+   w.sigrejlo = sigrejlo;
+   w.sigrejhi = sigrejhi;
+   w.maxiter = maxiter;
+
+   npix = (long) nlo * nhi;
+   idlutils_run(idlutils_nthreads(npix / 4096 + 1), avsigmask_thread, &w);
+}
+
 /******************************************************************************/
 IDL_LONG arravsigclip_mask
   (int         argc,
@@ -43,14 +152,6 @@ IDL_LONG arravsigclip_mask
    IDL_LONG    nlo;
    IDL_LONG    nmid;
    IDL_LONG    nhi;
-   IDL_LONG    ilo;
-   IDL_LONG    imid;
-   IDL_LONG    ihi;
-   IDL_LONG    i1;
-   IDL_LONG    indx;
-   float    *  tempvec;
-   char     *  tempm1;
-   char     *  tempm2;
    IDL_LONG    retval = 1;
 
    /* Allocate pointers from IDL */
@@ -71,41 +172,8 @@ IDL_LONG arravsigclip_mask
    for (i=dim; i < ndim; i++) nhi *= dimvec[i];
    nmid = dimvec[dim-1];
 
-   /* Allocate memory for temporary vector */
-   tempvec = malloc(nmid * sizeof(float));
-   tempm1 = malloc(nmid * sizeof(char));
-   tempm2 = malloc(nmid * sizeof(char));
-
-   /* Loop through all pixels in array */
-   for (ilo=0; ilo < nlo; ilo++) {
-      for (ihi=0; ihi < nhi; ihi++) {
-         i1 = ilo + ihi * nmid * nlo;
-
-         /* Construct the vector of values from which to compute */
-         for (imid=0; imid < nmid; imid++) {
-            indx = i1 + imid * nlo;
-            tempvec[imid] = array[indx];
-            tempm1[imid] = maskin[indx];
-            tempm2[imid] = maskout[indx];
-         }
-
-         /* Compute a single average value with sigma clipping */
-         avearr[ilo + ihi * nlo] =
-          vector_avsigclip_mask(nmid, tempvec, tempm1, tempm2,
-           sigrejlo, sigrejhi, maxiter);
-
-         /* Copy output mask values */
-         for (imid=0; imid < nmid; imid++) {
-            indx = i1 + imid * nlo;
-            maskout[indx] = tempm2[imid];
-         }
-      }
-   }
-
-   /* Free temporary memory */
-   free(tempvec);
-   free(tempm1);
-   free(tempm2);
+   arravsigmask_cube(array, maskin, maskout, nlo, nmid, nhi, sigrejlo,
+    sigrejhi, maxiter, avearr);
 
    return retval;
 }
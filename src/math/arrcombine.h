@@ -0,0 +1,41 @@
+/*
+ * arrcombine.h
+ *
+ * Combine a cube of nhi x nmid x nlo values (nlo varying fastest) along
+ * its middle dimension into nhi x nlo outputs.  These are the engines
+ * behind arrmedian, arravsigclip and arravsigclip_mask, callable
+ * directly from C (as by stackcombine) without going through argv.
+ */
+#ifndef _ARRCOMBINE_H_
+#define _ARRCOMBINE_H_
+
+void arrmedian_cube
+  (float    *  array,
+   IDL_LONG    nlo,
+   IDL_LONG    nmid,
+   IDL_LONG    nhi,
+   float    *  medarr);
+
+void arravsigclip_cube
+  (float    *  array,
+   IDL_LONG    nlo,
+   IDL_LONG    nmid,
+   IDL_LONG    nhi,
+   float       sigrejlo,
+   float       sigrejhi,
+   IDL_LONG    maxiter,
+   float    *  avearr);
+
+void arravsigmask_cube
+  (float    *  array,
+   char     *  maskin,
+   char     *  maskout,
+   IDL_LONG    nlo,
+   IDL_LONG    nmid,
+   IDL_LONG    nhi,
+   float       sigrejlo,
+   float       sigrejhi,
+   IDL_LONG    maxiter,
+   float    *  avearr);
+
+#endif /* _ARRCOMBINE_H_ */
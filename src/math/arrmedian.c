@@ -1,13 +1,143 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "export.h"
-#include "nr.h"
+#include "idlutils_select.h"
+#include "idlutils_threads.h"
+#include "arrcombine.h"
+
+/* Number of adjacent output pixels (along the "lo" dimensions) whose
+ * vectors are gathered together into one tile.
+ */
+#define ARRMEDIAN_BLOCK 64
+
+typedef struct {
+   float    *  array;
+   float    *  medarr;
+   IDL_LONG    nlo;
+   IDL_LONG    nmid;
+   IDL_LONG    nhi;
+   IDL_LONG    nblock;
+   idlutils_queue queue;
+} arrmedian_work;
 
 float vector_median
   (IDL_LONG   nData,
    float *    pData);
 
+/******************************************************************************/
+/* Medians of one tile: the "nlane" output pixels starting at "ilo0" for the
+ * outer index "ihi".  Each row of the input contributes "nlane" adjacent
+ * values, so the tile is read sequentially.  Short vectors are sorted all
+ * at once, lane by lane, with a sorting network; long ones are transposed
+ * so that each pixel's vector is contiguous.
+ */
+static void arrmedian_tile
+  (arrmedian_work * w,
+   IDL_LONG   ihi,
+   IDL_LONG   ilo0,
+   IDL_LONG   nlane,
+   float *    tile,
+   float *    work)
+{
+   IDL_LONG    nmid = w->nmid;
+   IDL_LONG    imid;
+   IDL_LONG    lane;
+   float    *  pIn;
+   float    *  pOut;
+
+   pIn = w->array + ilo0 + ihi * nmid * w->nlo;
+   pOut = w->medarr + ilo0 + ihi * w->nlo;
+
+   if (nmid <= IDLUTILS_SELECT_NETWORK) {
+      for (imid=0; imid < nmid; imid++)
+         memcpy(tile + imid*nlane, pIn + imid * w->nlo, nlane*sizeof(float));
+      idlutils_network_lanes_float(tile, nmid, nlane);
+      if (nmid % 2 == 1) {
+         memcpy(pOut, tile + (nmid/2)*nlane, nlane*sizeof(float));
+      } else {
+         for (lane=0; lane < nlane; lane++)
+            pOut[lane] = 0.5 * (tile[(nmid/2-1)*nlane + lane]
+                              + tile[(nmid/2)*nlane + lane]);
+      }
+   } else {
+      for (imid=0; imid < nmid; imid++)
+         for (lane=0; lane < nlane; lane++)
+            tile[lane*nmid + imid] = pIn[imid * w->nlo + lane];
+      for (lane=0; lane < nlane; lane++)
+         pOut[lane] = idlutils_median_float(tile + lane*nmid, nmid, work);
+   }
+}
+
+/******************************************************************************/
+static void arrmedian_thread
+  (void *     arg,
+   int        ithread,
+   int        nthreads)
+{
+   arrmedian_work * w = (arrmedian_work *) arg;
+   IDL_LONG    nlane;
+   IDL_LONG    ilo0;
+   float    *  tile;
+   float    *  work;
+   long        lo;
+   long        hi;
+   long        item;
+
+   nlane = (w->nlo < ARRMEDIAN_BLOCK) ? w->nlo : ARRMEDIAN_BLOCK;
+   tile = malloc(nlane * w->nmid * sizeof(float));
+   work = malloc(w->nmid * sizeof(float));
+
+   while (idlutils_queue_next(&(w->queue), &lo, &hi)) {
+      for (item=lo; item < hi; item++) {
+         ilo0 = (item % w->nblock) * ARRMEDIAN_BLOCK;
+         nlane = w->nlo - ilo0;
+         if (nlane > ARRMEDIAN_BLOCK) nlane = ARRMEDIAN_BLOCK;
+         arrmedian_tile(w, item / w->nblock, ilo0, nlane, tile, work);
+      }
+   }
+
+   free(tile);
+   free(work);
+}
+
+/******************************************************************************/
+/* Medians along the middle dimension of an nhi x nmid x nlo cube.
+ */
+void arrmedian_cube
+  (float    *  array,
+   IDL_LONG    nlo,
+   IDL_LONG    nmid,
+   IDL_LONG    nhi,
+   float    *  medarr)
+{
+   arrmedian_work w;
+   long        nitem;
+   long        chunk;
+
+   if (nlo <= 0 || nhi <= 0 || nmid <= 0) return;
+   w.array = array;
+   w.medarr = medarr;
+   w.nlo = nlo;
+   w.nmid = nmid;
+   w.nhi = nhi;
+
+   /* Split the output into tiles of adjacent pixels, handed out to the
+    * threads in chunks of roughly 64k input values.
+    */
+   w.nblock = (nlo + ARRMEDIAN_BLOCK - 1) / ARRMEDIAN_BLOCK;
+   nitem = (long) w.nblock * nhi;
+   chunk = 65536 / ((nlo < ARRMEDIAN_BLOCK ? nlo : ARRMEDIAN_BLOCK)
+    * (long) nmid);
+   if (chunk < 1) chunk = 1;
+
+   idlutils_queue_init(&(w.queue), nitem, chunk);
+   idlutils_run(idlutils_nthreads((nitem + chunk - 1) / chunk),
+    arrmedian_thread, &w);
+   idlutils_queue_free(&(w.queue));
+}
+
 /******************************************************************************/
 IDL_LONG arrmedian
   (int      argc,
@@ -23,12 +153,6 @@ IDL_LONG arrmedian
    IDL_LONG    nlo;
    IDL_LONG    nmid;
    IDL_LONG    nhi;
-   IDL_LONG    ilo;
-   IDL_LONG    imid;
-   IDL_LONG    ihi;
-   IDL_LONG    i1;
-   IDL_LONG    indx;
-   float    *  tempvec;
    IDL_LONG    retval = 1;
 
    /* Allocate pointers from IDL */
@@ -44,25 +168,7 @@ IDL_LONG arrmedian
    for (i=dim; i < ndim; i++) nhi *= dimvec[i];
    nmid = dimvec[dim-1];
 
-   /* Allocate memory for temporary vector */
-   tempvec = malloc(nmid * sizeof(float));
-
-   /* Loop through all pixels in array */
-   for (ilo=0; ilo < nlo; ilo++) {
-      for (ihi=0; ihi < nhi; ihi++) {
-         i1 = ilo + ihi * nmid * nlo;
-         /* Construct the vector of values from which to compute a median */
-         for (imid=0; imid < nmid; imid++) {
-            indx = i1 + imid * nlo;
-            tempvec[imid] = array[indx];
-         }
-         /* Compute a single median value */
-         medarr[ilo + ihi * nlo] = vector_median(nmid, tempvec);
-      }
-   }
-
-   /* Free temporary memory */
-   free(tempvec);
+   arrmedian_cube(array, nlo, nmid, nhi, medarr);
 
    return retval;
 }
@@ -75,21 +181,5 @@ float vector_median
   (IDL_LONG   nData,
    float *    pData)
 {
-   unsigned long nlong;
-   unsigned long klong;
-   float    retval;
-
-   /* Numerical Recipes routines expect everything to be 1-indexed.
-    * Pass the array pData as 1-indexed, and the element counter klong
-    * as a 1-indexed element number.
-    */
-   nlong = nData;
-   klong = (nlong+1)/2;
-   retval = selip(klong, nlong, pData-1);
-   if (nData % 2 == 0) {
-      retval = 0.5 * (retval + selip(klong+1, nlong, pData-1));
-   }
-
-   return retval;
+   return idlutils_median_float(pData, nData, NULL);
 }
-
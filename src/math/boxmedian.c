@@ -0,0 +1,690 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "idlutils_threads.h"
+#include "idlutils_select.h"
+
+/* Data whose values are all integers spanning at most this many levels
+ * can be filtered with histograms, which is done when the box is large
+ * enough for that to be faster; anything else uses sorted windows, or
+ * ranked windows for large boxes.
+ */
+#define BOXMEDIAN_MAXLEVELS 4096
+
+/* Levels per coarse histogram bin.
+ */
+#define BOXMEDIAN_FINE 64
+
+/* Smallest box radius for which non-integer data is filtered with
+ * ranked rather than sorted windows.
+ */
+#define BOXMEDIAN_MINRANKED 6
+
+/* Width of the blocks of output done with one ranking, in units of the
+ * box width.
+ */
+#define BOXMEDIAN_BLOCK 4
+
+/* Fewest output rows per thread, in units of the box width, so that
+ * setting up each strip stays a small part of its cost.
+ */
+#define BOXMEDIAN_MINSTRIP 4
+
+/* Most memory used by the per-thread column histograms or rankings.
+ */
+#define BOXMEDIAN_MAXMEM 268435456L
+
+#define BOXMEDIAN_NONE 0
+#define BOXMEDIAN_REFLECT 1
+
+typedef struct {
+   double   *  image;
+   double   *  medarr;
+   IDL_LONG    nx;
+   IDL_LONG    ny;
+   IDL_LONG    radius;
+   IDL_LONG    xlo;       /* output pixels [xlo,xhi) x [ylo,yhi) are */
+   IDL_LONG    xhi;       /* filtered, the rest copied */
+   IDL_LONG    ylo;
+   IDL_LONG    yhi;
+   IDL_LONG *  xmap;      /* image column of box column xlo-radius+i */
+   IDL_LONG *  ymap;      /* image row of box row ylo-radius+i */
+   unsigned short * level; /* integerized image, or NULL */
+   double      vmin;
+   IDL_LONG    nlevel;
+   IDL_LONG    ncoarse;
+} boxmedian_work;
+
+/******************************************************************************/
+/* Image index of pixel i of a row or column of n pixels, reflecting
+ * about the edges as djs_median does: -1 is 0, n is n-1.  Only the
+ * lower-right corner of the padding differs; see boxmedian_padded().
+ */
+static IDL_LONG boxmedian_reflect
+  (IDL_LONG   i,
+   IDL_LONG   n)
+{
+   while (i < 0 || i >= n) {
+      if (i < 0) i = -1 - i;
+      if (i >= n) i = 2*n - 1 - i;
+   }
+   return i;
+}
+
+/******************************************************************************/
+/* Index in the image of pixel (x,y) of the padding djs_median 'reflect'
+ * builds around it, for x and y at most r beyond the edges.  The sides
+ * and three corners are reflected about both edges, but the lower-right
+ * corner (x >= nx, y < 0) is reverse(array[nx-r-1:nx-1,0:r],2), reflected
+ * in y only.
+ */
+static size_t boxmedian_padded
+  (IDL_LONG   x,
+   IDL_LONG   y,
+   IDL_LONG   nx,
+   IDL_LONG   ny,
+   IDL_LONG   r)
+{
+   if (x >= nx && y < 0)
+      return (size_t) (x - r - 1) + (size_t) (-1 - y) * nx;
+   return (size_t) boxmedian_reflect(x, nx)
+    + (size_t) boxmedian_reflect(y, ny) * nx;
+}
+
+/******************************************************************************/
+/* Perreault & Hebert (2007) median filter of the output rows [y0,y1).
+ * Each image column keeps coarse and fine histograms of the box rows
+ * around the current output row, updated by one pixel in and one out per
+ * row.  Along a row the box's coarse histogram is updated by one column
+ * histogram in and one out per pixel; the fine histogram of a coarse
+ * bin is only brought up to date when the median falls in that bin.
+ * The cost per pixel does not depend on the box size.
+ */
+static void boxmedian_histogram
+  (boxmedian_work * w,
+   IDL_LONG   y0,
+   IDL_LONG   y1)
+{
+   IDL_LONG    nx = w->nx;
+   IDL_LONG    r = w->radius;
+   IDL_LONG    nbox = 2*r + 1;
+   IDL_LONG    nlevel = w->nlevel;
+   IDL_LONG    ncoarse = w->ncoarse;
+   IDL_LONG    rank = (nbox*nbox)/2;
+   unsigned short * colc;
+   unsigned short * colf;
+   unsigned short * pc;
+   unsigned short * pf;
+   unsigned short * pl;
+   IDL_LONG *  boxc;
+   IDL_LONG *  boxf;
+   IDL_LONG *  last;
+   IDL_LONG    x;
+   IDL_LONG    y;
+   IDL_LONG    i;
+   IDL_LONG    b;
+   IDL_LONG    l;
+   IDL_LONG    l0;
+   IDL_LONG    l1;
+   IDL_LONG    p;
+   IDL_LONG    lin;
+   IDL_LONG    lout;
+   IDL_LONG    cum;
+
+   colc = (unsigned short *) calloc((size_t) nx * ncoarse,
+    sizeof(unsigned short));
+   colf = (unsigned short *) calloc((size_t) nx * nlevel,
+    sizeof(unsigned short));
+   boxc = (IDL_LONG *) malloc(ncoarse * sizeof(IDL_LONG));
+   boxf = (IDL_LONG *) malloc(nlevel * sizeof(IDL_LONG));
+   last = (IDL_LONG *) malloc(ncoarse * sizeof(IDL_LONG));
+
+   /* Column histograms of the box rows around the first output row */
+   for (i=0; i < nbox; i++) {
+      pl = w->level + (size_t) w->ymap[y0 - w->ylo + i] * nx;
+      for (x=0; x < nx; x++) {
+         colc[(size_t) x*ncoarse + pl[x]/BOXMEDIAN_FINE]++;
+         colf[(size_t) x*nlevel + pl[x]]++;
+      }
+   }
+
+   for (y=y0; y < y1; y++) {
+      if (y > y0) {
+         pl = w->level + (size_t) w->ymap[y - w->ylo - 1] * nx;
+         for (x=0; x < nx; x++) {
+            colc[(size_t) x*ncoarse + pl[x]/BOXMEDIAN_FINE]--;
+            colf[(size_t) x*nlevel + pl[x]]--;
+         }
+         pl = w->level + (size_t) w->ymap[y - w->ylo + nbox - 1] * nx;
+         for (x=0; x < nx; x++) {
+            colc[(size_t) x*ncoarse + pl[x]/BOXMEDIAN_FINE]++;
+            colf[(size_t) x*nlevel + pl[x]]++;
+         }
+      }
+
+      /* Coarse histogram of the first box of the row; no fine
+       * histogram is up to date yet */
+      for (b=0; b < ncoarse; b++) {
+         boxc[b] = 0;
+         last[b] = -1;
+      }
+      for (i=0; i < nbox; i++) {
+         pc = colc + (size_t) w->xmap[i] * ncoarse;
+         for (b=0; b < ncoarse; b++) boxc[b] += pc[b];
+      }
+
+      for (x=w->xlo; x < w->xhi; x++) {
+         p = x - w->xlo;
+         if (p > 0) {
+            pc = colc + (size_t) w->xmap[p + nbox - 1] * ncoarse;
+            for (b=0; b < ncoarse; b++) boxc[b] += pc[b];
+            pc = colc + (size_t) w->xmap[p - 1] * ncoarse;
+            for (b=0; b < ncoarse; b++) boxc[b] -= pc[b];
+         }
+
+         /* Coarse bin holding the median */
+         cum = 0;
+         for (b=0; cum + boxc[b] <= rank; b++) cum += boxc[b];
+         l0 = b*BOXMEDIAN_FINE;
+         l1 = l0 + BOXMEDIAN_FINE;
+         if (l1 > nlevel) l1 = nlevel;
+
+         /* Bring its fine histogram up to date, from scratch if it is
+          * more than a box behind */
+         if (last[b] < 0 || p - last[b] >= nbox) {
+            for (l=l0; l < l1; l++) boxf[l] = 0;
+            for (i=0; i < nbox; i++) {
+               pf = colf + (size_t) w->xmap[p + i] * nlevel;
+               for (l=l0; l < l1; l++) boxf[l] += pf[l];
+            }
+         } else {
+            for (i=last[b]+1; i <= p; i++) {
+               lin = w->xmap[i + nbox - 1];
+               lout = w->xmap[i - 1];
+               pf = colf + (size_t) lin * nlevel;
+               for (l=l0; l < l1; l++) boxf[l] += pf[l];
+               pf = colf + (size_t) lout * nlevel;
+               for (l=l0; l < l1; l++) boxf[l] -= pf[l];
+            }
+         }
+         last[b] = p;
+
+         for (l=l0; cum + boxf[l] <= rank; l++) cum += boxf[l];
+         w->medarr[x + (size_t) y*nx] = w->vmin + l;
+      }
+   }
+
+   free(colc);
+   free(colf);
+   free(boxc);
+   free(boxf);
+   free(last);
+}
+
+/******************************************************************************/
+static int boxmedian_compare
+  (const void * a,
+   const void * b)
+{
+   double      da = *((const double *) a);
+   double      db = *((const double *) b);
+
+   return (da < db) ? -1 : ((da > db) ? 1 : 0);
+}
+
+/******************************************************************************/
+/* Replace one element equal to vout of the sorted col[n] by v, keeping
+ * it sorted.
+ */
+static void boxmedian_replace
+  (double   * col,
+   IDL_LONG   n,
+   double     vout,
+   double     v)
+{
+   IDL_LONG    i;
+
+   for (i=0; col[i] != vout; i++) ;
+   if (v > vout) {
+      for ( ; i < n-1 && col[i+1] < v; i++) col[i] = col[i+1];
+   } else {
+      for ( ; i > 0 && col[i-1] > v; i--) col[i] = col[i-1];
+   }
+   col[i] = v;
+}
+
+/******************************************************************************/
+/* Sorted-window median filter of the output rows [y0,y1), for small
+ * boxes over data that cannot be integerized or for which histograms do
+ * not pay.  Each image column keeps its box rows sorted, and the box is
+ * kept sorted along a row by merging in the column entering it while
+ * dropping the column leaving it, O(nbox^2) per pixel.
+ */
+static void boxmedian_sorted
+  (boxmedian_work * w,
+   IDL_LONG   y0,
+   IDL_LONG   y1)
+{
+   IDL_LONG    nx = w->nx;
+   IDL_LONG    r = w->radius;
+   IDL_LONG    nbox = 2*r + 1;
+   IDL_LONG    nwin = nbox*nbox;
+   double   *  col;
+   double   *  win;
+   double   *  tmp;
+   double   *  swap;
+   double   *  pin;
+   double   *  pout;
+   double   *  row;
+   double      v;
+   IDL_LONG    x;
+   IDL_LONG    y;
+   IDL_LONG    i;
+   IDL_LONG    j;
+   IDL_LONG    k;
+   IDL_LONG    m;
+   IDL_LONG    p;
+
+   col = (double *) malloc((size_t) nx * nbox * sizeof(double));
+   win = (double *) malloc(nwin * sizeof(double));
+   tmp = (double *) malloc(nwin * sizeof(double));
+
+   /* Sorted columns of the box rows around the first output row */
+   for (i=0; i < nbox; i++) {
+      row = w->image + (size_t) w->ymap[y0 - w->ylo + i] * nx;
+      for (x=0; x < nx; x++) col[(size_t) x*nbox + i] = row[x];
+   }
+   for (x=0; x < nx; x++)
+      qsort(col + (size_t) x*nbox, nbox, sizeof(double), boxmedian_compare);
+
+   for (y=y0; y < y1; y++) {
+      if (y > y0) {
+         pout = w->image + (size_t) w->ymap[y - w->ylo - 1] * nx;
+         pin = w->image + (size_t) w->ymap[y - w->ylo + nbox - 1] * nx;
+         for (x=0; x < nx; x++)
+            boxmedian_replace(col + (size_t) x*nbox, nbox, pout[x], pin[x]);
+      }
+
+      for (i=0; i < nbox; i++)
+         memcpy(win + i*nbox, col + (size_t) w->xmap[i] * nbox,
+          nbox * sizeof(double));
+      qsort(win, nwin, sizeof(double), boxmedian_compare);
+
+      for (x=w->xlo; x < w->xhi; x++) {
+         p = x - w->xlo;
+         if (p > 0) {
+            /* Merge the entering column into the box without the
+             * leaving one; both are sorted, and the leaving values are
+             * all in the box */
+            pin = col + (size_t) w->xmap[p + nbox - 1] * nbox;
+            pout = col + (size_t) w->xmap[p - 1] * nbox;
+            i = j = k = m = 0;
+            while (i < nwin) {
+               v = win[i++];
+               if (j < nbox && v == pout[j]) {
+                  j++;
+                  continue;
+               }
+               while (k < nbox && pin[k] < v) tmp[m++] = pin[k++];
+               tmp[m++] = v;
+            }
+            while (k < nbox) tmp[m++] = pin[k++];
+            swap = win;
+            win = tmp;
+            tmp = swap;
+         }
+         w->medarr[x + (size_t) y*nx] = win[nwin/2];
+      }
+   }
+
+   free(col);
+   free(win);
+   free(tmp);
+}
+
+/******************************************************************************/
+typedef struct {
+   double      v;
+   IDL_LONG    i;
+} boxmedian_pixel;
+
+static int boxmedian_pixel_compare
+  (const void * a,
+   const void * b)
+{
+   const boxmedian_pixel * pa = (const boxmedian_pixel *) a;
+   const boxmedian_pixel * pb = (const boxmedian_pixel *) b;
+
+   if (pa->v != pb->v) return (pa->v < pb->v) ? -1 : 1;
+   return (pa->i < pb->i) ? -1 : ((pa->i > pb->i) ? 1 : 0);
+}
+
+/******************************************************************************/
+/* Add d to the count of rank k in the Fenwick tree tree[1..n].
+ */
+static void boxmedian_count
+  (IDL_LONG * tree,
+   IDL_LONG   n,
+   IDL_LONG   k,
+   IDL_LONG   d)
+{
+   for (k++; k <= n; k += k & (-k)) tree[k] += d;
+}
+
+/******************************************************************************/
+/* Most pixels ranked at once by boxmedian_ranked() for a strip of nstrip
+ * output rows.
+ */
+static long boxmedian_nrank
+  (boxmedian_work * w,
+   IDL_LONG   nstrip)
+{
+   IDL_LONG    nbox = 2*w->radius + 1;
+   IDL_LONG    nblock = BOXMEDIAN_BLOCK * nbox;
+   long        nrow;
+   long        ncol;
+
+   nrow = ((nblock < nstrip) ? nblock : nstrip) + nbox - 1;
+   ncol = ((nblock < w->xhi - w->xlo) ? nblock : w->xhi - w->xlo) + nbox - 1;
+   return nrow * ncol;
+}
+
+/******************************************************************************/
+/* Ranked-window median filter of the output rows [y0,y1), for data that
+ * cannot be integerized and boxes wide enough for this to beat
+ * boxmedian_sorted().  The output is done in blocks of nblock x nblock
+ * pixels.  The pixels the boxes of a block read are ranked by value
+ * once, and the box is a Fenwick tree of counts over those ranks, small
+ * enough to stay in cache: moving it along a row costs 2*nbox updates and
+ * its median one descent of the tree, each O(log nbox).
+ */
+static void boxmedian_ranked
+  (boxmedian_work * w,
+   IDL_LONG   y0,
+   IDL_LONG   y1)
+{
+   IDL_LONG    r = w->radius;
+   IDL_LONG    nbox = 2*r + 1;
+   IDL_LONG    nblock = BOXMEDIAN_BLOCK * nbox;
+   IDL_LONG    half = (nbox*nbox)/2;
+   IDL_LONG    ncol;
+   IDL_LONG    nrow;
+   IDL_LONG    nrank;
+   IDL_LONG    top;
+   IDL_LONG    step;
+   IDL_LONG    bx0;
+   IDL_LONG    bx1;
+   IDL_LONG    by0;
+   IDL_LONG    by1;
+   boxmedian_pixel * pix;
+   IDL_LONG *  rank;
+   IDL_LONG *  tree;
+   IDL_LONG *  prank;
+   double   *  value;
+   double   *  row;
+   IDL_LONG    x;
+   IDL_LONG    y;
+   IDL_LONG    i;
+   IDL_LONG    k;
+   IDL_LONG    m;
+
+   nrank = boxmedian_nrank(w, y1 - y0);
+   pix = (boxmedian_pixel *) malloc((size_t) nrank * sizeof(boxmedian_pixel));
+   rank = (IDL_LONG *) malloc((size_t) nrank * sizeof(IDL_LONG));
+   value = (double *) malloc((size_t) nrank * sizeof(double));
+   tree = (IDL_LONG *) calloc((size_t) nrank + 1, sizeof(IDL_LONG));
+
+   for (by0=y0; by0 < y1; by0 += nblock) {
+      by1 = (by0 + nblock < y1) ? by0 + nblock : y1;
+      nrow = by1 - by0 + nbox - 1;
+      for (bx0=w->xlo; bx0 < w->xhi; bx0 += nblock) {
+         bx1 = (bx0 + nblock < w->xhi) ? bx0 + nblock : w->xhi;
+         ncol = bx1 - bx0 + nbox - 1;
+
+         /* Rank the nrow x ncol pixels the boxes of the block read, as
+          * laid out in the padded image */
+         nrank = nrow * ncol;
+         for (k=0; k < nrow; k++) {
+            row = w->image + (size_t) w->ymap[by0 - w->ylo + k] * w->nx;
+            for (i=0; i < ncol; i++) {
+               pix[k*ncol + i].v = row[w->xmap[bx0 - w->xlo + i]];
+               pix[k*ncol + i].i = k*ncol + i;
+            }
+         }
+         qsort(pix, nrank, sizeof(boxmedian_pixel), boxmedian_pixel_compare);
+         for (i=0; i < nrank; i++) {
+            rank[pix[i].i] = i;
+            value[i] = pix[i].v;
+         }
+         for (top=1; 2*top <= nrank; top *= 2) ;
+
+         for (y=by0; y < by1; y++) {
+            prank = rank + (y - by0) * ncol;
+            for (k=0; k < nbox; k++)
+               for (i=0; i < nbox; i++)
+                  boxmedian_count(tree, nrank, prank[k*ncol + i], 1);
+
+            for (x=bx0; x < bx1; x++) {
+               i = x - bx0;
+               if (i > 0) {
+                  for (k=0; k < nbox; k++) {
+                     boxmedian_count(tree, nrank, prank[k*ncol + i - 1], -1);
+                     boxmedian_count(tree, nrank,
+                      prank[k*ncol + i + nbox - 1], 1);
+                  }
+               }
+
+               /* Rank of the half-th smallest value in the box */
+               m = 0;
+               k = half;
+               for (step=top; step > 0; step /= 2) {
+                  if (m + step <= nrank && tree[m + step] <= k) {
+                     m += step;
+                     k -= tree[m];
+                  }
+               }
+               w->medarr[x + (size_t) y*w->nx] = value[m];
+            }
+
+            /* Empty the tree of the last box of the row */
+            for (k=0; k < nbox; k++)
+               for (i=bx1 - bx0 - 1; i < ncol; i++)
+                  boxmedian_count(tree, nrank, prank[k*ncol + i], -1);
+         }
+      }
+   }
+
+   free(pix);
+   free(rank);
+   free(value);
+   free(tree);
+}
+
+/******************************************************************************/
+/* With BOXMEDIAN_REFLECT, refilter the output pixels whose boxes reach
+ * the lower-right corner of the padding, which the separable xmap and
+ * ymap cannot describe, one box at a time.
+ */
+static void boxmedian_corner
+  (void *     arg,
+   int        ithread,
+   int        nthreads)
+{
+   boxmedian_work * w = (boxmedian_work *) arg;
+   IDL_LONG    r = w->radius;
+   IDL_LONG    nbox = 2*r + 1;
+   IDL_LONG    ncorner = (r < w->ny) ? r : w->ny;
+   double   *  win;
+   double   *  work;
+   IDL_LONG    x;
+   IDL_LONG    y;
+   IDL_LONG    i;
+   IDL_LONG    j;
+   long        lo;
+   long        hi;
+
+   idlutils_range(ncorner, ithread, nthreads, &lo, &hi);
+   if (hi <= lo) return;
+   win = (double *) malloc((size_t) nbox * nbox * sizeof(double));
+   work = (double *) malloc((size_t) nbox * nbox * sizeof(double));
+   for (y=lo; y < hi; y++) {
+      for (x=w->nx - r; x < w->nx; x++) {
+         for (j=0; j < nbox; j++)
+            for (i=0; i < nbox; i++)
+               win[j*nbox + i] = w->image[boxmedian_padded(x - r + i,
+                y - r + j, w->nx, w->ny, r)];
+         w->medarr[x + (size_t) y*w->nx] =
+          idlutils_select_double(win, nbox*nbox, (nbox*nbox)/2, work);
+      }
+   }
+   free(win);
+   free(work);
+}
+
+/******************************************************************************/
+static void boxmedian_thread
+  (void *     arg,
+   int        ithread,
+   int        nthreads)
+{
+   boxmedian_work * w = (boxmedian_work *) arg;
+   long        lo;
+   long        hi;
+
+   idlutils_range(w->yhi - w->ylo, ithread, nthreads, &lo, &hi);
+   if (hi <= lo) return;
+   if (w->level != NULL)
+      boxmedian_histogram(w, w->ylo + lo, w->ylo + hi);
+   else if (w->radius >= BOXMEDIAN_MINRANKED)
+      boxmedian_ranked(w, w->ylo + lo, w->ylo + hi);
+   else
+      boxmedian_sorted(w, w->ylo + lo, w->ylo + hi);
+}
+
+/******************************************************************************/
+/* Median filter of an nx x ny image with a width x width box, for odd
+ * width no larger than nx or ny.  With boundary=BOXMEDIAN_NONE, pixels
+ * within width/2 of the edge are copied; with BOXMEDIAN_REFLECT the
+ * image is reflected about its edges.  The image must be finite.
+ */
+void boxmedian_image
+  (double   *  image,
+   IDL_LONG    nx,
+   IDL_LONG    ny,
+   IDL_LONG    width,
+   IDL_LONG    boundary,
+   double   *  medarr)
+{
+   boxmedian_work w;
+   IDL_LONG    nbox;
+   IDL_LONG    i;
+   double      vmax;
+   long        npix;
+   long        ipix;
+   long        maxthreads;
+   int         integral;
+   int         nthreads;
+
+   if (nx <= 0 || ny <= 0) return;
+   npix = (long) nx * ny;
+   memcpy(medarr, image, npix * sizeof(double));
+   if (width <= 1) return;
+
+   w.image = image;
+   w.medarr = medarr;
+   w.nx = nx;
+   w.ny = ny;
+   w.radius = width/2;
+   nbox = 2*w.radius + 1;
+   if (boundary == BOXMEDIAN_REFLECT) {
+      w.xlo = 0;
+      w.xhi = nx;
+      w.ylo = 0;
+      w.yhi = ny;
+   } else {
+      w.xlo = w.radius;
+      w.xhi = nx - w.radius;
+      w.ylo = w.radius;
+      w.yhi = ny - w.radius;
+   }
+   if (w.xhi <= w.xlo || w.yhi <= w.ylo) return;
+
+   w.xmap = (IDL_LONG *) malloc((w.xhi - w.xlo + nbox - 1) * sizeof(IDL_LONG));
+   for (i=0; i < w.xhi - w.xlo + nbox - 1; i++)
+      w.xmap[i] = boxmedian_reflect(w.xlo - w.radius + i, nx);
+   w.ymap = (IDL_LONG *) malloc((w.yhi - w.ylo + nbox - 1) * sizeof(IDL_LONG));
+   for (i=0; i < w.yhi - w.ylo + nbox - 1; i++)
+      w.ymap[i] = boxmedian_reflect(w.ylo - w.radius + i, ny);
+
+   /* Integerize the image if its values are integers over few enough
+    * levels */
+   w.vmin = vmax = image[0];
+   integral = 1;
+   for (ipix=0; ipix < npix && integral; ipix++) {
+      if (image[ipix] != floor(image[ipix])) integral = 0;
+      if (image[ipix] < w.vmin) w.vmin = image[ipix];
+      if (image[ipix] > vmax) vmax = image[ipix];
+   }
+   w.level = NULL;
+   maxthreads = (w.yhi - w.ylo) / (BOXMEDIAN_MINSTRIP * nbox) + 1;
+   /* The range is checked as a double before it is converted, since a
+    * wide range may not fit in an IDL_LONG */
+   if (integral && vmax - w.vmin < BOXMEDIAN_MAXLEVELS) {
+      w.nlevel = (IDL_LONG) (vmax - w.vmin) + 1;
+      w.ncoarse = (w.nlevel + BOXMEDIAN_FINE - 1) / BOXMEDIAN_FINE;
+   } else {
+      integral = 0;
+   }
+   if (integral && nbox < 65536
+    && (double) nbox*nbox > 2.*w.ncoarse + BOXMEDIAN_FINE) {
+      w.level = (unsigned short *) malloc(npix * sizeof(unsigned short));
+      for (ipix=0; ipix < npix; ipix++)
+         w.level[ipix] = (unsigned short) (image[ipix] - w.vmin);
+      i = BOXMEDIAN_MAXMEM
+       / ((long) nx * (w.nlevel + w.ncoarse) * sizeof(unsigned short));
+      if (i < maxthreads) maxthreads = i;
+   } else if (w.radius >= BOXMEDIAN_MINRANKED) {
+      i = BOXMEDIAN_MAXMEM / (boxmedian_nrank(&w, w.yhi - w.ylo)
+       * (sizeof(boxmedian_pixel) + 2*sizeof(IDL_LONG) + sizeof(double)));
+      if (i < maxthreads) maxthreads = i;
+   }
+
+   /* Strips of output rows in parallel */
+   nthreads = idlutils_nthreads(maxthreads);
+   idlutils_run(nthreads, boxmedian_thread, &w);
+   if (boundary == BOXMEDIAN_REFLECT)
+      idlutils_run(idlutils_nthreads(w.radius), boxmedian_corner, &w);
+
+   if (w.level != NULL) free(w.level);
+   free(w.xmap);
+   free(w.ymap);
+}
+
+/******************************************************************************/
+IDL_LONG boxmedian
+  (int      argc,
+   void *   argv[])
+{
+   IDL_LONG    nx;
+   IDL_LONG    ny;
+   IDL_LONG    width;
+   IDL_LONG    boundary;
+   double   *  image;
+   double   *  medarr;
+
+   IDL_LONG    retval = 1;
+
+   /* Allocate pointers from IDL */
+   nx = *((IDL_LONG *)argv[0]);
+   ny = *((IDL_LONG *)argv[1]);
+   image = (double *)argv[2];
+   width = *((IDL_LONG *)argv[3]);
+   boundary = *((IDL_LONG *)argv[4]);
+   medarr = (double *)argv[5];
+
+   boxmedian_image(image, nx, ny, width, boundary, medarr);
+
+   return retval;
+}
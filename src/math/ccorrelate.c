@@ -1,31 +1,69 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "export.h"
-#include "nr.h"
+#include "idlutils_threads.h"
 
-/******************************************************************************/
-IDL_LONG ccorrelate
-  (int      argc,
-   void *   argv[])
-{
+/* The FFT path is used when the direct sums would take more than this many
+ * times the operations of one complex FFT of the padded length.
+ */
+#define CCORRELATE_FFT_RATIO 5.0
+
+/* Number of real sequences transformed for each of X and Y */
+#define CCORRELATE_NSEQ 6
+
+typedef struct {
+   long        n;
+   double   *  cosv;
+   double   *  sinv;
+} ccorr_plan;
+
+/* Transforms of the six X-side (or Y-side) sequences, each with n complex
+ * values stored as re[iseq*n+k], im[iseq*n+k].
+ */
+typedef struct {
+   double   *  re;
+   double   *  im;
+} ccorr_spec;
+
+/* Shared state of a batch of nspec spectra (X) against ntemp templates (Y) */
+typedef struct {
    IDL_LONG    nx;
+   IDL_LONG    nspec;
    float    *  xvec;
    float    *  xweight;
    IDL_LONG    ny;
+   IDL_LONG    ntemp;
    float    *  yvec;
    float    *  yweight;
    IDL_LONG    nlag;
    IDL_LONG *  lags;
    float    *  result;
+   int         usefft;
+   ccorr_plan  plan;
+   ccorr_spec * tspec;
+   idlutils_queue queue;
+} ccorr_batch;
 
-   IDL_LONG    ilag;
+/******************************************************************************/
+/* Direct sums for one lag, with wvec as scratch.  Note that the last
+ * overlapping pair of elements is not included.
+ */
+static float ccorr_direct_lag
+  (IDL_LONG    nx,
+   float    *  xvec,
+   float    *  xweight,
+   IDL_LONG    ny,
+   float    *  yvec,
+   float    *  yweight,
+   IDL_LONG    lag,
+   float    *  wvec)
+{
    IDL_LONG    startx;
    IDL_LONG    starty;
    IDL_LONG    ii;
    IDL_LONG    ncomp;
-   IDL_LONG    retval = 1;
-   float    *  wvec;
    double      wx;
    double      wy;
    double      sumw;
@@ -37,22 +75,321 @@ IDL_LONG ccorrelate
    double      meany;
    float       res;
 
-   /* Allocate pointers from IDL */
-   nx = *((IDL_LONG *)argv[0]);
-   xvec = (float *)argv[1];
-   xweight = (float *)argv[2];
-   ny = *((IDL_LONG *)argv[3]);
-   yvec = (float *)argv[4];
-   yweight = (float *)argv[5];
-   nlag = *((IDL_LONG *)argv[6]);
-   lags = (IDL_LONG *)argv[7];
-   result = (float *)argv[8];
+   if (lag < 0) {
+      startx = -lag;
+      starty = 0;
+   } else {
+      startx = 0;
+      starty = lag;
+   }
+
+   ncomp = (nx - startx - 1) < (ny - starty - 1) ?
+    (nx - startx - 1) : (ny - starty - 1);
+
+   for (ii=0; ii < ncomp; ii++)
+    wvec[ii] = xweight[startx+ii] * yweight[starty+ii];
+
+   sumw = 0.0;
+   sumwx = 0.0;
+   sumwy = 0.0;
+   sumwxwx = 0.0;
+   sumwywy = 0.0;
+   for (ii=0; ii < ncomp; ii++) {
+      sumw += wvec[ii];
+      wx = wvec[ii] * xvec[startx+ii];
+      wy = wvec[ii] * yvec[starty+ii];
+      sumwx += wx;
+      sumwy += wy;
+      sumwxwx += wx * wx;
+      sumwywy += wy * wy;
+   }
+
+   meanx = sumwx / sumw;
+   meany = sumwy / sumw;
+
+   res = 0.0;
+   for (ii=0; ii < ncomp; ii++) {
+      res += wvec[ii] * wvec[ii] * (xvec[startx+ii] - meanx)
+       * (yvec[starty+ii] - meany);
+   }
+   return res / sqrt( (sumwxwx - sumwx * sumwx / sumw)
+                    * (sumwywy - sumwy * sumwy / sumw) );
+}
+
+/******************************************************************************/
+/* Direct sums, one lag at a time.
+ */
+static void ccorrelate_direct
+  (IDL_LONG    nx,
+   float    *  xvec,
+   float    *  xweight,
+   IDL_LONG    ny,
+   float    *  yvec,
+   float    *  yweight,
+   IDL_LONG    nlag,
+   IDL_LONG *  lags,
+   float    *  result)
+{
+   IDL_LONG    ilag;
+   float    *  wvec;
 
    /* Allocate memory for temporary vector */
    wvec = malloc((nx > ny ? nx : ny)  * sizeof(float));
 
-   for (ilag=0; ilag < nlag; ilag++) {
+   for (ilag=0; ilag < nlag; ilag++)
+      result[ilag] = ccorr_direct_lag(nx, xvec, xweight, ny, yvec, yweight,
+       lags[ilag], wvec);
+
+   /* Free temporary memory */
+   free(wvec);
+}
+
+/******************************************************************************/
+/* Twiddle factors for complex FFTs of length n, a power of 2.
+ */
+static void ccorr_plan_init
+  (ccorr_plan * plan,
+   long        n)
+{
+   long        k;
 
+   plan->n = n;
+   plan->cosv = malloc((n/2 + 1) * sizeof(double));
+   plan->sinv = malloc((n/2 + 1) * sizeof(double));
+   for (k=0; k <= n/2; k++) {
+      plan->cosv[k] = cos(2.0 * M_PI * k / n);
+      plan->sinv[k] = sin(2.0 * M_PI * k / n);
+   }
+}
+
+static void ccorr_plan_free
+  (ccorr_plan * plan)
+{
+   free(plan->cosv);
+   free(plan->sinv);
+}
+
+/******************************************************************************/
+/* In-place radix-2 complex FFT, exp(-2 pi i jk/n) for sign=-1 and the
+ * unnormalized inverse for sign=+1.
+ */
+static void ccorr_fft
+  (ccorr_plan * plan,
+   double   *  re,
+   double   *  im,
+   int         sign)
+{
+   long        n = plan->n;
+   long        i;
+   long        j;
+   long        k;
+   long        len;
+   long        half;
+   long        step;
+   double      wr;
+   double      wi;
+   double      tr;
+   double      ti;
+
+   /* Bit-reversal permutation */
+   for (i=1, j=0; i < n; i++) {
+      k = n >> 1;
+      while (j & k) {
+         j ^= k;
+         k >>= 1;
+      }
+      j |= k;
+      if (i < j) {
+         tr = re[i]; re[i] = re[j]; re[j] = tr;
+         ti = im[i]; im[i] = im[j]; im[j] = ti;
+      }
+   }
+
+   for (len=2; len <= n; len <<= 1) {
+      half = len >> 1;
+      step = n / len;
+      for (i=0; i < n; i += len) {
+         for (k=0; k < half; k++) {
+            wr = plan->cosv[k*step];
+            wi = sign * plan->sinv[k*step];
+            tr = wr * re[i+k+half] - wi * im[i+k+half];
+            ti = wr * im[i+k+half] + wi * re[i+k+half];
+            re[i+k+half] = re[i+k] - tr;
+            im[i+k+half] = im[i+k] - ti;
+            re[i+k] += tr;
+            im[i+k] += ti;
+         }
+      }
+   }
+}
+
+/******************************************************************************/
+/* Weighted mean of a vector, or zero if the weights sum to zero */
+static double ccorr_mean
+  (IDL_LONG    nv,
+   float    *  vec,
+   float    *  weight)
+{
+   IDL_LONG    i;
+   double      sumw;
+   double      sumwv;
+
+   sumw = 0.0;
+   sumwv = 0.0;
+   for (i=0; i < nv; i++) {
+      sumw += weight[i];
+      sumwv += weight[i] * vec[i];
+   }
+   return (sumw != 0.0) ? sumwv / sumw : 0.0;
+}
+
+/******************************************************************************/
+/* Forward transforms of the sequences w, w*v, (w*v)^2, w^2, w^2*v and
+ * (w != 0), where v is the vector less its weighted mean, which keeps the
+ * sums well conditioned.  Two real sequences are transformed at a time, as
+ * the real and imaginary parts of one complex sequence.  zr and zi are
+ * scratch of n values.
+ */
+static void ccorr_transform
+  (ccorr_plan * plan,
+   IDL_LONG    nv,
+   float    *  vec,
+   float    *  weight,
+   ccorr_spec * spec,
+   double   *  zr,
+   double   *  zi)
+{
+   long        n = plan->n;
+   long        i;
+   long        k;
+   long        iseq;
+   double      mean;
+   double      w;
+   double      v;
+   double      seq[CCORRELATE_NSEQ];
+   double   *  pr;
+   double   *  pi;
+
+   mean = ccorr_mean(nv, vec, weight);
+   for (iseq=0; iseq < CCORRELATE_NSEQ; iseq += 2) {
+      for (i=0; i < nv; i++) {
+         w = weight[i];
+         v = vec[i] - mean;
+         seq[0] = w;
+         seq[1] = w * v;
+         seq[2] = w * v * w * v;
+         seq[3] = w * w;
+         seq[4] = w * w * v;
+         seq[5] = (w != 0.0);
+         zr[i] = seq[iseq];
+         zi[i] = seq[iseq+1];
+      }
+      for (i=nv; i < n; i++) {
+         zr[i] = 0.0;
+         zi[i] = 0.0;
+      }
+      ccorr_fft(plan, zr, zi, -1);
+
+      /* Separate the two spectra, P = (Z_k + conj Z_n-k)/2 and
+       * Q = (Z_k - conj Z_n-k)/2i
+       */
+      pr = spec->re + iseq * n;
+      pi = spec->im + iseq * n;
+      for (k=0; k < n; k++) {
+         i = (n - k) & (n - 1);
+         pr[k] = 0.5 * (zr[k] + zr[i]);
+         pi[k] = 0.5 * (zi[k] - zi[i]);
+         pr[n+k] = 0.5 * (zi[k] + zi[i]);
+         pi[n+k] = -0.5 * (zr[k] - zr[i]);
+      }
+   }
+}
+
+/******************************************************************************/
+/* Correlation coefficients at the requested lags from the transforms of X
+ * and Y.  The ten sums (the nine of ccorr_direct_lag() about the weighted
+ * means, and the number of pairs with nonzero weight) are correlations of
+ * X-side with Y-side sequences, two per inverse FFT.  The FFT sums include
+ * every overlapping pair, so the last pair is subtracted to match
+ * ccorr_direct_lag().  Lags with fewer than three weighted pairs, where the
+ * coefficient is degenerate, are computed directly.  zr and zi are scratch
+ * of 5*n values, and wvec of nx+ny.
+ */
+static void ccorr_lags
+  (ccorr_plan * plan,
+   ccorr_spec * xspec,
+   ccorr_spec * yspec,
+   IDL_LONG    nx,
+   float    *  xvec,
+   float    *  xweight,
+   IDL_LONG    ny,
+   float    *  yvec,
+   float    *  yweight,
+   IDL_LONG    nlag,
+   IDL_LONG *  lags,
+   float    *  result,
+   double   *  zr,
+   double   *  zi,
+   float    *  wvec)
+{
+   /* X-side and Y-side sequence of each sum: w, wx, wy, wxwx, wywy,
+    * w2xy, w2x, w2y, w2, npair
+    */
+   static const int xseq[10] = {0, 1, 0, 2, 3, 4, 4, 3, 3, 5};
+   static const int yseq[10] = {0, 0, 1, 3, 2, 4, 3, 4, 3, 5};
+   long        n = plan->n;
+   long        k;
+   long        isum;
+   long        indx;
+   IDL_LONG    ilag;
+   IDL_LONG    startx;
+   IDL_LONG    starty;
+   IDL_LONG    ncomp;
+   double      sum[10];
+   double      ar;
+   double      ai;
+   double      br;
+   double      bi;
+   double      xmean;
+   double      ymean;
+   double      w;
+   double      vx;
+   double      vy;
+   double      meanx;
+   double      meany;
+   double      numer;
+   double      varx;
+   double      vary;
+   double   *  pr;
+   double   *  pi;
+
+   /* Products conj(X) * Y, packed two to a complex inverse transform */
+   for (isum=0; isum < 10; isum += 2) {
+      pr = zr + (isum/2) * n;
+      pi = zi + (isum/2) * n;
+      for (k=0; k < n; k++) {
+         ar = xspec->re[xseq[isum]*n+k];
+         ai = xspec->im[xseq[isum]*n+k];
+         br = yspec->re[yseq[isum]*n+k];
+         bi = yspec->im[yseq[isum]*n+k];
+         pr[k] = ar * br + ai * bi;
+         pi[k] = ar * bi - ai * br;
+
+         /* plus i * conj(X) * Y for the next sum */
+         ar = xspec->re[xseq[isum+1]*n+k];
+         ai = xspec->im[xseq[isum+1]*n+k];
+         br = yspec->re[yseq[isum+1]*n+k];
+         bi = yspec->im[yseq[isum+1]*n+k];
+         pr[k] -= ar * bi - ai * br;
+         pi[k] += ar * br + ai * bi;
+      }
+      ccorr_fft(plan, pr, pi, +1);
+   }
+
+   xmean = ccorr_mean(nx, xvec, xweight);
+   ymean = ccorr_mean(ny, yvec, yweight);
+
+   for (ilag=0; ilag < nlag; ilag++) {
       if (lags[ilag] < 0) {
          startx = -lags[ilag];
          starty = 0;
@@ -60,45 +397,335 @@ IDL_LONG ccorrelate
          startx = 0;
          starty = lags[ilag];
       }
-
       ncomp = (nx - startx - 1) < (ny - starty - 1) ?
        (nx - startx - 1) : (ny - starty - 1);
 
-      for (ii=0; ii < ncomp; ii++)
-       wvec[ii] = xweight[startx+ii] * yweight[starty+ii];
-
-      sumw = 0.0;
-      sumwx = 0.0;
-      sumwy = 0.0;
-      sumwxwx = 0.0;
-      sumwywy = 0.0;
-      for (ii=0; ii < ncomp; ii++) {
-         sumw += wvec[ii];
-         wx = wvec[ii] * xvec[startx+ii];
-         wy = wvec[ii] * yvec[starty+ii];
-         sumwx += wx;
-         sumwy += wy;
-         sumwxwx += wx * wx;
-         sumwywy += wy * wy;
+      if (ncomp > 0) {
+         indx = (lags[ilag] >= 0) ? lags[ilag] : n + lags[ilag];
+         for (isum=0; isum < 10; isum++)
+            sum[isum] = ((isum % 2) ? zi : zr)[(isum/2) * n + indx] / n;
+
+         /* Remove the last overlapping pair */
+         w = xweight[startx+ncomp] * yweight[starty+ncomp];
+         vx = xvec[startx+ncomp] - xmean;
+         vy = yvec[starty+ncomp] - ymean;
+         sum[0] -= w;
+         sum[1] -= w * vx;
+         sum[2] -= w * vy;
+         sum[3] -= w * vx * w * vx;
+         sum[4] -= w * vy * w * vy;
+         sum[5] -= w * w * vx * vy;
+         sum[6] -= w * w * vx;
+         sum[7] -= w * w * vy;
+         sum[8] -= w * w;
+         sum[9] -= (xweight[startx+ncomp] != 0 && yweight[starty+ncomp] != 0);
+      }
+      if (ncomp <= 0 || sum[9] < 2.5) {
+         result[ilag] = ccorr_direct_lag(nx, xvec, xweight, ny, yvec, yweight,
+          lags[ilag], wvec);
+         continue;
       }
 
-      meanx = sumwx / sumw;
-      meany = sumwy / sumw;
+      /* The numerator does not depend on the means removed from X and Y,
+       * but sum(w^2 x^2) - sum(w x)^2 / sum(w) does; add their terms back.
+       */
+      meanx = sum[1] / sum[0];
+      meany = sum[2] / sum[0];
+      numer = sum[5] - meany * sum[6] - meanx * sum[7]
+       + meanx * meany * sum[8];
+      varx = sum[3] - sum[1] * sum[1] / sum[0]
+       + 2.0 * xmean * (sum[6] - sum[1]) + xmean * xmean * (sum[8] - sum[0]);
+      vary = sum[4] - sum[2] * sum[2] / sum[0]
+       + 2.0 * ymean * (sum[7] - sum[2]) + ymean * ymean * (sum[8] - sum[0]);
+      result[ilag] = numer / sqrt(varx * vary);
+   }
+}
+
+/******************************************************************************/
+/* Length of the zero-padded transforms for vectors of nx and ny elements */
+static long ccorr_fftsize
+  (IDL_LONG    nx,
+   IDL_LONG    ny)
+{
+   long        n;
+
+   for (n=2; n < (long) nx + ny; n <<= 1) ;
+   return n;
+}
+
+/******************************************************************************/
+/* Whether the FFT path is cheaper than the direct sums */
+static int ccorr_usefft
+  (IDL_LONG    nx,
+   IDL_LONG    ny,
+   IDL_LONG    nlag)
+{
+   long        n;
+
+   n = ccorr_fftsize(nx, ny);
+   return ((double) nlag * (nx < ny ? nx : ny)
+    > CCORRELATE_FFT_RATIO * n * log((double) n) / log(2.0));
+}
+
+/******************************************************************************/
+static void ccorrelate_fft
+  (IDL_LONG    nx,
+   float    *  xvec,
+   float    *  xweight,
+   IDL_LONG    ny,
+   float    *  yvec,
+   float    *  yweight,
+   IDL_LONG    nlag,
+   IDL_LONG *  lags,
+   float    *  result)
+{
+   ccorr_plan  plan;
+   ccorr_spec  xspec;
+   ccorr_spec  yspec;
+   double   *  zr;
+   double   *  zi;
+   float    *  wvec;
+   long        n;
+
+   n = ccorr_fftsize(nx, ny);
+   ccorr_plan_init(&plan, n);
+   xspec.re = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+   xspec.im = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+   yspec.re = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+   yspec.im = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+   zr = malloc(5 * n * sizeof(double));
+   zi = malloc(5 * n * sizeof(double));
+   wvec = malloc((nx > ny ? nx : ny) * sizeof(float));
+
+   ccorr_transform(&plan, nx, xvec, xweight, &xspec, zr, zi);
+   ccorr_transform(&plan, ny, yvec, yweight, &yspec, zr, zi);
+   ccorr_lags(&plan, &xspec, &yspec, nx, xvec, xweight, ny, yvec, yweight,
+    nlag, lags, result, zr, zi, wvec);
+
+   free(xspec.re);
+   free(xspec.im);
+   free(yspec.re);
+   free(yspec.im);
+   free(zr);
+   free(zi);
+   free(wvec);
+   ccorr_plan_free(&plan);
+}
+
+/******************************************************************************/
+IDL_LONG ccorrelate
+  (int      argc,
+   void *   argv[])
+{
+   IDL_LONG    nx;
+   float    *  xvec;
+   float    *  xweight;
+   IDL_LONG    ny;
+   float    *  yvec;
+   float    *  yweight;
+   IDL_LONG    nlag;
+   IDL_LONG *  lags;
+   float    *  result;
+
+   IDL_LONG    retval = 1;
+
+   /* Allocate pointers from IDL */
+   nx = *((IDL_LONG *)argv[0]);
+   xvec = (float *)argv[1];
+   xweight = (float *)argv[2];
+   ny = *((IDL_LONG *)argv[3]);
+   yvec = (float *)argv[4];
+   yweight = (float *)argv[5];
+   nlag = *((IDL_LONG *)argv[6]);
+   lags = (IDL_LONG *)argv[7];
+   result = (float *)argv[8];
+
+   /* All lags at once from FFTs when there are many lags */
+   if (ccorr_usefft(nx, ny, nlag))
+      ccorrelate_fft(nx, xvec, xweight, ny, yvec, yweight, nlag, lags, result);
+   else
+      ccorrelate_direct(nx, xvec, xweight, ny, yvec, yweight, nlag, lags,
+       result);
+
+   return retval;
+}
+
+/******************************************************************************/
+/* Template transforms for a batch, one template per work item.
+ */
+static void ccorr_batch_templates
+  (void *     arg,
+   int        ithread,
+   int        nthreads)
+{
+   ccorr_batch * b = (ccorr_batch *) arg;
+   long        n = b->plan.n;
+   long        lo;
+   long        hi;
+   long        itemp;
+   double   *  zr;
+   double   *  zi;
+
+   zr = malloc(n * sizeof(double));
+   zi = malloc(n * sizeof(double));
+
+   while (idlutils_queue_next(&(b->queue), &lo, &hi)) {
+      for (itemp=lo; itemp < hi; itemp++)
+         ccorr_transform(&(b->plan), b->ny, b->yvec + itemp * b->ny,
+          b->yweight + itemp * b->ny, &(b->tspec[itemp]), zr, zi);
+   }
+
+   free(zr);
+   free(zi);
+}
+
+/******************************************************************************/
+/* Spectrum-template pairs for a batch, numbered spectrum-major so that a
+ * thread transforms each spectrum once for the run of templates it gets.
+ */
+static void ccorr_batch_pairs
+  (void *     arg,
+   int        ithread,
+   int        nthreads)
+{
+   ccorr_batch * b = (ccorr_batch *) arg;
+   long        n = b->plan.n;
+   long        lo;
+   long        hi;
+   long        item;
+   long        ispec;
+   long        itemp;
+   long        lastspec = -1;
+   IDL_LONG    ilag;
+   float    *  xv;
+   float    *  xw;
+   float    *  yv;
+   float    *  yw;
+   float    *  res;
+   float    *  wvec;
+   double   *  zr = NULL;
+   double   *  zi = NULL;
+   ccorr_spec  xspec;
+
+   res = malloc(b->nlag * sizeof(float));
+   wvec = malloc((b->nx > b->ny ? b->nx : b->ny) * sizeof(float));
+   if (b->usefft) {
+      xspec.re = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+      xspec.im = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+      zr = malloc(5 * n * sizeof(double));
+      zi = malloc(5 * n * sizeof(double));
+   }
 
-      res = 0.0;
-      for (ii=0; ii < ncomp; ii++) {
-         res += wvec[ii] * wvec[ii] * (xvec[startx+ii] - meanx)
-          * (yvec[starty+ii] - meany);
+   while (idlutils_queue_next(&(b->queue), &lo, &hi)) {
+      for (item=lo; item < hi; item++) {
+         ispec = item / b->ntemp;
+         itemp = item % b->ntemp;
+         xv = b->xvec + ispec * b->nx;
+         xw = b->xweight + ispec * b->nx;
+         yv = b->yvec + itemp * b->ny;
+         yw = b->yweight + itemp * b->ny;
+
+         if (b->usefft) {
+            if (ispec != lastspec)
+               ccorr_transform(&(b->plan), b->nx, xv, xw, &xspec, zr, zi);
+            lastspec = ispec;
+            ccorr_lags(&(b->plan), &xspec, &(b->tspec[itemp]),
+             b->nx, xv, xw, b->ny, yv, yw, b->nlag, b->lags, res,
+             zr, zi, wvec);
+         } else {
+            for (ilag=0; ilag < b->nlag; ilag++)
+               res[ilag] = ccorr_direct_lag(b->nx, xv, xw, b->ny, yv, yw,
+                b->lags[ilag], wvec);
+         }
+
+         /* Result is [nspec,ntemp,nlag] with the spectrum varying fastest */
+         for (ilag=0; ilag < b->nlag; ilag++)
+            b->result[ispec + b->nspec * (itemp + b->ntemp * (long) ilag)]
+             = res[ilag];
       }
-      result[ilag] = res / sqrt( (sumwxwx - sumwx * sumwx / sumw)
-                          * (sumwywy - sumwy * sumwy / sumw) );
    }
 
-   /* Free temporary memory */
+   if (b->usefft) {
+      free(xspec.re);
+      free(xspec.im);
+      free(zr);
+      free(zi);
+   }
+   free(res);
    free(wvec);
+}
+
+/******************************************************************************/
+/* Cross-correlate each of nspec spectra of nx elements against each of
+ * ntemp templates of ny elements, as ccorrelate() does for one pair.  The
+ * template transforms are computed once and shared by every spectrum.
+ */
+IDL_LONG ccorrelate_batch
+  (int      argc,
+   void *   argv[])
+{
+   ccorr_batch b;
+   long        nitem;
+   long        chunk;
+   long        itemp;
+   long        n;
+   int         nthreads;
+
+   IDL_LONG    retval = 1;
+
+   /* Allocate pointers from IDL */
+   b.nx = *((IDL_LONG *)argv[0]);
+   b.nspec = *((IDL_LONG *)argv[1]);
+   b.xvec = (float *)argv[2];
+   b.xweight = (float *)argv[3];
+   b.ny = *((IDL_LONG *)argv[4]);
+   b.ntemp = *((IDL_LONG *)argv[5]);
+   b.yvec = (float *)argv[6];
+   b.yweight = (float *)argv[7];
+   b.nlag = *((IDL_LONG *)argv[8]);
+   b.lags = (IDL_LONG *)argv[9];
+   b.result = (float *)argv[10];
+
+   if (b.nspec <= 0 || b.ntemp <= 0 || b.nlag <= 0) return retval;
+
+   b.usefft = ccorr_usefft(b.nx, b.ny, b.nlag);
+   b.tspec = NULL;
+   b.plan.n = 0;
+   if (b.usefft) {
+      n = ccorr_fftsize(b.nx, b.ny);
+      ccorr_plan_init(&(b.plan), n);
+      b.tspec = malloc(b.ntemp * sizeof(ccorr_spec));
+      for (itemp=0; itemp < b.ntemp; itemp++) {
+         b.tspec[itemp].re = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+         b.tspec[itemp].im = malloc(CCORRELATE_NSEQ * n * sizeof(double));
+      }
+      idlutils_queue_init(&(b.queue), b.ntemp, 1);
+      idlutils_run(idlutils_nthreads(b.ntemp), ccorr_batch_templates, &b);
+      idlutils_queue_free(&(b.queue));
+   }
+
+   /* Hand out whole runs of templates for one spectrum when there are
+    * enough spectra to keep the threads busy, shorter runs otherwise.
+    */
+   nitem = (long) b.nspec * b.ntemp;
+   nthreads = idlutils_nthreads(nitem);
+   chunk = nitem / (4 * nthreads);
+   if (chunk > b.ntemp) chunk = b.ntemp;
+   if (chunk < 1) chunk = 1;
+   idlutils_queue_init(&(b.queue), nitem, chunk);
+   idlutils_run(nthreads, ccorr_batch_pairs, &b);
+   idlutils_queue_free(&(b.queue));
+
+   if (b.usefft) {
+      for (itemp=0; itemp < b.ntemp; itemp++) {
+         free(b.tspec[itemp].re);
+         free(b.tspec[itemp].im);
+      }
+      free(b.tspec);
+      ccorr_plan_free(&(b.plan));
+   }
 
    return retval;
 }
 
 /******************************************************************************/
-
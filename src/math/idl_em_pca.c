@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "idlutils_threads.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+/*
+ * EM-PCA iterations of em_pca.pro.  For data X[p,N] and eigenvectors
+ * E[p,k], each iteration is
+ *
+ *   H = (E^T E)^-1 E^T X
+ *   E = X H^T (H H^T)^-1
+ *
+ * or with weights W[p,N], solving for each data vector n and pixel j
+ *
+ *   h_n = (E^T W_n E)^-1 E^T W_n x_n
+ *   e_j = (sum_n w_jn x_jn h_n^T) (sum_n w_jn h_n h_n^T)^-1
+ *
+ * Both the E and H steps are done in one pass over the data: each thread
+ * streams its share of the data vectors in blocks of EMPCA_BLOCK, converts
+ * the block to double, projects it, and adds it into its own sums for the
+ * E step, which are combined in thread order afterwards.  With weights
+ * those sums hold a k x k matrix per pixel, so fewer threads are used
+ * when they would take more than EMPCA_MAXMEM between them.
+ */
+
+/* data vectors converted and projected together */
+#define EMPCA_BLOCK 64
+
+/* Most memory used by the per-thread sums */
+#define EMPCA_MAXMEM 268435456L
+
+typedef struct {
+  IDL_LONG p, n, k, isdouble, weighted;
+  void *data, *weight;
+  double *eigenvec, *hidden;
+  double *proj;      /* (E^T E)^-1 E^T [k,p], unweighted, or with weights
+                        E transposed, proj[c+j*k] */
+  int nthreads;
+  double *xh;        /* sum x h^T [nthreads][p*k], as xh[c*p+j] */
+  double *hh;        /* sum h h^T [nthreads][k*k], or with weights
+                        [nthreads][p*k*k] per pixel */
+} empca_work;
+
+/********************************************************************/
+/* Cholesky factorization in place of the symmetric k x k matrix a, lower
+   triangle; returns 0 if it is not positive definite */
+static int empca_cholesky(double *a, IDL_LONG k)
+{
+  IDL_LONG i,j,l;
+  double sum;
+
+  for(i=0;i<k;i++) {
+    for(j=0;j<=i;j++) {
+      sum=a[i*k+j];
+      for(l=0;l<j;l++) sum-=a[i*k+l]*a[j*k+l];
+      if(i==j) {
+        if(sum<=0.) return(0);
+        a[i*k+i]=sqrt(sum);
+      } else {
+        a[i*k+j]=sum/a[j*k+j];
+      }
+    }
+  }
+  return(1);
+} /* end empca_cholesky */
+
+/* solve l l^T x = b in place, for the factor from empca_cholesky() */
+static void empca_cholsolve(double *a, IDL_LONG k, double *b)
+{
+  IDL_LONG i,l;
+  double sum;
+
+  for(i=0;i<k;i++) {
+    sum=b[i];
+    for(l=0;l<i;l++) sum-=a[i*k+l]*b[l];
+    b[i]=sum/a[i*k+i];
+  }
+  for(i=k-1;i>=0;i--) {
+    sum=b[i];
+    for(l=i+1;l<k;l++) sum-=a[l*k+i]*b[l];
+    b[i]=sum/a[i*k+i];
+  }
+} /* end empca_cholsolve */
+
+/********************************************************************/
+/* copy data vectors n0..n0+nb-1 (and their weights) into xb[nb][p] as
+   double */
+static void empca_load(empca_work *w, long n0, IDL_LONG nb, void *src,
+                       double *xb)
+{
+  long i,len;
+  float *fsrc;
+  double *dsrc;
+
+  len=(long) nb*w->p;
+  if(w->isdouble) {
+    dsrc=(double *) src+n0*w->p;
+    memcpy(xb, dsrc, len*sizeof(double));
+  } else {
+    fsrc=(float *) src+n0*w->p;
+    for(i=0;i<len;i++) xb[i]=fsrc[i];
+  }
+} /* end empca_load */
+
+/********************************************************************/
+/* unweighted pass over this thread's data vectors */
+static void empca_pass(void *arg, int ithread, int nthreads)
+{
+  empca_work *w=(empca_work *) arg;
+  IDL_LONG p=w->p, k=w->k;
+  IDL_LONG nb,ib,c,d,j;
+  long lo,hi,n0;
+  double *xb, *hb, *xh, *hh, *pc, *x0, *x1, *x2, *x3, *a;
+  double sum, h0, h1, h2, h3;
+
+  idlutils_range(w->n, ithread, nthreads, &lo, &hi);
+  xb=(double *) malloc((size_t) EMPCA_BLOCK*p*sizeof(double));
+  hb=(double *) malloc((size_t) EMPCA_BLOCK*k*sizeof(double));
+  xh=w->xh+(long) ithread*p*k;
+  hh=w->hh+(long) ithread*k*k;
+  memset(xh, 0, (size_t) p*k*sizeof(double));
+  memset(hh, 0, (size_t) k*k*sizeof(double));
+
+  for(n0=lo;n0<hi;n0+=EMPCA_BLOCK) {
+    nb=(hi-n0<EMPCA_BLOCK) ? hi-n0 : EMPCA_BLOCK;
+    empca_load(w, n0, nb, w->data, xb);
+
+    /* H step for the block, four data vectors at a time to share each
+       pass over the projection */
+    for(ib=0;ib+3<nb;ib+=4) {
+      x0=xb+(long) ib*p;
+      x1=x0+p;
+      x2=x1+p;
+      x3=x2+p;
+      for(c=0;c<k;c++) {
+        pc=w->proj+(long) c*p;
+        h0=h1=h2=h3=0.;
+        for(j=0;j<p;j++) {
+          h0+=pc[j]*x0[j];
+          h1+=pc[j]*x1[j];
+          h2+=pc[j]*x2[j];
+          h3+=pc[j]*x3[j];
+        }
+        hb[ib*k+c]=h0;
+        hb[(ib+1)*k+c]=h1;
+        hb[(ib+2)*k+c]=h2;
+        hb[(ib+3)*k+c]=h3;
+      }
+    }
+    for(;ib<nb;ib++) {
+      x0=xb+(long) ib*p;
+      for(c=0;c<k;c++) {
+        pc=w->proj+(long) c*p;
+        sum=0.;
+        for(j=0;j<p;j++) sum+=pc[j]*x0[j];
+        hb[ib*k+c]=sum;
+      }
+    }
+    memcpy(w->hidden+n0*k, hb, (size_t) nb*k*sizeof(double));
+    for(ib=0;ib<nb;ib++)
+      for(c=0;c<k;c++)
+        for(d=0;d<k;d++) hh[c*k+d]+=hb[ib*k+c]*hb[ib*k+d];
+
+    /* sum x h^T, four data vectors at a time to share each pass over xh */
+    for(ib=0;ib+3<nb;ib+=4) {
+      x0=xb+(long) ib*p;
+      x1=x0+p;
+      x2=x1+p;
+      x3=x2+p;
+      for(c=0;c<k;c++) {
+        a=xh+(long) c*p;
+        h0=hb[ib*k+c];
+        h1=hb[(ib+1)*k+c];
+        h2=hb[(ib+2)*k+c];
+        h3=hb[(ib+3)*k+c];
+        for(j=0;j<p;j++) a[j]+=h0*x0[j]+h1*x1[j]+h2*x2[j]+h3*x3[j];
+      }
+    }
+    for(;ib<nb;ib++) {
+      x0=xb+(long) ib*p;
+      for(c=0;c<k;c++) {
+        a=xh+(long) c*p;
+        h0=hb[ib*k+c];
+        for(j=0;j<p;j++) a[j]+=h0*x0[j];
+      }
+    }
+  }
+
+  FREEVEC(xb);
+  FREEVEC(hb);
+} /* end empca_pass */
+
+/********************************************************************/
+/* weighted pass over this thread's data vectors */
+static void empca_pass_weighted(void *arg, int ithread, int nthreads)
+{
+  empca_work *w=(empca_work *) arg;
+  IDL_LONG p=w->p, k=w->k;
+  IDL_LONG nb,ib,c,d,j;
+  long lo,hi,n0;
+  double *xb, *wb, *ew, *m, *h, *xh, *hh, *x, *wt, *e, *hhj;
+  double wx;
+
+  idlutils_range(w->n, ithread, nthreads, &lo, &hi);
+  xb=(double *) malloc((size_t) EMPCA_BLOCK*p*sizeof(double));
+  wb=(double *) malloc((size_t) EMPCA_BLOCK*p*sizeof(double));
+  ew=(double *) malloc((size_t) k*sizeof(double));
+  m=(double *) malloc((size_t) k*k*sizeof(double));
+  h=(double *) malloc((size_t) k*sizeof(double));
+  xh=w->xh+(long) ithread*p*k;
+  hh=w->hh+(long) ithread*p*k*k;
+  memset(xh, 0, (size_t) p*k*sizeof(double));
+  memset(hh, 0, (size_t) p*k*k*sizeof(double));
+
+  for(n0=lo;n0<hi;n0+=EMPCA_BLOCK) {
+    nb=(hi-n0<EMPCA_BLOCK) ? hi-n0 : EMPCA_BLOCK;
+    empca_load(w, n0, nb, w->data, xb);
+    empca_load(w, n0, nb, w->weight, wb);
+
+    for(ib=0;ib<nb;ib++) {
+      x=xb+(long) ib*p;
+      wt=wb+(long) ib*p;
+
+      /* h = (E^T W E)^-1 E^T W x, or zero if nothing constrains it */
+      memset(m, 0, (size_t) k*k*sizeof(double));
+      memset(h, 0, (size_t) k*sizeof(double));
+      for(j=0;j<p;j++) {
+        if(wt[j]==0.) continue;
+        e=w->proj+(long) j*k;
+        for(c=0;c<k;c++) ew[c]=wt[j]*e[c];
+        for(c=0;c<k;c++) {
+          h[c]+=ew[c]*x[j];
+          for(d=0;d<=c;d++) m[c*k+d]+=ew[c]*e[d];
+        }
+      }
+      if(empca_cholesky(m, k)) empca_cholsolve(m, k, h);
+      else memset(h, 0, (size_t) k*sizeof(double));
+      memcpy(w->hidden+(n0+ib)*k, h, k*sizeof(double));
+
+      /* per-pixel sums for the E step */
+      for(j=0;j<p;j++) {
+        if(wt[j]==0.) continue;
+        wx=wt[j]*x[j];
+        hhj=hh+(long) j*k*k;
+        for(c=0;c<k;c++) {
+          xh[(long) c*p+j]+=wx*h[c];
+          for(d=0;d<=c;d++) hhj[c*k+d]+=wt[j]*h[c]*h[d];
+        }
+      }
+    }
+  }
+
+  FREEVEC(xb);
+  FREEVEC(wb);
+  FREEVEC(ew);
+  FREEVEC(m);
+  FREEVEC(h);
+} /* end empca_pass_weighted */
+
+/********************************************************************/
+/* p, n, k, data[p,n], isdouble, weight[p,n], weighted, eigenvec[p,k],
+   hidden[k,n], maxiter, tol, niter, diffs[maxiter].
+
+   data and weight are FLOAT, or DOUBLE if isdouble is set; weight is
+   ignored unless weighted is set.  eigenvec (DOUBLE) is the starting point
+   and is replaced by the result, hidden (DOUBLE) is set to the hidden
+   variables of the last iteration, and tol (DOUBLE) and niter are as in
+   em_pca.pro; diffs (DOUBLE) gets the change of each iteration, if tol
+   is set, for em_pca.pro to log */
+IDL_LONG idl_em_pca (int argc,
+                     void *argv[])
+{
+  empca_work w;
+  IDL_LONG p, k, maxiter, niter, *niterout, c, d, j, t;
+  double tol, diff, dot, oldsq, newsq, *eold, *g, *b, *acc, *diffs;
+  long nhh, maxthreads;
+  IDL_LONG i;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  w.p=*((IDL_LONG *)argv[i]); i++;
+  w.n=*((IDL_LONG *)argv[i]); i++;
+  w.k=*((IDL_LONG *)argv[i]); i++;
+  w.data=argv[i]; i++;
+  w.isdouble=*((IDL_LONG *)argv[i]); i++;
+  w.weight=argv[i]; i++;
+  w.weighted=*((IDL_LONG *)argv[i]); i++;
+  w.eigenvec=((double *)argv[i]); i++;
+  w.hidden=((double *)argv[i]); i++;
+  maxiter=*((IDL_LONG *)argv[i]); i++;
+  tol=*((double *)argv[i]); i++;
+  niterout=((IDL_LONG *)argv[i]); i++;
+  diffs=((double *)argv[i]); i++;
+  p=w.p;
+  k=w.k;
+
+  if(p<=0 || w.n<=0 || k<=0) return retval;
+
+  /* 1. per-thread sums, for as many threads as fit in EMPCA_MAXMEM */
+  nhh=w.weighted ? (long) p*k*k : (long) k*k;
+  maxthreads=(w.n+EMPCA_BLOCK-1)/EMPCA_BLOCK;
+  if(EMPCA_MAXMEM/(((long) p*k+nhh)*(long) sizeof(double))<maxthreads)
+    maxthreads=EMPCA_MAXMEM/(((long) p*k+nhh)*(long) sizeof(double));
+  w.nthreads=idlutils_nthreads(maxthreads);
+  w.xh=(double *) malloc((size_t) w.nthreads*p*k*sizeof(double));
+  w.hh=(double *) malloc((size_t) w.nthreads*nhh*sizeof(double));
+  w.proj=(double *) malloc((size_t) p*k*sizeof(double));
+  eold=(double *) malloc((size_t) p*k*sizeof(double));
+  g=(double *) malloc((size_t) k*k*sizeof(double));
+  b=(double *) malloc((size_t) k*sizeof(double));
+
+  /* 2. iterate */
+  niter=0;
+  diff=tol*2.+1.;
+  while(niter<maxiter && diff>tol) {
+
+    /* projection (E^T E)^-1 E^T for the H step, or just E^T with
+       weights since each data vector has its own projection */
+    if(w.weighted) {
+      for(j=0;j<p;j++)
+        for(c=0;c<k;c++) w.proj[c+(long) j*k]=w.eigenvec[j+(long) c*p];
+    } else {
+      for(c=0;c<k;c++)
+        for(d=0;d<=c;d++) {
+          dot=0.;
+          for(j=0;j<p;j++)
+            dot+=w.eigenvec[j+(long) c*p]*w.eigenvec[j+(long) d*p];
+          g[c*k+d]=dot;
+          g[d*k+c]=dot;
+        }
+      if(!empca_cholesky(g, k)) break;
+      for(j=0;j<p;j++) {
+        for(c=0;c<k;c++) b[c]=w.eigenvec[j+(long) c*p];
+        empca_cholsolve(g, k, b);
+        for(c=0;c<k;c++) w.proj[j+(long) c*p]=b[c];
+      }
+    }
+
+    idlutils_run(w.nthreads, w.weighted ? empca_pass_weighted : empca_pass,
+                 &w);
+    for(t=1;t<w.nthreads;t++) {
+      acc=w.xh+(long) t*p*k;
+      for(j=0;j<p*k;j++) w.xh[j]+=acc[j];
+      acc=w.hh+(long) t*nhh;
+      for(j=0;j<nhh;j++) w.hh[j]+=acc[j];
+    }
+
+    /* E step: E = (sum x h^T) (sum h h^T)^-1, per pixel with weights;
+       pixels with no weight keep their old values */
+    memcpy(eold, w.eigenvec, (size_t) p*k*sizeof(double));
+    if(!w.weighted && !empca_cholesky(w.hh, k)) break;
+    for(j=0;j<p;j++) {
+      for(c=0;c<k;c++) b[c]=w.xh[j+(long) c*p];
+      if(w.weighted) {
+        for(c=0;c<k;c++)
+          for(d=0;d<=c;d++) g[c*k+d]=w.hh[(long) j*k*k+c*k+d];
+        if(!empca_cholesky(g, k)) continue;
+        empca_cholsolve(g, k, b);
+      } else {
+        empca_cholsolve(w.hh, k, b);
+      }
+      for(c=0;c<k;c++) w.eigenvec[j+(long) c*p]=b[c];
+    }
+
+    if(tol>0.) {
+      diff=0.;
+      for(c=0;c<k;c++) {
+        dot=0.;
+        oldsq=0.;
+        newsq=0.;
+        for(j=0;j<p;j++) {
+          dot+=eold[j+(long) c*p]*w.eigenvec[j+(long) c*p];
+          oldsq+=eold[j+(long) c*p]*eold[j+(long) c*p];
+          newsq+=w.eigenvec[j+(long) c*p]*w.eigenvec[j+(long) c*p];
+        }
+        diff+=fabs(1.-dot/sqrt(oldsq*newsq));
+      }
+      diffs[niter]=diff;
+    }
+    niter++;
+  }
+  *niterout=niter;
+
+  FREEVEC(w.xh);
+  FREEVEC(w.hh);
+  FREEVEC(w.proj);
+  FREEVEC(eold);
+  FREEVEC(g);
+  FREEVEC(b);
+
+  return retval;
+}
+
+/***************************************************************************/
@@ -2,18 +2,106 @@
 #include <math.h>
 #include <stdlib.h>
 #include "export.h" 
+#include "idlutils_threads.h"
 
 #define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
 
+/* partial sums kept per dot product; the inner loop runs over this many
+   consecutive k so it maps onto vector registers */
+#define MMEVAL_LANES 8
+
+/* nonzeros of a row evaluated together, sharing each load of aa */
+#define MMEVAL_NNZ 4
+
+typedef struct {
+  float *val, *bb, *aa;
+  IDL_LONG nx, ny, *x, *rowstart, *nxrow;
+  long *cumwork;
+} mmeval_work;
+
+/********************************************************************/
+/* dot products of aa with the columns bb+ib[0..ncol-1]*nx, ncol up to
+   MMEVAL_NNZ */
+static void mmeval_dots(const float *aa, const float *bb, IDL_LONG nx, 
+                        const IDL_LONG *ib, int ncol, float *dot)
+{
+  float acc[MMEVAL_NNZ][MMEVAL_LANES], a, sum;
+  const float *b[MMEVAL_NNZ];
+  IDL_LONG k,kend;
+  int c,m;
+
+  for(c=0;c<MMEVAL_NNZ;c++) {
+    b[c]=bb+(size_t) ib[c<ncol ? c : 0]*nx;
+    for(m=0;m<MMEVAL_LANES;m++) acc[c][m]=0.;
+  }
+
+  kend=nx-nx%MMEVAL_LANES;
+  for(k=0;k<kend;k+=MMEVAL_LANES) 
+    for(c=0;c<MMEVAL_NNZ;c++) 
+      for(m=0;m<MMEVAL_LANES;m++) 
+        acc[c][m]+=b[c][k+m]*aa[k+m];
+
+  for(c=0;c<ncol;c++) {
+    sum=0.;
+    for(m=0;m<MMEVAL_LANES;m++) sum+=acc[c][m];
+    for(k=kend;k<nx;k++) {
+      a=aa[k];
+      sum+=b[c][k]*a;
+    }
+    dot[c]=sum;
+  }
+} /* end mmeval_dots */
+
+/********************************************************************/
+/* first row whose cumulative work reaches target */
+static long mmeval_first_row(const long *cumwork, long ny, long target)
+{
+  long lo,hi,mid;
+
+  lo=0;
+  hi=ny;
+  while(lo<hi) {
+    mid=(lo+hi)/2;
+    if(cumwork[mid]<target) lo=mid+1; else hi=mid;
+  }
+  return(lo);
+} /* end mmeval_first_row */
+
+/********************************************************************/
+/* rows of this thread's share, split so that each thread has about the
+   same number of nonzeros (plus one per row for reading aa) */
+static void mmeval_rows(void *arg, int ithread, int nthreads)
+{
+  mmeval_work *w=(mmeval_work *) arg;
+  long total,jlo,jhi;
+  IDL_LONG j,l,l0,nl,ncol;
+
+  total=w->cumwork[w->ny];
+  jlo=mmeval_first_row(w->cumwork, w->ny, (total*ithread)/nthreads);
+  jhi=mmeval_first_row(w->cumwork, w->ny, (total*(ithread+1))/nthreads);
+  if(ithread==nthreads-1) jhi=w->ny;
+
+  for(j=jlo;j<jhi;j++) {
+    l0=w->rowstart[j];
+    nl=w->nxrow[j];
+    for(l=0;l<nl;l+=MMEVAL_NNZ) {
+      ncol=nl-l;
+      if(ncol>MMEVAL_NNZ) ncol=MMEVAL_NNZ;
+      mmeval_dots(w->aa+(size_t) j*w->nx, w->bb, w->nx, w->x+l0+l, ncol,
+                  w->val+l0+l);
+    }
+  }
+} /* end mmeval_rows */
+
 /********************************************************************/
 IDL_LONG idl_mmeval (int argc, 
                        void *argv[])
 {
   IDL_LONG nx,ny,nz,*rowstart,*nxrow,*x;
   float *aa, *bb, *val;
+  mmeval_work w;
     
-	IDL_LONG i,j,k,l;
-  float comp;
+	IDL_LONG i,j;
 	IDL_LONG retval=1;
 
 	/* 0. allocate pointers from IDL */
@@ -28,18 +116,27 @@ IDL_LONG idl_mmeval (int argc,
 	rowstart=((IDL_LONG *)argv[i]); i++;
 	nxrow=((IDL_LONG *)argv[i]); i++;
 
-  for(j=0L; j<ny; j++) {
-    for(l=0L; l<nxrow[j]; l++) {
-      i=x[rowstart[j]+l];
-      comp=0.;
-      for(k=0;k<nx;k++) 
-        comp+=bb[k+i*nx]*aa[k+j*nx];
-      val[rowstart[j]+l]=comp;
-    }
-  }
+  if(ny<=0) return retval;
+
+  /* 1. cumulative work per row for the partition */
+  w.cumwork=(long *) malloc((ny+1)*sizeof(long));
+  w.cumwork[0]=0;
+  for(j=0;j<ny;j++) w.cumwork[j+1]=w.cumwork[j]+nxrow[j]+1;
+
+  /* 2. evaluate, rows in parallel */
+  w.val=val;
+  w.bb=bb;
+  w.aa=aa;
+  w.nx=nx;
+  w.ny=ny;
+  w.x=x;
+  w.rowstart=rowstart;
+  w.nxrow=nxrow;
+  idlutils_run(idlutils_nthreads(w.cumwork[ny]/1024+1), mmeval_rows, &w);
+
+  FREEVEC(w.cumwork);
 
 	return retval;
 }
 
 /***************************************************************************/
-
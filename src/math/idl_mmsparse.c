@@ -1,12 +1,76 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "export.h" 
+#include "idlutils_threads.h"
 
 #define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
 
-int mmcomp(float *b, int nxb, int nyb, float *a, int *ax, int nxa, 
-           int xstart, int i, float *comp);
+/* number of dense columns multiplied together; each panel holds this many
+   columns of bb interleaved, so one sparse entry reads one contiguous run */
+#define MMSPARSE_BLOCK 16
+
+/* number of sparse rows handed to a thread at a time */
+#define MMSPARSE_ROWS 64
+
+typedef struct {
+  float *cc, *bb, *bt, *val;
+  IDL_LONG nx, ny, nz, nblock, *x, *rowstart, *nxrow;
+  idlutils_queue queue;
+} mmsparse_work;
+
+/********************************************************************/
+/* copy the columns of bb into panels bt[(iblock*nx+k)*MMSPARSE_BLOCK+ib],
+   zero padding the last one */
+static void mmsparse_pack(void *arg, int ithread, int nthreads)
+{
+  mmsparse_work *w=(mmsparse_work *) arg;
+  long lo,hi,iblock;
+  IDL_LONG i,ib,k;
+  float *panel;
+
+  idlutils_range(w->nblock, ithread, nthreads, &lo, &hi);
+  for(iblock=lo;iblock<hi;iblock++) {
+    panel=w->bt+iblock*w->nx*MMSPARSE_BLOCK;
+    for(ib=0;ib<MMSPARSE_BLOCK;ib++) {
+      i=iblock*MMSPARSE_BLOCK+ib;
+      if(i<w->nz) 
+        for(k=0;k<w->nx;k++) panel[k*MMSPARSE_BLOCK+ib]=w->bb[k+i*w->nx];
+      else
+        for(k=0;k<w->nx;k++) panel[k*MMSPARSE_BLOCK+ib]=0.;
+    }
+  }
+} /* end mmsparse_pack */
+
+/********************************************************************/
+/* cc[i+j*nz] for the rows j of each chunk, one panel of columns i at a
+   time so the panel stays in cache across the rows */
+static void mmsparse_rows(void *arg, int ithread, int nthreads)
+{
+  mmsparse_work *w=(mmsparse_work *) arg;
+  long lo,hi,iblock;
+  IDL_LONG i0,ib,j,l,nb;
+  float acc[MMSPARSE_BLOCK], v, *panel, *pb;
+
+  while(idlutils_queue_next(&(w->queue), &lo, &hi)) {
+    for(iblock=0;iblock<w->nblock;iblock++) {
+      panel=w->bt+iblock*w->nx*MMSPARSE_BLOCK;
+      i0=iblock*MMSPARSE_BLOCK;
+      nb=w->nz-i0;
+      if(nb>MMSPARSE_BLOCK) nb=MMSPARSE_BLOCK;
+      for(j=lo;j<hi;j++) {
+        for(ib=0;ib<MMSPARSE_BLOCK;ib++) acc[ib]=0.;
+        for(l=w->rowstart[j];l<w->rowstart[j]+w->nxrow[j];l++) {
+          v=w->val[l];
+          pb=panel+w->x[l]*MMSPARSE_BLOCK;
+          for(ib=0;ib<MMSPARSE_BLOCK;ib++) acc[ib]+=v*pb[ib];
+        }
+        memcpy(w->cc+i0+j*w->nz, acc, nb*sizeof(float));
+      }
+    }
+  }
+} /* end mmsparse_rows */
 
 /********************************************************************/
 IDL_LONG idl_mmsparse (int argc, 
@@ -14,9 +78,9 @@ IDL_LONG idl_mmsparse (int argc,
 {
   IDL_LONG nx,ny,nz,*rowstart,*nxrow,*x;
   float *cc, *bb, *val;
+  mmsparse_work w;
     
-	IDL_LONG i,j,k,l;
-  float comp;
+	IDL_LONG i;
 	IDL_LONG retval=1;
 
 	/* 0. allocate pointers from IDL */
@@ -31,19 +95,31 @@ IDL_LONG idl_mmsparse (int argc,
 	rowstart=((IDL_LONG *)argv[i]); i++;
 	nxrow=((IDL_LONG *)argv[i]); i++;
 
-  for(i=0L; i<nz; i++) {
-    for(j=0L; j<ny; j++) {
-      comp=0.;
-      for(l=0; l<nxrow[j]; l++) {
-        k=x[rowstart[j]+l];
-        comp+=val[rowstart[j]+l]*bb[k+i*nx];
-      }
-      cc[i+j*nz]=comp;
-    }
-  }
+  if(nx<=0 || ny<=0 || nz<=0) return retval;
+
+  /* 1. pack bb into panels of MMSPARSE_BLOCK columns */
+  w.cc=cc;
+  w.bb=bb;
+  w.val=val;
+  w.nx=nx;
+  w.ny=ny;
+  w.nz=nz;
+  w.x=x;
+  w.rowstart=rowstart;
+  w.nxrow=nxrow;
+  w.nblock=(nz+MMSPARSE_BLOCK-1)/MMSPARSE_BLOCK;
+  w.bt=(float *) malloc((size_t) w.nblock*nx*MMSPARSE_BLOCK*sizeof(float));
+  idlutils_run(idlutils_nthreads(w.nblock), mmsparse_pack, &w);
+
+  /* 2. multiply, rows in parallel */
+  idlutils_queue_init(&(w.queue), ny, MMSPARSE_ROWS);
+  idlutils_run(idlutils_nthreads((ny+MMSPARSE_ROWS-1)/MMSPARSE_ROWS),
+               mmsparse_rows, &w);
+  idlutils_queue_free(&(w.queue));
+
+  FREEVEC(w.bt);
 	
 	return retval;
 }
 
 /***************************************************************************/
-
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "idlutils_threads.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+/*
+ * Multiplicative-update NMF of a sparse data matrix, as iterated by
+ * nmf_sparse.pro.  With data D[d,k] and inverse variances I[d,k] known on
+ * a sparse set of (d,k), the model is Dhat = M T C, for the fixed [nd,nf]
+ * matrix M, templates T[nf,ncomp] and coefficients C[ncomp,nk].  Each
+ * iteration sets
+ *
+ *   C *= (T^T M^T (D I)) / (T^T M^T (Dhat I))
+ *   T *= (M^T (D I) C^T) / (M^T (Dhat I) C^T)
+ *
+ * with the new C in the second update, then normalizes each template to
+ * unit sum.  Every sparse product is fused into one pass over the rows
+ * (data points k), so neither Dhat nor M^T (D I) is stored.
+ */
+
+typedef struct {
+  IDL_LONG nd, nk, nf, ncomp, *x, *rowstart, *nxrow;
+  float *val, *ivar;
+  double *mt;           /* M transposed, mt[f+d*nf] */
+  double *templates, *coeffs, *newcoeffs;
+  long *cumwork;
+  int nthreads;
+  double *tnum, *tden;  /* template update sums [nthreads][nf*ncomp] */
+  double *err;          /* chi^2 [nthreads] */
+} nmf_work;
+
+/********************************************************************/
+/* first row whose cumulative work reaches target */
+static long nmf_first_row(const long *cumwork, long nk, long target)
+{
+  long lo,hi,mid;
+
+  lo=0;
+  hi=nk;
+  while(lo<hi) {
+    mid=(lo+hi)/2;
+    if(cumwork[mid]<target) lo=mid+1; else hi=mid;
+  }
+  return(lo);
+} /* end nmf_first_row */
+
+/********************************************************************/
+/* one pass over this thread's rows: chi^2 of the current model, the new
+   coefficients, and this thread's share of the template update sums */
+static void nmf_rows(void *arg, int ithread, int nthreads)
+{
+  nmf_work *w=(nmf_work *) arg;
+  IDL_LONG nf=w->nf, ncomp=w->ncomp;
+  IDL_LONG f,c,l,k,lend;
+  long total,klo,khi;
+  double *mc, *mdp, *mdhp, *row, *tnum, *tden, *ck, *nck, *tc;
+  double dot, diff, iv, s, sp, num, den, err;
+
+  total=w->cumwork[w->nk];
+  klo=nmf_first_row(w->cumwork, w->nk, (total*ithread)/nthreads);
+  khi=nmf_first_row(w->cumwork, w->nk, (total*(ithread+1))/nthreads);
+  if(ithread==nthreads-1) khi=w->nk;
+
+  mc=(double *) malloc(3*nf*sizeof(double));
+  mdp=mc+nf;
+  mdhp=mdp+nf;
+  tnum=w->tnum+(long) ithread*nf*ncomp;
+  tden=w->tden+(long) ithread*nf*ncomp;
+  for(f=0;f<nf*ncomp;f++) {
+    tnum[f]=0.;
+    tden[f]=0.;
+  }
+  err=0.;
+
+  for(k=klo;k<khi;k++) {
+    ck=w->coeffs+(long) k*ncomp;
+    nck=w->newcoeffs+(long) k*ncomp;
+
+    /* model of this data point in the template basis, T C[*,k] */
+    for(f=0;f<nf;f++) mc[f]=0.;
+    for(c=0;c<ncomp;c++) {
+      tc=w->templates+(long) c*nf;
+      for(f=0;f<nf;f++) mc[f]+=tc[f]*ck[c];
+    }
+
+    /* M^T (D I) and M^T (Dhat I) for this data point, with Dhat = M mc
+       evaluated only where there is data */
+    for(f=0;f<nf;f++) {
+      mdp[f]=0.;
+      mdhp[f]=0.;
+    }
+    lend=w->rowstart[k]+w->nxrow[k];
+    for(l=w->rowstart[k];l<lend;l++) {
+      row=w->mt+(long) w->x[l]*nf;
+      dot=0.;
+      for(f=0;f<nf;f++) dot+=row[f]*mc[f];
+      iv=w->ivar[l];
+      diff=dot-w->val[l];
+      err+=diff*diff*iv;
+      s=dot*iv;
+      sp=w->val[l]*iv;
+      for(f=0;f<nf;f++) {
+        mdhp[f]+=s*row[f];
+        mdp[f]+=sp*row[f];
+      }
+    }
+
+    /* new coefficients, and their terms of the template update */
+    for(c=0;c<ncomp;c++) {
+      tc=w->templates+(long) c*nf;
+      num=0.;
+      den=0.;
+      for(f=0;f<nf;f++) {
+        num+=tc[f]*mdp[f];
+        den+=tc[f]*mdhp[f];
+      }
+      nck[c]=ck[c]*(num/den);
+      for(f=0;f<nf;f++) {
+        tnum[f+c*nf]+=mdp[f]*nck[c];
+        tden[f+c*nf]+=mdhp[f]*nck[c];
+      }
+    }
+  }
+
+  w->err[ithread]=err;
+  FREEVEC(mc);
+} /* end nmf_rows */
+
+/********************************************************************/
+/* nd, nk, nf, ncomp, val[nval], ivar[nval], x[nval], rowstart[nk],
+   nxrow[nk], mmatrix[nd,nf], templates[nf,ncomp], coeffs[ncomp,nk],
+   maxiter, tol (DOUBLE), niter, err (DOUBLE).
+
+   templates and coeffs (DOUBLE) are the starting point and are replaced
+   by the result.  Iterates until the fractional change in chi^2 is no
+   more than tol, or for maxiter iterations; returns the number of
+   iterations in niter and the final chi^2 in err, as nmf_sparse.pro */
+IDL_LONG idl_nmf_sparse (int argc,
+                         void *argv[])
+{
+  nmf_work w;
+  float *mmatrix;
+  double tol, *errout, *coeffsin, *tmp;
+  double err, eold, errsum, ttot;
+  IDL_LONG maxiter, niter, *niterout, nf, ncomp, d, f, c, k, t;
+  IDL_LONG i;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  w.nd=*((IDL_LONG *)argv[i]); i++;
+  w.nk=*((IDL_LONG *)argv[i]); i++;
+  w.nf=*((IDL_LONG *)argv[i]); i++;
+  w.ncomp=*((IDL_LONG *)argv[i]); i++;
+  w.val=((float *)argv[i]); i++;
+  w.ivar=((float *)argv[i]); i++;
+  w.x=((IDL_LONG *)argv[i]); i++;
+  w.rowstart=((IDL_LONG *)argv[i]); i++;
+  w.nxrow=((IDL_LONG *)argv[i]); i++;
+  mmatrix=((float *)argv[i]); i++;
+  w.templates=((double *)argv[i]); i++;
+  w.coeffs=((double *)argv[i]); i++;
+  maxiter=*((IDL_LONG *)argv[i]); i++;
+  tol=*((double *)argv[i]); i++;
+  niterout=((IDL_LONG *)argv[i]); i++;
+  errout=((double *)argv[i]); i++;
+  nf=w.nf;
+  ncomp=w.ncomp;
+  coeffsin=w.coeffs;
+
+  if(w.nd<=0 || w.nk<=0 || nf<=0 || ncomp<=0) return retval;
+
+  /* 1. resident copies: M transposed so each data dimension reads one
+     contiguous row, the work per row for the partition, and the sums */
+  w.mt=(double *) malloc((size_t) w.nd*nf*sizeof(double));
+  for(d=0;d<w.nd;d++)
+    for(f=0;f<nf;f++)
+      w.mt[f+(long) d*nf]=mmatrix[d+(long) f*w.nd];
+  w.cumwork=(long *) malloc((w.nk+1)*sizeof(long));
+  w.cumwork[0]=0;
+  for(k=0;k<w.nk;k++) w.cumwork[k+1]=w.cumwork[k]+w.nxrow[k]+ncomp;
+  w.nthreads=idlutils_nthreads(w.cumwork[w.nk]*(long) nf/65536+1);
+  w.newcoeffs=(double *) malloc((size_t) ncomp*w.nk*sizeof(double));
+  w.tnum=(double *) malloc((size_t) w.nthreads*nf*ncomp*sizeof(double));
+  w.tden=(double *) malloc((size_t) w.nthreads*nf*ncomp*sizeof(double));
+  w.err=(double *) malloc(w.nthreads*sizeof(double));
+
+  /* 2. iterate; each pass gives chi^2 of the current model along with the
+     next update, which is kept only if the fit has not converged */
+  err=1.e+99;
+  eold=1.e+100;
+  niter=0;
+  for(;;) {
+    idlutils_run(w.nthreads, nmf_rows, &w);
+    errsum=0.;
+    for(t=0;t<w.nthreads;t++) errsum+=w.err[t];
+    if(niter>0) {
+      eold=err;
+      err=errsum;
+    }
+    if(niter>=maxiter || fabs(err-eold)/err<=tol) break;
+
+    tmp=w.coeffs;
+    w.coeffs=w.newcoeffs;
+    w.newcoeffs=tmp;
+    for(t=1;t<w.nthreads;t++) {
+      for(f=0;f<nf*ncomp;f++) {
+        w.tnum[f]+=w.tnum[f+(long) t*nf*ncomp];
+        w.tden[f]+=w.tden[f+(long) t*nf*ncomp];
+      }
+    }
+    for(c=0;c<ncomp;c++) {
+      ttot=0.;
+      for(f=0;f<nf;f++) {
+        w.templates[f+c*nf]*=w.tnum[f+c*nf]/w.tden[f+c*nf];
+        ttot+=w.templates[f+c*nf];
+      }
+      for(f=0;f<nf;f++) w.templates[f+c*nf]/=ttot;
+    }
+    niter++;
+  }
+
+  /* 3. the result must end up in the coeffs array from IDL */
+  if(w.coeffs!=coeffsin) {
+    memcpy(coeffsin, w.coeffs, (size_t) ncomp*w.nk*sizeof(double));
+    w.newcoeffs=w.coeffs;
+  }
+  *niterout=niter;
+  *errout=errsum;
+
+  FREEVEC(w.mt);
+  FREEVEC(w.cumwork);
+  FREEVEC(w.newcoeffs);
+  FREEVEC(w.tnum);
+  FREEVEC(w.tden);
+  FREEVEC(w.err);
+
+  return retval;
+}
+
+/***************************************************************************/
@@ -1,30 +1,413 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <float.h>
 #include "export.h"
+#include "idlutils_threads.h"
 
-void idl_nnls
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+/* right-hand sides handed to a thread at a time */
+#define NNLS_CHUNK 16
+
+/* a column whose Cholesky pivot falls below this fraction of its diagonal
+   is taken as dependent on the passive set, and is not added to it */
+#define NNLS_DEPENDENT 1.e-10
+
+/* status returned for each right-hand side, as from nnls.f */
+#define NNLS_OK 1
+#define NNLS_BADDIM 2
+#define NNLS_MAXITER 3
+
+typedef struct {
+  float *a, *b, *x, *resnorm, *w;
+  IDL_LONG mda, m, n, nrhs, maxiter, warm, *passive, *mde;
+  double *gram, anorm;
+  idlutils_queue queue;
+} nnls_work;
+
+/* working space for one right-hand side at a time */
+typedef struct {
+  double *c, *x, *z, *wd, *chol, *y;
+  IDL_LONG *plist, *state;
+} nnls_scratch;
+
+/********************************************************************/
+/* gram[j+k*n] = sum_i a[i+j*mda]*a[i+k*mda] */
+static void nnls_gram(float *a, IDL_LONG mda, IDL_LONG m, IDL_LONG n,
+                      double *gram)
+{
+  IDL_LONG i,j,k;
+  double sum;
+
+  for(j=0;j<n;j++) {
+    for(k=0;k<=j;k++) {
+      sum=0.;
+      for(i=0;i<m;i++) sum+=(double) a[i+j*mda]*a[i+k*mda];
+      gram[j+k*n]=sum;
+      gram[k+j*n]=sum;
+    }
+  }
+} /* end nnls_gram */
+
+/********************************************************************/
+/* solve gram[P,P] z[P] = c[P] for the passive set P=plist[0..np-1], by
+   Cholesky in the order of plist; z is zero outside P.  Returns -1, or the
+   position in plist of the first dependent column */
+static IDL_LONG nnls_solve(double *gram, IDL_LONG n, double *c,
+                           IDL_LONG *plist, IDL_LONG np, double *chol,
+                           double *y, double *z)
+{
+  IDL_LONG p,q,r,jp,jq;
+  double d,sum;
+
+  for(p=0;p<n;p++) z[p]=0.;
+
+  for(p=0;p<np;p++) {
+    jp=plist[p];
+    for(q=0;q<=p;q++) {
+      jq=plist[q];
+      sum=gram[jp+jq*n];
+      for(r=0;r<q;r++) sum-=chol[p+r*n]*chol[q+r*n];
+      if(q<p) {
+        chol[p+q*n]=sum/chol[q+q*n];
+      } else {
+        d=gram[jp+jp*n];
+        if(sum<=NNLS_DEPENDENT*d || d<=0.) return(p);
+        chol[p+p*n]=sqrt(sum);
+      }
+    }
+  }
+
+  /* forward and back substitution */
+  for(p=0;p<np;p++) {
+    sum=c[plist[p]];
+    for(r=0;r<p;r++) sum-=chol[p+r*n]*y[r];
+    y[p]=sum/chol[p+p*n];
+  }
+  for(p=np-1;p>=0;p--) {
+    sum=y[p];
+    for(r=p+1;r<np;r++) sum-=chol[r+p*n]*y[r];
+    y[p]=sum/chol[p+p*n];
+    z[plist[p]]=y[p];
+  }
+
+  return(-1);
+} /* end nnls_solve */
+
+/********************************************************************/
+/* drop the passive columns with v<=0, keeping plist in order; returns the
+   new size of the passive set */
+static IDL_LONG nnls_prune(IDL_LONG *plist, IDL_LONG np, IDL_LONG *state,
+                           double *v)
+{
+  IDL_LONG p,q;
+
+  for(p=0,q=0;p<np;p++) {
+    if(v[plist[p]]>0.) {
+      plist[q++]=plist[p];
+    } else {
+      state[plist[p]]=0;
+      v[plist[p]]=0.;
+    }
+  }
+  return(q);
+} /* end nnls_prune */
+
+/********************************************************************/
+/* Lawson & Hanson active-set NNLS for right-hand side b, on the normal
+   equations gram x = c with c = a^T b.  If warm is set the passive set
+   starts from passive[] (nonzero for passive), otherwise from empty; on
+   exit passive[] holds the final passive set.  Returns the status */
+static IDL_LONG nnls_one(nnls_work *wk, nnls_scratch *s, float *b,
+                         float *xout, IDL_LONG *passive, float *resnorm,
+                         float *wout)
+{
+  IDL_LONG m=wk->m, n=wk->n, mda=wk->mda;
+  IDL_LONG i,j,t,np,iter,bad,status;
+  double sum,bmax,tol,wmax,alpha,ratio;
+  float *col;
+
+  /* 1. c = a^T b, and the tolerance on the dual, which scales with a
+     and b */
+  bmax=0.;
+  for(i=0;i<m;i++) if(fabs(b[i])>bmax) bmax=fabs(b[i]);
+  for(j=0;j<n;j++) {
+    col=wk->a+j*mda;
+    sum=0.;
+    for(i=0;i<m;i++) sum+=(double) col[i]*b[i];
+    s->c[j]=sum;
+  }
+  tol=10.*DBL_EPSILON*wk->anorm*(m>n ? m : n)*(bmax>1. ? bmax : 1.);
+
+  /* 2. starting passive set, pruned until its solution is positive */
+  np=0;
+  for(j=0;j<n;j++) {
+    s->state[j]=(wk->warm && passive[j]) ? 1 : 0;
+    if(s->state[j]) s->plist[np++]=j;
+    s->x[j]=0.;
+  }
+  while(np>0) {
+    bad=nnls_solve(wk->gram, n, s->c, s->plist, np, s->chol, s->y, s->z);
+    if(bad>=0) {
+      s->state[s->plist[bad]]=0;
+      memmove(s->plist+bad, s->plist+bad+1, (np-bad-1)*sizeof(IDL_LONG));
+      np--;
+      continue;
+    }
+    for(i=0;i<np;i++) if(s->z[s->plist[i]]<=0.) break;
+    if(i==np) break;
+    np=nnls_prune(s->plist, np, s->state, s->z);
+  }
+  if(np>0) for(j=0;j<n;j++) s->x[j]=s->z[j];
+
+  /* 3. main loop: add the column with the largest dual, then step back
+     towards feasibility until the passive solution is positive */
+  status=NNLS_OK;
+  iter=0;
+  for(;;) {
+    for(j=0;j<n;j++) {
+      sum=s->c[j];
+      for(i=0;i<n;i++) sum-=wk->gram[j+i*n]*s->x[i];
+      s->wd[j]=sum;
+    }
+    t=-1;
+    wmax=tol;
+    for(j=0;j<n;j++)
+      if(s->state[j]==0 && s->wd[j]>wmax) {
+        wmax=s->wd[j];
+        t=j;
+      }
+    if(t<0 || np>=m) break;
+    if(iter++>=wk->maxiter) {
+      status=NNLS_MAXITER;
+      break;
+    }
+
+    s->plist[np++]=t;
+    s->state[t]=1;
+    bad=nnls_solve(wk->gram, n, s->c, s->plist, np, s->chol, s->y, s->z);
+    if(bad>=0 || s->z[t]<=0.) {
+      /* t is dependent on the passive set, or would not enter it; pass
+         over it until the passive set changes */
+      np--;
+      s->state[t]=-1;
+      continue;
+    }
+
+    while(np>0) {
+      alpha=2.;
+      for(i=0;i<np;i++) {
+        j=s->plist[i];
+        if(s->z[j]<=0.) {
+          ratio=s->x[j]/(s->x[j]-s->z[j]);
+          if(ratio<alpha) alpha=ratio;
+        }
+      }
+      if(alpha>1.) break;
+
+      /* step to the first bound reached, and drop the columns reaching it */
+      for(i=0;i<np;i++) {
+        j=s->plist[i];
+        if(s->z[j]<=0. && s->x[j]/(s->x[j]-s->z[j])<=alpha) s->x[j]=0.;
+        else s->x[j]+=alpha*(s->z[j]-s->x[j]);
+      }
+      np=nnls_prune(s->plist, np, s->state, s->x);
+      nnls_solve(wk->gram, n, s->c, s->plist, np, s->chol, s->y, s->z);
+    }
+    for(j=0;j<n;j++) {
+      s->x[j]=s->z[j];
+      if(s->state[j]<0) s->state[j]=0;
+    }
+  }
+
+  /* 4. outputs; the residual is taken from a directly rather than from the
+     normal equations, which lose precision for good fits */
+  sum=0.;
+  for(i=0;i<m;i++) {
+    alpha=-b[i];
+    for(j=0;j<np;j++)
+      alpha+=(double) wk->a[i+s->plist[j]*mda]*s->x[s->plist[j]];
+    sum+=alpha*alpha;
+  }
+  *resnorm=sqrt(sum);
+  for(j=0;j<n;j++) {
+    xout[j]=s->x[j];
+    passive[j]=(s->state[j]==1);
+    if(wout!=NULL) wout[j]=(s->state[j]==1) ? 0. : s->wd[j];
+  }
+
+  return(status);
+} /* end nnls_one */
+
+/********************************************************************/
+static void nnls_scratch_alloc(nnls_scratch *s, IDL_LONG n)
+{
+  s->c=(double *) malloc(n*sizeof(double));
+  s->x=(double *) malloc(n*sizeof(double));
+  s->z=(double *) malloc(n*sizeof(double));
+  s->wd=(double *) malloc(n*sizeof(double));
+  s->y=(double *) malloc(n*sizeof(double));
+  s->chol=(double *) malloc(n*n*sizeof(double));
+  s->plist=(IDL_LONG *) malloc(n*sizeof(IDL_LONG));
+  s->state=(IDL_LONG *) malloc(n*sizeof(IDL_LONG));
+} /* end nnls_scratch_alloc */
+
+static void nnls_scratch_free(nnls_scratch *s)
+{
+  FREEVEC(s->c);
+  FREEVEC(s->x);
+  FREEVEC(s->z);
+  FREEVEC(s->wd);
+  FREEVEC(s->y);
+  FREEVEC(s->chol);
+  FREEVEC(s->plist);
+  FREEVEC(s->state);
+} /* end nnls_scratch_free */
+
+/********************************************************************/
+/* set up the design matrix: its Gram matrix and largest column sum */
+static void nnls_setup(nnls_work *wk)
+{
+  IDL_LONG i,j;
+  double sum;
+
+  wk->gram=(double *) malloc(wk->n*wk->n*sizeof(double));
+  nnls_gram(wk->a, wk->mda, wk->m, wk->n, wk->gram);
+  wk->anorm=0.;
+  for(j=0;j<wk->n;j++) {
+    sum=0.;
+    for(i=0;i<wk->m;i++) sum+=fabs(wk->a[i+j*wk->mda]);
+    if(sum>wk->anorm) wk->anorm=sum;
+  }
+} /* end nnls_setup */
+
+/********************************************************************/
+static void nnls_batch_thread(void *arg, int ithread, int nthreads)
+{
+  nnls_work *wk=(nnls_work *) arg;
+  nnls_scratch s;
+  long lo,hi,irhs;
+  IDL_LONG n=wk->n;
+
+  nnls_scratch_alloc(&s, n);
+  while(idlutils_queue_next(&(wk->queue), &lo, &hi))
+    for(irhs=lo;irhs<hi;irhs++)
+      wk->mde[irhs]=nnls_one(wk, &s, wk->b+irhs*wk->m, wk->x+irhs*n,
+                             wk->passive+irhs*n, wk->resnorm+irhs,
+                             wk->w!=NULL ? wk->w+irhs*n : NULL);
+  nnls_scratch_free(&s);
+} /* end nnls_batch_thread */
+
+/********************************************************************/
+/* single problem, with the arguments of nnls.f:
+   a[mda,n], mda, m, n, b[m], x[n], resnorm, w[n], zz[m], indx[n], mde.
+   a and b are not changed; indx lists the passive set then the zero set,
+   1-based, and zz returns the residual b-ax */
+IDL_LONG idl_nnls
+  (int         argc,
+   void    *   argv[])
+{
+  nnls_work wk;
+  nnls_scratch s;
+  float *zz;
+  IDL_LONG *indx, i, j, np;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  wk.a=(float *) argv[i]; i++;
+  wk.mda=*((IDL_LONG *) argv[i]); i++;
+  wk.m=*((IDL_LONG *) argv[i]); i++;
+  wk.n=*((IDL_LONG *) argv[i]); i++;
+  wk.b=(float *) argv[i]; i++;
+  wk.x=(float *) argv[i]; i++;
+  wk.resnorm=(float *) argv[i]; i++;
+  wk.w=(float *) argv[i]; i++;
+  zz=(float *) argv[i]; i++;
+  indx=(IDL_LONG *) argv[i]; i++;
+  wk.mde=(IDL_LONG *) argv[i]; i++;
+
+  if(wk.m<=0 || wk.n<=0 || wk.mda<wk.m) {
+    wk.mde[0]=NNLS_BADDIM;
+    return retval;
+  }
+
+  /* 1. solve from an empty passive set, with nnls.f's iteration limit */
+  wk.nrhs=1;
+  wk.warm=0;
+  wk.maxiter=3*wk.n;
+  wk.passive=(IDL_LONG *) malloc(wk.n*sizeof(IDL_LONG));
+  nnls_setup(&wk);
+  nnls_scratch_alloc(&s, wk.n);
+  wk.mde[0]=nnls_one(&wk, &s, wk.b, wk.x, wk.passive, wk.resnorm, wk.w);
+
+  /* 2. sets P and Z, and the residual */
+  np=0;
+  for(j=0;j<wk.n;j++) if(wk.passive[j]) indx[np++]=j+1;
+  for(j=0;j<wk.n;j++) if(!wk.passive[j]) indx[np++]=j+1;
+  for(i=0;i<wk.m;i++) {
+    zz[i]=wk.b[i];
+    for(j=0;j<wk.n;j++) zz[i]-=wk.a[i+j*wk.mda]*wk.x[j];
+  }
+
+  nnls_scratch_free(&s);
+  FREEVEC(wk.gram);
+  FREEVEC(wk.passive);
+
+  return retval;
+}
+
+/********************************************************************/
+/* many right-hand sides against one design matrix:
+   a[m,n], m, n, nrhs, b[m,nrhs], x[n,nrhs], passive[n,nrhs], warm,
+   maxiter, resnorm[nrhs], w[n,nrhs], mde[nrhs].
+   With warm set each problem starts from its passive[] set, as returned
+   by an earlier call; passive[] always returns the final sets */
+IDL_LONG idl_nnls_batch
   (int         argc,
    void    *   argv[])
 {
-  extern void nnls_();/* Fortran routine */
-  int *mda,*m,*n,*indx,*mde;
-  float *a,*b,*x,*resnorm,*w,*zz;
-  a = (float *) argv[0];
-  mda = * (int *) argv[1];
-  m = * (int *) argv[2];
-  n = * (int *) argv[3];
-  b = (float *) argv[4];
-  x = (float *) argv[5];
-  resnorm = * (float *) argv[6];
-  w = (float *) argv[7];
-  zz = (float *) argv[8] ;
-  indx = (int *) argv[9] ;
-  mde = (int *) argv[10] ;
-  for(i=0;i<mda[0];i++){
-    for(j=0;j<n[0];j++){
-      printf("%d %d %lf\n",i,j,a[i][j]) ;
-    }
-  }
-  nnls_(a,mda,m,n,b,x,resnorm,w,zz,indx,mde);
+  nnls_work wk;
+  IDL_LONG i;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  wk.a=(float *) argv[i]; i++;
+  wk.m=*((IDL_LONG *) argv[i]); i++;
+  wk.n=*((IDL_LONG *) argv[i]); i++;
+  wk.nrhs=*((IDL_LONG *) argv[i]); i++;
+  wk.b=(float *) argv[i]; i++;
+  wk.x=(float *) argv[i]; i++;
+  wk.passive=(IDL_LONG *) argv[i]; i++;
+  wk.warm=*((IDL_LONG *) argv[i]); i++;
+  wk.maxiter=*((IDL_LONG *) argv[i]); i++;
+  wk.resnorm=(float *) argv[i]; i++;
+  wk.w=(float *) argv[i]; i++;
+  wk.mde=(IDL_LONG *) argv[i]; i++;
+  wk.mda=wk.m;
+
+  if(wk.nrhs<=0) return retval;
+  if(wk.m<=0 || wk.n<=0) {
+    for(i=0;i<wk.nrhs;i++) wk.mde[i]=NNLS_BADDIM;
+    return retval;
+  }
+  if(wk.maxiter<=0) wk.maxiter=3*wk.n;
+
+  /* 1. the Gram matrix is shared by every right-hand side */
+  nnls_setup(&wk);
+
+  /* 2. solve, right-hand sides in parallel */
+  idlutils_queue_init(&(wk.queue), wk.nrhs, NNLS_CHUNK);
+  idlutils_run(idlutils_nthreads((wk.nrhs+NNLS_CHUNK-1)/NNLS_CHUNK),
+               nnls_batch_thread, &wk);
+  idlutils_queue_free(&(wk.queue));
+
+  FREEVEC(wk.gram);
+
+  return retval;
 }
+
+/***************************************************************************/
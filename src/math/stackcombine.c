@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "export.h"
+#include "arrcombine.h"
+
+/*
+ * stackcombine.c
+ *
+ * Combine a stack of frames on disk into one image, pixel by pixel, by
+ * median (arrmedian), sigma-clipped mean (arravsigclip) or masked
+ * sigma-clipped mean (arravsigclip_mask).  Each frame is a 2-D image at a
+ * byte offset in its own file, such as the data segment of a FITS file;
+ * the files are memory mapped and read a band of rows at a time into a
+ * cube of nband x nx x nframe values, which is combined and written to
+ * the (mapped) output image, and the output mask planes, before the next
+ * band is read.  Memory in use is one band of every frame, never the
+ * whole stack.
+ *
+ * Frames may be 8, 16 or 32-bit integers or 32 or 64-bit floats
+ * (FITS BITPIX 8, 16, 32, -32, -64), scaled by BSCALE and BZERO, in
+ * either byte order.  Input masks are bytes, nonzero where bad.
+ */
+
+/* Default number of values (rows x nx x nframe) in one band */
+#define STACKCOMBINE_BANDSIZE (16L*1024L*1024L)
+
+#define STACKCOMBINE_MEDIAN  0
+#define STACKCOMBINE_SIGCLIP 1
+#define STACKCOMBINE_SIGMASK 2
+
+typedef struct {
+   char     *  map;       /* whole file mapped from byte 0 */
+   size_t      size;
+   long        offset;    /* byte offset of the first pixel */
+   int         nbyte;     /* bytes per pixel */
+   int         bitpix;
+   double      bscale;
+   double      bzero;
+   int         swap;      /* pixels stored in the other byte order */
+   long        released;  /* pixels before this have been released */
+} stack_file;
+
+/******************************************************************************/
+static int stack_littleendian()
+{
+   int one = 1;
+   return (int) *((char *) &one);
+}
+
+/******************************************************************************/
+/* Map npix pixels of the given type at offset; output files are created or
+ * extended as needed.  The descriptor is closed once mapped.
+ */
+static int stack_open
+  (stack_file * f,
+   char     *  filename,
+   long        offset,
+   int         bitpix,
+   double      bscale,
+   double      bzero,
+   int         bigendian,
+   long        npix,
+   int         output)
+{
+   struct stat st;
+   int         fd;
+
+   f->map = NULL;
+   f->released = 0;
+   f->offset = offset;
+   f->bitpix = bitpix;
+   f->bscale = bscale;
+   f->bzero = bzero;
+   f->nbyte = abs(bitpix) / 8;
+   if (bitpix != 8 && bitpix != 16 && bitpix != 32 && bitpix != -32
+    && bitpix != -64) {
+      fprintf(stderr, "stackcombine: unsupported BITPIX %d for %s\n",
+       bitpix, filename);
+      return 0;
+   }
+   f->swap = (f->nbyte > 1)
+    && ((bigendian != 0) == (stack_littleendian() != 0));
+   f->size = (size_t) offset + (size_t) npix * f->nbyte;
+
+   if (output) fd = open(filename, O_RDWR|O_CREAT, 0644);
+   else fd = open(filename, O_RDONLY);
+   if (fd < 0) {
+      fprintf(stderr, "stackcombine: cannot open %s\n", filename);
+      return 0;
+   }
+   if (fstat(fd, &st) != 0) {
+      close(fd);
+      return 0;
+   }
+   if ((size_t) st.st_size < f->size) {
+      if (!output || ftruncate(fd, (off_t) f->size) != 0) {
+         fprintf(stderr, "stackcombine: %s is too short\n", filename);
+         close(fd);
+         return 0;
+      }
+   }
+
+   f->map = (char *) mmap(NULL, f->size,
+    output ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (f->map == MAP_FAILED) {
+      fprintf(stderr, "stackcombine: cannot map %s\n", filename);
+      f->map = NULL;
+      return 0;
+   }
+   madvise(f->map, f->size, MADV_SEQUENTIAL);
+   return 1;
+}
+
+/******************************************************************************/
+static void stack_close
+  (stack_file * f)
+{
+   if (f->map != NULL) {
+      msync(f->map, f->size, MS_SYNC);
+      munmap(f->map, f->size);
+      f->map = NULL;
+   }
+}
+
+/******************************************************************************/
+/* Let the kernel drop the pages of the pixels before pix, which are done
+ * with, in each of nplane planes of planesize pixels; dirty pages are
+ * written back first.
+ */
+static void stack_release_planes
+  (stack_file * f,
+   long        nplane,
+   long        planesize,
+   long        pix)
+{
+   long        pagesize;
+   long        start;
+   long        end;
+   long        iplane;
+
+   if (f->map == NULL || pix <= f->released) return;
+   pagesize = sysconf(_SC_PAGESIZE);
+   for (iplane=0; iplane < nplane; iplane++) {
+      start = f->offset + (iplane * planesize + f->released) * f->nbyte;
+      end = f->offset + (iplane * planesize + pix) * f->nbyte;
+      start = ((start + pagesize - 1) / pagesize) * pagesize;
+      end = (end / pagesize) * pagesize;
+      if (end > start) {
+         msync(f->map + start, end - start, MS_ASYNC);
+         madvise(f->map + start, end - start, MADV_DONTNEED);
+      }
+   }
+   f->released = pix;
+}
+
+/******************************************************************************/
+/* The same, for a file of one plane */
+static void stack_release
+  (stack_file * f,
+   long        pix)
+{
+   stack_release_planes(f, 1, 0, pix);
+}
+
+/******************************************************************************/
+/* Read npix pixels starting at pixel pix0, converted to float */
+static void stack_read
+  (stack_file * f,
+   float    *  buf,
+   long        pix0,
+   long        npix)
+{
+   unsigned char * p;
+   union {
+      unsigned char c[8];
+      short    s;
+      int      i;
+      float    f;
+      double   d;
+   }           u;
+   long        i;
+   int         j;
+   double      value;
+
+   p = (unsigned char *) f->map + f->offset + pix0 * f->nbyte;
+   for (i=0; i < npix; i++, p += f->nbyte) {
+      if (f->swap) {
+         for (j=0; j < f->nbyte; j++) u.c[j] = p[f->nbyte-1-j];
+      } else {
+         memcpy(u.c, p, f->nbyte);
+      }
+      switch (f->bitpix) {
+         case 8: value = u.c[0]; break;
+         case 16: value = u.s; break;
+         case 32: value = u.i; break;
+         case -32: value = u.f; break;
+         default: value = u.d; break;
+      }
+      buf[i] = (float) (f->bzero + f->bscale * value);
+   }
+}
+
+/******************************************************************************/
+/* Write npix floats starting at pixel pix0 */
+static void stack_write
+  (stack_file * f,
+   float    *  buf,
+   long        pix0,
+   long        npix)
+{
+   char     *  dest;
+   char        tmp;
+   long        i;
+
+   dest = f->map + f->offset + pix0 * 4;
+   memcpy(dest, buf, (size_t) npix * 4);
+   if (f->swap) {
+      for (i=0; i < npix; i++, dest += 4) {
+         tmp = dest[0]; dest[0] = dest[3]; dest[3] = tmp;
+         tmp = dest[1]; dest[1] = dest[2]; dest[2] = tmp;
+      }
+   }
+}
+
+/******************************************************************************/
+IDL_LONG stackcombine
+  (int         argc,
+   void    *   argv[])
+{
+   IDL_LONG    nfile;
+   IDL_STRING * files;
+   IDL_LONG64 * offsets;
+   IDL_LONG *  bitpix;
+   double   *  bscale;
+   double   *  bzero;
+   IDL_LONG    bigendian;
+   IDL_LONG    nx;
+   IDL_LONG    ny;
+   IDL_LONG    method;
+   float       sigrejlo;
+   float       sigrejhi;
+   IDL_LONG    maxiter;
+   IDL_LONG    nmaskfile;
+   IDL_STRING * maskfiles;
+   IDL_LONG64 * maskoffsets;
+   IDL_STRING * outfile;
+   IDL_LONG64  outoffset;
+   IDL_STRING * outmaskfile;
+   IDL_LONG64  outmaskoffset;
+   IDL_LONG    nband;
+
+   stack_file * in = NULL;
+   stack_file * inmask = NULL;
+   stack_file  out;
+   stack_file  outmask;
+   float    *  cube = NULL;
+   char     *  maskin = NULL;
+   char     *  maskout = NULL;
+   float    *  combined = NULL;
+   long        npix;
+   long        row0;
+   long        nrow;
+   long        nlo;
+   long        pix0;
+   long        ifile;
+   IDL_LONG    i;
+   IDL_LONG    retval = 1;
+
+   /* Allocate pointers from IDL */
+   i = 0;
+   nfile = *((IDL_LONG *)argv[i++]);
+   files = (IDL_STRING *)argv[i++];
+   offsets = (IDL_LONG64 *)argv[i++];
+   bitpix = (IDL_LONG *)argv[i++];
+   bscale = (double *)argv[i++];
+   bzero = (double *)argv[i++];
+   bigendian = *((IDL_LONG *)argv[i++]);
+   nx = *((IDL_LONG *)argv[i++]);
+   ny = *((IDL_LONG *)argv[i++]);
+   method = *((IDL_LONG *)argv[i++]);
+   sigrejlo = *((float *)argv[i++]);
+   sigrejhi = *((float *)argv[i++]);
+   maxiter = *((IDL_LONG *)argv[i++]);
+   nmaskfile = *((IDL_LONG *)argv[i++]);
+   maskfiles = (IDL_STRING *)argv[i++];
+   maskoffsets = (IDL_LONG64 *)argv[i++];
+   outfile = (IDL_STRING *)argv[i++];
+   outoffset = *((IDL_LONG64 *)argv[i++]);
+   outmaskfile = (IDL_STRING *)argv[i++];
+   outmaskoffset = *((IDL_LONG64 *)argv[i++]);
+   nband = *((IDL_LONG *)argv[i++]);
+
+   if (nfile <= 0 || nx <= 0 || ny <= 0) return 0;
+   if (nmaskfile != 0 && nmaskfile != nfile) return 0;
+   if (method < STACKCOMBINE_MEDIAN || method > STACKCOMBINE_SIGMASK)
+    return 0;
+   npix = (long) nx * ny;
+   if (nband <= 0) {
+      nband = STACKCOMBINE_BANDSIZE / ((long) nx * nfile);
+      if (nband < 1) nband = 1;
+   }
+   if (nband > ny) nband = ny;
+
+   /* Map the frames, masks and outputs */
+   in = calloc(nfile, sizeof(stack_file));
+   inmask = calloc(nfile, sizeof(stack_file));
+   out.map = NULL;
+   outmask.map = NULL;
+   for (ifile=0; ifile < nfile && retval; ifile++) {
+      retval = stack_open(&in[ifile], files[ifile].s, (long) offsets[ifile],
+       bitpix[ifile], bscale[ifile], bzero[ifile], bigendian, npix, 0);
+      if (retval && nmaskfile > 0)
+         retval = stack_open(&inmask[ifile], maskfiles[ifile].s,
+          (long) maskoffsets[ifile], 8, 1.0, 0.0, 0, npix, 0);
+   }
+   if (retval)
+      retval = stack_open(&out, outfile->s, (long) outoffset, -32, 1.0, 0.0,
+       bigendian, npix, 1);
+   if (retval && method == STACKCOMBINE_SIGMASK && outmaskfile->slen > 0)
+      retval = stack_open(&outmask, outmaskfile->s, (long) outmaskoffset, 8,
+       1.0, 0.0, 0, npix * nfile, 1);
+
+   /* Combine band by band: the band is an nfile x (nrow*nx) cube */
+   if (retval) {
+      cube = malloc((size_t) nband * nx * nfile * sizeof(float));
+      combined = malloc((size_t) nband * nx * sizeof(float));
+      if (method == STACKCOMBINE_SIGMASK) {
+         maskin = calloc((size_t) nband * nx * nfile, sizeof(char));
+         maskout = malloc((size_t) nband * nx * nfile * sizeof(char));
+      }
+   }
+   for (row0=0; retval && row0 < ny; row0 += nband) {
+      nrow = (row0 + nband > ny) ? ny - row0 : nband;
+      nlo = nrow * nx;
+      pix0 = row0 * nx;
+      for (ifile=0; ifile < nfile; ifile++) {
+         stack_read(&in[ifile], cube + ifile * nlo, pix0, nlo);
+         if (maskin != NULL && nmaskfile > 0)
+            memcpy(maskin + ifile * nlo,
+             inmask[ifile].map + inmask[ifile].offset + pix0, nlo);
+      }
+
+      switch (method) {
+         case STACKCOMBINE_MEDIAN:
+            arrmedian_cube(cube, nlo, nfile, 1, combined);
+            break;
+         case STACKCOMBINE_SIGCLIP:
+            arravsigclip_cube(cube, nlo, nfile, 1, sigrejlo, sigrejhi,
+             maxiter, combined);
+            break;
+         default:
+            arravsigmask_cube(cube, maskin, maskout, nlo, nfile, 1,
+             sigrejlo, sigrejhi, maxiter, combined);
+            break;
+      }
+
+      stack_write(&out, combined, pix0, nlo);
+      if (outmask.map != NULL)
+         for (ifile=0; ifile < nfile; ifile++)
+            memcpy(outmask.map + outmask.offset + ifile * npix + pix0,
+             maskout + ifile * nlo, nlo);
+
+      /* Drop the pages of the finished rows */
+      for (ifile=0; ifile < nfile; ifile++) {
+         stack_release(&in[ifile], pix0 + nlo);
+         if (nmaskfile > 0) stack_release(&inmask[ifile], pix0 + nlo);
+      }
+      stack_release(&out, pix0 + nlo);
+      if (outmask.map != NULL)
+         stack_release_planes(&outmask, nfile, npix, pix0 + nlo);
+   }
+
+   /* Free memory and unmap */
+   for (ifile=0; ifile < nfile; ifile++) {
+      stack_close(&in[ifile]);
+      stack_close(&inmask[ifile]);
+   }
+   stack_close(&out);
+   stack_close(&outmask);
+   free(in);
+   free(inmask);
+   if (cube != NULL) free(cube);
+   if (combined != NULL) free(combined);
+   if (maskin != NULL) free(maskin);
+   if (maskout != NULL) free(maskout);
+
+   return retval;
+}
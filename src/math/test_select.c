@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "idlutils_select.h"
+
+/*
+ * test_select.c
+ *
+ * Checks idlutils_select_{float,double} against a full sort, on arrays
+ * large enough to use the histogram pre-pass, with and without NaNs.
+ * Build with "make test_select"; exits non-zero on any failure.
+ */
+
+#define NTEST 200000
+
+static int compare_double(const void *a, const void *b)
+{
+  double x=*((const double *) a), y=*((const double *) b);
+  return((x>y)-(x<y));
+} /* end compare_double */
+
+/********************************************************************/
+/* k-th smallest of arr for several k, against the sorted values; with
+   NaNs, only that the value is a NaN or one of the other values */
+static int check_double(double *arr, long n, int nnan)
+{
+  double *sorted,*work,value;
+  long i,k,nfinite,nbad=0;
+
+  sorted=(double *) malloc(n*sizeof(double));
+  work=(double *) malloc(n*sizeof(double));
+  for(i=0,nfinite=0;i<n;i++)
+    if(!isnan(arr[i])) sorted[nfinite++]=arr[i];
+  qsort(sorted, nfinite, sizeof(double), compare_double);
+  for(k=0;k<n;k+=n/37+1) {
+    value=idlutils_select_double(arr, n, k, work);
+    if(nnan==0) {
+      if(value!=sorted[k]) nbad++;
+    } else if(!isnan(value) && !(value>=sorted[0] && value<=sorted[nfinite-1])) {
+      nbad++;
+    }
+  }
+  value=idlutils_select_double(arr, n, n-1, NULL);
+  if(nnan==0 && value!=sorted[n-1]) nbad++;
+  free(sorted);
+  free(work);
+  return(nbad);
+} /* end check_double */
+
+/********************************************************************/
+static int check_float(float *arr, long n, int nnan)
+{
+  float *work,value,vmin,vmax;
+  long i,k,nbad=0;
+
+  work=(float *) malloc(n*sizeof(float));
+  vmin=INFINITY;
+  vmax=-INFINITY;
+  for(i=0;i<n;i++) {
+    if(arr[i]<vmin) vmin=arr[i];
+    if(arr[i]>vmax) vmax=arr[i];
+  }
+  for(k=0;k<n;k+=n/37+1) {
+    value=idlutils_select_float(arr, n, k, work);
+    if(!(isnan(value) && nnan>0) && !(value>=vmin && value<=vmax)) nbad++;
+  }
+  value=idlutils_median_float(arr, n, NULL);
+  if(!(isnan(value) && nnan>0) && !(value>=vmin && value<=vmax)) nbad++;
+  free(work);
+  return(nbad);
+} /* end check_float */
+
+/********************************************************************/
+int main(int argc, char **argv)
+{
+  double *darr;
+  float *farr;
+  long i,n=NTEST;
+  int nbad,ntotal=0;
+
+  darr=(double *) malloc(n*sizeof(double));
+  farr=(float *) malloc(n*sizeof(float));
+  srand48(1);
+
+  /* no NaNs */
+  for(i=0;i<n;i++) darr[i]=drand48()*drand48()*100.-20.;
+  nbad=check_double(darr, n, 0);
+  printf("double, no NaNs: %d failures\n", nbad);
+  ntotal+=nbad;
+
+  /* NaNs scattered through, and at the start */
+  for(i=0;i<n;i+=997) darr[i]=NAN;
+  nbad=check_double(darr, n, 1);
+  printf("double, NaNs: %d failures\n", nbad);
+  ntotal+=nbad;
+
+  for(i=0;i<n;i++) farr[i]=(float) darr[i];
+  nbad=check_float(farr, n, 1);
+  printf("float, NaNs: %d failures\n", nbad);
+  ntotal+=nbad;
+
+  /* mostly NaNs */
+  for(i=0;i<n;i++) farr[i]=(i%5) ? NAN : (float) i;
+  nbad=check_float(farr, n, 1);
+  printf("float, mostly NaNs: %d failures\n", nbad);
+  ntotal+=nbad;
+
+  free(darr);
+  free(farr);
+  return(ntotal>0);
+} /* end main */
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "kdtree.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+/* deepest a median-split tree can get, with room to spare */
+#define KDTREE_MAXDEPTH 128
+
+/********************************************************************/
+/* partially sort perm[lo..hi) by dimension d so that perm[mid] is in its
+   sorted place, with nothing larger before it or smaller after it */
+static void kdtree_select(const double *x, IDL_LONG ndim, IDL_LONG d,
+                          IDL_LONG *perm, IDL_LONG lo, IDL_LONG hi,
+                          IDL_LONG mid)
+{
+  IDL_LONG i,j,tmp;
+  double pivot;
+
+  hi--;
+  while(hi>lo) {
+    pivot=x[d+(long) perm[(lo+hi)/2]*ndim];
+    i=lo;
+    j=hi;
+    while(i<=j) {
+      while(x[d+(long) perm[i]*ndim]<pivot) i++;
+      while(x[d+(long) perm[j]*ndim]>pivot) j--;
+      if(i<=j) {
+        tmp=perm[i];
+        perm[i]=perm[j];
+        perm[j]=tmp;
+        i++;
+        j--;
+      }
+    }
+    if(mid<=j) hi=j;
+    else if(mid>=i) lo=i;
+    else return;
+  }
+} /* end kdtree_select */
+
+/********************************************************************/
+/* squared distance from q to the bounding box of node n */
+static double kdtree_boxdist2(const kdtree *tree, IDL_LONG n, const double *q)
+{
+  const double *bmin, *bmax;
+  double dist2,diff;
+  IDL_LONG d;
+
+  bmin=tree->bmin+(long) n*tree->ndim;
+  bmax=tree->bmax+(long) n*tree->ndim;
+  dist2=0.;
+  for(d=0;d<tree->ndim;d++) {
+    if(q[d]<bmin[d]) {
+      diff=bmin[d]-q[d];
+      dist2+=diff*diff;
+    } else if(q[d]>bmax[d]) {
+      diff=q[d]-bmax[d];
+      dist2+=diff*diff;
+    }
+  }
+  return(dist2);
+} /* end kdtree_boxdist2 */
+
+/********************************************************************/
+kdtree *kdtree_build(const double *x, IDL_LONG ndim, IDL_LONG npoints)
+{
+  kdtree *tree;
+  IDL_LONG *perm, stack[KDTREE_MAXDEPTH], nstack, n, nmax, i, d, dsplit;
+  IDL_LONG lo, hi, mid;
+  double *bmin, *bmax, width, maxwidth, v;
+
+  tree=(kdtree *) malloc(sizeof(kdtree));
+  tree->ndim=ndim;
+  tree->npoints=npoints;
+  nmax=4*(npoints/KDTREE_LEAF+1);
+  tree->lo=(IDL_LONG *) malloc(nmax*sizeof(IDL_LONG));
+  tree->hi=(IDL_LONG *) malloc(nmax*sizeof(IDL_LONG));
+  tree->left=(IDL_LONG *) malloc(nmax*sizeof(IDL_LONG));
+  tree->right=(IDL_LONG *) malloc(nmax*sizeof(IDL_LONG));
+  tree->bmin=(double *) malloc((size_t) nmax*ndim*sizeof(double));
+  tree->bmax=(double *) malloc((size_t) nmax*ndim*sizeof(double));
+  perm=(IDL_LONG *) malloc(npoints*sizeof(IDL_LONG));
+  for(i=0;i<npoints;i++) perm[i]=i;
+
+  /* 1. split nodes depth first; each node gets the exact bounding box of
+     its points, and is split at the median of its widest dimension */
+  tree->nnodes=1;
+  tree->lo[0]=0;
+  tree->hi[0]=npoints;
+  stack[0]=0;
+  nstack=1;
+  while(nstack>0) {
+    n=stack[--nstack];
+    lo=tree->lo[n];
+    hi=tree->hi[n];
+    bmin=tree->bmin+(long) n*ndim;
+    bmax=tree->bmax+(long) n*ndim;
+    for(d=0;d<ndim;d++) {
+      bmin[d]=bmax[d]=(hi>lo) ? x[d+(long) perm[lo]*ndim] : 0.;
+      for(i=lo+1;i<hi;i++) {
+        v=x[d+(long) perm[i]*ndim];
+        if(v<bmin[d]) bmin[d]=v;
+        if(v>bmax[d]) bmax[d]=v;
+      }
+    }
+    tree->left[n]=tree->right[n]=-1;
+    if(hi-lo<=KDTREE_LEAF) continue;
+
+    dsplit=0;
+    maxwidth=-1.;
+    for(d=0;d<ndim;d++) {
+      width=bmax[d]-bmin[d];
+      if(width>maxwidth) {
+        maxwidth=width;
+        dsplit=d;
+      }
+    }
+    if(maxwidth<=0.) continue;   /* all points identical */
+
+    mid=(lo+hi)/2;
+    kdtree_select(x, ndim, dsplit, perm, lo, hi, mid);
+    tree->left[n]=tree->nnodes;
+    tree->right[n]=tree->nnodes+1;
+    tree->lo[tree->nnodes]=lo;
+    tree->hi[tree->nnodes]=mid;
+    tree->lo[tree->nnodes+1]=mid;
+    tree->hi[tree->nnodes+1]=hi;
+    stack[nstack++]=tree->nnodes+1;
+    stack[nstack++]=tree->nnodes;
+    tree->nnodes+=2;
+  }
+
+  /* 2. copy the points into tree order */
+  tree->index=perm;
+  tree->x=(double *) malloc((size_t) npoints*ndim*sizeof(double));
+  for(i=0;i<npoints;i++)
+    memcpy(tree->x+(long) i*ndim, x+(long) perm[i]*ndim,
+           ndim*sizeof(double));
+
+  return(tree);
+} /* end kdtree_build */
+
+/********************************************************************/
+void kdtree_free(kdtree *tree)
+{
+  if(tree==NULL) return;
+  FREEVEC(tree->index);
+  FREEVEC(tree->x);
+  FREEVEC(tree->lo);
+  FREEVEC(tree->hi);
+  FREEVEC(tree->left);
+  FREEVEC(tree->right);
+  FREEVEC(tree->bmin);
+  FREEVEC(tree->bmax);
+  FREEVEC(tree);
+} /* end kdtree_free */
+
+/********************************************************************/
+IDL_LONG kdtree_radius(const kdtree *tree, const double *q, double r2,
+                       IDL_LONG **ind, double **d2, IDL_LONG *nalloc)
+{
+  IDL_LONG stack[KDTREE_MAXDEPTH], nstack, n, i, d, nfound, ndim;
+  const double *xi;
+  double dist2, diff;
+
+  ndim=tree->ndim;
+  nfound=0;
+  if(tree->npoints<=0) return(0);
+  stack[0]=0;
+  nstack=1;
+  while(nstack>0) {
+    n=stack[--nstack];
+    if(kdtree_boxdist2(tree, n, q)>=r2) continue;
+    if(tree->left[n]>=0) {
+      stack[nstack++]=tree->right[n];
+      stack[nstack++]=tree->left[n];
+      continue;
+    }
+    for(i=tree->lo[n];i<tree->hi[n];i++) {
+      xi=tree->x+(long) i*ndim;
+      dist2=0.;
+      for(d=0;d<ndim;d++) {
+        diff=xi[d]-q[d];
+        dist2+=diff*diff;
+      }
+      if(dist2<r2) {
+        if(nfound>=(*nalloc)) {
+          (*nalloc)=2*(*nalloc)+KDTREE_LEAF;
+          (*ind)=(IDL_LONG *) realloc(*ind, (*nalloc)*sizeof(IDL_LONG));
+          (*d2)=(double *) realloc(*d2, (*nalloc)*sizeof(double));
+        }
+        (*ind)[nfound]=tree->index[i];
+        (*d2)[nfound]=dist2;
+        nfound++;
+      }
+    }
+  }
+  return(nfound);
+} /* end kdtree_radius */
+
+/********************************************************************/
+IDL_LONG kdtree_nearest(const kdtree *tree, const double *q, IDL_LONG k,
+                        double r2, IDL_LONG *ind, double *d2)
+{
+  IDL_LONG stack[KDTREE_MAXDEPTH], nstack, n, near, far, i, d, j, c;
+  IDL_LONG nfound, ndim, itmp;
+  const double *xi;
+  double dist2, diff, bound, dtmp, dnear, dfar;
+
+  /* ind and d2 hold a max-heap on d2 while searching, so d2[0] is the
+     worst of the nearest found so far */
+  ndim=tree->ndim;
+  nfound=0;
+  if(tree->npoints<=0 || k<=0) return(0);
+  bound=(r2<0.) ? HUGE_VAL : r2;
+  stack[0]=0;
+  nstack=1;
+  while(nstack>0) {
+    n=stack[--nstack];
+    if(kdtree_boxdist2(tree, n, q)>=bound) continue;
+    if(tree->left[n]>=0) {
+      /* visit the nearer child first */
+      dnear=kdtree_boxdist2(tree, tree->left[n], q);
+      dfar=kdtree_boxdist2(tree, tree->right[n], q);
+      near=tree->left[n];
+      far=tree->right[n];
+      if(dfar<dnear) {
+        near=tree->right[n];
+        far=tree->left[n];
+      }
+      stack[nstack++]=far;
+      stack[nstack++]=near;
+      continue;
+    }
+    for(i=tree->lo[n];i<tree->hi[n];i++) {
+      xi=tree->x+(long) i*ndim;
+      dist2=0.;
+      for(d=0;d<ndim;d++) {
+        diff=xi[d]-q[d];
+        dist2+=diff*diff;
+      }
+      if(dist2>=bound) continue;
+      if(nfound<k) {
+        /* sift up */
+        j=nfound++;
+        while(j>0 && d2[(j-1)/2]<dist2) {
+          d2[j]=d2[(j-1)/2];
+          ind[j]=ind[(j-1)/2];
+          j=(j-1)/2;
+        }
+        d2[j]=dist2;
+        ind[j]=tree->index[i];
+      } else {
+        /* replace the worst and sift down */
+        j=0;
+        for(;;) {
+          c=2*j+1;
+          if(c>=k) break;
+          if(c+1<k && d2[c+1]>d2[c]) c++;
+          if(d2[c]<=dist2) break;
+          d2[j]=d2[c];
+          ind[j]=ind[c];
+          j=c;
+        }
+        d2[j]=dist2;
+        ind[j]=tree->index[i];
+      }
+      if(nfound==k) bound=d2[0];
+    }
+  }
+
+  /* heap sort into increasing distance */
+  for(n=nfound-1;n>0;n--) {
+    dtmp=d2[0];
+    itmp=ind[0];
+    dist2=d2[n];
+    j=0;
+    for(;;) {
+      c=2*j+1;
+      if(c>=n) break;
+      if(c+1<n && d2[c+1]>d2[c]) c++;
+      if(d2[c]<=dist2) break;
+      d2[j]=d2[c];
+      ind[j]=ind[c];
+      j=c;
+    }
+    d2[j]=dist2;
+    ind[j]=ind[n];
+    d2[n]=dtmp;
+    ind[n]=itmp;
+  }
+
+  return(nfound);
+} /* end kdtree_nearest */
+
+/***************************************************************************/
@@ -0,0 +1,43 @@
+/*
+ * kdtree.h
+ *
+ * A static kd-tree over points in N dimensions, for matchnd and groupnd.
+ * Nodes are split at the median of their widest dimension down to
+ * buckets of at most KDTREE_LEAF points, and each node keeps the exact
+ * bounding box of its points for pruning.  The points are copied into
+ * tree order, so a bucket is one contiguous block of memory.
+ *
+ * A built tree is only read by the queries, so any number of threads may
+ * query it at once.
+ */
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#define KDTREE_LEAF 16
+
+typedef struct {
+  IDL_LONG ndim, npoints, nnodes;
+  IDL_LONG *index;          /* original index of each point, in tree order */
+  double *x;                /* points in tree order, x[d+i*ndim] */
+  IDL_LONG *lo, *hi;        /* node i holds points [lo[i],hi[i]) */
+  IDL_LONG *left, *right;   /* children of node i, -1 for buckets */
+  double *bmin, *bmax;      /* bounding box of node i, [ndim*i+d] */
+} kdtree;
+
+/* build a tree over x[ndim,npoints]; use kdtree_free to clean up */
+kdtree *kdtree_build(const double *x, IDL_LONG ndim, IDL_LONG npoints);
+void kdtree_free(kdtree *tree);
+
+/* all points with squared distance strictly less than r2 from q; ind and
+ * d2 are buffers of *nalloc elements owned by the caller, which are grown
+ * with realloc as necessary; returns the number found, in tree order */
+IDL_LONG kdtree_radius(const kdtree *tree, const double *q, double r2,
+                       IDL_LONG **ind, double **d2, IDL_LONG *nalloc);
+
+/* the k nearest points to q with squared distance strictly less than r2
+ * (r2<0 for no limit), nearest first, in ind[k] and d2[k]; returns the
+ * number found, which is less than k if there are not enough */
+IDL_LONG kdtree_nearest(const kdtree *tree, const double *q, IDL_LONG k,
+                        double r2, IDL_LONG *ind, double *d2);
+
+#endif
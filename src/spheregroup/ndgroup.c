@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "kdtree.h"
+#include "idlutils_threads.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+/* points handed to a thread at a time */
+#define NDGROUP_CHUNK 256
+
+/* links a thread collects before adding them to the forest */
+#define NDGROUP_NLINK 65536
+
+typedef struct {
+  kdtree *tree;
+  IDL_LONG ndim, npoints;
+  double *x, r2;
+  idlutils_queue queue;
+  IDL_LONG *parent;   /* one union-find forest [npoints] for all threads */
+  pthread_mutex_t lock;   /* held to change the forest */
+} ndgroup_work;
+
+/********************************************************************/
+static IDL_LONG ndgroup_find(IDL_LONG *parent, IDL_LONG i)
+{
+  IDL_LONG root, next;
+
+  root=i;
+  while(parent[root]!=root) root=parent[root];
+  while(parent[i]!=root) {
+    next=parent[i];
+    parent[i]=root;
+    i=next;
+  }
+  return(root);
+} /* end ndgroup_find */
+
+/********************************************************************/
+/* the root of a set is always its lowest member */
+static void ndgroup_union(IDL_LONG *parent, IDL_LONG i, IDL_LONG j)
+{
+  i=ndgroup_find(parent, i);
+  j=ndgroup_find(parent, j);
+  if(i<j) parent[j]=i;
+  else if(j<i) parent[i]=j;
+} /* end ndgroup_union */
+
+/********************************************************************/
+/* add nlink links (i,j), as link[2*l], link[2*l+1], to the forest */
+static void ndgroup_flush(ndgroup_work *w, IDL_LONG *link, long nlink)
+{
+  long l;
+
+  pthread_mutex_lock(&(w->lock));
+  for(l=0;l<nlink;l++)
+    ndgroup_union(w->parent, link[2*l], link[2*l+1]);
+  pthread_mutex_unlock(&(w->lock));
+} /* end ndgroup_flush */
+
+/********************************************************************/
+/* links each point of this thread's share to its friends of higher
+   index; the links are collected in a list of the thread's own and added
+   to the forest under its lock whenever the list fills */
+static void ndgroup_links(void *arg, int ithread, int nthreads)
+{
+  ndgroup_work *w=(ndgroup_work *) arg;
+  IDL_LONG *ind=NULL, *link, nalloc=0, nfound, j;
+  double *d2=NULL;
+  long lo, hi, i, nlink;
+
+  link=(IDL_LONG *) malloc((size_t) 2*NDGROUP_NLINK*sizeof(IDL_LONG));
+  nlink=0;
+  while(idlutils_queue_next(&(w->queue), &lo, &hi)) {
+    for(i=lo;i<hi;i++) {
+      nfound=kdtree_radius(w->tree, w->x+i*w->ndim, w->r2, &ind, &d2,
+                           &nalloc);
+      for(j=0;j<nfound;j++) {
+        if(ind[j]<=i) continue;
+        link[2*nlink]=(IDL_LONG) i;
+        link[2*nlink+1]=ind[j];
+        if(++nlink==NDGROUP_NLINK) {
+          ndgroup_flush(w, link, nlink);
+          nlink=0;
+        }
+      }
+    }
+  }
+  ndgroup_flush(w, link, nlink);
+
+  FREEVEC(link);
+  FREEVEC(ind);
+  FREEVEC(d2);
+} /* end ndgroup_links */
+
+/********************************************************************/
+/* ndim, npoints, x[ndim,npoints], distance, ingroup, multgroup,
+   firstgroup, nextgroup, ngroup.
+
+   Friends-of-friends groups of points linked if closer than distance, as
+   groupnd.pro.  Groups are numbered in order of their lowest member;
+   ingroup and nextgroup have npoints elements, multgroup and firstgroup
+   need npoints but only the first ngroup are set.  nextgroup is -1 for
+   the last member of each group */
+IDL_LONG ndgroup
+  (int      argc,
+   void *   argv[])
+{
+  IDL_LONG ndim, npoints, *ingroup, *multgroup, *firstgroup, *nextgroup;
+  IDL_LONG *ngroup, *parent;
+  double distance;
+  ndgroup_work w;
+  IDL_LONG i, root, ng;
+  int nthreads;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  ndim=*((IDL_LONG *)argv[i]); i++;
+  npoints=*((IDL_LONG *)argv[i]); i++;
+  w.x=((double *)argv[i]); i++;
+  distance=*((double *)argv[i]); i++;
+  ingroup=((IDL_LONG *)argv[i]); i++;
+  multgroup=((IDL_LONG *)argv[i]); i++;
+  firstgroup=((IDL_LONG *)argv[i]); i++;
+  nextgroup=((IDL_LONG *)argv[i]); i++;
+  ngroup=((IDL_LONG *)argv[i]); i++;
+  (*ngroup)=0;
+  if(ndim<=0 || npoints<=0) return retval;
+
+  /* 1. find the links in parallel, into one forest; the final sets do
+     not depend on the order in which links are added */
+  w.tree=kdtree_build(w.x, ndim, npoints);
+  w.ndim=ndim;
+  w.npoints=npoints;
+  w.r2=distance*distance;
+  w.parent=(IDL_LONG *) malloc((size_t) npoints*sizeof(IDL_LONG));
+  for(i=0;i<npoints;i++) w.parent[i]=i;
+  pthread_mutex_init(&(w.lock), NULL);
+  nthreads=idlutils_nthreads(npoints/NDGROUP_CHUNK+1);
+  idlutils_queue_init(&(w.queue), npoints, NDGROUP_CHUNK);
+  idlutils_run(nthreads, ndgroup_links, &w);
+  idlutils_queue_free(&(w.queue));
+  pthread_mutex_destroy(&(w.lock));
+  kdtree_free(w.tree);
+  parent=w.parent;
+
+  /* 2. number the groups by their lowest member, which is the root */
+  ng=0;
+  for(i=0;i<npoints;i++) {
+    root=ndgroup_find(parent, i);
+    if(root==i) {
+      multgroup[ng]=0;
+      ingroup[i]=ng++;
+    } else {
+      ingroup[i]=ingroup[root];
+    }
+    multgroup[ingroup[i]]++;
+  }
+  for(i=0;i<ng;i++) firstgroup[i]=-1;
+  for(i=npoints-1;i>=0;i--) {
+    nextgroup[i]=firstgroup[ingroup[i]];
+    firstgroup[ingroup[i]]=i;
+  }
+  (*ngroup)=ng;
+
+  FREEVEC(w.parent);
+
+  return retval;
+}
+
+/***************************************************************************/
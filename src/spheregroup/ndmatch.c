@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "kdtree.h"
+#include "idlutils_threads.h"
+
+#define FREEVEC(a) {if((a)!=NULL) free((char *) (a)); (a)=NULL;}
+
+/* queries handed to a thread at a time */
+#define NDMATCH_CHUNK 256
+
+typedef struct {
+  IDL_LONG m1, m2;
+  double d12;
+} ndmatch_pair;
+
+typedef struct {
+  kdtree *tree;
+  IDL_LONG ndim, n1, k;
+  double *x1, r2;
+  idlutils_queue queue;
+  /* ndmatch: each thread appends the pairs of its chunks to its own list,
+     and records where each chunk's pairs went */
+  ndmatch_pair *pairs[IDLUTILS_MAXTHREADS];
+  IDL_LONG npairs[IDLUTILS_MAXTHREADS], nalloc[IDLUTILS_MAXTHREADS];
+  IDL_LONG *chunkthread, *chunkstart, *chunkcount;
+  /* ndknn */
+  IDL_LONG *match;
+  double *dist;
+} ndmatch_work;
+
+/********************************************************************/
+static void ndmatch_queries(void *arg, int ithread, int nthreads)
+{
+  ndmatch_work *w=(ndmatch_work *) arg;
+  IDL_LONG *ind=NULL, nalloc=0, nfound, j, ichunk;
+  double *d2=NULL;
+  long lo, hi, i;
+
+  while(idlutils_queue_next(&(w->queue), &lo, &hi)) {
+    ichunk=lo/NDMATCH_CHUNK;
+    w->chunkthread[ichunk]=ithread;
+    w->chunkstart[ichunk]=w->npairs[ithread];
+    for(i=lo;i<hi;i++) {
+      nfound=kdtree_radius(w->tree, w->x1+i*w->ndim, w->r2, &ind, &d2,
+                           &nalloc);
+      if(w->npairs[ithread]+nfound>w->nalloc[ithread]) {
+        w->nalloc[ithread]=2*w->nalloc[ithread]+nfound;
+        w->pairs[ithread]=(ndmatch_pair *)
+          realloc(w->pairs[ithread], w->nalloc[ithread]*sizeof(ndmatch_pair));
+      }
+      for(j=0;j<nfound;j++) {
+        w->pairs[ithread][w->npairs[ithread]].m1=i;
+        w->pairs[ithread][w->npairs[ithread]].m2=ind[j];
+        w->pairs[ithread][w->npairs[ithread]].d12=d2[j];
+        w->npairs[ithread]++;
+      }
+    }
+    w->chunkcount[ichunk]=w->npairs[ithread]-w->chunkstart[ichunk];
+  }
+
+  FREEVEC(ind);
+  FREEVEC(d2);
+} /* end ndmatch_queries */
+
+/********************************************************************/
+/* by distance, then by index, so the result does not depend on the order
+   the pairs were found in */
+static int ndmatch_compare(const void *a, const void *b)
+{
+  const ndmatch_pair *pa=(const ndmatch_pair *) a;
+  const ndmatch_pair *pb=(const ndmatch_pair *) b;
+
+  if(pa->d12<pb->d12) return(-1);
+  if(pa->d12>pb->d12) return(1);
+  if(pa->m1!=pb->m1) return(pa->m1<pb->m1 ? -1 : 1);
+  if(pa->m2!=pb->m2) return(pa->m2<pb->m2 ? -1 : 1);
+  return(0);
+} /* end ndmatch_compare */
+
+/********************************************************************/
+/* ndim, n1, x1[ndim,n1], n2, x2[ndim,n2], distance, maxmatch, match1,
+   match2, distance12, nmatch.
+
+   Finds all pairs closer than distance, sorted by separation, and keeps a
+   pair only if neither point already has maxmatch closer pairs kept
+   (maxmatch=0 keeps them all), as matchnd.pro.  nmatch on input is the
+   size of match1, match2 and distance12 (DOUBLE); on output it is the
+   number of matches, of which only the first nmatch on input are
+   returned */
+IDL_LONG ndmatch
+  (int      argc,
+   void *   argv[])
+{
+  IDL_LONG ndim, n1, n2, maxmatch, *match1, *match2, *nmatch;
+  double *x2, distance, *distance12;
+  ndmatch_work w;
+  ndmatch_pair *all;
+  IDL_LONG nchunk, ntotal, nkept, nmax, c, t, i, *gotten1, *gotten2;
+  int nthreads;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  ndim=*((IDL_LONG *)argv[i]); i++;
+  n1=*((IDL_LONG *)argv[i]); i++;
+  w.x1=((double *)argv[i]); i++;
+  n2=*((IDL_LONG *)argv[i]); i++;
+  x2=((double *)argv[i]); i++;
+  distance=*((double *)argv[i]); i++;
+  maxmatch=*((IDL_LONG *)argv[i]); i++;
+  match1=((IDL_LONG *)argv[i]); i++;
+  match2=((IDL_LONG *)argv[i]); i++;
+  distance12=((double *)argv[i]); i++;
+  nmatch=((IDL_LONG *)argv[i]); i++;
+  nmax=(*nmatch);
+  (*nmatch)=0;
+  if(ndim<=0 || n1<=0 || n2<=0) return retval;
+
+  /* 1. tree on the second set, queries from the first in parallel */
+  w.tree=kdtree_build(x2, ndim, n2);
+  w.ndim=ndim;
+  w.n1=n1;
+  w.r2=distance*distance;
+  nchunk=(n1+NDMATCH_CHUNK-1)/NDMATCH_CHUNK;
+  w.chunkthread=(IDL_LONG *) malloc(nchunk*sizeof(IDL_LONG));
+  w.chunkstart=(IDL_LONG *) malloc(nchunk*sizeof(IDL_LONG));
+  w.chunkcount=(IDL_LONG *) malloc(nchunk*sizeof(IDL_LONG));
+  for(t=0;t<IDLUTILS_MAXTHREADS;t++) {
+    w.pairs[t]=NULL;
+    w.npairs[t]=0;
+    w.nalloc[t]=0;
+  }
+  nthreads=idlutils_nthreads(nchunk);
+  idlutils_queue_init(&(w.queue), n1, NDMATCH_CHUNK);
+  idlutils_run(nthreads, ndmatch_queries, &w);
+  idlutils_queue_free(&(w.queue));
+
+  /* 2. gather the chunks in order of the first set */
+  ntotal=0;
+  for(t=0;t<nthreads;t++) ntotal+=w.npairs[t];
+  all=(ndmatch_pair *) malloc((ntotal>0 ? ntotal : 1)*sizeof(ndmatch_pair));
+  ntotal=0;
+  for(c=0;c<nchunk;c++) {
+    memcpy(all+ntotal, w.pairs[w.chunkthread[c]]+w.chunkstart[c],
+           w.chunkcount[c]*sizeof(ndmatch_pair));
+    ntotal+=w.chunkcount[c];
+  }
+  for(t=0;t<nthreads;t++) FREEVEC(w.pairs[t]);
+
+  /* 3. sort by separation and trim to maxmatch matches per point */
+  qsort(all, ntotal, sizeof(ndmatch_pair), ndmatch_compare);
+  gotten1=(IDL_LONG *) calloc(n1, sizeof(IDL_LONG));
+  gotten2=(IDL_LONG *) calloc(n2, sizeof(IDL_LONG));
+  nkept=0;
+  for(i=0;i<ntotal;i++) {
+    if(maxmatch>0) {
+      if(gotten1[all[i].m1]>=maxmatch || gotten2[all[i].m2]>=maxmatch)
+        continue;
+      gotten1[all[i].m1]++;
+      gotten2[all[i].m2]++;
+    }
+    if(nkept<nmax) {
+      match1[nkept]=all[i].m1;
+      match2[nkept]=all[i].m2;
+      distance12[nkept]=sqrt(all[i].d12);
+    }
+    nkept++;
+  }
+  (*nmatch)=nkept;
+
+  FREEVEC(gotten1);
+  FREEVEC(gotten2);
+  FREEVEC(all);
+  FREEVEC(w.chunkthread);
+  FREEVEC(w.chunkstart);
+  FREEVEC(w.chunkcount);
+  kdtree_free(w.tree);
+
+  return retval;
+}
+
+/********************************************************************/
+static void ndknn_queries(void *arg, int ithread, int nthreads)
+{
+  ndmatch_work *w=(ndmatch_work *) arg;
+  IDL_LONG nfound, j, *match;
+  double *dist;
+  long lo, hi, i;
+
+  while(idlutils_queue_next(&(w->queue), &lo, &hi)) {
+    for(i=lo;i<hi;i++) {
+      match=w->match+i*w->k;
+      dist=w->dist+i*w->k;
+      nfound=kdtree_nearest(w->tree, w->x1+i*w->ndim, w->k, w->r2, match,
+                            dist);
+      for(j=0;j<nfound;j++) dist[j]=sqrt(dist[j]);
+      for(j=nfound;j<w->k;j++) {
+        match[j]=-1;
+        dist[j]=-1.;
+      }
+    }
+  }
+} /* end ndknn_queries */
+
+/********************************************************************/
+/* ndim, n1, x1[ndim,n1], n2, x2[ndim,n2], k, distance, match[k,n1],
+   distance12[k,n1] (DOUBLE).
+
+   The k nearest points of the second set to each point of the first,
+   nearest first, closer than distance (or without limit if distance is
+   not positive).  Unused places get match=-1 and distance12=-1 */
+IDL_LONG ndknn
+  (int      argc,
+   void *   argv[])
+{
+  IDL_LONG ndim, n1, n2;
+  double *x2, distance;
+  ndmatch_work w;
+  IDL_LONG i;
+  IDL_LONG retval=1;
+
+  /* 0. allocate pointers from IDL */
+  i=0;
+  ndim=*((IDL_LONG *)argv[i]); i++;
+  n1=*((IDL_LONG *)argv[i]); i++;
+  w.x1=((double *)argv[i]); i++;
+  n2=*((IDL_LONG *)argv[i]); i++;
+  x2=((double *)argv[i]); i++;
+  w.k=*((IDL_LONG *)argv[i]); i++;
+  distance=*((double *)argv[i]); i++;
+  w.match=((IDL_LONG *)argv[i]); i++;
+  w.dist=((double *)argv[i]); i++;
+  if(ndim<=0 || n1<=0 || n2<=0 || w.k<=0) return retval;
+
+  /* 1. tree on the second set, queries from the first in parallel */
+  w.tree=kdtree_build(x2, ndim, n2);
+  w.ndim=ndim;
+  w.n1=n1;
+  w.r2=(distance>0.) ? distance*distance : -1.;
+  idlutils_queue_init(&(w.queue), n1, NDMATCH_CHUNK);
+  idlutils_run(idlutils_nthreads(n1/NDMATCH_CHUNK+1), ndknn_queries, &w);
+  idlutils_queue_free(&(w.queue));
+
+  kdtree_free(w.tree);
+
+  return retval;
+}
+
+/***************************************************************************/